@@ -298,6 +298,8 @@ static inline block_t *block_ChainGather( block_t *p_list )
  * Fifos of blocks.
  ****************************************************************************
  * - block_FifoNew : create and init a new fifo
+ * - block_FifoNewSPSC : create a fifo for one producer and one consumer,
+ *      mostly without locking
  * - block_FifoRelease : destroy a fifo and free all blocks in it.
  * - block_FifoEmpty : free all blocks in a fifo
  * - block_FifoPut : put a block
@@ -311,6 +313,7 @@ static inline block_t *block_ChainGather( block_t *p_list )
  ****************************************************************************/
 
 VLC_API block_fifo_t *block_FifoNew( void ) VLC_USED VLC_MALLOC;
+VLC_API block_fifo_t *block_FifoNewSPSC( size_t ) VLC_USED VLC_MALLOC;
 VLC_API void block_FifoRelease( block_fifo_t * );
 VLC_API void block_FifoEmpty( block_fifo_t * );
 VLC_API void block_FifoPut( block_fifo_t *, block_t * );
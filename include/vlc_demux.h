@@ -323,6 +323,16 @@ enum demux_query_e
     DEMUX_NAV_POPUP,
     /** Activate disc Root Menu. Can fail */
     DEMUX_NAV_MENU,            /* res=can fail */
+
+    /** Checks whether the timestamps are dates of the system clock, taken
+     * as the data was captured (e.g. by a live capture card). The input
+     * clock then follows them as is, without drift estimation nor jitter
+     * smoothing, so that the PTS delay is the exact capture to output delay.
+     *
+     * Can fail if the timestamps are stream times (same as returning false).
+     *
+     * arg1= bool * */
+    DEMUX_IS_SYSTEM_CLOCK,
 };
 
 /*************************************************************************
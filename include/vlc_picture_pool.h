@@ -166,6 +166,23 @@ unsigned picture_pool_Reset( picture_pool_t * );
  */
 void picture_pool_Cancel( picture_pool_t *, bool canceled );
 
+/**
+ * Picture pool statistics
+ */
+typedef struct {
+    uint64_t contended; /**< lost races for a free picture */
+    uint64_t waits;     /**< picture_pool_Wait() calls that had to sleep */
+    mtime_t  wait_time; /**< total time slept in picture_pool_Wait() */
+    unsigned waiters;   /**< threads currently in picture_pool_Wait() */
+} picture_pool_stats_t;
+
+/**
+ * Reads the pool statistics.
+ * @note This function is thread-safe.
+ */
+VLC_API void picture_pool_GetStats( const picture_pool_t *,
+                                    picture_pool_stats_t * );
+
 /**
  * Reserves pictures from a pool and creates a new pool with those.
  *
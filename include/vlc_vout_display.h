@@ -212,6 +212,9 @@ enum {
     VOUT_DISPLAY_EVENT_MOUSE_PRESSED,
     VOUT_DISPLAY_EVENT_MOUSE_RELEASED,
     VOUT_DISPLAY_EVENT_MOUSE_DOUBLE_CLICK,
+
+    /* */
+    VOUT_DISPLAY_EVENT_PICTURES_LOST,       /* Pictures were dropped or shown late by the display : int count */
 };
 
 /**
@@ -352,6 +355,10 @@ static inline void vout_display_SendEventPicturesInvalid(vout_display_t *vd)
 {
     vout_display_SendEvent(vd, VOUT_DISPLAY_EVENT_PICTURES_INVALID);
 }
+static inline void vout_display_SendEventPicturesLost(vout_display_t *vd, int count)
+{
+    vout_display_SendEvent(vd, VOUT_DISPLAY_EVENT_PICTURES_LOST, count);
+}
 static inline void vout_display_SendEventClose(vout_display_t *vd)
 {
     vout_display_SendEvent(vd, VOUT_DISPLAY_EVENT_CLOSE);
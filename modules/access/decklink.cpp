@@ -29,9 +29,15 @@
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_demux.h>
+#include <vlc_meta.h>
 #include <vlc_atomic.h>
 
 #include <arpa/inet.h>
+#include <assert.h>
+#include <limits.h>
+#ifdef HAVE_SCHED_GETAFFINITY
+# include <sched.h>
+#endif
 
 #include <DeckLinkAPI.h>
 #include <DeckLinkAPIDispatch.cpp>
@@ -46,6 +52,18 @@ static void Close(vlc_object_t *);
     "DeckLink capture card to use, if multiple exist. " \
     "The cards are numbered from 0.")
 
+#define CARDS_TEXT N_("Input cards to use")
+#define CARDS_LONGTEXT N_( \
+    "Comma separated list of DeckLink cards or sub-devices to capture " \
+    "at once, e.g. \"0,1,2,3\". Each one is captured into its own " \
+    "program. Overrides the input card option.")
+
+#define AFFINITY_TEXT N_("Capture threads CPU affinity")
+#define AFFINITY_LONGTEXT N_( \
+    "CPUs to run the capture thread of each input card on, as lists " \
+    "separated by semicolons, in the order of the cards, " \
+    "e.g. \"0-3;4-7\". Leave empty to let the system decide.")
+
 #define MODE_TEXT N_("Desired input video mode. Leave empty for autodetection.")
 #define MODE_LONGTEXT N_( \
     "Desired input video mode for DeckLink captures. " \
@@ -89,6 +107,14 @@ static const char *const ppsz_audioconns_text[] = {
     N_("Embedded"), N_("AES/EBU"), N_("Analog")
 };
 
+#define FRAME_SYNC_TEXT N_("Frame synchronous output depth")
+#define FRAME_SYNC_LONGTEXT N_( \
+    "Number of frames (1 or 2) between the capture of a frame and its " \
+    "output, when the capture drives the output directly, as a frame " \
+    "synchroniser or confidence monitor would. The capture dates are then " \
+    "used without clock smoothing nor extra caching. " \
+    "0 uses the live caching instead.")
+
 #define ASPECT_RATIO_TEXT N_("Aspect ratio")
 #define ASPECT_RATIO_LONGTEXT N_(\
     "Aspect ratio (4:3, 16:9). Default assumes square pixels.")
@@ -101,6 +127,10 @@ vlc_module_begin ()
 
     add_integer("decklink-card-index", 0,
                  CARD_INDEX_TEXT, CARD_INDEX_LONGTEXT, true)
+    add_string("decklink-cards", NULL,
+                 CARDS_TEXT, CARDS_LONGTEXT, true)
+    add_string("decklink-affinity", NULL,
+                 AFFINITY_TEXT, AFFINITY_LONGTEXT, true)
     add_string("decklink-mode", NULL,
                  MODE_TEXT, MODE_LONGTEXT, true)
     add_string("decklink-audio-connection", 0,
@@ -115,7 +145,11 @@ vlc_module_begin ()
         change_string_list(ppsz_videoconns, ppsz_videoconns_text)
     add_string("decklink-aspect-ratio", NULL,
                 ASPECT_RATIO_TEXT, ASPECT_RATIO_LONGTEXT, true)
-    add_bool("decklink-tenbits", false, N_("10 bits"), N_("10 bits"), true)
+    add_bool("decklink-tenbits", false, N_("10 bits"), N_("10 bits. "
+        "Use --codec=v210,any to pass the v210 frames through to a DeckLink "
+        "output without unpacking them."), true)
+    add_integer_with_range("decklink-frame-sync", 0, 0, 2,
+                 FRAME_SYNC_TEXT, FRAME_SYNC_LONGTEXT, true)
 
     add_shortcut("decklink")
     set_capability("access_demux", 10)
@@ -123,11 +157,28 @@ vlc_module_begin ()
 vlc_module_end ()
 
 static int Control(demux_t *, int, va_list);
+static void WaitModes(demux_t *);
 
 class DeckLinkCaptureDelegate;
 
-struct demux_sys_t
+/* Kind of the captured blocks, in their private flags */
+enum
 {
+    BLOCK_VIDEO = 1,
+    BLOCK_AUDIO,
+    BLOCK_CC,
+    BLOCK_TELX,
+};
+
+/* One captured card or sub-device. The card callbacks queue the captured
+ * blocks, which the thread of the input sends to the es_out, so that each
+ * input is served by its own thread, possibly pinned to its own cores. */
+struct decklink_input_t
+{
+    demux_t *demux;
+    unsigned index;         /* card index */
+    int group;              /* ES group, 0 when capturing a single input */
+
     IDeckLink *card;
     IDeckLinkInput *input;
     DeckLinkCaptureDelegate *delegate;
@@ -138,18 +189,47 @@ struct demux_sys_t
     IDeckLinkAttributes *attributes;
 
     bool autodetect;
+    uint32_t dominance_flags;
+
+    block_fifo_t *fifo;
+    bool fifo_full;         /* dropping, owned by the card callbacks */
+    vlc_thread_t thread;
+    bool running;
+    char *affinity;         /* CPU list of the thread, NULL for any */
 
+    /* Owned by the input thread */
     es_out_id_t *video_es;
     es_out_id_t *audio_es;
     es_out_id_t *cc_es;
+    es_out_id_t *telx_es;
+
+    /* Video format detected by the card, protected by <lock> */
+    vlc_mutex_t lock;
+    vlc_cond_t wait;        /* signaled when the mode is known */
+    es_format_t video_fmt;
+    bool video_fmt_changed;
+    bool video_fmt_known;   /* signal received in <video_fmt> */
+
+    /* Owned by the card callbacks */
+    mtime_t capture_offset; /* capture date minus stream time */
+    int afd;                /* last Active Format Description, -1 if none */
+    bool timecode;          /* whether time codes were received */
+};
+
+struct demux_sys_t
+{
+    decklink_input_t *inputs;
+    unsigned input_count;
 
     vlc_mutex_t pts_lock;
-    int last_pts;  /* protected by <pts_lock> */
+    mtime_t last_pts;  /* protected by <pts_lock> */
 
-    uint32_t dominance_flags;
     int channels;
+    int physical_channels;
+    int rate;
 
     bool tenbits;
+    unsigned frame_sync;    /* output depth in frames, 0 if disabled */
 };
 
 static const char *GetFieldDominance(BMDFieldDominance dom, uint32_t *flags)
@@ -172,8 +252,9 @@ static const char *GetFieldDominance(BMDFieldDominance dom, uint32_t *flags)
     }
 }
 
-static es_format_t GetModeSettings(demux_t *demux, IDeckLinkDisplayMode *m)
+static es_format_t GetModeSettings(decklink_input_t *in, IDeckLinkDisplayMode *m)
 {
+    demux_t *demux = in->demux;
     demux_sys_t *sys = demux->p_sys;
     uint32_t flags = 0;
     (void)GetFieldDominance(m->GetFieldDominance(), &flags);
@@ -185,9 +266,10 @@ static es_format_t GetModeSettings(demux_t *demux, IDeckLinkDisplayMode *m)
     }
 
     es_format_t video_fmt;
-    vlc_fourcc_t chroma; chroma = sys->tenbits ? VLC_CODEC_I422_10L : VLC_CODEC_UYVY;
+    vlc_fourcc_t chroma; chroma = sys->tenbits ? VLC_CODEC_V210 : VLC_CODEC_UYVY;
     es_format_Init(&video_fmt, VIDEO_ES, chroma);
 
+    video_fmt.i_group = in->group;
     video_fmt.video.i_width = m->GetWidth();
     video_fmt.video.i_height = m->GetHeight();
     video_fmt.video.i_sar_num = 1;
@@ -203,15 +285,111 @@ static es_format_t GetModeSettings(demux_t *demux, IDeckLinkDisplayMode *m)
         video_fmt.video.i_sar_den = aspect_den * video_fmt.video.i_width;
     }
 
-    sys->dominance_flags = flags;
+    in->dominance_flags = flags;
 
     return video_fmt;
 }
 
+/* Blocks waiting for the input thread: about two seconds of video, audio and
+ * ancillary data at 60 fps */
+#define FIFO_MAX_BLOCKS 512
+
+static void QueueBlock(decklink_input_t *in, block_t *block, int kind)
+{
+    if (block_FifoCount(in->fifo) >= FIFO_MAX_BLOCKS) {
+        if (!in->fifo_full)
+            msg_Warn(in->demux, "Card %u: input thread too slow, "
+                     "dropping captured data", in->index);
+        in->fifo_full = true;
+        block_Release(block);
+        return;
+    }
+    in->fifo_full = false;
+
+    block->i_flags |= kind << BLOCK_FLAG_PRIVATE_SHIFT;
+    block_FifoPut(in->fifo, block);
+}
+
+/*
+ * Ancillary data
+ */
+struct vanc_ctx_t
+{
+    decklink_input_t *in;
+    mtime_t pts;
+};
+
+static void HandleCEA708(void *opaque, const anc_packet_t *pkt)
+{
+    struct vanc_ctx_t *ctx = (struct vanc_ctx_t *)opaque;
+    block_t *cc = anc_cea708_to_cc(ctx->in->demux, pkt);
+    if (cc) {
+        cc->i_pts = cc->i_dts = ctx->pts;
+        QueueBlock(ctx->in, cc, BLOCK_CC);
+    }
+}
+
+static void HandleOP47(void *opaque, const anc_packet_t *pkt)
+{
+    struct vanc_ctx_t *ctx = (struct vanc_ctx_t *)opaque;
+    block_t *telx = anc_op47_to_telx(pkt);
+    if (telx) {
+        telx->i_pts = telx->i_dts = ctx->pts;
+        QueueBlock(ctx->in, telx, BLOCK_TELX);
+    }
+}
+
+static void HandleAFD(void *opaque, const anc_packet_t *pkt)
+{
+    struct vanc_ctx_t *ctx = (struct vanc_ctx_t *)opaque;
+    decklink_input_t *in = ctx->in;
+    anc_afd_t afd;
+
+    if (!anc_afd(pkt, &afd) || afd.afd == in->afd)
+        return;
+    in->afd = afd.afd;
+    msg_Dbg(in->demux, "Active Format Description %u (%s), bars 0x%x %u %u",
+            afd.afd, afd.wide ? "16:9" : "4:3", afd.bar_flags, afd.bar1, afd.bar2);
+}
+
+static void HandleSCTE104(void *opaque, const anc_packet_t *pkt)
+{
+    struct vanc_ctx_t *ctx = (struct vanc_ctx_t *)opaque;
+    block_t *msg = anc_scte104(pkt);
+    if (!msg)
+        return;
+    if (msg->i_buffer >= 2)
+        msg_Dbg(ctx->in->demux, "SCTE 104 message, opID 0x%.4x",
+                GetWBE(msg->p_buffer));
+    block_Release(msg);
+}
+
+static void HandleTimecode(void *opaque, const anc_packet_t *pkt)
+{
+    struct vanc_ctx_t *ctx = (struct vanc_ctx_t *)opaque;
+    decklink_input_t *in = ctx->in;
+    anc_timecode_t tc;
+
+    if (in->timecode || !anc_timecode(pkt, &tc))
+        return;
+    in->timecode = true;
+    msg_Dbg(in->demux, "SMPTE 12M time code %.2u:%.2u:%.2u%c%.2u",
+            tc.hours, tc.minutes, tc.seconds, tc.drop_frame ? ';' : ':',
+            tc.frames);
+}
+
+static const anc_handler_t vanc_handlers[] = {
+    { ANC_DID_CEA708,   ANC_SDID_CEA708,    HandleCEA708 },
+    { ANC_DID_OP47,     ANC_SDID_OP47,      HandleOP47 },
+    { ANC_DID_AFD,      ANC_SDID_AFD,       HandleAFD },
+    { ANC_DID_SCTE104,  ANC_SDID_SCTE104,   HandleSCTE104 },
+    { ANC_DID_TIMECODE, ANC_SDID_TIMECODE,  HandleTimecode },
+};
+
 class DeckLinkCaptureDelegate : public IDeckLinkInputCallback
 {
 public:
-    DeckLinkCaptureDelegate(demux_t *demux) : demux_(demux)
+    DeckLinkCaptureDelegate(decklink_input_t *in) : in_(in)
     {
         m_ref_.store(1);
     }
@@ -233,7 +411,8 @@ public:
 
     virtual HRESULT STDMETHODCALLTYPE VideoInputFormatChanged(BMDVideoInputFormatChangedEvents events, IDeckLinkDisplayMode *mode, BMDDetectedVideoInputFormatFlags)
     {
-        demux_sys_t *sys = demux_->p_sys;
+        demux_t *demux = in_->demux;
+        demux_sys_t *sys = demux->p_sys;
 
         if( !(events & bmdVideoInputDisplayModeChanged ))
             return S_OK;
@@ -242,21 +421,27 @@ public:
         if (mode->GetName(&mode_name) != S_OK)
             mode_name = "unknown";
 
-        msg_Dbg(demux_, "Video input format changed to %s", mode_name);
-        if (!sys->autodetect) {
-            msg_Err(demux_, "Video format detection disabled");
+        msg_Dbg(demux, "Video input format of card %u changed to %s",
+                in_->index, mode_name);
+        if (!in_->autodetect) {
+            msg_Err(demux, "Video format detection disabled");
             return S_OK;
         }
 
-        es_out_Del(demux_->out, sys->video_es);
-        es_format_t video_fmt = GetModeSettings(demux_, mode);
-        sys->video_es = es_out_Add(demux_->out, &video_fmt);
+        /* The input thread replaces the ES before sending the next frame */
+        es_format_t video_fmt = GetModeSettings(in_, mode);
+        vlc_mutex_lock(&in_->lock);
+        in_->video_fmt = video_fmt;
+        in_->video_fmt_changed = true;
+        in_->video_fmt_known = true;
+        vlc_cond_signal(&in_->wait);
+        vlc_mutex_unlock(&in_->lock);
 
         BMDPixelFormat fmt = sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV;
-        sys->input->PauseStreams();
-        sys->input->EnableVideoInput( mode->GetDisplayMode(), fmt, bmdVideoInputEnableFormatDetection );
-        sys->input->FlushStreams();
-        sys->input->StartStreams();
+        in_->input->PauseStreams();
+        in_->input->EnableVideoInput( mode->GetDisplayMode(), fmt, bmdVideoInputEnableFormatDetection );
+        in_->input->FlushStreams();
+        in_->input->StartStreams();
 
         return S_OK;
     }
@@ -265,25 +450,70 @@ public:
 
 private:
     std::atomic_uint m_ref_;
-    demux_t *demux_;
+    decklink_input_t *in_;
+};
+
+struct decklink_frame_block
+{
+    block_t self;
+    IDeckLinkVideoInputFrame *frame;
 };
 
+static void decklink_frame_block_Release(block_t *block)
+{
+    decklink_frame_block *b = (decklink_frame_block *)block;
+
+    b->frame->Release();
+    free(b);
+}
+
+/* Wraps the card buffer without copying it: the frame is handed back to the
+ * driver when the block is released, so the capture stalls if too many
+ * blocks are held downstream. */
+static block_t *decklink_frame_block_Wrap(IDeckLinkVideoInputFrame *frame)
+{
+    void *bytes;
+    if (frame->GetBytes(&bytes) != S_OK)
+        return NULL;
+
+    decklink_frame_block *b = (decklink_frame_block *)malloc(sizeof (*b));
+    if (unlikely(b == NULL))
+        return NULL;
+
+    block_Init(&b->self, bytes, frame->GetRowBytes() * frame->GetHeight());
+    b->self.pf_release = decklink_frame_block_Release;
+    b->frame = frame;
+    frame->AddRef();
+    return &b->self;
+}
+
 HRESULT DeckLinkCaptureDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame* videoFrame, IDeckLinkAudioInputPacket* audioFrame)
 {
-    demux_sys_t *sys = demux_->p_sys;
+    demux_t *demux = in_->demux;
+    demux_sys_t *sys = demux->p_sys;
+    const mtime_t now = mdate();
 
     if (videoFrame) {
         if (videoFrame->GetFlags() & bmdFrameHasNoInputSource) {
-            msg_Warn(demux_, "No input signal detected");
+            msg_Warn(demux, "No input signal detected on card %u", in_->index);
             return S_OK;
         }
 
+        /* The signal matches the enabled mode */
+        vlc_mutex_lock(&in_->lock);
+        if (!in_->video_fmt_known) {
+            in_->video_fmt_known = true;
+            vlc_cond_signal(&in_->wait);
+        }
+        vlc_mutex_unlock(&in_->lock);
+
         const int width = videoFrame->GetWidth();
         const int height = videoFrame->GetHeight();
         const int stride = videoFrame->GetRowBytes();
 
-        int bpp = sys->tenbits ? 4 : 2;
-        block_t *video_frame = block_Alloc(width * height * bpp);
+        block_t *video_frame = sys->tenbits ?
+            decklink_frame_block_Wrap(videoFrame) :
+            block_Alloc(width * height * 2);
         if (!video_frame)
             return S_OK;
 
@@ -292,40 +522,32 @@ HRESULT DeckLinkCaptureDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame
 
         BMDTimeValue stream_time, frame_duration;
         videoFrame->GetStreamTime(&stream_time, &frame_duration, CLOCK_FREQ);
-        video_frame->i_flags = BLOCK_FLAG_TYPE_I | sys->dominance_flags;
+        video_frame->i_flags = BLOCK_FLAG_TYPE_I | in_->dominance_flags;
         video_frame->i_pts = video_frame->i_dts = VLC_TS_0 + stream_time;
+        if (sys->frame_sync) {
+            /* The frame was fully received just now, and is due
+             * frame_sync frames later */
+            in_->capture_offset = now - stream_time;
+            video_frame->i_pts = video_frame->i_dts = now;
+        }
 
         if (sys->tenbits) {
-            v210_convert((uint16_t*)video_frame->p_buffer, frame_bytes, width, height);
             IDeckLinkVideoFrameAncillary *vanc;
             if (videoFrame->GetAncillaryData(&vanc) == S_OK) {
+                struct vanc_ctx_t ctx = { in_, video_frame->i_pts };
+                uint16_t dec[width * 2];
+                unsigned errors = 0;
+
                 for (int i = 1; i < 21; i++) {
                     uint32_t *buf;
                     if (vanc->GetBufferForVerticalBlankingLine(i, (void**)&buf) != S_OK)
                         break;
-                    uint16_t dec[width * 2];
-                    v210_convert(&dec[0], buf, width, 1);
-                    block_t *cc = vanc_to_cc(demux_, dec, width * 2);
-                    if (!cc)
-                        continue;
-                    cc->i_pts = cc->i_dts = VLC_TS_0 + stream_time;
-
-                    if (!sys->cc_es) {
-                        es_format_t fmt;
-
-                        es_format_Init( &fmt, SPU_ES, VLC_FOURCC('c', 'c', '1' , ' ') );
-                        fmt.psz_description = strdup(N_("Closed captions 1"));
-                        if (fmt.psz_description) {
-                            sys->cc_es = es_out_Add(demux_->out, &fmt);
-                            msg_Dbg(demux_, "Adding Closed captions stream");
-                        }
-                    }
-                    if (sys->cc_es)
-                        es_out_Send(demux_->out, sys->cc_es, cc);
-                    else
-                        block_Release(cc);
-                    break; // we found the line with Closed Caption data
+                    size_t words = v210_unpack_anc(dec, buf, width, height > 576);
+                    errors += anc_parse(dec, words, i, vanc_handlers,
+                                        ARRAY_SIZE(vanc_handlers), &ctx);
                 }
+                if (errors)
+                    msg_Dbg(demux, "%u malformed ancillary packets", errors);
                 vanc->Release();
             }
         } else {
@@ -336,13 +558,7 @@ HRESULT DeckLinkCaptureDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame
             }
         }
 
-        vlc_mutex_lock(&sys->pts_lock);
-        if (video_frame->i_pts > sys->last_pts)
-            sys->last_pts = video_frame->i_pts;
-        vlc_mutex_unlock(&sys->pts_lock);
-
-        es_out_Control(demux_->out, ES_OUT_SET_PCR, video_frame->i_pts);
-        es_out_Send(demux_->out, sys->video_es, video_frame);
+        QueueBlock(in_, video_frame, BLOCK_VIDEO);
     }
 
     if (audioFrame) {
@@ -359,23 +575,139 @@ HRESULT DeckLinkCaptureDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame
         BMDTimeValue packet_time;
         audioFrame->GetPacketTime(&packet_time, CLOCK_FREQ);
         audio_frame->i_pts = audio_frame->i_dts = VLC_TS_0 + packet_time;
+        if (sys->frame_sync) {
+            if (in_->capture_offset == 0)
+                in_->capture_offset = now - packet_time;
+            audio_frame->i_pts = audio_frame->i_dts =
+                packet_time + in_->capture_offset;
+        }
+
+        QueueBlock(in_, audio_frame, BLOCK_AUDIO);
+    }
+
+    return S_OK;
+}
+
+static es_out_id_t *AddSubtitles(decklink_input_t *in, vlc_fourcc_t codec,
+                                 const char *description)
+{
+    es_format_t fmt;
+    es_out_id_t *es = NULL;
+
+    es_format_Init(&fmt, SPU_ES, codec);
+    fmt.i_group = in->group;
+    fmt.psz_description = strdup(description);
+    if (fmt.psz_description) {
+        es = es_out_Add(in->demux->out, &fmt);
+        msg_Dbg(in->demux, "Adding %s stream", description);
+    }
+    es_format_Clean(&fmt);
+    return es;
+}
+
+static void SendBlock(decklink_input_t *in, block_t *block)
+{
+    demux_t *demux = in->demux;
+    demux_sys_t *sys = demux->p_sys;
+    es_out_id_t *es = NULL;
+
+    switch (block->i_flags >> BLOCK_FLAG_PRIVATE_SHIFT) {
+    case BLOCK_VIDEO:
+        vlc_mutex_lock(&in->lock);
+        if (in->video_fmt_changed) {
+            es_out_Del(demux->out, in->video_es);
+            in->video_es = es_out_Add(demux->out, &in->video_fmt);
+            in->video_fmt_changed = false;
+        }
+        vlc_mutex_unlock(&in->lock);
+        es = in->video_es;
+        break;
+    case BLOCK_AUDIO:
+        es = in->audio_es;
+        break;
+    case BLOCK_CC:
+        if (!in->cc_es)
+            in->cc_es = AddSubtitles(in, VLC_FOURCC('c', 'c', '1' , ' '),
+                                     N_("Closed captions 1"));
+        es = in->cc_es;
+        break;
+    case BLOCK_TELX:
+        if (!in->telx_es)
+            in->telx_es = AddSubtitles(in, VLC_CODEC_TELETEXT, N_("Teletext"));
+        es = in->telx_es;
+        break;
+    }
+    block->i_flags &= ~BLOCK_FLAG_PRIVATE_MASK;
+
+    if (!es) {
+        block_Release(block);
+        return;
+    }
 
+    if (es == in->video_es || es == in->audio_es) {
         vlc_mutex_lock(&sys->pts_lock);
-        if (audio_frame->i_pts > sys->last_pts)
-            sys->last_pts = audio_frame->i_pts;
+        if (block->i_pts > sys->last_pts)
+            sys->last_pts = block->i_pts;
         vlc_mutex_unlock(&sys->pts_lock);
 
-        es_out_Control(demux_->out, ES_OUT_SET_PCR, audio_frame->i_pts);
-        es_out_Send(demux_->out, sys->audio_es, audio_frame);
+        if (in->group)
+            es_out_Control(demux->out, ES_OUT_SET_GROUP_PCR, in->group,
+                           block->i_pts);
+        else
+            es_out_Control(demux->out, ES_OUT_SET_PCR, block->i_pts);
     }
 
-    return S_OK;
+    es_out_Send(demux->out, es, block);
+}
+
+/* Parses a CPU list such as "0-3,8" */
+static void SetAffinity(decklink_input_t *in)
+{
+#ifdef HAVE_SCHED_GETAFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (const char *p = in->affinity; *p; ) {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10), last = first;
+        if (end == p)
+            break;
+        if (*end == '-')
+            last = strtoul(end + 1, &end, 10);
+        for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &set);
+        p = end + (*end == ',');
+    }
+
+    if (CPU_COUNT(&set) == 0 || sched_setaffinity(0, sizeof (set), &set))
+        msg_Warn(in->demux, "Cannot bind card %u to CPUs %s",
+                 in->index, in->affinity);
+#else
+    msg_Warn(in->demux, "CPU affinity not supported");
+#endif
 }
 
+static void *InputThread(void *data)
+{
+    decklink_input_t *in = (decklink_input_t *)data;
+
+    if (in->affinity)
+        SetAffinity(in);
+
+    for (;;) {
+        block_t *block = block_FifoGet(in->fifo);
+
+        int canc = vlc_savecancel();
+        SendBlock(in, block);
+        vlc_restorecancel(canc);
+    }
+
+    vlc_assert_unreachable();
+}
 
-static int GetAudioConn(demux_t *demux)
+static int GetAudioConn(decklink_input_t *in)
 {
-    demux_sys_t *sys = demux->p_sys;
+    demux_t *demux = in->demux;
 
     char *opt = var_CreateGetNonEmptyString(demux, "decklink-audio-connection");
     if (!opt)
@@ -394,7 +726,7 @@ static int GetAudioConn(demux_t *demux)
         return VLC_EGENERIC;
     }
 
-    if (sys->config->SetInt(bmdDeckLinkConfigAudioInputConnection, c) != S_OK) {
+    if (in->config->SetInt(bmdDeckLinkConfigAudioInputConnection, c) != S_OK) {
         msg_Err(demux, "Failed to set audio input connection");
         return VLC_EGENERIC;
     }
@@ -402,9 +734,9 @@ static int GetAudioConn(demux_t *demux)
     return VLC_SUCCESS;
 }
 
-static int GetVideoConn(demux_t *demux)
+static int GetVideoConn(decklink_input_t *in)
 {
-    demux_sys_t *sys = demux->p_sys;
+    demux_t *demux = in->demux;
 
     char *opt = var_InheritString(demux, "decklink-video-connection");
     if (!opt)
@@ -430,7 +762,7 @@ static int GetVideoConn(demux_t *demux)
     }
 
     free(opt);
-    if (sys->config->SetInt(bmdDeckLinkConfigVideoInputConnection, c) != S_OK) {
+    if (in->config->SetInt(bmdDeckLinkConfigVideoInputConnection, c) != S_OK) {
         msg_Err(demux, "Failed to set video input connection");
         return VLC_EGENERIC;
     }
@@ -438,92 +770,50 @@ static int GetVideoConn(demux_t *demux)
     return VLC_SUCCESS;
 }
 
-static int Open(vlc_object_t *p_this)
+/* Sets up the card of an input, up to enabling its video and audio */
+static int OpenInput(decklink_input_t *in)
 {
-    demux_t     *demux = (demux_t*)p_this;
-    demux_sys_t *sys;
-    int         ret = VLC_EGENERIC;
-    int         card_index;
-    int         physical_channels = 0;
-    int         rate;
+    demux_t *demux = in->demux;
+    demux_sys_t *sys = demux->p_sys;
     BMDVideoInputFlags flags = bmdVideoInputFlagDefault;
 
-    /* Only when selected */
-    if (*demux->psz_access == '\0')
-        return VLC_EGENERIC;
-
-    /* Set up demux */
-    demux->pf_demux = NULL;
-    demux->pf_control = Control;
-    demux->info.i_update = 0;
-    demux->info.i_title = 0;
-    demux->info.i_seekpoint = 0;
-    demux->p_sys = sys = (demux_sys_t*)calloc(1, sizeof(demux_sys_t));
-    if (!sys)
-        return VLC_ENOMEM;
-
-    vlc_mutex_init(&sys->pts_lock);
-
-    sys->tenbits = var_InheritBool(p_this, "decklink-tenbits");
-
-    IDeckLinkIterator *decklink_iterator = CreateDeckLinkIteratorInstance();
-    if (!decklink_iterator) {
-        msg_Err(demux, "DeckLink drivers not found.");
-        goto finish;
-    }
-
-    card_index = var_InheritInteger(demux, "decklink-card-index");
-    if (card_index < 0) {
-        msg_Err(demux, "Invalid card index %d", card_index);
-        goto finish;
-    }
-
-    for (int i = 0; i <= card_index; i++) {
-        if (sys->card)
-            sys->card->Release();
-        if (decklink_iterator->Next(&sys->card) != S_OK) {
-            msg_Err(demux, "DeckLink PCI card %d not found", card_index);
-            goto finish;
-        }
-    }
-
     const char *model_name;
-    if (sys->card->GetModelName(&model_name) != S_OK)
+    if (in->card->GetModelName(&model_name) != S_OK)
         model_name = "unknown";
 
-    msg_Dbg(demux, "Opened DeckLink PCI card %d (%s)", card_index, model_name);
+    msg_Dbg(demux, "Opened DeckLink PCI card %u (%s)", in->index, model_name);
 
-    if (sys->card->QueryInterface(IID_IDeckLinkInput, (void**)&sys->input) != S_OK) {
+    if (in->card->QueryInterface(IID_IDeckLinkInput, (void**)&in->input) != S_OK) {
         msg_Err(demux, "Card has no inputs");
-        goto finish;
+        return VLC_EGENERIC;
     }
 
     /* Set up the video and audio sources. */
-    if (sys->card->QueryInterface(IID_IDeckLinkConfiguration, (void**)&sys->config) != S_OK) {
+    if (in->card->QueryInterface(IID_IDeckLinkConfiguration, (void**)&in->config) != S_OK) {
         msg_Err(demux, "Failed to get configuration interface");
-        goto finish;
+        return VLC_EGENERIC;
     }
 
-    if (sys->card->QueryInterface(IID_IDeckLinkAttributes, (void**)&sys->attributes) != S_OK) {
+    if (in->card->QueryInterface(IID_IDeckLinkAttributes, (void**)&in->attributes) != S_OK) {
         msg_Err(demux, "Failed to get attributes interface");
-        goto finish;
+        return VLC_EGENERIC;
     }
 
-    if (GetVideoConn(demux) || GetAudioConn(demux))
-        goto finish;
+    if (GetVideoConn(in) || GetAudioConn(in))
+        return VLC_EGENERIC;
 
     BMDPixelFormat fmt;
     fmt = sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV;
-    if (sys->attributes->GetFlag(BMDDeckLinkSupportsInputFormatDetection, &sys->autodetect) != S_OK) {
+    if (in->attributes->GetFlag(BMDDeckLinkSupportsInputFormatDetection, &in->autodetect) != S_OK) {
         msg_Err(demux, "Failed to query card attribute");
-        goto finish;
+        return VLC_EGENERIC;
     }
 
     /* Get the list of display modes. */
     IDeckLinkDisplayModeIterator *mode_it;
-    if (sys->input->GetDisplayModeIterator(&mode_it) != S_OK) {
+    if (in->input->GetDisplayModeIterator(&mode_it) != S_OK) {
         msg_Err(demux, "Failed to enumerate display modes");
-        goto finish;
+        return VLC_EGENERIC;
     }
 
     union {
@@ -536,9 +826,9 @@ static int Open(vlc_object_t *p_this)
     char *mode;
     mode = var_CreateGetNonEmptyString(demux, "decklink-mode");
     if (mode)
-        sys->autodetect = false; // disable autodetection if mode was set
+        in->autodetect = false; // disable autodetection if mode was set
 
-    if (sys->autodetect) {
+    if (in->autodetect) {
         msg_Dbg(demux, "Card supports input format detection");
         flags |= bmdVideoInputEnableFormatDetection;
         /* Enable a random format, we will reconfigure on format detection */
@@ -547,7 +837,8 @@ static int Open(vlc_object_t *p_this)
         if (!mode || strlen(mode) < 3 || strlen(mode) > 4) {
             msg_Err(demux, "Invalid mode: \'%s\'", mode ? mode : "");
             free(mode);
-            goto finish;
+            mode_it->Release();
+            return VLC_EGENERIC;
         }
 
         msg_Dbg(demux, "Looking for mode \'%s\'", mode);
@@ -557,8 +848,7 @@ static int Open(vlc_object_t *p_this)
         free(mode);
     }
 
-    es_format_t video_fmt;
-    video_fmt.video.i_width = 0;
+    in->video_fmt.video.i_width = 0;
 
     for (IDeckLinkDisplayMode *m;; m->Release()) {
         if ((mode_it->Next(&m) != S_OK) || !m)
@@ -583,78 +873,297 @@ static int Open(vlc_object_t *p_this)
                  double(time_scale) / frame_duration, field);
 
         if (u.id == id) {
-            video_fmt = GetModeSettings(demux, m);
+            in->video_fmt = GetModeSettings(in, m);
             msg_Dbg(demux, "Using that mode");
         }
     }
 
     mode_it->Release();
 
-    if (video_fmt.video.i_width == 0) {
+    if (in->video_fmt.video.i_width == 0) {
         msg_Err(demux, "Unknown video mode `%4.4s\' specified.", (char*)&u.id);
-        goto finish;
+        return VLC_EGENERIC;
     }
 
-    if (sys->input->EnableVideoInput(htonl(u.id), fmt, flags) != S_OK) {
+    if (in->input->EnableVideoInput(htonl(u.id), fmt, flags) != S_OK) {
         msg_Err(demux, "Failed to enable video input");
-        goto finish;
+        return VLC_EGENERIC;
     }
 
     /* Set up audio. */
+    if (sys->rate > 0 && sys->channels > 0) {
+        if (in->input->EnableAudioInput(sys->rate, bmdAudioSampleType16bitInteger, sys->channels) != S_OK) {
+            msg_Err(demux, "Failed to enable audio input");
+            return VLC_EGENERIC;
+        }
+    }
+
+    return VLC_SUCCESS;
+}
+
+/* Adds the ES of an input, and starts its thread and its card */
+static int StartInput(decklink_input_t *in)
+{
+    demux_t *demux = in->demux;
+    demux_sys_t *sys = demux->p_sys;
+
+    if (in->group) {
+        vlc_meta_t *meta = vlc_meta_New();
+        if (meta) {
+            char *title;
+            if (asprintf(&title, "DeckLink %u", in->index) >= 0) {
+                vlc_meta_SetTitle(meta, title);
+                free(title);
+            }
+            es_out_Control(demux->out, ES_OUT_SET_GROUP_META, in->group, meta);
+            vlc_meta_Delete(meta);
+        }
+    }
+
+    msg_Dbg(demux, "added new video es %4.4s %dx%d",
+             (char*)&in->video_fmt.i_codec, in->video_fmt.video.i_width, in->video_fmt.video.i_height);
+    in->video_es = es_out_Add(demux->out, &in->video_fmt);
+
+    es_format_t audio_fmt;
+    es_format_Init(&audio_fmt, AUDIO_ES, VLC_CODEC_S16N);
+    audio_fmt.i_group = in->group;
+    audio_fmt.audio.i_channels = sys->channels;
+    audio_fmt.audio.i_physical_channels = sys->physical_channels;
+    audio_fmt.audio.i_rate = sys->rate;
+    audio_fmt.audio.i_bitspersample = 16;
+    audio_fmt.audio.i_blockalign = audio_fmt.audio.i_channels * audio_fmt.audio.i_bitspersample / 8;
+    audio_fmt.i_bitrate = audio_fmt.audio.i_channels * audio_fmt.audio.i_rate * audio_fmt.audio.i_bitspersample;
+
+    msg_Dbg(demux, "added new audio es %4.4s %dHz %dbpp %dch",
+             (char*)&audio_fmt.i_codec, audio_fmt.audio.i_rate, audio_fmt.audio.i_bitspersample, audio_fmt.audio.i_channels);
+    in->audio_es = es_out_Add(demux->out, &audio_fmt);
+
+    if (vlc_clone(&in->thread, InputThread, in, VLC_THREAD_PRIORITY_INPUT))
+        return VLC_EGENERIC;
+    in->running = true;
+
+    in->delegate = new DeckLinkCaptureDelegate(in);
+    in->input->SetCallback(in->delegate);
+
+    if (in->input->StartStreams() != S_OK) {
+        msg_Err(demux, "Could not start streaming from SDI card %u. This could be caused "
+                          "by invalid video mode or flags, access denied, or card already in use.",
+                in->index);
+        return VLC_EGENERIC;
+    }
+
+    return VLC_SUCCESS;
+}
+
+static void CloseInput(decklink_input_t *in)
+{
+    if (in->input)
+        in->input->StopStreams();
+
+    if (in->running) {
+        vlc_cancel(in->thread);
+        vlc_join(in->thread, NULL);
+    }
+
+    if (in->attributes)
+        in->attributes->Release();
+
+    if (in->config)
+        in->config->Release();
+
+    if (in->input)
+        in->input->Release();
+
+    if (in->card)
+        in->card->Release();
+
+    if (in->delegate)
+        in->delegate->Release();
+
+    if (in->fifo)
+        block_FifoRelease(in->fifo);
+
+    vlc_cond_destroy(&in->wait);
+    vlc_mutex_destroy(&in->lock);
+    free(in->affinity);
+}
+
+/* Gets the card indexes from decklink-cards, or decklink-card-index */
+static int GetCards(demux_t *demux, unsigned **indexes)
+{
+    char *list = var_InheritString(demux, "decklink-cards");
+    unsigned count = 0;
+
+    if (!list) {
+        int card_index = var_InheritInteger(demux, "decklink-card-index");
+        if (card_index < 0) {
+            msg_Err(demux, "Invalid card index %d", card_index);
+            return -1;
+        }
+        *indexes = (unsigned *)malloc(sizeof (**indexes));
+        if (!*indexes)
+            return -1;
+        (*indexes)[0] = card_index;
+        return 1;
+    }
+
+    *indexes = (unsigned *)malloc((strlen(list) / 2 + 1) * sizeof (**indexes));
+    if (!*indexes) {
+        free(list);
+        return -1;
+    }
+
+    char *saveptr;
+    for (char *tok = strtok_r(list, ",", &saveptr); tok;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        char *end;
+        unsigned long index = strtoul(tok, &end, 10);
+        if (end == tok || *end != '\0' || index > INT_MAX) {
+            msg_Err(demux, "Invalid card index `%s\'", tok);
+            count = 0;
+            break;
+        }
+        for (unsigned i = 0; i < count; i++)
+            if ((*indexes)[i] == index) {
+                msg_Err(demux, "Card %lu specified twice", index);
+                count = 0;
+                goto end;
+            }
+        (*indexes)[count++] = index;
+    }
+end:
+    free(list);
+
+    if (count == 0) {
+        free(*indexes);
+        return -1;
+    }
+    return count;
+}
+
+static int Open(vlc_object_t *p_this)
+{
+    demux_t     *demux = (demux_t*)p_this;
+    demux_sys_t *sys;
+    int         ret = VLC_EGENERIC;
+    unsigned    *indexes = NULL;
+    int         count;
+    unsigned    max_index = 0;
+    char        *affinity, *affinity_list;
+
+    /* Only when selected */
+    if (*demux->psz_access == '\0')
+        return VLC_EGENERIC;
+
+    /* Set up demux */
+    demux->pf_demux = NULL;
+    demux->pf_control = Control;
+    demux->info.i_update = 0;
+    demux->info.i_title = 0;
+    demux->info.i_seekpoint = 0;
+    demux->p_sys = sys = (demux_sys_t*)calloc(1, sizeof(demux_sys_t));
+    if (!sys)
+        return VLC_ENOMEM;
+
+    vlc_mutex_init(&sys->pts_lock);
+
+    sys->tenbits = var_InheritBool(p_this, "decklink-tenbits");
+    sys->frame_sync = var_InheritInteger(demux, "decklink-frame-sync");
+
     sys->channels = var_InheritInteger(demux, "decklink-audio-channels");
     switch (sys->channels) {
     case 0:
         break;
     case 2:
-        physical_channels = AOUT_CHANS_STEREO;
+        sys->physical_channels = AOUT_CHANS_STEREO;
         break;
     case 8:
-        physical_channels = AOUT_CHANS_7_1;
+        sys->physical_channels = AOUT_CHANS_7_1;
         break;
     //case 16:
     default:
         msg_Err(demux, "Invalid number of channels (%d), disabling audio", sys->channels);
         sys->channels = 0;
     }
-    rate = var_InheritInteger(demux, "decklink-audio-rate");
-    if (rate > 0 && sys->channels > 0) {
-        if (sys->input->EnableAudioInput(rate, bmdAudioSampleType16bitInteger, sys->channels) != S_OK) {
-            msg_Err(demux, "Failed to enable audio input");
+    sys->rate = var_InheritInteger(demux, "decklink-audio-rate");
+
+    count = GetCards(demux, &indexes);
+    if (count <= 0)
+        goto finish;
+
+    sys->inputs = (decklink_input_t *)calloc(count, sizeof (*sys->inputs));
+    if (!sys->inputs)
+        goto finish;
+    sys->input_count = count;
+
+    /* CPU lists of the input threads, separated by semicolons */
+    affinity = var_InheritString(demux, "decklink-affinity");
+    affinity_list = affinity;
+    for (int i = 0; i < count; i++) {
+        decklink_input_t *in = &sys->inputs[i];
+        in->demux = demux;
+        in->index = indexes[i];
+        in->group = count > 1 ? i + 1 : 0;
+        in->afd = -1;
+        vlc_mutex_init(&in->lock);
+        vlc_cond_init(&in->wait);
+        in->fifo = block_FifoNew();
+
+        char *cpus = affinity_list ? strsep(&affinity_list, ";") : NULL;
+        if (cpus && *cpus)
+            in->affinity = strdup(cpus);
+
+        max_index = __MAX(max_index, indexes[i]);
+    }
+    free(affinity);
+
+    {
+        /* Walk the cards once for all the inputs */
+        IDeckLinkIterator *decklink_iterator = CreateDeckLinkIteratorInstance();
+        if (!decklink_iterator) {
+            msg_Err(demux, "DeckLink drivers not found.");
             goto finish;
         }
-    }
 
-    sys->delegate = new DeckLinkCaptureDelegate(demux);
-    sys->input->SetCallback(sys->delegate);
+        for (unsigned index = 0; index <= max_index; index++) {
+            IDeckLink *card;
+            if (decklink_iterator->Next(&card) != S_OK)
+                break;
 
-    if (sys->input->StartStreams() != S_OK) {
-        msg_Err(demux, "Could not start streaming from SDI card. This could be caused "
-                          "by invalid video mode or flags, access denied, or card already in use.");
-        goto finish;
+            for (int i = 0; i < count && card; i++)
+                if (sys->inputs[i].index == index) {
+                    sys->inputs[i].card = card;
+                    card = NULL;
+                }
+            if (card)
+                card->Release();
+        }
+
+        decklink_iterator->Release();
     }
 
-    msg_Dbg(demux, "added new video es %4.4s %dx%d",
-             (char*)&video_fmt.i_codec, video_fmt.video.i_width, video_fmt.video.i_height);
-    sys->video_es = es_out_Add(demux->out, &video_fmt);
+    for (int i = 0; i < count; i++) {
+        decklink_input_t *in = &sys->inputs[i];
+        if (!in->card) {
+            msg_Err(demux, "DeckLink PCI card %u not found", in->index);
+            goto finish;
+        }
+        if (!in->fifo || OpenInput(in))
+            goto finish;
+    }
 
-    es_format_t audio_fmt;
-    es_format_Init(&audio_fmt, AUDIO_ES, VLC_CODEC_S16N);
-    audio_fmt.audio.i_channels = sys->channels;
-    audio_fmt.audio.i_physical_channels = physical_channels;
-    audio_fmt.audio.i_rate = rate;
-    audio_fmt.audio.i_bitspersample = 16;
-    audio_fmt.audio.i_blockalign = audio_fmt.audio.i_channels * audio_fmt.audio.i_bitspersample / 8;
-    audio_fmt.i_bitrate = audio_fmt.audio.i_channels * audio_fmt.audio.i_rate * audio_fmt.audio.i_bitspersample;
+    for (int i = 0; i < count; i++)
+        if (StartInput(&sys->inputs[i]))
+            goto finish;
 
-    msg_Dbg(demux, "added new audio es %4.4s %dHz %dbpp %dch",
-             (char*)&audio_fmt.i_codec, audio_fmt.audio.i_rate, audio_fmt.audio.i_bitspersample, audio_fmt.audio.i_channels);
-    sys->audio_es = es_out_Add(demux->out, &audio_fmt);
+    /* The PTS delay is a number of frames of the detected modes */
+    if (sys->frame_sync)
+        WaitModes(demux);
 
     ret = VLC_SUCCESS;
 
 finish:
-    if (decklink_iterator)
-        decklink_iterator->Release();
+    free(indexes);
 
     if (ret != VLC_SUCCESS)
         Close(p_this);
@@ -667,25 +1176,59 @@ static void Close(vlc_object_t *p_this)
     demux_t     *demux = (demux_t *)p_this;
     demux_sys_t *sys   = demux->p_sys;
 
-    if (sys->attributes)
-        sys->attributes->Release();
+    for (unsigned i = 0; i < sys->input_count; i++)
+        CloseInput(&sys->inputs[i]);
+    free(sys->inputs);
 
-    if (sys->config)
-        sys->config->Release();
+    vlc_mutex_destroy(&sys->pts_lock);
+    free(sys);
+}
+
+/* Waits until the modes of the autodetecting inputs are known, for up to
+ * DETECT_TIMEOUT, so that the PTS delay is computed from them */
+#define DETECT_TIMEOUT (CLOCK_FREQ / 2)
+
+static void WaitModes(demux_t *demux)
+{
+    demux_sys_t *sys = demux->p_sys;
+    const mtime_t deadline = mdate() + DETECT_TIMEOUT;
+
+    for (unsigned i = 0; i < sys->input_count; i++) {
+        decklink_input_t *in = &sys->inputs[i];
+        bool known;
+
+        if (!in->autodetect)
+            continue;
 
-    if (sys->input) {
-        sys->input->StopStreams();
-        sys->input->Release();
+        vlc_mutex_lock(&in->lock);
+        while (!in->video_fmt_known)
+            if (vlc_cond_timedwait(&in->wait, &in->lock, deadline))
+                break;
+        known = in->video_fmt_known;
+        vlc_mutex_unlock(&in->lock);
+
+        if (!known)
+            msg_Warn(demux, "No video mode detected on card %u yet, "
+                     "the PTS delay may be wrong", in->index);
     }
+}
 
-    if (sys->card)
-        sys->card->Release();
+/* Longest frame of the inputs, in CLOCK_FREQ units */
+static mtime_t GetFrameLength(demux_sys_t *sys)
+{
+    mtime_t length = 0;
 
-    if (sys->delegate)
-        sys->delegate->Release();
+    for (unsigned i = 0; i < sys->input_count; i++) {
+        decklink_input_t *in = &sys->inputs[i];
+        const video_format_t *fmt = &in->video_fmt.video;
 
-    vlc_mutex_destroy(&sys->pts_lock);
-    free(sys);
+        vlc_mutex_lock(&in->lock);
+        if (fmt->i_frame_rate > 0)
+            length = __MAX(length, CLOCK_FREQ * fmt->i_frame_rate_base
+                                   / fmt->i_frame_rate);
+        vlc_mutex_unlock(&in->lock);
+    }
+    return length;
 }
 
 static int Control(demux_t *demux, int query, va_list args)
@@ -706,7 +1249,15 @@ static int Control(demux_t *demux, int query, va_list args)
 
         case DEMUX_GET_PTS_DELAY:
             pi64 = (int64_t*)va_arg(args, int64_t *);
-            *pi64 = INT64_C(1000) * var_InheritInteger(demux, "live-caching");
+            if (sys->frame_sync)
+                *pi64 = sys->frame_sync * GetFrameLength(sys);
+            else
+                *pi64 = INT64_C(1000) * var_InheritInteger(demux, "live-caching");
+            return VLC_SUCCESS;
+
+        case DEMUX_IS_SYSTEM_CLOCK:
+            pb = (bool*)va_arg(args, bool *);
+            *pb = sys->frame_sync > 0;
             return VLC_SUCCESS;
 
         case DEMUX_GET_TIME:
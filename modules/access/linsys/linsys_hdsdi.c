@@ -44,9 +44,11 @@
 #include <vlc_demux.h>
 
 #include <vlc_fs.h>
+#include <vlc_cpu.h>
 
 #include "linsys_sdivideo.h"
 #include "linsys_sdiaudio.h"
+#include "linsys_unpack.h"
 
 #undef HAVE_MMAP_SDIVIDEO
 #undef HAVE_MMAP_SDIAUDIO
@@ -154,6 +156,7 @@ struct demux_sys_t
     int          i_id_video;
     es_out_id_t  *p_es_video;
     hdsdi_audio_t p_audios[MAX_AUDIOS];
+    const linsys_unpack_t *p_unpack;
 
     pthread_t thread;
     int evfd;
@@ -179,6 +182,7 @@ static int Open( vlc_object_t *p_this )
     p_demux->p_sys = p_sys = calloc( 1, sizeof( demux_sys_t ) );
     if( unlikely(!p_sys) )
         return VLC_ENOMEM;
+    p_sys->p_unpack = linsys_GetUnpack( vlc_CPU() );
 
     /* HDSDI AR */
     char *psz_ar = var_InheritString( p_demux, "linsys-hdsdi-aspect-ratio" );
@@ -328,74 +332,6 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 /*****************************************************************************
  * HDSDI syntax parsing stuff
  *****************************************************************************/
-#define U   (uint16_t)(p_line[0])
-#define Y1  (uint16_t)(p_line[1])
-#define V   (uint16_t)(p_line[2])
-#define Y2  (uint16_t)(p_line[3])
-
-/* For lines 0 [4] or 1 [4] */
-static void Unpack01( const uint8_t *p_line, unsigned int i_size,
-                      uint8_t *p_y, uint8_t *p_u, uint8_t *p_v )
-{
-    const uint8_t *p_end = p_line + i_size;
-
-    while ( p_line < p_end )
-    {
-        *p_u++ = U;
-        *p_y++ = Y1;
-        *p_v++ = V;
-        *p_y++ = Y2;
-        p_line += 4;
-    }
-}
-
-/* For lines 2 [4] */
-static void Unpack2( const uint8_t *p_line, unsigned int i_size,
-                     uint8_t *p_y, uint8_t *p_u, uint8_t *p_v )
-{
-    const uint8_t *p_end = p_line + i_size;
-
-    while ( p_line < p_end )
-    {
-        uint16_t tmp;
-        tmp = 3 * *p_u;
-        tmp += U;
-        *p_u++ = tmp / 4;
-        *p_y++ = Y1;
-        tmp = 3 * *p_v;
-        tmp += V;
-        *p_v++ = tmp / 4;
-        *p_y++ = Y2;
-        p_line += 4;
-    }
-}
-
-/* For lines 3 [4] */
-static void Unpack3( const uint8_t *p_line, unsigned int i_size,
-                     uint8_t *p_y, uint8_t *p_u, uint8_t *p_v )
-{
-    const uint8_t *p_end = p_line + i_size;
-
-    while ( p_line < p_end )
-    {
-        uint16_t tmp;
-        tmp = *p_u;
-        tmp += 3 * U;
-        *p_u++ = tmp / 4;
-        *p_y++ = Y1;
-        tmp = *p_v;
-        tmp += 3 * V;
-        *p_v++ = tmp / 4;
-        *p_y++ = Y2;
-        p_line += 4;
-    }
-}
-
-#undef U
-#undef Y1
-#undef V
-#undef Y2
-
 static void SparseCopy( int16_t *p_dest, const int16_t *p_src,
                         size_t i_nb_samples, size_t i_offset, size_t i_stride )
 {
@@ -565,6 +501,7 @@ static int HandleVideo( demux_t *p_demux, const uint8_t *p_buffer )
     uint8_t *p_y = p_current_picture->p_buffer;
     uint8_t *p_u = p_y + p_sys->i_width * p_sys->i_height;
     uint8_t *p_v = p_u + p_sys->i_width * p_sys->i_height / 4;
+    const linsys_unpack_t *p_unpack = p_sys->p_unpack;
     unsigned int i_total_size = p_sys->i_width * 2;
     unsigned int i_current_line;
     struct block_extension_t ext;
@@ -579,26 +516,34 @@ static int HandleVideo( demux_t *p_demux, const uint8_t *p_buffer )
         unsigned int i_real_line = b_field + i_field_line * 2;
         const uint8_t *p_line = p_buffer + i_current_line * p_sys->i_width * 2;
 
+        linsys_unpack_line_t pf_unpack;
+        unsigned int i_chroma_line;
+
         if ( !(i_field_line % 2) && !b_field )
-            Unpack01( p_line, i_total_size,
-                      p_y + p_sys->i_width * i_real_line,
-                      p_u + (p_sys->i_width / 2) * (i_real_line / 2),
-                      p_v + (p_sys->i_width / 2) * (i_real_line / 2) );
+        {
+            pf_unpack = p_unpack->pf_unpack8[0];
+            i_chroma_line = i_real_line / 2;
+        }
         else if ( !(i_field_line % 2) )
-            Unpack01( p_line, i_total_size,
-                      p_y + p_sys->i_width * i_real_line,
-                      p_u + (p_sys->i_width / 2) * (i_real_line / 2 + 1),
-                      p_v + (p_sys->i_width / 2) * (i_real_line / 2 + 1) );
-       else if ( !b_field )
-            Unpack2( p_line, i_total_size,
-                     p_y + p_sys->i_width * i_real_line,
-                     p_u + (p_sys->i_width / 2) * (i_real_line / 2 - 1),
-                     p_v + (p_sys->i_width / 2) * (i_real_line / 2 - 1) );
-       else
-            Unpack3( p_line, i_total_size,
-                     p_y + p_sys->i_width * i_real_line,
-                     p_u + (p_sys->i_width / 2) * (i_real_line / 2),
-                     p_v + (p_sys->i_width / 2) * (i_real_line / 2) );
+        {
+            pf_unpack = p_unpack->pf_unpack8[0];
+            i_chroma_line = i_real_line / 2 + 1;
+        }
+        else if ( !b_field )
+        {
+            pf_unpack = p_unpack->pf_unpack8[1];
+            i_chroma_line = i_real_line / 2 - 1;
+        }
+        else
+        {
+            pf_unpack = p_unpack->pf_unpack8[2];
+            i_chroma_line = i_real_line / 2;
+        }
+
+        pf_unpack( p_line, i_total_size,
+                   p_y + p_sys->i_width * i_real_line,
+                   p_u + (p_sys->i_width / 2) * i_chroma_line,
+                   p_v + (p_sys->i_width / 2) * i_chroma_line );
     }
 
     /* FIXME: progressive formats ? */
@@ -43,8 +43,11 @@
 #include <vlc_demux.h>
 
 #include <vlc_fs.h>
+#include <vlc_cpu.h>
 
 #include "linsys_sdi.h"
+#include "linsys_unpack.h"
+#include "../sdi.h"
 
 #undef ZVBI_DEBUG
 #include <libzvbi.h>
@@ -162,6 +165,7 @@ struct demux_sys_t
     unsigned int     i_line_offset, i_nb_lines;
 
     /* SDI parser */
+    const linsys_unpack_t *p_unpack;
     unsigned int     i_line_buffer;
     unsigned int     i_current_line;
     uint8_t          *p_line_buffer;
@@ -221,6 +225,7 @@ static int DemuxOpen( vlc_object_t *p_this )
 
     p_sys->i_state = STATE_NOSYNC;
     p_sys->i_last_state_change = mdate();
+    p_sys->p_unpack = linsys_GetUnpack( vlc_CPU() );
 
     /* SDI AR */
     char *psz_ar = var_InheritString( p_demux, "linsys-sdi-aspect-ratio" );
@@ -1015,26 +1020,13 @@ static int DecodeFrame( demux_t *p_demux )
 #define FIELD_2_ACTIVE_EAV  0xDA
 #define FIELD_2_ACTIVE_SAV  0xC7
 
-static const uint8_t *FindReferenceCode( uint8_t i_code,
-                                         const uint8_t *p_parser,
-                                         const uint8_t *p_end )
-{
-    while ( p_parser <= p_end - 5 )
-    {
-        if ( p_parser[0] == 0xff && p_parser[1] == 0x3 && p_parser[2] == 0x0
-              && p_parser[3] == 0x0 && p_parser[4] == i_code )
-            return p_parser;
-        p_parser += 5;
-    }
-
-    return NULL;
-}
-
-static const uint8_t *CountReference( unsigned int *pi_count, uint8_t i_code,
+static const uint8_t *CountReference( const linsys_unpack_t *p_unpack,
+                                      unsigned int *pi_count, uint8_t i_code,
                                       const uint8_t *p_parser,
                                       const uint8_t *p_end )
 {
-    const uint8_t *p_tmp = FindReferenceCode( i_code, p_parser, p_end );
+    const uint8_t *p_tmp = p_unpack->pf_find_reference( i_code, p_parser,
+                                                        p_end );
     if ( p_tmp == NULL )
     {
         *pi_count += p_end - p_parser;
@@ -1075,114 +1067,6 @@ static const uint8_t *GetLine( demux_t *p_demux, const uint8_t **pp_parser,
     return p_tmp;
 }
 
-#define U   (uint16_t)((p_line[0]) | ((p_line[1] & 0x3) << 8))
-#define Y1  (uint16_t)((p_line[1] >> 2) | ((p_line[2] & 0xf) << 6))
-#define V   (uint16_t)((p_line[2] >> 4) | ((p_line[3] & 0x3f) << 4))
-#define Y2  (uint16_t)((p_line[3] >> 6) | (p_line[4] << 2))
-
-static void UnpackVBI( const uint8_t *p_line, unsigned int i_size,
-                       uint8_t *p_dest )
-{
-    const uint8_t *p_end = p_line + i_size;
-
-    while ( p_line < p_end )
-    {
-        *p_dest++ = (U + 2) / 4;
-        *p_dest++ = (Y1 + 2) / 4;
-        *p_dest++ = (V + 2) / 4;
-        *p_dest++ = (Y2 + 2) / 4;
-        p_line += 5;
-    }
-}
-
-/* For lines 0 [4] or 1 [4] */
-static void Unpack01( const uint8_t *p_line, unsigned int i_size,
-                      uint8_t *p_y, uint8_t *p_u, uint8_t *p_v )
-{
-    const uint8_t *p_end = p_line + i_size;
-
-    while ( p_line < p_end )
-    {
-        *p_u++ = (U + 2) / 4;
-        *p_y++ = (Y1 + 2) / 4;
-        *p_v++ = (V + 2) / 4;
-        *p_y++ = (Y2 + 2) / 4;
-        p_line += 5;
-    }
-}
-
-/* For lines 2 [4] */
-static void Unpack2( const uint8_t *p_line, unsigned int i_size,
-                     uint8_t *p_y, uint8_t *p_u, uint8_t *p_v )
-{
-    const uint8_t *p_end = p_line + i_size;
-
-    while ( p_line < p_end )
-    {
-        uint16_t tmp;
-        tmp = 3 * *p_u;
-        tmp += (U + 2) / 4;
-        *p_u++ = tmp / 4;
-        *p_y++ = (Y1 + 2) / 4;
-        tmp = 3 * *p_v;
-        tmp += (V + 2) / 4;
-        *p_v++ = tmp / 4;
-        *p_y++ = (Y2 + 2) / 4;
-        p_line += 5;
-    }
-}
-
-/* For lines 3 [4] */
-static void Unpack3( const uint8_t *p_line, unsigned int i_size,
-                     uint8_t *p_y, uint8_t *p_u, uint8_t *p_v )
-{
-    const uint8_t *p_end = p_line + i_size;
-
-    while ( p_line < p_end )
-    {
-        uint16_t tmp;
-        tmp = *p_u;
-        tmp += 3 * (U + 2) / 4;
-        *p_u++ = tmp / 4;
-        *p_y++ = (Y1 + 2) / 4;
-        tmp = *p_v;
-        tmp += 3 * (V + 2) / 4;
-        *p_v++ = tmp / 4;
-        *p_y++ = (Y2 + 2) / 4;
-        p_line += 5;
-    }
-}
-
-#undef U
-#undef Y1
-#undef V
-#undef Y2
-
-#define A0  (uint16_t)((p_anc[0]) | ((p_anc[1] & 0x3) << 8))
-#define A1  (uint16_t)((p_anc[1] >> 2) | ((p_anc[2] & 0xf) << 6))
-#define A2  (uint16_t)((p_anc[2] >> 4) | ((p_anc[3] & 0x3f) << 4))
-#define A3  (uint16_t)((p_anc[3] >> 6) | (p_anc[4] << 2))
-
-static void UnpackAnc( const uint8_t *p_anc, unsigned int i_size,
-                       uint16_t *p_dest )
-{
-    const uint8_t *p_end = p_anc + i_size;
-
-    while ( p_anc <= p_end - 5 )
-    {
-        *p_dest++ = A0;
-        *p_dest++ = A1;
-        *p_dest++ = A2;
-        *p_dest++ = A3;
-        p_anc += 5;
-    }
-}
-
-#undef A0
-#undef A1
-#undef A2
-#undef A3
-
 static int HasAncillary( const uint8_t *p_anc )
 {
     return ( (p_anc[0] == 0x0 && p_anc[1] == 0xfc && p_anc[2] == 0xff
@@ -1335,94 +1219,45 @@ static void HandleAudioConfig( demux_t *p_demux, const uint16_t *p_anc,
     }
 }
 
-/*
- * Ancillary packet structure:
- *  byte 0: Ancillary Data Flag (0)
- *  byte 1: Ancillary Data Flag (0x3ff)
- *  byte 2: Ancillary Data Flag (0x3ff)
- *  byte 3: Data ID (2 high order bits = parity)
- *  byte 4: Data Block Number 1-255 or 0=unknown (if DID < 0x80)
- *       or Secondary Data ID (if DID >= 0x80)
- *  byte 5: Data Count (10 bits)
- *  byte 6+DC: Checksum
- */
-static void HandleAncillary( demux_t *p_demux, const uint16_t *p_anc,
-                             unsigned int i_size )
+/* Audio data packets of groups 1 to 4 */
+static void HandleAudioPacket( void *opaque, const anc_packet_t *p_pkt )
 {
-    uint8_t i_data_count;
-
-    if ( i_size < 7
-          || p_anc[0] != 0x0 || p_anc[1] != 0x3ff || p_anc[2] != 0x3ff )
-        return;
-
-    i_data_count = p_anc[5] & 0xff;
-    if ( i_size - 6 < i_data_count )
-    {
-        msg_Warn( p_demux, "malformed ancillary packet (size %u > %u)",
-                  i_data_count, i_size - 6 );
-        return;
-    }
-
-    switch ( p_anc[3] ) /* Data ID */
-    {
-    case 0x2ff:
-        HandleAudioData( p_demux, p_anc + 6, i_data_count, 1, p_anc[4] & 0xff );
-        break;
-    case 0x1fd:
-        HandleAudioData( p_demux, p_anc + 6, i_data_count, 2, p_anc[4] & 0xff );
-        break;
-    case 0x1fb:
-        HandleAudioData( p_demux, p_anc + 6, i_data_count, 3, p_anc[4] & 0xff );
-        break;
-    case 0x2f9:
-        HandleAudioData( p_demux, p_anc + 6, i_data_count, 4, p_anc[4] & 0xff );
-        break;
-
-    case 0x1ef:
-        HandleAudioConfig( p_demux, p_anc + 6, i_data_count, 1 );
-        break;
-    case 0x2ee:
-        HandleAudioConfig( p_demux, p_anc + 6, i_data_count, 2 );
-        break;
-    case 0x2ed:
-        HandleAudioConfig( p_demux, p_anc + 6, i_data_count, 3 );
-        break;
-    case 0x1ec:
-        HandleAudioConfig( p_demux, p_anc + 6, i_data_count, 4 );
-        break;
-
-    /* Extended data packets, same order */
-    case 0x1fe:
-    case 0x2fc:
-    case 0x2fa:
-    case 0x1f8:
-
-    default:
-        break;
+    HandleAudioData( (demux_t *)opaque, p_pkt->udw, p_pkt->dc,
+                     (0xff - p_pkt->did) / 2 + 1, p_pkt->sdid );
+}
 
-    case 0x88: /* non-conforming ANC packet */
-        p_anc += 7;
-        i_size -= 7;
-        while ( i_size >= 7 && (p_anc[0] != 0x0 || p_anc[1] != 0x3ff
-                                 || p_anc[2] != 0x3ff) )
-        {
-            p_anc++;
-            i_size--;
-        }
-        if ( i_size >= 7 )
-            HandleAncillary( p_demux, p_anc, i_size );
-        return;
-    }
+/* Audio control packets of groups 1 to 4 */
+static void HandleAudioControl( void *opaque, const anc_packet_t *p_pkt )
+{
+    HandleAudioConfig( (demux_t *)opaque, p_pkt->udw, p_pkt->dc,
+                       0xef - p_pkt->did + 1 );
+}
 
-    return HandleAncillary( p_demux, p_anc + i_data_count + 7,
-                            i_size - i_data_count - 7 );
+static const anc_handler_t p_anc_handlers[] =
+{
+    { 0xff, 0, HandleAudioPacket },
+    { 0xfd, 0, HandleAudioPacket },
+    { 0xfb, 0, HandleAudioPacket },
+    { 0xf9, 0, HandleAudioPacket },
+    { 0xef, 0, HandleAudioControl },
+    { 0xee, 0, HandleAudioControl },
+    { 0xed, 0, HandleAudioControl },
+    { 0xec, 0, HandleAudioControl },
+    /* Extended data packets (0xfe, 0xfc, 0xfa, 0xf8) are ignored */
+};
 
+static void HandleAncillary( demux_t *p_demux, const uint16_t *p_anc,
+                             unsigned int i_size )
+{
+    anc_parse( p_anc, i_size, 0, p_anc_handlers,
+               ARRAY_SIZE(p_anc_handlers), p_demux );
 }
 
 static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
                            unsigned int i_buffer_size )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
+    const linsys_unpack_t *p_unpack = p_sys->p_unpack;
     const uint8_t *p_parser = p_buffer;
     const uint8_t *p_end = p_parser + i_buffer_size;
     const uint8_t *p_line;
@@ -1439,14 +1274,16 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
     {
     case STATE_NOSYNC:
     default:
-        p_parser = FindReferenceCode( FIELD_2_VBLANK_SAV, p_parser, p_end );
+        p_parser = p_unpack->pf_find_reference( FIELD_2_VBLANK_SAV,
+                                                p_parser, p_end );
         if ( p_parser == NULL )
             break;
         p_sys->i_state = STATE_STARTSYNC;
         p_sys->i_last_state_change = mdate();
 
     case STATE_STARTSYNC:
-        p_parser = FindReferenceCode( FIELD_1_VBLANK_EAV, p_parser, p_end );
+        p_parser = p_unpack->pf_find_reference( FIELD_1_VBLANK_EAV,
+                                                p_parser, p_end );
         if ( p_parser == NULL )
             break;
         p_sys->i_anc_size = 0;
@@ -1454,7 +1291,7 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
         p_sys->i_last_state_change = mdate();
 
     case STATE_ANCSYNC:
-        p_parser = CountReference( &p_sys->i_anc_size,
+        p_parser = CountReference( p_unpack, &p_sys->i_anc_size,
                                    FIELD_1_VBLANK_SAV, p_parser, p_end );
         if ( p_parser == NULL )
             break;
@@ -1463,7 +1300,7 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
         p_sys->i_last_state_change = mdate();
 
     case STATE_LINESYNC:
-        p_parser = CountReference( &p_sys->i_active_size,
+        p_parser = CountReference( p_unpack, &p_sys->i_active_size,
                                    FIELD_1_VBLANK_EAV, p_parser, p_end );
         if ( p_parser == NULL )
             break;
@@ -1472,7 +1309,7 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
         p_sys->i_last_state_change = mdate();
 
     case STATE_ACTIVESYNC:
-        p_parser = CountReference( &p_sys->i_picture_size,
+        p_parser = CountReference( p_unpack, &p_sys->i_picture_size,
                                    FIELD_1_ACTIVE_EAV, p_parser, p_end );
         if ( p_parser == NULL )
             break;
@@ -1482,7 +1319,7 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
         p_sys->i_last_state_change = mdate();
 
     case STATE_VBLANKSYNC:
-        p_parser = CountReference( &p_sys->i_picture_size,
+        p_parser = CountReference( p_unpack, &p_sys->i_picture_size,
                                    FIELD_2_ACTIVE_EAV, p_parser, p_end );
         if ( p_parser == NULL )
             break;
@@ -1490,7 +1327,7 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
         p_sys->i_last_state_change = mdate();
 
     case STATE_PICSYNC:
-        p_parser = CountReference( &p_sys->i_picture_size,
+        p_parser = CountReference( p_unpack, &p_sys->i_picture_size,
                                    FIELD_1_VBLANK_EAV, p_parser, p_end );
         if ( p_parser == NULL )
             break;
@@ -1573,7 +1410,8 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
                 /* HANC */
                 unsigned int i_anc_words = (p_sys->i_anc_size - 5) * 4 / 5;
                 uint16_t p_anc[i_anc_words];
-                UnpackAnc( p_line + 5, p_sys->i_anc_size - 5, p_anc );
+                p_unpack->pf_unpack_anc( p_line + 5, p_sys->i_anc_size - 5,
+                                         p_anc );
                 HandleAncillary( p_demux, p_anc, i_anc_words );
             }
 
@@ -1583,41 +1421,43 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
                                                     - p_sys->i_line_offset;
                 unsigned int i_active_line = b_field
                                               + i_active_field_line * 2;
+                const uint8_t *p_active = p_line + anc + 5;
+                unsigned int i_active_size = p_sys->i_active_size - 5;
+                linsys_unpack_line_t pf_unpack;
+                unsigned int i_chroma_line;
+
                 if ( !(i_active_field_line % 2) && !b_field )
-                    Unpack01( p_line + anc + 5, p_sys->i_active_size - 5,
-                              p_sys->p_y + p_sys->i_width * i_active_line,
-                              p_sys->p_u + (p_sys->i_width / 2)
-                               * (i_active_line / 2),
-                              p_sys->p_v + (p_sys->i_width / 2)
-                               * (i_active_line / 2) );
+                {
+                    pf_unpack = p_unpack->pf_unpack10[0];
+                    i_chroma_line = i_active_line / 2;
+                }
                 else if ( !(i_active_field_line % 2) )
-                    Unpack01( p_line + anc + 5, p_sys->i_active_size - 5,
-                              p_sys->p_y + p_sys->i_width * i_active_line,
-                              p_sys->p_u + (p_sys->i_width / 2)
-                               * (i_active_line / 2 + 1),
-                              p_sys->p_v + (p_sys->i_width / 2)
-                               * (i_active_line / 2 + 1) );
+                {
+                    pf_unpack = p_unpack->pf_unpack10[0];
+                    i_chroma_line = i_active_line / 2 + 1;
+                }
                 else if ( !b_field )
-                    Unpack2( p_line + anc + 5, p_sys->i_active_size - 5,
-                             p_sys->p_y + p_sys->i_width * i_active_line,
-                             p_sys->p_u + (p_sys->i_width / 2)
-                              * (i_active_line / 2 - 1),
-                             p_sys->p_v + (p_sys->i_width / 2)
-                              * (i_active_line / 2 - 1) );
+                {
+                    pf_unpack = p_unpack->pf_unpack10[1];
+                    i_chroma_line = i_active_line / 2 - 1;
+                }
                 else
-                    Unpack3( p_line + anc + 5, p_sys->i_active_size - 5,
-                             p_sys->p_y + p_sys->i_width * i_active_line,
-                             p_sys->p_u + (p_sys->i_width / 2)
-                              * (i_active_line / 2),
-                             p_sys->p_v + (p_sys->i_width / 2)
-                              * (i_active_line / 2) );
+                {
+                    pf_unpack = p_unpack->pf_unpack10[2];
+                    i_chroma_line = i_active_line / 2;
+                }
+
+                pf_unpack( p_active, i_active_size,
+                           p_sys->p_y + p_sys->i_width * i_active_line,
+                           p_sys->p_u + (p_sys->i_width / 2) * i_chroma_line,
+                           p_sys->p_v + (p_sys->i_width / 2) * i_chroma_line );
 
                 if ( p_sys->b_vbi && p_sys->i_height == 576
                       && p_sys->i_current_line == p_sys->i_line_offset )
                 {
                     /* Line 23 is half VBI, half active */
-                    UnpackVBI( p_line + anc + 5, p_sys->i_active_size - 5,
-                               p_sys->p_wss_buffer );
+                    p_unpack->pf_unpack_vbi( p_active, i_active_size,
+                                             p_sys->p_wss_buffer );
                 }
             }
             else if ( p_sys->b_vbi && p_sys->i_telx_count &&
@@ -1625,8 +1465,8 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
                       i_field_line < p_sys->i_telx_line
                                       + p_sys->i_telx_count )
             {
-                UnpackVBI( p_line + anc + 5, p_sys->i_active_size - 5,
-                    &p_sys->p_telx_buffer[(i_field_line
+                p_unpack->pf_unpack_vbi( p_line + anc + 5,
+                    p_sys->i_active_size - 5, &p_sys->p_telx_buffer[(i_field_line
                         - p_sys->i_telx_line + b_field * p_sys->i_telx_count)
                         * p_sys->i_width * 2] );
             }
@@ -1635,8 +1475,8 @@ static int HandleSDBuffer( demux_t *p_demux, uint8_t *p_buffer,
                 /* VANC */
                 unsigned int i_anc_words = (p_sys->i_active_size - 5) * 4 / 5;
                 uint16_t p_anc[i_anc_words];
-                UnpackAnc( p_line + 5, p_sys->i_active_size - 5,
-                           p_anc );
+                p_unpack->pf_unpack_anc( p_line + anc + 5,
+                                         p_sys->i_active_size - 5, p_anc );
                 HandleAncillary( p_demux, p_anc, i_anc_words );
             }
 
@@ -0,0 +1,499 @@
+/*****************************************************************************
+ * linsys_unpack.c: raw SDI line unpacking for Linear Systems cards
+ *****************************************************************************
+ * Copyright (C) 2009-2011 VideoLAN
+ *
+ * Authors: Christophe Massiot <massiot@via.ecp.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "linsys_unpack.h"
+
+#ifdef HAVE_SSE2_INTRINSICS
+# include <emmintrin.h>
+#endif
+#ifdef HAVE_SSSE3_INTRINSICS
+# include <tmmintrin.h>
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+# include <immintrin.h>
+#endif
+
+/* Chroma handling of the line, see linsys_unpack_line_t */
+enum
+{
+    CHROMA_SET,
+    CHROMA_BLEND_2,
+    CHROMA_BLEND_3,
+};
+
+/*****************************************************************************
+ * Timing reference signals: 3ff 000 000 XYZ
+ *****************************************************************************/
+static inline bool IsReference( const uint8_t *p, uint8_t i_code )
+{
+    return p[0] == 0xff && p[1] == 0x3 && p[2] == 0x0 && p[3] == 0x0
+            && p[4] == i_code;
+}
+
+static const uint8_t *FindReference_c( uint8_t i_code,
+                                       const uint8_t *p_parser,
+                                       const uint8_t *p_end )
+{
+    while ( p_parser <= p_end - 5 )
+    {
+        if ( IsReference( p_parser, i_code ) )
+            return p_parser;
+        p_parser += 5;
+    }
+
+    return NULL;
+}
+
+#ifdef HAVE_AVX2_INTRINSICS
+/* The candidates are the bytes equal to 0xff followed four bytes later by
+ * the code, and starting a five bytes group: 160 bytes hold 32 groups, and
+ * these masks select the group starts among the 32 bytes of each load. */
+static const uint32_t pi_phase_avx2[5] =
+    { 0x42108421, 0x10842108, 0x84210842, 0x21084210, 0x08421084 };
+
+__attribute__ ((__target__ ("avx2")))
+static const uint8_t *FindReference_avx2( uint8_t i_code,
+                                          const uint8_t *p_parser,
+                                          const uint8_t *p_end )
+{
+    const __m256i ff = _mm256_set1_epi8( (char)0xff );
+    const __m256i code = _mm256_set1_epi8( (char)i_code );
+
+    while ( p_end - p_parser >= 160 + 4 )
+    {
+        for ( unsigned int i = 0; i < 5; i++ )
+        {
+            const uint8_t *p = p_parser + 32 * i;
+            __m256i start = _mm256_loadu_si256( (const __m256i *)p );
+            __m256i last = _mm256_loadu_si256( (const __m256i *)(p + 4) );
+            uint32_t i_mask = (uint32_t)_mm256_movemask_epi8(
+                    _mm256_and_si256( _mm256_cmpeq_epi8( start, ff ),
+                                      _mm256_cmpeq_epi8( last, code ) ) )
+                & pi_phase_avx2[i];
+
+            while ( i_mask )
+            {
+                if ( IsReference( p + ctz( i_mask ), i_code ) )
+                    return p + ctz( i_mask );
+                i_mask &= i_mask - 1;
+            }
+        }
+        p_parser += 160;
+    }
+
+    return FindReference_c( i_code, p_parser, p_end );
+}
+#endif
+
+/*****************************************************************************
+ * Raw 10-bit SD-SDI
+ *****************************************************************************/
+#define U   (uint16_t)((p_line[0]) | ((p_line[1] & 0x3) << 8))
+#define Y1  (uint16_t)((p_line[1] >> 2) | ((p_line[2] & 0xf) << 6))
+#define V   (uint16_t)((p_line[2] >> 4) | ((p_line[3] & 0x3f) << 4))
+#define Y2  (uint16_t)((p_line[3] >> 6) | (p_line[4] << 2))
+
+/* Rounds to 8 bits; 3fe and 3ff are reserved for timing references and
+ * would otherwise wrap to black */
+static inline uint8_t Round10( uint16_t i_sample )
+{
+    i_sample = (i_sample + 2) / 4;
+    return i_sample > 255 ? 255 : i_sample;
+}
+
+static inline uint8_t Chroma10( uint8_t i_old, uint16_t i_sample, int i_mode )
+{
+    uint16_t tmp;
+
+    switch ( i_mode )
+    {
+    case CHROMA_SET:
+    default:
+        return Round10( i_sample );
+    case CHROMA_BLEND_2:
+        tmp = 3 * i_old;
+        tmp += Round10( i_sample );
+        return tmp / 4;
+    case CHROMA_BLEND_3:
+        tmp = i_old;
+        tmp += 3 * (i_sample + 2) / 4;
+        return tmp / 4;
+    }
+}
+
+static inline void Unpack10_c( const uint8_t *p_line, unsigned int i_size,
+                               uint8_t *p_y, uint8_t *p_u, uint8_t *p_v,
+                               int i_mode )
+{
+    const uint8_t *p_end = p_line + i_size;
+
+    while ( p_line < p_end )
+    {
+        *p_u = Chroma10( *p_u, U, i_mode );
+        p_u++;
+        *p_y++ = Round10( Y1 );
+        *p_v = Chroma10( *p_v, V, i_mode );
+        p_v++;
+        *p_y++ = Round10( Y2 );
+        p_line += 5;
+    }
+}
+
+static void UnpackVBI_c( const uint8_t *p_line, unsigned int i_size,
+                         uint8_t *p_dest )
+{
+    const uint8_t *p_end = p_line + i_size;
+
+    while ( p_line < p_end )
+    {
+        *p_dest++ = Round10( U );
+        *p_dest++ = Round10( Y1 );
+        *p_dest++ = Round10( V );
+        *p_dest++ = Round10( Y2 );
+        p_line += 5;
+    }
+}
+
+static void UnpackAnc_c( const uint8_t *p_line, unsigned int i_size,
+                         uint16_t *p_dest )
+{
+    const uint8_t *p_end = p_line + i_size;
+
+    while ( p_line <= p_end - 5 )
+    {
+        *p_dest++ = U;
+        *p_dest++ = Y1;
+        *p_dest++ = V;
+        *p_dest++ = Y2;
+        p_line += 5;
+    }
+}
+
+#undef U
+#undef Y1
+#undef V
+#undef Y2
+
+/*****************************************************************************
+ * 8-bit UYVY HD-SDI
+ *****************************************************************************/
+static inline uint8_t Chroma8( uint8_t i_old, uint8_t i_sample, int i_mode )
+{
+    switch ( i_mode )
+    {
+    case CHROMA_SET:
+    default:
+        return i_sample;
+    case CHROMA_BLEND_2:
+        return (3 * i_old + i_sample) / 4;
+    case CHROMA_BLEND_3:
+        return (i_old + 3 * i_sample) / 4;
+    }
+}
+
+static inline void Unpack8_c( const uint8_t *p_line, unsigned int i_size,
+                              uint8_t *p_y, uint8_t *p_u, uint8_t *p_v,
+                              int i_mode )
+{
+    const uint8_t *p_end = p_line + i_size;
+
+    while ( p_line < p_end )
+    {
+        *p_u = Chroma8( *p_u, p_line[0], i_mode );
+        p_u++;
+        *p_y++ = p_line[1];
+        *p_v = Chroma8( *p_v, p_line[2], i_mode );
+        p_v++;
+        *p_y++ = p_line[3];
+        p_line += 4;
+    }
+}
+
+#ifdef HAVE_SSSE3_INTRINSICS
+/* Each 10 bytes of a raw line give 8 samples: the shuffles gather the two
+ * bytes holding each sample in a 16-bit lane, and the multiplications
+ * align the sample on the top of the lane, dropping the bits above it. */
+# define RAW10_SHUF_PLANAR 0, 1, 5, 6, 2, 3, 7, 8, 1, 2, 3, 4, 6, 7, 8, 9
+# define RAW10_MUL_PLANAR 64, 64, 4, 4, 16, 1, 16, 1
+# define RAW10_SHUF_PACKED 0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9
+# define RAW10_MUL_PACKED 64, 16, 4, 1, 64, 16, 4, 1
+/* UYVY to Y0..Y7 U0..U3 V0..V3 */
+# define UYVY_SHUF_PLANAR 1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14
+
+__attribute__ ((__target__ ("ssse3")))
+static inline __m128i Load10_ssse3( const uint8_t *p, __m128i shuf,
+                                    __m128i mul )
+{
+    __m128i x = _mm_loadu_si128( (const __m128i *)p );
+    return _mm_srli_epi16( _mm_mullo_epi16( _mm_shuffle_epi8( x, shuf ),
+                                            mul ), 6 );
+}
+
+/* Blends the 8-bit chroma of the previous line, as 16-bit lanes */
+__attribute__ ((__target__ ("ssse3")))
+static inline __m128i Blend_ssse3( __m128i old, __m128i x, int i_mode )
+{
+    if ( i_mode == CHROMA_BLEND_2 )
+        x = _mm_add_epi16( x, _mm_add_epi16( old, _mm_add_epi16( old, old ) ) );
+    else
+        x = _mm_add_epi16( old, x );
+    return _mm_srli_epi16( x, 2 );
+}
+
+__attribute__ ((__target__ ("ssse3")))
+static inline void Unpack10_ssse3( const uint8_t *p_line, unsigned int i_size,
+                                   uint8_t *p_y, uint8_t *p_u, uint8_t *p_v,
+                                   int i_mode )
+{
+    const uint8_t *p_end = p_line + i_size;
+    const __m128i shuf = _mm_setr_epi8( RAW10_SHUF_PLANAR );
+    const __m128i mul = _mm_setr_epi16( RAW10_MUL_PLANAR );
+    const __m128i two = _mm_set1_epi16( 2 );
+    const __m128i max = _mm_set1_epi16( 255 );
+    const __m128i zero = _mm_setzero_si128();
+
+    /* 40 bytes give 16 Y, 8 U and 8 V; the last load reads 6 more bytes */
+    while ( p_end - p_line >= 40 + 6 )
+    {
+        /* U0 U1 V0 V1 Y0 Y1 Y2 Y3 */
+        __m128i x0 = Load10_ssse3( p_line, shuf, mul );
+        __m128i x1 = Load10_ssse3( p_line + 10, shuf, mul );
+        __m128i x2 = Load10_ssse3( p_line + 20, shuf, mul );
+        __m128i x3 = Load10_ssse3( p_line + 30, shuf, mul );
+        __m128i y0 = _mm_unpackhi_epi64( x0, x1 );
+        __m128i y1 = _mm_unpackhi_epi64( x2, x3 );
+        __m128i uv0 = _mm_unpacklo_epi32( x0, x1 );
+        __m128i uv1 = _mm_unpacklo_epi32( x2, x3 );
+        __m128i u = _mm_unpacklo_epi64( uv0, uv1 );
+        __m128i v = _mm_unpackhi_epi64( uv0, uv1 );
+
+        y0 = _mm_srli_epi16( _mm_add_epi16( y0, two ), 2 );
+        y1 = _mm_srli_epi16( _mm_add_epi16( y1, two ), 2 );
+        _mm_storeu_si128( (__m128i *)p_y, _mm_packus_epi16( y0, y1 ) );
+
+        if ( i_mode == CHROMA_BLEND_3 )
+        {
+            const __m128i three = _mm_set1_epi16( 3 );
+            u = _mm_srli_epi16( _mm_mullo_epi16( _mm_add_epi16( u, two ),
+                                                 three ), 2 );
+            v = _mm_srli_epi16( _mm_mullo_epi16( _mm_add_epi16( v, two ),
+                                                 three ), 2 );
+        }
+        else
+        {
+            u = _mm_min_epi16( _mm_srli_epi16( _mm_add_epi16( u, two ), 2 ),
+                               max );
+            v = _mm_min_epi16( _mm_srli_epi16( _mm_add_epi16( v, two ), 2 ),
+                               max );
+        }
+
+        if ( i_mode != CHROMA_SET )
+        {
+            __m128i old_u = _mm_loadl_epi64( (const __m128i *)p_u );
+            __m128i old_v = _mm_loadl_epi64( (const __m128i *)p_v );
+            u = Blend_ssse3( _mm_unpacklo_epi8( old_u, zero ), u, i_mode );
+            v = Blend_ssse3( _mm_unpacklo_epi8( old_v, zero ), v, i_mode );
+        }
+
+        __m128i uv = _mm_packus_epi16( u, v );
+        _mm_storel_epi64( (__m128i *)p_u, uv );
+        _mm_storel_epi64( (__m128i *)p_v, _mm_srli_si128( uv, 8 ) );
+
+        p_line += 40;
+        p_y += 16;
+        p_u += 8;
+        p_v += 8;
+    }
+
+    Unpack10_c( p_line, p_end - p_line, p_y, p_u, p_v, i_mode );
+}
+
+__attribute__ ((__target__ ("ssse3")))
+static void UnpackVBI_ssse3( const uint8_t *p_line, unsigned int i_size,
+                             uint8_t *p_dest )
+{
+    const uint8_t *p_end = p_line + i_size;
+    const __m128i shuf = _mm_setr_epi8( RAW10_SHUF_PACKED );
+    const __m128i mul = _mm_setr_epi16( RAW10_MUL_PACKED );
+    const __m128i two = _mm_set1_epi16( 2 );
+
+    while ( p_end - p_line >= 20 + 6 )
+    {
+        __m128i x0 = Load10_ssse3( p_line, shuf, mul );
+        __m128i x1 = Load10_ssse3( p_line + 10, shuf, mul );
+
+        x0 = _mm_srli_epi16( _mm_add_epi16( x0, two ), 2 );
+        x1 = _mm_srli_epi16( _mm_add_epi16( x1, two ), 2 );
+        _mm_storeu_si128( (__m128i *)p_dest, _mm_packus_epi16( x0, x1 ) );
+
+        p_line += 20;
+        p_dest += 16;
+    }
+
+    UnpackVBI_c( p_line, p_end - p_line, p_dest );
+}
+
+__attribute__ ((__target__ ("ssse3")))
+static void UnpackAnc_ssse3( const uint8_t *p_line, unsigned int i_size,
+                             uint16_t *p_dest )
+{
+    const uint8_t *p_end = p_line + i_size;
+    const __m128i shuf = _mm_setr_epi8( RAW10_SHUF_PACKED );
+    const __m128i mul = _mm_setr_epi16( RAW10_MUL_PACKED );
+
+    while ( p_end - p_line >= 10 + 6 )
+    {
+        _mm_storeu_si128( (__m128i *)p_dest,
+                          Load10_ssse3( p_line, shuf, mul ) );
+        p_line += 10;
+        p_dest += 8;
+    }
+
+    UnpackAnc_c( p_line, p_end - p_line, p_dest );
+}
+
+__attribute__ ((__target__ ("ssse3")))
+static inline void Unpack8_ssse3( const uint8_t *p_line, unsigned int i_size,
+                                  uint8_t *p_y, uint8_t *p_u, uint8_t *p_v,
+                                  int i_mode )
+{
+    const uint8_t *p_end = p_line + i_size;
+    const __m128i shuf = _mm_setr_epi8( UYVY_SHUF_PLANAR );
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i three = _mm_set1_epi16( 3 );
+
+    while ( p_end - p_line >= 32 )
+    {
+        __m128i a = _mm_shuffle_epi8(
+                _mm_loadu_si128( (const __m128i *)p_line ), shuf );
+        __m128i b = _mm_shuffle_epi8(
+                _mm_loadu_si128( (const __m128i *)(p_line + 16) ), shuf );
+        /* U0..U7 V0..V7 */
+        __m128i uv = _mm_unpackhi_epi32( a, b );
+
+        _mm_storeu_si128( (__m128i *)p_y, _mm_unpacklo_epi64( a, b ) );
+
+        if ( i_mode != CHROMA_SET )
+        {
+            __m128i old = _mm_unpacklo_epi64(
+                    _mm_loadl_epi64( (const __m128i *)p_u ),
+                    _mm_loadl_epi64( (const __m128i *)p_v ) );
+            __m128i u = _mm_unpacklo_epi8( uv, zero );
+            __m128i v = _mm_unpackhi_epi8( uv, zero );
+
+            if ( i_mode == CHROMA_BLEND_3 )
+            {
+                u = _mm_mullo_epi16( u, three );
+                v = _mm_mullo_epi16( v, three );
+            }
+            u = Blend_ssse3( _mm_unpacklo_epi8( old, zero ), u,
+                             i_mode );
+            v = Blend_ssse3( _mm_unpackhi_epi8( old, zero ), v,
+                             i_mode );
+            uv = _mm_packus_epi16( u, v );
+        }
+
+        _mm_storel_epi64( (__m128i *)p_u, uv );
+        _mm_storel_epi64( (__m128i *)p_v, _mm_srli_si128( uv, 8 ) );
+
+        p_line += 32;
+        p_y += 16;
+        p_u += 8;
+        p_v += 8;
+    }
+
+    Unpack8_c( p_line, p_end - p_line, p_y, p_u, p_v, i_mode );
+}
+#endif
+
+/*****************************************************************************
+ * Function tables
+ *****************************************************************************/
+#define UNPACK_LINES(name, attr) \
+attr static void name##_01( const uint8_t *p_line, unsigned int i_size, \
+                       uint8_t *p_y, uint8_t *p_u, uint8_t *p_v ) \
+{ \
+    name( p_line, i_size, p_y, p_u, p_v, CHROMA_SET ); \
+} \
+attr static void name##_2( const uint8_t *p_line, unsigned int i_size, \
+                      uint8_t *p_y, uint8_t *p_u, uint8_t *p_v ) \
+{ \
+    name( p_line, i_size, p_y, p_u, p_v, CHROMA_BLEND_2 ); \
+} \
+attr static void name##_3( const uint8_t *p_line, unsigned int i_size, \
+                      uint8_t *p_y, uint8_t *p_u, uint8_t *p_v ) \
+{ \
+    name( p_line, i_size, p_y, p_u, p_v, CHROMA_BLEND_3 ); \
+}
+
+UNPACK_LINES(Unpack10_c, )
+UNPACK_LINES(Unpack8_c, )
+
+static const linsys_unpack_t unpack_c =
+{
+    FindReference_c, UnpackVBI_c, UnpackAnc_c,
+    { Unpack10_c_01, Unpack10_c_2, Unpack10_c_3 },
+    { Unpack8_c_01, Unpack8_c_2, Unpack8_c_3 },
+};
+
+#if defined(HAVE_SSE2_INTRINSICS) && defined(HAVE_SSSE3_INTRINSICS)
+UNPACK_LINES(Unpack10_ssse3, __attribute__ ((__target__ ("ssse3"))))
+UNPACK_LINES(Unpack8_ssse3, __attribute__ ((__target__ ("ssse3"))))
+
+static const linsys_unpack_t unpack_ssse3 =
+{
+    FindReference_c, UnpackVBI_ssse3, UnpackAnc_ssse3,
+    { Unpack10_ssse3_01, Unpack10_ssse3_2, Unpack10_ssse3_3 },
+    { Unpack8_ssse3_01, Unpack8_ssse3_2, Unpack8_ssse3_3 },
+};
+#endif
+
+#if defined(HAVE_AVX2_INTRINSICS) && defined(HAVE_SSSE3_INTRINSICS)
+static const linsys_unpack_t unpack_avx2 =
+{
+    FindReference_avx2, UnpackVBI_ssse3, UnpackAnc_ssse3,
+    { Unpack10_ssse3_01, Unpack10_ssse3_2, Unpack10_ssse3_3 },
+    { Unpack8_ssse3_01, Unpack8_ssse3_2, Unpack8_ssse3_3 },
+};
+#endif
+
+const linsys_unpack_t *linsys_GetUnpack( unsigned int i_cpu )
+{
+#if defined(HAVE_AVX2_INTRINSICS) && defined(HAVE_SSSE3_INTRINSICS)
+    if ( (i_cpu & (VLC_CPU_AVX2 | VLC_CPU_SSSE3))
+           == (VLC_CPU_AVX2 | VLC_CPU_SSSE3) )
+        return &unpack_avx2;
+#endif
+#if defined(HAVE_SSE2_INTRINSICS) && defined(HAVE_SSSE3_INTRINSICS)
+    if ( i_cpu & VLC_CPU_SSSE3 )
+        return &unpack_ssse3;
+#endif
+    (void) i_cpu;
+    return &unpack_c;
+}
@@ -0,0 +1,51 @@
+/*****************************************************************************
+ * linsys_unpack.h: raw SDI line unpacking for Linear Systems cards
+ *****************************************************************************
+ * Copyright (C) 2009-2011 VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef LINSYS_UNPACK_H
+#define LINSYS_UNPACK_H
+
+#include <stdint.h>
+
+/* Converts a line of 4:2:2 samples to planar 4:2:0. The chroma of lines
+ * 0 and 1 [4] is written as is, the chroma of lines 2 and 3 [4] is blended
+ * with the one written by the previous line of the same field. */
+typedef void (*linsys_unpack_line_t)( const uint8_t *p_line,
+                                      unsigned int i_size, uint8_t *p_y,
+                                      uint8_t *p_u, uint8_t *p_v );
+
+typedef struct
+{
+    /* Raw 10-bit SD-SDI, four samples in five bytes */
+    const uint8_t *(*pf_find_reference)( uint8_t i_code,
+                                         const uint8_t *p_parser,
+                                         const uint8_t *p_end );
+    void (*pf_unpack_vbi)( const uint8_t *p_line, unsigned int i_size,
+                           uint8_t *p_dest );
+    void (*pf_unpack_anc)( const uint8_t *p_anc, unsigned int i_size,
+                           uint16_t *p_dest );
+    linsys_unpack_line_t pf_unpack10[3]; /* lines 0 or 1, 2 and 3 [4] */
+
+    /* 8-bit UYVY HD-SDI */
+    linsys_unpack_line_t pf_unpack8[3];
+} linsys_unpack_t;
+
+const linsys_unpack_t *linsys_GetUnpack( unsigned int i_cpu );
+
+#endif
@@ -0,0 +1,472 @@
+/**
+ * @file fec.c
+ * @brief SMPTE 2022-1 forward error correction and 2022-7 path merging
+ */
+/*****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_input_item.h>
+
+#include "rtp.h"
+
+/* Media sequence numbers remembered to drop duplicates, power of 2.
+ * The two paths of a 2022-7 stream may be that many packets apart. */
+#define FEC_WINDOW  4096
+/* Media packets kept for recovery, power of 2. A 2022-1 matrix has at most
+ * 100 packets, and its column FEC packets may follow it by as much. */
+#define FEC_KEEP    1024
+/* FEC packets waiting for the missing media packets */
+#define FEC_PENDING 64
+
+#define FEC_HEADER_SIZE 16
+
+/** SMPTE 2022 receiver state */
+struct rtp_fec_t
+{
+    bool      keep;     /* keep media packets for FEC recovery */
+    bool      started;
+    uint32_t  ssrc;
+    uint16_t  max_seq;  /* highest media sequence */
+    uint16_t  bad_seq;  /* tentatively next expected sequence for resync */
+    unsigned  fill;     /* valid sequences in the window, up to max_seq */
+
+    uint64_t  seen[FEC_WINDOW / 64];
+    block_t  *media[FEC_KEEP];
+    block_t  *pending[FEC_PENDING];
+    unsigned  pendingc;
+
+    unsigned  span;     /* media packets covered by the largest FEC packet */
+    mtime_t   last_rx;
+    mtime_t   interval; /* average media packet interval */
+
+    mtime_t   last_export;
+    uint64_t  received;
+    uint64_t  duplicates;
+    uint64_t  recovered;
+    uint64_t  lost;
+};
+
+/**
+ * Creates the receiver state.
+ * @param keep whether FEC packets will be received
+ */
+rtp_fec_t *rtp_fec_create (bool keep)
+{
+    rtp_fec_t *fec = calloc (1, sizeof (*fec));
+    if (fec == NULL)
+        return NULL;
+
+    fec->keep = keep;
+    fec->last_export = VLC_TS_INVALID;
+    return fec;
+}
+
+static void fec_reset (rtp_fec_t *fec, uint32_t ssrc, uint16_t seq)
+{
+    for (unsigned i = 0; i < FEC_KEEP; i++)
+        if (fec->media[i] != NULL)
+        {
+            block_Release (fec->media[i]);
+            fec->media[i] = NULL;
+        }
+    for (unsigned i = 0; i < fec->pendingc; i++)
+        block_Release (fec->pending[i]);
+    fec->pendingc = 0;
+    memset (fec->seen, 0, sizeof (fec->seen));
+
+    fec->started = true;
+    fec->ssrc = ssrc;
+    fec->max_seq = seq - 1;
+    fec->bad_seq = seq;
+    fec->fill = 0;
+}
+
+void rtp_fec_destroy (rtp_fec_t *fec)
+{
+    fec_reset (fec, 0, 0);
+    free (fec);
+}
+
+static bool fec_seen (const rtp_fec_t *fec, uint16_t seq)
+{
+    unsigned i = seq % FEC_WINDOW;
+    return (fec->seen[i / 64] >> (i % 64)) & 1;
+}
+
+static void fec_set_seen (rtp_fec_t *fec, uint16_t seq, bool seen)
+{
+    unsigned i = seq % FEC_WINDOW;
+    if (seen)
+        fec->seen[i / 64] |= UINT64_C(1) << (i % 64);
+    else
+        fec->seen[i / 64] &= ~(UINT64_C(1) << (i % 64));
+}
+
+/** Returns the kept media packet of a sequence number, or NULL */
+static block_t *fec_media (const rtp_fec_t *fec, uint16_t seq)
+{
+    block_t *block = fec->media[seq % FEC_KEEP];
+    if (block == NULL || GetWBE (block->p_buffer + 2) != seq)
+        return NULL;
+    return block;
+}
+
+/**
+ * Moves the window forward to a new highest sequence number. The packets
+ * falling out of it without having been received are lost.
+ */
+static void fec_advance (rtp_fec_t *fec, uint16_t seq)
+{
+    while (fec->max_seq != seq)
+    {
+        uint16_t next = ++fec->max_seq;
+
+        if (fec->fill == FEC_WINDOW)
+        {   /* reuses the slot of next - FEC_WINDOW */
+            if (!fec_seen (fec, next))
+                fec->lost++;
+        }
+        else
+            fec->fill++;
+        fec_set_seen (fec, next, false);
+
+        block_t **pp = &fec->media[next % FEC_KEEP];
+        if (*pp != NULL)
+        {
+            block_Release (*pp);
+            *pp = NULL;
+        }
+    }
+}
+
+/**
+ * Records a media sequence number.
+ * @param resync whether a packet outside the window may restart it
+ * @return false if it was already received or is too old
+ */
+static bool fec_mark (rtp_fec_t *fec, uint16_t seq, bool resync)
+{
+    int16_t delta = seq - fec->max_seq;
+
+    if (delta >= FEC_WINDOW && resync)
+    {   /* the sender skipped ahead */
+        fec_reset (fec, fec->ssrc, seq);
+        fec_advance (fec, seq);
+    }
+    else if (delta > 0)
+        fec_advance (fec, seq);
+    else if ((unsigned)-delta >= fec->fill)
+    {   /* too late, or the sender restarted */
+        if (seq != fec->bad_seq || !resync)
+        {
+            fec->bad_seq = seq + 1;
+            return false;
+        }
+        fec_reset (fec, fec->ssrc, seq);
+        fec_advance (fec, seq);
+    }
+    else if (fec_seen (fec, seq))
+        return false;
+
+    fec_set_seen (fec, seq, true);
+    return true;
+}
+
+static void fec_keep (rtp_fec_t *fec, uint16_t seq, block_t *block)
+{
+    if (!fec->keep)
+        return;
+
+    block_t **pp = &fec->media[seq % FEC_KEEP];
+    if (*pp != NULL)
+        block_Release (*pp);
+    *pp = block_Duplicate (block);
+}
+
+/** Parses the 2022-1 header of a FEC packet, NULL if invalid */
+static const uint8_t *fec_header (const block_t *block, size_t *restrict lenp)
+{
+    if (block->i_buffer < 12)
+        return NULL;
+
+    size_t skip = 12u + (block->p_buffer[0] & 0x0F) * 4;
+    if (block->i_buffer < skip + FEC_HEADER_SIZE)
+        return NULL;
+
+    const uint8_t *h = block->p_buffer + skip;
+    if (((h[12] >> 3) & 7) != 0 /* XOR */ || h[13] == 0 || h[14] == 0)
+        return NULL;
+    *lenp = block->i_buffer - skip - FEC_HEADER_SIZE;
+    return h;
+}
+
+static inline uint16_t fec_base (const uint8_t *h)
+{
+    return GetWBE (h);
+}
+
+/**
+ * Rebuilds the one missing media packet protected by a FEC packet, from the
+ * other ones.
+ */
+static block_t *fec_rebuild (const rtp_fec_t *fec, const block_t *fblock,
+                             const uint8_t *h, size_t len, uint16_t seq)
+{
+    const unsigned offset = h[13], count = h[14];
+    uint16_t length = GetWBE (h + 2);
+    uint8_t  ptype = h[4] & 0x7F;
+    uint32_t ts = GetDWBE (h + 8);
+    uint8_t  flags = fblock->p_buffer[0] & 0x3F; /* P, X and CC */
+    uint8_t  marker = fblock->p_buffer[1] & 0x80;
+
+    block_t *block = block_Alloc (12 + len);
+    if (unlikely(block == NULL))
+        return NULL;
+
+    uint8_t *payload = block->p_buffer + 12;
+    memcpy (payload, h + FEC_HEADER_SIZE, len);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        uint16_t s = fec_base (h) + i * offset;
+        if (s == seq)
+            continue;
+
+        const block_t *media = fec_media (fec, s);
+        assert (media != NULL);
+
+        const uint8_t *p = media->p_buffer;
+        const size_t plen = media->i_buffer - 12;
+
+        length ^= plen;
+        ptype ^= p[1] & 0x7F;
+        ts ^= GetDWBE (p + 4);
+        flags ^= p[0] & 0x3F;
+        marker ^= p[1] & 0x80;
+        for (size_t j = 0; j < __MIN(plen, len); j++)
+            payload[j] ^= p[12 + j];
+    }
+
+    if (length > len)
+    {
+        block_Release (block);
+        return NULL;
+    }
+
+    uint8_t *p = block->p_buffer;
+    p[0] = 0x80 | flags;
+    p[1] = marker | ptype;
+    SetWBE (p + 2, seq);
+    SetDWBE (p + 4, ts);
+    SetDWBE (p + 8, fec->ssrc);
+    block->i_buffer = 12 + length;
+    return block;
+}
+
+static void fec_drop_pending (rtp_fec_t *fec, unsigned i)
+{
+    block_Release (fec->pending[i]);
+    fec->pending[i] = fec->pending[--fec->pendingc];
+}
+
+/**
+ * Recovers what the pending FEC packets can, and forgets those that are
+ * complete or too old.
+ * @return chain of recovered media packets
+ */
+static block_t *fec_recover (rtp_fec_t *fec)
+{
+    block_t *chain = NULL, **pp = &chain;
+    bool progress;
+
+    do
+    {
+        progress = false;
+
+        for (unsigned i = 0; i < fec->pendingc;)
+        {
+            size_t len;
+            const uint8_t *h = fec_header (fec->pending[i], &len);
+            const unsigned offset = h[13], count = h[14];
+            const uint16_t base = fec_base (h);
+
+            if ((uint16_t)(fec->max_seq - base) >= FEC_KEEP / 2
+             && (int16_t)(fec->max_seq - base) > 0)
+            {   /* protected packets no longer kept */
+                fec_drop_pending (fec, i);
+                continue;
+            }
+
+            unsigned missing = 0;
+            uint16_t seq = 0;
+            for (unsigned j = 0; j < count && missing < 2; j++)
+            {
+                uint16_t s = base + j * offset;
+                if (fec_media (fec, s) == NULL)
+                {
+                    missing++;
+                    seq = s;
+                }
+            }
+
+            if (missing >= 2)
+            {
+                i++;
+                continue;
+            }
+
+            if (missing == 1)
+            {
+                block_t *block = fec_rebuild (fec, fec->pending[i], h, len,
+                                              seq);
+                if (block != NULL && fec_mark (fec, seq, false))
+                {
+                    fec_keep (fec, seq, block);
+                    fec->recovered++;
+                    *pp = block;
+                    pp = &block->p_next;
+                    progress = true;
+                }
+                else if (block != NULL)
+                    block_Release (block);
+            }
+            fec_drop_pending (fec, i);
+        }
+    }
+    while (progress);
+
+    return chain;
+}
+
+static inline bool fec_is_media (const block_t *block)
+{
+    if (block->i_buffer < 12 || (block->p_buffer[0] >> 6) != 2)
+        return false;
+    const uint8_t ptype = rtp_ptype (block);
+    return ptype < 72 || ptype > 76; /* not muxed RTCP */
+}
+
+/**
+ * Receives a media packet from either path.
+ * @return the packet unless it is a duplicate, followed by the packets it
+ * allowed to recover
+ */
+block_t *rtp_fec_media (rtp_fec_t *fec, block_t *block)
+{
+    if (!fec_is_media (block))
+        return block; /* let the RTP session deal with it */
+
+    const uint16_t seq = GetWBE (block->p_buffer + 2);
+    const uint32_t ssrc = GetDWBE (block->p_buffer + 8);
+
+    if (!fec->started || ssrc != fec->ssrc)
+        fec_reset (fec, ssrc, seq);
+
+    const bool newest = (int16_t)(seq - fec->max_seq) > 0;
+    if (!fec_mark (fec, seq, true))
+    {
+        fec->duplicates++;
+        block_Release (block);
+        return NULL;
+    }
+    fec->received++;
+
+    if (newest)
+    {
+        mtime_t now = mdate ();
+        if (fec->last_rx != 0)
+            fec->interval += ((now - fec->last_rx) - fec->interval) / 16;
+        fec->last_rx = now;
+    }
+
+    if (!fec->keep)
+        return block;
+
+    fec_keep (fec, seq, block);
+    block->p_next = fec_recover (fec);
+    return block;
+}
+
+/**
+ * Receives a FEC packet, from the column or the row stream.
+ * @return chain of recovered media packets
+ */
+block_t *rtp_fec_packet (rtp_fec_t *fec, block_t *block)
+{
+    size_t len;
+    const uint8_t *h = fec_header (block, &len);
+
+    if (h == NULL || !fec->started
+     || (unsigned)(h[14] - 1) * h[13] >= FEC_KEEP / 4
+     || abs ((int16_t)(fec_base (h) - fec->max_seq)) >= FEC_KEEP / 2)
+    {   /* not XOR, too large, or unrelated to the media packets */
+        block_Release (block);
+        return NULL;
+    }
+
+    unsigned span = (h[14] - 1) * h[13] + 1;
+    if (span > fec->span)
+        fec->span = span;
+
+    if (fec->pendingc == FEC_PENDING)
+        fec_drop_pending (fec, 0);
+    fec->pending[fec->pendingc++] = block;
+    return fec_recover (fec);
+}
+
+/**
+ * How long to wait for FEC packets before giving up a missing packet.
+ * Column FEC packets are usually spread over the next matrix.
+ */
+mtime_t rtp_fec_delay (const rtp_fec_t *fec)
+{
+    if (!fec->keep)
+        return 0;
+    return 2 * fec->span * fec->interval;
+}
+
+/**
+ * Updates the "RTP" information of the input item, at most once per second.
+ */
+void rtp_fec_export (rtp_fec_t *fec, input_item_t *item, mtime_t now)
+{
+    if (fec->last_export != VLC_TS_INVALID
+     && now - fec->last_export < CLOCK_FREQ)
+        return;
+    fec->last_export = now;
+
+    const char *cat = _("RTP");
+    input_item_AddInfo (item, cat, _("Received packets"), "%"PRIu64,
+                        fec->received);
+    input_item_AddInfo (item, cat, _("Duplicate packets"), "%"PRIu64,
+                        fec->duplicates);
+    if (fec->keep)
+        input_item_AddInfo (item, cat, _("Recovered packets"), "%"PRIu64,
+                            fec->recovered);
+    input_item_AddInfo (item, cat, _("Lost packets"), "%"PRIu64, fec->lost);
+}
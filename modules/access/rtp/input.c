@@ -28,6 +28,7 @@
 #include <vlc_demux.h>
 #include <vlc_block.h>
 #include <vlc_network.h>
+#include <vlc_input.h>
 
 #include <limits.h>
 #include <errno.h>
@@ -82,6 +83,29 @@ drop:
     block_Release (block);
 }
 
+/**
+ * Processes a packet received from the RTP socket of either path, once the
+ * duplicates are dropped and the lost packets recovered.
+ */
+static void rtp_process_fec (demux_t *demux, block_t *block, bool media)
+{
+    demux_sys_t *sys = demux->p_sys;
+
+    if (media)
+        block = rtp_fec_media (sys->fec, block);
+    else
+        block = rtp_fec_packet (sys->fec, block);
+
+    while (block != NULL)
+    {
+        block_t *next = block->p_next;
+
+        block->p_next = NULL;
+        rtp_process (demux, block);
+        block = next;
+    }
+}
+
 static int rtp_timeout (mtime_t deadline)
 {
     if (deadline == VLC_TS_INVALID)
@@ -105,7 +129,6 @@ void *rtp_dgram_thread (void *opaque)
     demux_t *demux = opaque;
     demux_sys_t *sys = demux->p_sys;
     mtime_t deadline = VLC_TS_INVALID;
-    int rtp_fd = sys->fd;
     struct iovec iov =
     {
         .iov_len = DEFAULT_MRU,
@@ -116,13 +139,22 @@ void *rtp_dgram_thread (void *opaque)
         .msg_iovlen = 1,
     };
 
-    struct pollfd ufd[1];
-    ufd[0].fd = rtp_fd;
-    ufd[0].events = POLLIN;
+    /* RTP socket, then the 2022-7 and 2022-1 ones if any */
+    struct pollfd ufd[4];
+    unsigned nfd = 0;
+    const int fds[4] = { sys->fd, sys->red_fd, sys->fec_fd[0], sys->fec_fd[1] };
+
+    for (unsigned i = 0; i < 4; i++)
+        if (fds[i] != -1)
+        {
+            ufd[nfd].fd = fds[i];
+            ufd[nfd].events = POLLIN;
+            nfd++;
+        }
 
     for (;;)
     {
-        int n = poll (ufd, 1, rtp_timeout (deadline));
+        int n = poll (ufd, nfd, rtp_timeout (deadline));
         if (n == -1)
             continue;
 
@@ -130,17 +162,22 @@ void *rtp_dgram_thread (void *opaque)
         if (n == 0)
             goto dequeue;
 
-        if (ufd[0].revents)
+        for (unsigned i = 0; i < nfd; i++)
         {
-            n--;
-            if (unlikely(ufd[0].revents & POLLHUP))
-                break; /* RTP socket dead (DCCP only) */
+            if (!ufd[i].revents)
+                continue;
+            if (unlikely(ufd[i].revents & POLLHUP))
+            {
+                if (i == 0)
+                    goto out; /* RTP socket dead (DCCP only) */
+                continue;
+            }
 
             block_t *block = block_Alloc (iov.iov_len);
             if (unlikely(block == NULL))
             {
                 if (iov.iov_len == DEFAULT_MRU)
-                    break; /* we are totallly screwed */
+                    goto out; /* we are totallly screwed */
                 iov.iov_len = DEFAULT_MRU;
                 continue; /* retry with shrunk MRU */
             }
@@ -152,7 +189,7 @@ void *rtp_dgram_thread (void *opaque)
             msg.msg_flags = 0;
 #endif
 
-            ssize_t len = recvmsg (rtp_fd, &msg, 0);
+            ssize_t len = recvmsg (ufd[i].fd, &msg, 0);
             if (len != -1)
             {
 #ifdef MSG_TRUNC
@@ -167,7 +204,11 @@ void *rtp_dgram_thread (void *opaque)
 #endif
                     block->i_buffer = len;
 
-                rtp_process (demux, block);
+                if (sys->fec != NULL)
+                    rtp_process_fec (demux, block, ufd[i].fd == sys->fd
+                                                || ufd[i].fd == sys->red_fd);
+                else
+                    rtp_process (demux, block);
             }
             else
             {
@@ -180,8 +221,11 @@ void *rtp_dgram_thread (void *opaque)
     dequeue:
         if (!rtp_dequeue (demux, sys->session, &deadline))
             deadline = VLC_TS_INVALID;
+        if (sys->fec != NULL && demux->p_input != NULL)
+            rtp_fec_export (sys->fec, input_GetItem (demux->p_input), mdate ());
         vlc_restorecancel (canc);
     }
+out:
     return NULL;
 }
 
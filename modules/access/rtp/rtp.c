@@ -82,6 +82,17 @@
     "(between 96 and 127) if it can't be determined otherwise with " \
     "out-of-band mappings (SDP)" )
 
+#define RTP_FEC_TEXT N_("SMPTE 2022-1 FEC")
+#define RTP_FEC_LONGTEXT N_( \
+    "Receive the column and row forward error correction streams on the " \
+    "RTP port plus 2 and plus 4, and recover the lost packets with them." )
+
+#define RTP_REDUNDANT_TEXT N_("SMPTE 2022-7 redundant path")
+#define RTP_REDUNDANT_LONGTEXT N_( \
+    "Also receive the same RTP stream from this address, as " \
+    "[source[:port]@]group[:port], and merge both so that a packet lost " \
+    "on one path is taken from the other." )
+
 static const char *const dynamic_pt_list[] = { "theora" };
 static const char *const dynamic_pt_list_text[] = { "Theora Encoded Video" };
 
@@ -125,6 +136,11 @@ vlc_module_begin ()
     add_string ("rtp-dynamic-pt", NULL, RTP_DYNAMIC_PT_TEXT,
                 RTP_DYNAMIC_PT_LONGTEXT, true)
         change_string_list (dynamic_pt_list, dynamic_pt_list_text)
+    add_bool ("rtp-fec", false, RTP_FEC_TEXT, RTP_FEC_LONGTEXT, true)
+        change_safe ()
+    add_string ("rtp-redundant", NULL, RTP_REDUNDANT_TEXT,
+                RTP_REDUNDANT_LONGTEXT, true)
+        change_safe ()
 
     /*add_shortcut ("sctp")*/
     add_shortcut ("dccp", "rtptcp", /* "tcp" is already taken :( */
@@ -152,7 +168,7 @@ vlc_module_end ()
  * Local prototypes
  */
 static int Control (demux_t *, int i_query, va_list args);
-static int extract_port (char **phost);
+static void parse_location (char *, char **, int *, char **, int *);
 
 /**
  * Probes and initializes.
@@ -180,32 +196,14 @@ static int Open (vlc_object_t *obj)
     if (tmp == NULL)
         return VLC_ENOMEM;
 
-    char *shost;
-    char *dhost = strchr (tmp, '@');
-    if (dhost != NULL)
-    {
-        *(dhost++) = '\0';
-        shost = tmp;
-    }
-    else
-    {
-        dhost = tmp;
-        shost = NULL;
-    }
-
-    /* Parses the port numbers */
-    int sport = 0, dport = 0;
-    if (shost != NULL)
-        sport = extract_port (&shost);
-    if (dhost != NULL)
-        dport = extract_port (&dhost);
-    if (dport == 0)
-        dport = 5004; /* avt-profile-1 port */
+    char *shost, *dhost;
+    int sport, dport;
+    parse_location (tmp, &shost, &sport, &dhost, &dport);
 
     int rtcp_dport = var_CreateGetInteger (obj, "rtcp-port");
 
     /* Try to connect */
-    int fd = -1, rtcp_fd = -1;
+    int fd = -1, rtcp_fd = -1, red_fd = -1, fec_fd[2] = { -1, -1 };
 
     switch (tp)
     {
@@ -216,6 +214,33 @@ static int Open (vlc_object_t *obj)
                 break;
             if (rtcp_dport > 0) /* XXX: source port is unknown */
                 rtcp_fd = net_OpenDgram (obj, dhost, rtcp_dport, shost, 0, tp);
+
+            /* SMPTE 2022-1: columns on port + 2, rows on port + 4 */
+            if (var_CreateGetBool (obj, "rtp-fec"))
+                for (int i = 0; i < 2; i++)
+                {
+                    fec_fd[i] = net_OpenDgram (obj, dhost, dport + 2 + 2 * i,
+                                               shost, sport ? sport + 2 + 2 * i
+                                                            : 0, tp);
+                    if (fec_fd[i] == -1)
+                        msg_Warn (obj, "cannot receive FEC on port %d",
+                                  dport + 2 + 2 * i);
+                }
+
+            /* SMPTE 2022-7 */
+            char *red;
+            red = var_CreateGetNonEmptyString (obj, "rtp-redundant");
+            if (red != NULL)
+            {
+                char *rshost, *rdhost;
+                int rsport, rdport;
+                parse_location (red, &rshost, &rsport, &rdhost, &rdport);
+                red_fd = net_OpenDgram (obj, rdhost, rdport, rshost, rsport,
+                                        tp);
+                if (red_fd == -1)
+                    msg_Warn (obj, "cannot receive the redundant path");
+                free (red);
+            }
             break;
 
          case IPPROTO_DCCP:
@@ -250,6 +275,11 @@ static int Open (vlc_object_t *obj)
         net_Close (fd);
         if (rtcp_fd != -1)
             net_Close (rtcp_fd);
+        if (red_fd != -1)
+            net_Close (red_fd);
+        for (int i = 0; i < 2; i++)
+            if (fec_fd[i] != -1)
+                net_Close (fec_fd[i]);
         return VLC_EGENERIC;
     }
 
@@ -259,6 +289,10 @@ static int Open (vlc_object_t *obj)
 #endif
     p_sys->fd           = fd;
     p_sys->rtcp_fd      = rtcp_fd;
+    p_sys->red_fd       = red_fd;
+    p_sys->fec_fd[0]    = fec_fd[0];
+    p_sys->fec_fd[1]    = fec_fd[1];
+    p_sys->fec          = NULL;
     p_sys->max_src      = var_CreateGetInteger (obj, "rtp-max-src");
     p_sys->timeout      = var_CreateGetInteger (obj, "rtp-timeout")
                         * CLOCK_FREQ;
@@ -275,6 +309,13 @@ static int Open (vlc_object_t *obj)
     if (p_sys->session == NULL)
         goto error;
 
+    if (red_fd != -1 || fec_fd[0] != -1 || fec_fd[1] != -1)
+    {
+        p_sys->fec = rtp_fec_create (fec_fd[0] != -1 || fec_fd[1] != -1);
+        if (p_sys->fec == NULL)
+            goto error;
+    }
+
 #ifdef HAVE_SRTP
     char *key = var_CreateGetNonEmptyString (demux, "srtp-key");
     if (key)
@@ -334,6 +375,13 @@ static void Close (vlc_object_t *obj)
 #endif
     if (p_sys->session)
         rtp_session_destroy (demux, p_sys->session);
+    if (p_sys->fec)
+        rtp_fec_destroy (p_sys->fec);
+    for (int i = 0; i < 2; i++)
+        if (p_sys->fec_fd[i] != -1)
+            net_Close (p_sys->fec_fd[i]);
+    if (p_sys->red_fd != -1)
+        net_Close (p_sys->red_fd);
     if (p_sys->rtcp_fd != -1)
         net_Close (p_sys->rtcp_fd);
     net_Close (p_sys->fd);
@@ -368,6 +416,41 @@ static int extract_port (char **phost)
     return atoi (port);
 }
 
+/**
+ * Splits a "[source[:port]@]destination[:port]" location in place.
+ * The destination port defaults to 5004, the source port to 0.
+ */
+static void parse_location (char *location, char **shostp, int *sportp,
+                            char **dhostp, int *dportp)
+{
+    char *shost;
+    char *dhost = strchr (location, '@');
+    if (dhost != NULL)
+    {
+        *(dhost++) = '\0';
+        shost = location;
+    }
+    else
+    {
+        dhost = location;
+        shost = NULL;
+    }
+
+    /* Parses the port numbers */
+    int sport = 0, dport = 0;
+    if (shost != NULL)
+        sport = extract_port (&shost);
+    if (dhost != NULL)
+        dport = extract_port (&dhost);
+    if (dport == 0)
+        dport = 5004; /* avt-profile-1 port */
+
+    *shostp = shost;
+    *sportp = sport;
+    *dhostp = dhost;
+    *dportp = dport;
+}
+
 
 /**
  * Control callback
@@ -22,6 +22,7 @@
 
 typedef struct rtp_pt_t rtp_pt_t;
 typedef struct rtp_session_t rtp_session_t;
+typedef struct rtp_fec_t rtp_fec_t;
 
 struct vlc_demux_chained_t;
 
@@ -57,6 +58,14 @@ bool rtp_dequeue (demux_t *, const rtp_session_t *, mtime_t *);
 void rtp_dequeue_force (demux_t *, const rtp_session_t *);
 int rtp_add_type (demux_t *demux, rtp_session_t *ses, const rtp_pt_t *pt);
 
+/** @section SMPTE 2022-1 FEC and 2022-7 redundancy */
+rtp_fec_t *rtp_fec_create (bool keep);
+void rtp_fec_destroy (rtp_fec_t *);
+block_t *rtp_fec_media (rtp_fec_t *, block_t *);
+block_t *rtp_fec_packet (rtp_fec_t *, block_t *);
+mtime_t rtp_fec_delay (const rtp_fec_t *);
+void rtp_fec_export (rtp_fec_t *, input_item_t *, mtime_t);
+
 void *rtp_dgram_thread (void *data);
 void *rtp_stream_thread (void *data);
 
@@ -70,6 +79,9 @@ struct demux_sys_t
 #endif
     int           fd;
     int           rtcp_fd;
+    int           red_fd; /**< 2022-7 second path */
+    int           fec_fd[2]; /**< 2022-1 column and row FEC */
+    rtp_fec_t    *fec;
     vlc_thread_t  thread;
 
     mtime_t       timeout;
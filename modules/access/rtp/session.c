@@ -441,6 +441,10 @@ bool rtp_dequeue (demux_t *demux, const rtp_session_t *session,
             if (deadline < (CLOCK_FREQ / 40))
                 deadline = CLOCK_FREQ / 40;
 
+            /* Also wait for the FEC packets that could recover them */
+            if (demux->p_sys->fec != NULL)
+                deadline += rtp_fec_delay (demux->p_sys->fec);
+
             /* Additionnaly, we implicitly wait for the packetization time
              * multiplied by the number of missing packets. block is the first
              * non-missing packet (lowest sequence number). We have no better
@@ -20,8 +20,25 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
 #include "sdi.h"
 
+#include <vlc_cpu.h>
+
+#ifdef HAVE_SSSE3_INTRINSICS
+# include <tmmintrin.h>
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+# include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && !defined(WORDS_BIGENDIAN)
+# include <arm_neon.h>
+# define HAVE_V210_NEON 1
+#endif
+
 static inline uint32_t av_le2ne32(uint32_t val)
 {
     union {
@@ -32,12 +49,42 @@ static inline uint32_t av_le2ne32(uint32_t val)
     return (u.b[0] << 0) | (u.b[1] << 8) | (u.b[2] << 16) | (u.b[3] << 24);
 }
 
-void v210_convert(uint16_t *dst, const uint32_t *bytes, const int width, const int height)
+static inline void put_le32(uint8_t **p, uint32_t d)
 {
-    const int stride = ((width + 47) / 48) * 48 * 8 / 3 / 4;
-    uint16_t *y = &dst[0];
-    uint16_t *u = &dst[width * height * 2 / 2];
-    uint16_t *v = &dst[width * height * 3 / 2];
+    SetDWLE(*p, d);
+    (*p) += 4;
+}
+
+static inline int clip(int a)
+{
+    if      (a < 4) return 4;
+    else if (a > 1019) return 1019;
+    else               return a;
+}
+
+/*
+ * v210 packs 6 pixels (6 Y, 3 U, 3 V) of 10 bits into 4 little endian
+ * 32-bits words:
+ *   w0 = U0 | Y0 << 10 | V0 << 20
+ *   w1 = Y1 | U1 << 10 | Y2 << 20
+ *   w2 = V1 | Y3 << 10 | U2 << 20
+ *   w3 = Y4 | V2 << 10 | Y5 << 20
+ *
+ * The line converters below work on one line, the vectorized versions
+ * process whole groups of pixels and leave the remainder of the line to
+ * the C version. They may write a few samples past the current group, but
+ * never past the end of the line.
+ */
+typedef void (*v210_unpack_line_t)(uint16_t *, uint16_t *, uint16_t *,
+                                   const uint32_t *, int);
+typedef void (*v210_pack_line_t)(uint8_t *, const uint16_t *,
+                                 const uint16_t *, const uint16_t *, int);
+
+static void v210_unpack_line_c(uint16_t *y, uint16_t *u, uint16_t *v,
+                               const uint32_t *src, int width)
+{
+    uint32_t val = 0;
+    int w;
 
 #define READ_PIXELS(a, b, c)         \
     do {                             \
@@ -47,89 +94,546 @@ void v210_convert(uint16_t *dst, const uint32_t *bytes, const int width, const i
         *c++ = (val >> 20) & 0x3FF;  \
     } while (0)
 
-    for (int h = 0; h < height; h++) {
-        const uint32_t *src = bytes;
-        uint32_t val = 0;
-        int w;
-        for (w = 0; w < width - 5; w += 6) {
-            READ_PIXELS(u, y, v);
-            READ_PIXELS(y, u, y);
-            READ_PIXELS(v, y, u);
-            READ_PIXELS(y, v, y);
-        }
-        if (w < width - 1) {
-            READ_PIXELS(u, y, v);
+    for (w = 0; w < width - 5; w += 6) {
+        READ_PIXELS(u, y, v);
+        READ_PIXELS(y, u, y);
+        READ_PIXELS(v, y, u);
+        READ_PIXELS(y, v, y);
+    }
+    if (w < width - 1) {
+        READ_PIXELS(u, y, v);
 
-            val  = av_le2ne32(*src++);
-            *y++ =  val & 0x3FF;
-        }
-        if (w < width - 3) {
-            *u++ = (val >> 10) & 0x3FF;
-            *y++ = (val >> 20) & 0x3FF;
+        val  = av_le2ne32(*src++);
+        *y++ =  val & 0x3FF;
+    }
+    if (w < width - 3) {
+        *u++ = (val >> 10) & 0x3FF;
+        *y++ = (val >> 20) & 0x3FF;
 
-            val  = av_le2ne32(*src++);
-            *v++ =  val & 0x3FF;
-            *y++ = (val >> 10) & 0x3FF;
-        }
+        val  = av_le2ne32(*src++);
+        *v++ =  val & 0x3FF;
+        *y++ = (val >> 10) & 0x3FF;
+    }
+#undef READ_PIXELS
+}
 
-        bytes += stride;
+static void v210_pack_line_c(uint8_t *data, const uint16_t *y,
+                             const uint16_t *u, const uint16_t *v, int width)
+{
+    uint32_t val = 0;
+    int w;
+
+#define WRITE_PIXELS(a, b, c)           \
+    do {                                \
+        val =   clip(*a++);             \
+        val |= (clip(*b++) << 10) |     \
+               (clip(*c++) << 20);      \
+        put_le32(&data, val);           \
+    } while (0)
+
+    for (w = 0; w < width - 5; w += 6) {
+        WRITE_PIXELS(u, y, v);
+        WRITE_PIXELS(y, u, y);
+        WRITE_PIXELS(v, y, u);
+        WRITE_PIXELS(y, v, y);
     }
+    if (w < width - 1) {
+        WRITE_PIXELS(u, y, v);
+
+        val = clip(*y++);
+        if (w == width - 2)
+            put_le32(&data, val);
+    }
+    if (w < width - 3) {
+        val |= (clip(*u++) << 10) | (clip(*y++) << 20);
+        put_le32(&data, val);
+
+        val = clip(*v++) | (clip(*y++) << 10);
+        put_le32(&data, val);
+    }
+#undef WRITE_PIXELS
 }
 
-#undef vanc_to_cc
-block_t *vanc_to_cc(vlc_object_t *obj, uint16_t *buf, size_t words)
+#if defined(HAVE_SSSE3_INTRINSICS) || defined(HAVE_AVX2_INTRINSICS)
+/* Shuffles between the planar samples and two intermediate vectors of
+ * 16-bits lanes, A holding the low and middle samples of each word and B
+ * holding the high ones:
+ *   A = U0 Y0 Y1 U1 V1 Y3 Y4 V2
+ *   B = V0 -- Y2 -- U2 -- Y5 --
+ * Planar vectors are Y0..Y5 and U0 U1 U2 -- V0 V1 V2 --. */
+# define V210_Y_FROM_A  2, 3, 4, 5,-1,-1,10,11,12,13,-1,-1,-1,-1,-1,-1
+# define V210_Y_FROM_B -1,-1,-1,-1, 4, 5,-1,-1,-1,-1,12,13,-1,-1,-1,-1
+# define V210_U_FROM_A  0, 1, 6, 7,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+# define V210_U_FROM_B -1,-1,-1,-1, 8, 9,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+# define V210_V_FROM_A -1,-1, 8, 9,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+# define V210_V_FROM_B  0, 1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+# define V210_A_FROM_Y -1,-1, 0, 1, 2, 3,-1,-1,-1,-1, 6, 7, 8, 9,-1,-1
+# define V210_A_FROM_UV 0, 1,-1,-1,-1,-1, 2, 3,10,11,-1,-1,-1,-1,12,13
+# define V210_B_FROM_Y -1,-1,-1,-1, 4, 5,-1,-1,-1,-1,-1,-1,10,11,-1,-1
+# define V210_B_FROM_UV 8, 9,-1,-1,-1,-1,-1,-1, 4, 5,-1,-1,-1,-1,-1,-1
+#endif
+
+#ifdef HAVE_SSSE3_INTRINSICS
+__attribute__ ((__target__ ("ssse3")))
+static inline __m128i v210_clip_sse(__m128i x)
 {
-    if (words < 3) {
-        msg_Err(obj, "VANC line too small (%zu words)", words);
-        return NULL;
+    const __m128i lo = _mm_set1_epi16(4), hi = _mm_set1_epi16(1019);
+
+    x = _mm_sub_epi16(x, _mm_subs_epu16(x, hi)); /* unsigned min */
+    return _mm_add_epi16(_mm_subs_epu16(x, lo), lo); /* unsigned max */
+}
+
+__attribute__ ((__target__ ("ssse3")))
+static void v210_unpack_line_ssse3(uint16_t *y, uint16_t *u, uint16_t *v,
+                                   const uint32_t *src, int width)
+{
+    const __m128i lo_mask = _mm_set1_epi32(0x000003ff);
+    const __m128i hi_mask = _mm_set1_epi32(0x03ff0000);
+    const __m128i y_a = _mm_setr_epi8(V210_Y_FROM_A);
+    const __m128i y_b = _mm_setr_epi8(V210_Y_FROM_B);
+    const __m128i u_a = _mm_setr_epi8(V210_U_FROM_A);
+    const __m128i u_b = _mm_setr_epi8(V210_U_FROM_B);
+    const __m128i v_a = _mm_setr_epi8(V210_V_FROM_A);
+    const __m128i v_b = _mm_setr_epi8(V210_V_FROM_B);
+    int w;
+
+    for (w = 0; w + 12 <= width; w += 6) {
+        __m128i p = _mm_loadu_si128((const __m128i *)src);
+        __m128i a = _mm_or_si128(_mm_and_si128(p, lo_mask),
+                                 _mm_and_si128(_mm_slli_epi32(p, 6), hi_mask));
+        __m128i b = _mm_and_si128(_mm_srli_epi32(p, 20), lo_mask);
+
+        _mm_storeu_si128((__m128i *)y, _mm_or_si128(_mm_shuffle_epi8(a, y_a),
+                                                    _mm_shuffle_epi8(b, y_b)));
+        _mm_storel_epi64((__m128i *)u, _mm_or_si128(_mm_shuffle_epi8(a, u_a),
+                                                    _mm_shuffle_epi8(b, u_b)));
+        _mm_storel_epi64((__m128i *)v, _mm_or_si128(_mm_shuffle_epi8(a, v_a),
+                                                    _mm_shuffle_epi8(b, v_b)));
+        src += 4;
+        y += 6;
+        u += 3;
+        v += 3;
     }
 
-    static const uint8_t vanc_header[6] = { 0x00, 0x00, 0xff, 0x03, 0xff, 0x03 };
-    if (memcmp(vanc_header, buf, 3*2)) {
-        /* Does not start with the VANC header */
-        return NULL;
+    v210_unpack_line_c(y, u, v, src, width - w);
+}
+
+__attribute__ ((__target__ ("ssse3")))
+static void v210_pack_line_ssse3(uint8_t *dst, const uint16_t *y,
+                                 const uint16_t *u, const uint16_t *v,
+                                 int width)
+{
+    const __m128i mask10 = _mm_set1_epi32(0x000003ff);
+    const __m128i mask20 = _mm_set1_epi32(0x000ffc00);
+    const __m128i a_y  = _mm_setr_epi8(V210_A_FROM_Y);
+    const __m128i a_uv = _mm_setr_epi8(V210_A_FROM_UV);
+    const __m128i b_y  = _mm_setr_epi8(V210_B_FROM_Y);
+    const __m128i b_uv = _mm_setr_epi8(V210_B_FROM_UV);
+    int w;
+
+    for (w = 0; w + 12 <= width; w += 6) {
+        __m128i yy = v210_clip_sse(_mm_loadu_si128((const __m128i *)y));
+        __m128i uv = v210_clip_sse(_mm_unpacklo_epi64(
+                                        _mm_loadl_epi64((const __m128i *)u),
+                                        _mm_loadl_epi64((const __m128i *)v)));
+        __m128i a = _mm_or_si128(_mm_shuffle_epi8(yy, a_y),
+                                 _mm_shuffle_epi8(uv, a_uv));
+        __m128i b = _mm_or_si128(_mm_shuffle_epi8(yy, b_y),
+                                 _mm_shuffle_epi8(uv, b_uv));
+        __m128i p = _mm_or_si128(_mm_and_si128(a, mask10),
+                                 _mm_and_si128(_mm_srli_epi32(a, 6), mask20));
+
+        _mm_storeu_si128((__m128i *)dst, _mm_or_si128(p, _mm_slli_epi32(b, 20)));
+        dst += 16;
+        y += 6;
+        u += 3;
+        v += 3;
     }
 
-    size_t len = (buf[5] & 0xff) + 6 + 1;
-    if (len > words) {
-        msg_Err(obj, "Data Count (%zu) > line length (%zu)", len, words);
-        return NULL;
+    v210_pack_line_c(dst, y, u, v, width - w);
+}
+#endif
+
+#ifdef HAVE_AVX2_INTRINSICS
+__attribute__ ((__target__ ("avx2")))
+static inline __m256i v210_clip_avx2(__m256i x)
+{
+    const __m256i lo = _mm256_set1_epi16(4), hi = _mm256_set1_epi16(1019);
+
+    x = _mm256_min_epu16(x, hi);
+    return _mm256_max_epu16(x, lo);
+}
+
+__attribute__ ((__target__ ("avx2")))
+static void v210_unpack_line_avx2(uint16_t *y, uint16_t *u, uint16_t *v,
+                                  const uint32_t *src, int width)
+{
+    const __m256i lo_mask = _mm256_set1_epi32(0x000003ff);
+    const __m256i hi_mask = _mm256_set1_epi32(0x03ff0000);
+    const __m256i y_a = _mm256_setr_epi8(V210_Y_FROM_A, V210_Y_FROM_A);
+    const __m256i y_b = _mm256_setr_epi8(V210_Y_FROM_B, V210_Y_FROM_B);
+    const __m256i u_a = _mm256_setr_epi8(V210_U_FROM_A, V210_U_FROM_A);
+    const __m256i u_b = _mm256_setr_epi8(V210_U_FROM_B, V210_U_FROM_B);
+    const __m256i v_a = _mm256_setr_epi8(V210_V_FROM_A, V210_V_FROM_A);
+    const __m256i v_b = _mm256_setr_epi8(V210_V_FROM_B, V210_V_FROM_B);
+    /* gathers the 2 x 6 luma samples of each lane */
+    const __m256i y_perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    int w;
+
+    for (w = 0; w + 24 <= width; w += 12) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)src);
+        __m256i a = _mm256_or_si256(_mm256_and_si256(p, lo_mask),
+                        _mm256_and_si256(_mm256_slli_epi32(p, 6), hi_mask));
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 20), lo_mask);
+
+        __m256i yy = _mm256_or_si256(_mm256_shuffle_epi8(a, y_a),
+                                     _mm256_shuffle_epi8(b, y_b));
+        __m256i uu = _mm256_or_si256(_mm256_shuffle_epi8(a, u_a),
+                                     _mm256_shuffle_epi8(b, u_b));
+        __m256i vv = _mm256_or_si256(_mm256_shuffle_epi8(a, v_a),
+                                     _mm256_shuffle_epi8(b, v_b));
+
+        _mm256_storeu_si256((__m256i *)y,
+                            _mm256_permutevar8x32_epi32(yy, y_perm));
+        _mm_storeu_si128((__m128i *)u,
+            _mm_or_si128(_mm256_castsi256_si128(uu),
+                         _mm_slli_si128(_mm256_extracti128_si256(uu, 1), 6)));
+        _mm_storeu_si128((__m128i *)v,
+            _mm_or_si128(_mm256_castsi256_si128(vv),
+                         _mm_slli_si128(_mm256_extracti128_si256(vv, 1), 6)));
+        src += 8;
+        y += 12;
+        u += 6;
+        v += 6;
     }
 
-    uint16_t vanc_sum = 0;
-    for (size_t i = 3; i < len - 1; i++) {
-        uint16_t v = buf[i];
-        int np = v >> 8;
-        int p = parity(v & 0xff);
-        if ((!!p ^ !!(v & 0x100)) || (np != 1 && np != 2)) {
-            msg_Err(obj, "Parity incorrect for word %zu", i);
-            return NULL;
+    v210_unpack_line_c(y, u, v, src, width - w);
+}
+
+__attribute__ ((__target__ ("avx2")))
+static void v210_pack_line_avx2(uint8_t *dst, const uint16_t *y,
+                                const uint16_t *u, const uint16_t *v,
+                                int width)
+{
+    const __m256i mask10 = _mm256_set1_epi32(0x000003ff);
+    const __m256i mask20 = _mm256_set1_epi32(0x000ffc00);
+    const __m256i a_y  = _mm256_setr_epi8(V210_A_FROM_Y, V210_A_FROM_Y);
+    const __m256i a_uv = _mm256_setr_epi8(V210_A_FROM_UV, V210_A_FROM_UV);
+    const __m256i b_y  = _mm256_setr_epi8(V210_B_FROM_Y, V210_B_FROM_Y);
+    const __m256i b_uv = _mm256_setr_epi8(V210_B_FROM_UV, V210_B_FROM_UV);
+    /* spreads 2 x 6 luma samples, one group of 6 per lane */
+    const __m256i y_perm = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    int w;
+
+    for (w = 0; w + 24 <= width; w += 12) {
+        __m256i yy = _mm256_permutevar8x32_epi32(
+                        _mm256_loadu_si256((const __m256i *)y), y_perm);
+        __m128i uu = _mm_loadu_si128((const __m128i *)u);
+        __m128i vv = _mm_loadu_si128((const __m128i *)v);
+        __m256i uv = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_unpacklo_epi64(uu, vv)),
+            _mm_unpacklo_epi64(_mm_srli_si128(uu, 6), _mm_srli_si128(vv, 6)),
+            1);
+
+        yy = v210_clip_avx2(yy);
+        uv = v210_clip_avx2(uv);
+
+        __m256i a = _mm256_or_si256(_mm256_shuffle_epi8(yy, a_y),
+                                    _mm256_shuffle_epi8(uv, a_uv));
+        __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(yy, b_y),
+                                    _mm256_shuffle_epi8(uv, b_uv));
+        __m256i p = _mm256_or_si256(_mm256_and_si256(a, mask10),
+                        _mm256_and_si256(_mm256_srli_epi32(a, 6), mask20));
+
+        _mm256_storeu_si256((__m256i *)dst,
+                            _mm256_or_si256(p, _mm256_slli_epi32(b, 20)));
+        dst += 32;
+        y += 12;
+        u += 6;
+        v += 6;
+    }
+
+    v210_pack_line_c(dst, y, u, v, width - w);
+}
+#endif
+
+#ifdef HAVE_V210_NEON
+/* NEON (de)interleaves 4 groups of pixels at once: luma is handled as
+ * pairs of samples so that the 3-way structure accesses match the planar
+ * order. */
+static void v210_unpack_line_neon(uint16_t *y, uint16_t *u, uint16_t *v,
+                                  const uint32_t *src, int width)
+{
+    const uint32x4_t mask = vdupq_n_u32(0x3ff);
+    int w;
+
+    for (w = 0; w + 24 <= width; w += 24) {
+        uint32x4x4_t p = vld4q_u32(src);
+        uint32x4x3_t yy;
+        uint16x4x3_t uu, vv;
+
+        yy.val[0] = vorrq_u32(vandq_u32(vshrq_n_u32(p.val[0], 10), mask),
+                              vshlq_n_u32(vandq_u32(p.val[1], mask), 16));
+        yy.val[1] = vorrq_u32(vandq_u32(vshrq_n_u32(p.val[1], 20), mask),
+                    vshlq_n_u32(vandq_u32(vshrq_n_u32(p.val[2], 10), mask), 16));
+        yy.val[2] = vorrq_u32(vandq_u32(p.val[3], mask),
+                    vshlq_n_u32(vandq_u32(vshrq_n_u32(p.val[3], 20), mask), 16));
+
+        uu.val[0] = vmovn_u32(vandq_u32(p.val[0], mask));
+        uu.val[1] = vmovn_u32(vandq_u32(vshrq_n_u32(p.val[1], 10), mask));
+        uu.val[2] = vmovn_u32(vandq_u32(vshrq_n_u32(p.val[2], 20), mask));
+        vv.val[0] = vmovn_u32(vandq_u32(vshrq_n_u32(p.val[0], 20), mask));
+        vv.val[1] = vmovn_u32(vandq_u32(p.val[2], mask));
+        vv.val[2] = vmovn_u32(vandq_u32(vshrq_n_u32(p.val[3], 10), mask));
+
+        vst3q_u32((uint32_t *)y, yy);
+        vst3_u16(u, uu);
+        vst3_u16(v, vv);
+        src += 16;
+        y += 24;
+        u += 12;
+        v += 12;
+    }
+
+    v210_unpack_line_c(y, u, v, src, width - w);
+}
+
+static void v210_pack_line_neon(uint8_t *dst, const uint16_t *y,
+                                const uint16_t *u, const uint16_t *v,
+                                int width)
+{
+    const uint16x8_t lo = vdupq_n_u16(4), hi = vdupq_n_u16(1019);
+    const uint32x4_t mask = vdupq_n_u32(0xffff);
+    int w;
+
+    for (w = 0; w + 24 <= width; w += 24) {
+        uint32x4x3_t yy = vld3q_u32((const uint32_t *)y);
+        uint16x4x3_t uu = vld3_u16(u), vv = vld3_u16(v);
+        uint32x4_t uw[3], vw[3], yl[3], yh[3];
+        uint32x4x4_t p;
+
+        for (int i = 0; i < 3; i++) {
+            uint16x8_t l = vreinterpretq_u16_u32(yy.val[i]);
+            l = vminq_u16(vmaxq_u16(l, lo), hi);
+            yl[i] = vandq_u32(vreinterpretq_u32_u16(l), mask);
+            yh[i] = vshrq_n_u32(vreinterpretq_u32_u16(l), 16);
+            uw[i] = vmovl_u16(vmin_u16(vmax_u16(uu.val[i], vget_low_u16(lo)),
+                                       vget_low_u16(hi)));
+            vw[i] = vmovl_u16(vmin_u16(vmax_u16(vv.val[i], vget_low_u16(lo)),
+                                       vget_low_u16(hi)));
         }
-        vanc_sum += v;
-        vanc_sum &= 0x1ff;
-        buf[i] &= 0xff;
+
+        p.val[0] = vorrq_u32(vorrq_u32(uw[0], vshlq_n_u32(yl[0], 10)),
+                             vshlq_n_u32(vw[0], 20));
+        p.val[1] = vorrq_u32(vorrq_u32(yh[0], vshlq_n_u32(uw[1], 10)),
+                             vshlq_n_u32(yl[1], 20));
+        p.val[2] = vorrq_u32(vorrq_u32(vw[1], vshlq_n_u32(yh[1], 10)),
+                             vshlq_n_u32(uw[2], 20));
+        p.val[3] = vorrq_u32(vorrq_u32(yl[2], vshlq_n_u32(vw[2], 10)),
+                             vshlq_n_u32(yh[2], 20));
+
+        vst4q_u32((uint32_t *)dst, p);
+        dst += 64;
+        y += 24;
+        u += 12;
+        v += 12;
     }
 
-    vanc_sum |= ((~vanc_sum & 0x100) << 1);
-    if (buf[len - 1] != vanc_sum) {
-        msg_Err(obj, "VANC checksum incorrect: 0x%.4x != 0x%.4x", vanc_sum, buf[len-1]);
-        return NULL;
+    v210_pack_line_c(dst, y, u, v, width - w);
+}
+#endif
+
+static v210_unpack_line_t v210_GetUnpackLine(unsigned cpu)
+{
+#ifdef HAVE_AVX2_INTRINSICS
+    if (cpu & VLC_CPU_AVX2)
+        return v210_unpack_line_avx2;
+#endif
+#ifdef HAVE_SSSE3_INTRINSICS
+    if (cpu & VLC_CPU_SSSE3)
+        return v210_unpack_line_ssse3;
+#endif
+#ifdef HAVE_V210_NEON
+    return v210_unpack_line_neon;
+#endif
+    (void) cpu;
+    return v210_unpack_line_c;
+}
+
+static v210_pack_line_t v210_GetPackLine(unsigned cpu)
+{
+#ifdef HAVE_AVX2_INTRINSICS
+    if (cpu & VLC_CPU_AVX2)
+        return v210_pack_line_avx2;
+#endif
+#ifdef HAVE_SSSE3_INTRINSICS
+    if (cpu & VLC_CPU_SSSE3)
+        return v210_pack_line_ssse3;
+#endif
+#ifdef HAVE_V210_NEON
+    return v210_pack_line_neon;
+#endif
+    (void) cpu;
+    return v210_pack_line_c;
+}
+
+void v210_unpack(uint16_t *dst, const uint32_t *bytes, const int width, const int height)
+{
+    const int stride = ((width + 47) / 48) * 48 * 8 / 3 / 4;
+    uint16_t *y = &dst[0];
+    uint16_t *u = &dst[width * height * 2 / 2];
+    uint16_t *v = &dst[width * height * 3 / 2];
+    v210_unpack_line_t unpack_line = v210_GetUnpackLine(vlc_CPU());
+
+    for (int h = 0; h < height; h++) {
+        unpack_line(y, u, v, bytes, width);
+
+        y += width;
+        u += width / 2;
+        v += width / 2;
+        bytes += stride;
     }
+}
 
-    if (buf[3] != 0x61 /* DID */ || buf[4] != 0x01 /* SDID = CEA-708 */) {
-        //msg_Err(obj, "Not a CEA-708 packet: DID = 0x%.2x SDID = 0x%.2x", buf[3], buf[4]);
-        // XXX : what is Not a CEA-708 packet: DID = 0x61 SDID = 0x02 ?
-        return NULL;
+void v210_unpack_picture(picture_t *pic, const void *frame_bytes, int src_stride)
+{
+    const int width = pic->format.i_width;
+    const int height = pic->format.i_height;
+    const uint8_t *data = (const uint8_t*)frame_bytes;
+    v210_unpack_line_t unpack_line = v210_GetUnpackLine(vlc_CPU());
+
+    for (int h = 0; h < height; h++) {
+        uint16_t *y = (uint16_t *)&pic->p[0].p_pixels[h * pic->p[0].i_pitch];
+        uint16_t *u = (uint16_t *)&pic->p[1].p_pixels[h * pic->p[1].i_pitch];
+        uint16_t *v = (uint16_t *)&pic->p[2].p_pixels[h * pic->p[2].i_pitch];
+
+        unpack_line(y, u, v, (const uint32_t *)data, width);
+        data += src_stride;
     }
+}
 
-    /* CDP follows */
-    uint16_t *cdp = &buf[6];
-    if (cdp[0] != 0x96 || cdp[1] != 0x69) {
-        msg_Err(obj, "Invalid CDP header 0x%.2x 0x%.2x", cdp[0], cdp[1]);
-        return NULL;
+void v210_pack(void *frame_bytes, const picture_t *pic, int dst_stride)
+{
+    const int width = pic->format.i_width;
+    const int height = pic->format.i_height;
+    const int line_size = ((width * 8 + 11) / 12) * 4;
+    uint8_t *data = (uint8_t*)frame_bytes;
+    v210_pack_line_t pack_line = v210_GetPackLine(vlc_CPU());
+
+    for (int h = 0; h < height; h++) {
+        const uint16_t *y = (const uint16_t *)
+            &pic->p[0].p_pixels[h * pic->p[0].i_pitch];
+        const uint16_t *u = (const uint16_t *)
+            &pic->p[1].p_pixels[h * pic->p[1].i_pitch];
+        const uint16_t *v = (const uint16_t *)
+            &pic->p[2].p_pixels[h * pic->p[2].i_pitch];
+
+        pack_line(data, y, u, v, width);
+        memset(data + line_size, 0, dst_stride - line_size);
+        data += dst_stride;
+    }
+}
+
+size_t v210_unpack_anc(uint16_t *dst, const void *line, int width, bool hd)
+{
+    const uint32_t *src = (const uint32_t *)line;
+    const int count = 2 * width; /* multiplexed Cb Y Cr Y words */
+    uint16_t *out = dst;
+
+    for (int i = 0; i < count; i += 3) {
+        uint32_t val = av_le2ne32(*src++);
+        uint16_t words[3] = { val & 0x3ff, (val >> 10) & 0x3ff, (val >> 20) & 0x3ff };
+
+        for (int j = 0; j < 3 && i + j < count; j++)
+            if (!hd || ((i + j) & 1)) /* HD ANC is carried in luma */
+                *out++ = words[j];
+    }
+
+    return out - dst;
+}
+
+/* b8 is the even parity of b0-b7, b9 is the inverse of b8 */
+static bool anc_word_valid(uint16_t v)
+{
+    return !(parity(v & 0xff) ^ !!(v & 0x100)) && (v >> 9) == !(v & 0x100);
+}
+
+/*
+ * Ancillary packet structure:
+ *  word 0-2: Ancillary Data Flag (0x000, 0x3ff, 0x3ff)
+ *  word 3: Data ID
+ *  word 4: Secondary Data ID (DID < 0x80) or Data Block Number
+ *  word 5: Data Count
+ *  word 6 to 6+DC-1: User Data Words
+ *  word 6+DC: Checksum, 9 bits sum of words 3 to 6+DC-1, b9 = !b8
+ */
+unsigned anc_parse(const uint16_t *words, size_t count, unsigned line,
+                   const anc_handler_t *handlers, size_t handler_count,
+                   void *opaque)
+{
+    unsigned errors = 0;
+    size_t i = 0;
+
+    while (i + 7 <= count) {
+        const uint16_t *p = &words[i];
+        if (p[0] != 0x000 || p[1] != 0x3ff || p[2] != 0x3ff) {
+            i++;
+            continue;
+        }
+
+        const unsigned dc = p[5] & 0xff;
+        if (i + 7 + dc > count) {
+            errors++;
+            break;
+        }
+
+        uint16_t sum = 0;
+        for (unsigned j = 3; j < 6 + dc; j++)
+            sum += p[j];
+        sum &= 0x1ff;
+
+        if (!anc_word_valid(p[3]) || !anc_word_valid(p[4])
+         || !anc_word_valid(p[5]) || (p[6 + dc] & 0x1ff) != sum) {
+            /* Look for the next packet right after the flag */
+            errors++;
+            i += 3;
+            continue;
+        }
+
+        const anc_packet_t pkt = {
+            .did = p[3] & 0xff,
+            .sdid = p[4] & 0xff,
+            .dc = dc,
+            .udw = &p[6],
+            .line = line,
+        };
+
+        for (size_t h = 0; h < handler_count; h++)
+            if (handlers[h].did == pkt.did
+             && (pkt.did >= 0x80 || handlers[h].sdid == pkt.sdid)) {
+                handlers[h].handle(opaque, &pkt);
+                break;
+            }
+
+        i += 7 + dc;
     }
 
-    len -= 7; // remove VANC header and checksum
+    return errors;
+}
+
+#undef anc_cea708_to_cc
+block_t *anc_cea708_to_cc(vlc_object_t *obj, const anc_packet_t *pkt)
+{
+    uint8_t cdp[255];
+    const size_t len = pkt->dc;
+
+    for (size_t i = 0; i < len; i++)
+        cdp[i] = pkt->udw[i] & 0xff;
+
+    if (len < 13 || cdp[0] != 0x96 || cdp[1] != 0x69) {
+        msg_Err(obj, "Invalid CDP header");
+        return NULL;
+    }
 
     if (cdp[2] != len) {
         msg_Err(obj, "CDP len %d != %zu", cdp[2], len);
@@ -191,12 +695,118 @@ block_t *vanc_to_cc(vlc_object_t *obj, uint16_t *buf, size_t words)
     }
 
     block_t *cc = block_Alloc(cc_count * 3);
+    if (!cc)
+        return NULL;
+
+    memcpy(cc->p_buffer, &cdp[9], cc_count * 3);
+    return cc;
+}
+
+/* SMPTE 2016-3 */
+bool anc_afd(const anc_packet_t *pkt, anc_afd_t *afd)
+{
+    if (pkt->dc < 8)
+        return false;
+
+    const uint16_t *udw = pkt->udw;
+    afd->afd = (udw[0] >> 3) & 0xf;
+    afd->wide = (udw[0] >> 2) & 1;
+    afd->bar_flags = (udw[3] >> 4) & 0xf;
+    afd->bar1 = ((udw[4] & 0xff) << 8) | (udw[5] & 0xff);
+    afd->bar2 = ((udw[6] & 0xff) << 8) | (udw[7] & 0xff);
+    return true;
+}
+
+/* SMPTE 12M-2 ancillary time code: b4-b7 of each word carry one nibble of
+ * the time code, b3 of the first 8 words the DBB1 payload type */
+bool anc_timecode(const anc_packet_t *pkt, anc_timecode_t *tc)
+{
+    uint8_t n[16];
+
+    if (pkt->dc < 16)
+        return false;
+
+    tc->dbb1 = 0;
+    for (int i = 0; i < 16; i++)
+        n[i] = (pkt->udw[i] >> 4) & 0xf;
+    for (int i = 0; i < 8; i++)
+        tc->dbb1 |= ((pkt->udw[i] >> 3) & 1) << i;
+
+    tc->frames = n[0] + 10 * (n[2] & 0x3);
+    tc->drop_frame = n[2] & 0x4;
+    tc->seconds = n[4] + 10 * (n[6] & 0x7);
+    tc->minutes = n[8] + 10 * (n[10] & 0x7);
+    tc->hours = n[12] + 10 * (n[14] & 0x3);
+
+    return tc->frames < 60 && tc->seconds < 60 && tc->minutes < 60
+        && tc->hours < 24;
+}
 
-    for (size_t i = 0; i < cc_count; i++) {
-        cc->p_buffer[3*i+0] = cdp[9 + 3*i+0] /* & 3 */;
-        cc->p_buffer[3*i+1] = cdp[9 + 3*i+1];
-        cc->p_buffer[3*i+2] = cdp[9 + 3*i+2];
+static uint8_t reverse_bits(uint8_t x)
+{
+    x = (x >> 4) | (x << 4);
+    x = ((x & 0xcc) >> 2) | ((x & 0x33) << 2);
+    return ((x & 0xaa) >> 1) | ((x & 0x55) << 1);
+}
+
+/* OP-47 Subtitling Distribution Packet (SMPTE RDD 8) to EN 300 472 */
+block_t *anc_op47_to_telx(const anc_packet_t *pkt)
+{
+    const uint16_t *udw = pkt->udw;
+    unsigned dc = pkt->dc;
+
+    if (dc < 9 || (udw[0] & 0xff) != 0x51 || (udw[1] & 0xff) != 0x15
+     || (udw[3] & 0xff) != 0x02 /* WST */)
+        return NULL;
+
+    block_t *telx = block_Alloc(1 + 5 * 46);
+    if (!telx)
+        return NULL;
+
+    uint8_t *out = telx->p_buffer;
+    *out++ = 0x10; /* EBU data */
+
+    unsigned pos = 9;
+    for (unsigned i = 0; i < 5; i++) {
+        uint8_t desc = udw[4 + i] & 0xff;
+        if (!desc)
+            continue;
+        if (pos + 45 > dc)
+            break;
+
+        const uint16_t *data = &udw[pos];
+        pos += 45;
+        if ((data[0] & 0xff) != 0x55 || (data[1] & 0xff) != 0x55
+         || (data[2] & 0xff) != 0x27)
+            continue;
+
+        *out++ = 0x03; /* EBU Teletext subtitle data */
+        *out++ = 0x2c;
+        *out++ = (desc & 0x80 ? 0x00 : 0x20) | (desc & 0x1f);
+        *out++ = 0xe4;
+        for (unsigned j = 0; j < 42; j++)
+            *out++ = reverse_bits(data[3 + j] & 0xff);
     }
 
-    return cc;
+    telx->i_buffer = out - telx->p_buffer;
+    if (telx->i_buffer == 1) {
+        block_Release(telx);
+        return NULL;
+    }
+    return telx;
+}
+
+/* SMPTE 2010: payload descriptor, then the SCTE 104 message */
+block_t *anc_scte104(const anc_packet_t *pkt)
+{
+    if (pkt->dc < 2)
+        return NULL;
+
+    block_t *msg = block_Alloc(pkt->dc - 1);
+    if (!msg)
+        return NULL;
+
+    for (unsigned i = 1; i < pkt->dc; i++)
+        msg->p_buffer[i - 1] = pkt->udw[i] & 0xff;
+    return msg;
 }
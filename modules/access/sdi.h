@@ -24,13 +24,84 @@ extern "C" {
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_picture.h>
 
 #include <inttypes.h>
 
-void v210_convert(uint16_t *dst, const uint32_t *bytes, const int width, const int height);
+/* Converts v210 lines to planar 4:2:2 10 bits (Y plane then U then V) */
+void v210_unpack(uint16_t *dst, const uint32_t *bytes, const int width, const int height);
+/* Converts v210 lines to an I422_10L picture */
+void v210_unpack_picture(picture_t *pic, const void *frame_bytes, int src_stride);
+/* Converts an I422_10L picture to v210, clipping to the legal range */
+void v210_pack(void *frame_bytes, const picture_t *pic, int dst_stride);
 
-block_t *vanc_to_cc(vlc_object_t *, uint16_t *, size_t);
-#define vanc_to_cc(obj, buf, words) vanc_to_cc(VLC_OBJECT(obj), buf, words)
+/* Extracts the ancillary data words of a v210 line: the luma words for HD,
+ * the multiplexed chroma and luma words for SD. Returns the word count. */
+size_t v210_unpack_anc(uint16_t *dst, const void *line, int width, bool hd);
+
+/* SMPTE 291 ancillary data packet */
+typedef struct
+{
+    uint8_t did;            /* Data ID */
+    uint8_t sdid;           /* Secondary Data ID, or Data Block Number */
+    uint8_t dc;             /* Data Count */
+    const uint16_t *udw;    /* User Data Words, with their parity bits */
+    unsigned line;
+} anc_packet_t;
+
+typedef struct
+{
+    uint8_t did;
+    uint8_t sdid;           /* ignored for type 1 packets (DID >= 0x80) */
+    void (*handle)(void *opaque, const anc_packet_t *);
+} anc_handler_t;
+
+#define ANC_DID_AFD         0x41
+#define ANC_SDID_AFD        0x05
+#define ANC_DID_SCTE104     0x41
+#define ANC_SDID_SCTE104    0x07
+#define ANC_DID_OP47        0x43
+#define ANC_SDID_OP47       0x02
+#define ANC_DID_TIMECODE    0x60
+#define ANC_SDID_TIMECODE   0x60
+#define ANC_DID_CEA708      0x61
+#define ANC_SDID_CEA708     0x01
+
+/* Walks all the ancillary packets of a line in a single pass, passing each
+ * valid one to the first handler matching its DID (and SDID for type 2
+ * packets). Returns the number of malformed packets. */
+unsigned anc_parse(const uint16_t *words, size_t count, unsigned line,
+                   const anc_handler_t *handlers, size_t handler_count,
+                   void *opaque);
+
+/* CEA-708 CDP to closed captions */
+block_t *anc_cea708_to_cc(vlc_object_t *, const anc_packet_t *);
+#define anc_cea708_to_cc(obj, pkt) anc_cea708_to_cc(VLC_OBJECT(obj), pkt)
+
+typedef struct
+{
+    uint8_t afd;            /* Active Format Description code */
+    bool wide;              /* coded frame is 16:9 */
+    uint8_t bar_flags;      /* top, bottom, left, right */
+    uint16_t bar1, bar2;
+} anc_afd_t;
+
+bool anc_afd(const anc_packet_t *, anc_afd_t *);
+
+typedef struct
+{
+    uint8_t hours, minutes, seconds, frames;
+    bool drop_frame;
+    uint8_t dbb1;           /* payload type: 0 LTC, 1 VITC1, 2 VITC2 */
+} anc_timecode_t;
+
+bool anc_timecode(const anc_packet_t *, anc_timecode_t *);
+
+/* OP-47 teletext to EN 300 472 data units, as carried in PES */
+block_t *anc_op47_to_telx(const anc_packet_t *);
+
+/* SCTE 104 message bytes */
+block_t *anc_scte104(const anc_packet_t *);
 
 #ifdef __cplusplus
 }
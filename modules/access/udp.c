@@ -37,6 +37,7 @@
 #endif
 
 #include <errno.h>
+#include <time.h>
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_access.h>
@@ -75,6 +76,15 @@ vlc_module_begin ()
     set_callbacks( Open, Close )
 vlc_module_end ()
 
+/* Datagrams read per system call */
+#ifdef HAVE_RECVMMSG
+# define UDP_BATCH 32
+#else
+# define UDP_BATCH 1
+#endif
+
+typedef struct udp_pool udp_pool_t;
+
 struct access_sys_t
 {
     int fd;
@@ -85,6 +95,11 @@ struct access_sys_t
     vlc_sem_t semaphore;
     vlc_thread_t thread;
     atomic_bool timeout_reached;
+
+    /* Owned by the thread */
+    udp_pool_t *pool;
+    uint32_t drops;     /* datagrams dropped by the kernel */
+    mtime_t drops_date; /* last report of the drops */
 };
 
 /*****************************************************************************
@@ -94,6 +109,98 @@ static block_t *BlockUDP( access_t *, bool * );
 static int Control( access_t *, int, va_list );
 static void* ThreadRead( void *data );
 
+/*****************************************************************************
+ * Packet pool: MTU-sized blocks are recycled rather than allocated for every
+ * datagram. The pool is reference counted by the access and by the blocks in
+ * flight, since those can outlive the access.
+ *****************************************************************************/
+typedef struct udp_packet udp_packet_t;
+
+struct udp_packet
+{
+    block_t self;
+    udp_pool_t *pool;
+    udp_packet_t *next;
+    uint8_t data[];
+};
+
+struct udp_pool
+{
+    vlc_mutex_t lock;
+    udp_packet_t *free;
+    size_t size;
+    unsigned refs;
+};
+
+static udp_pool_t *udp_pool_New( size_t size )
+{
+    udp_pool_t *pool = malloc( sizeof( *pool ) );
+    if( unlikely(pool == NULL) )
+        return NULL;
+
+    vlc_mutex_init( &pool->lock );
+    pool->free = NULL;
+    pool->size = size;
+    pool->refs = 1;
+    return pool;
+}
+
+static void udp_pool_Unref( udp_pool_t *pool )
+{
+    vlc_mutex_lock( &pool->lock );
+    bool dead = --pool->refs == 0;
+    vlc_mutex_unlock( &pool->lock );
+
+    if( !dead )
+        return;
+
+    while( pool->free != NULL )
+    {
+        udp_packet_t *pkt = pool->free;
+        pool->free = pkt->next;
+        free( pkt );
+    }
+    vlc_mutex_destroy( &pool->lock );
+    free( pool );
+}
+
+static void udp_packet_Release( block_t *block )
+{
+    udp_packet_t *pkt = (udp_packet_t *)block;
+    udp_pool_t *pool = pkt->pool;
+
+    vlc_mutex_lock( &pool->lock );
+    pkt->next = pool->free;
+    pool->free = pkt;
+    vlc_mutex_unlock( &pool->lock );
+    udp_pool_Unref( pool );
+}
+
+static block_t *udp_pool_Get( udp_pool_t *pool )
+{
+    vlc_mutex_lock( &pool->lock );
+    udp_packet_t *pkt = pool->free;
+    if( pkt != NULL )
+        pool->free = pkt->next;
+    pool->refs++;
+    vlc_mutex_unlock( &pool->lock );
+
+    if( pkt == NULL )
+    {
+        pkt = malloc( sizeof( *pkt ) + pool->size );
+        if( unlikely(pkt == NULL) )
+        {
+            udp_pool_Unref( pool );
+            return NULL;
+        }
+        pkt->pool = pool;
+    }
+
+    block_Init( &pkt->self, pkt->data, pool->size );
+    pkt->self.pf_release = udp_packet_Release;
+    return &pkt->self;
+}
+
 /*****************************************************************************
  * Open: open the socket
  *****************************************************************************/
@@ -173,6 +280,17 @@ static int Open( vlc_object_t *p_this )
         goto error;
     }
 
+#ifdef SO_TIMESTAMPNS
+    /* Kernel receive dates */
+    setsockopt( sys->fd, SOL_SOCKET, SO_TIMESTAMPNS, &(int){ 1 }, sizeof (int) );
+#endif
+#ifdef SO_RXQ_OVFL
+    /* Count of datagrams dropped by the kernel */
+    setsockopt( sys->fd, SOL_SOCKET, SO_RXQ_OVFL, &(int){ 1 }, sizeof (int) );
+#endif
+    sys->drops = 0;
+    sys->drops_date = 0;
+
     /* Revert to blocking I/O */
 #ifndef _WIN32
     fcntl(sys->fd, F_SETFL, fcntl(sys->fd, F_GETFL) & ~O_NONBLOCK);
@@ -182,7 +300,7 @@ static int Open( vlc_object_t *p_this )
 
     /* FIXME: There are no particular reasons to create a FIFO and thread here.
      * Those are just working around bugs in the stream cache. */
-    sys->fifo = block_FifoNew();
+    sys->fifo = block_FifoNewSPSC( 4096 );
     if( unlikely( sys->fifo == NULL ) )
     {
         net_Close( sys->fd );
@@ -190,6 +308,13 @@ static int Open( vlc_object_t *p_this )
     }
 
     sys->mtu = 7 * 188;
+    sys->pool = udp_pool_New( sys->mtu );
+    if( unlikely( sys->pool == NULL ) )
+    {
+        block_FifoRelease( sys->fifo );
+        net_Close( sys->fd );
+        goto error;
+    }
     sys->fifo_size = var_InheritInteger( p_access, "udp-buffer");
     vlc_sem_init( &sys->semaphore, 0 );
 
@@ -202,6 +327,7 @@ static int Open( vlc_object_t *p_this )
                    VLC_THREAD_PRIORITY_INPUT ) )
     {
         vlc_sem_destroy( &sys->semaphore );
+        udp_pool_Unref( sys->pool );
         block_FifoRelease( sys->fifo );
         net_Close( sys->fd );
 error:
@@ -224,6 +350,7 @@ static void Close( vlc_object_t *p_this )
     vlc_join( sys->thread, NULL );
     vlc_sem_destroy( &sys->semaphore );
     block_FifoRelease( sys->fifo );
+    udp_pool_Unref( sys->pool );
     net_Close( sys->fd );
     free( sys );
 }
@@ -283,80 +410,244 @@ static block_t *BlockUDP( access_t *p_access, bool *restrict eof )
 /*****************************************************************************
  * ThreadRead: Pull packets from socket as soon as possible.
  *****************************************************************************/
+#if defined (SO_TIMESTAMPNS) || defined (SO_RXQ_OVFL)
+# define UDP_CMSG_SIZE (CMSG_SPACE(sizeof (struct timespec)) \
+                      + CMSG_SPACE(sizeof (uint32_t)))
+#endif
+
+/* Linux returns the full length of truncated datagrams with MSG_TRUNC */
+#ifdef __linux__
+# define UDP_RECV_FLAGS MSG_TRUNC
+#else
+# define UDP_RECV_FLAGS 0
+#endif
+
+struct udp_batch
+{
+    block_t *pkt[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msg[UDP_BATCH];
+#else
+    struct { struct msghdr msg_hdr; unsigned msg_len; } msg[UDP_BATCH];
+#endif
+#ifdef UDP_CMSG_SIZE
+    union
+    {
+        struct cmsghdr align;
+        char buf[UDP_CMSG_SIZE];
+    } cmsg[UDP_BATCH];
+#endif
+};
+
+static void ReleaseBatch( void *data )
+{
+    struct udp_batch *batch = data;
+
+    for( unsigned i = 0; i < UDP_BATCH; i++ )
+        if( batch->pkt[i] != NULL )
+            block_Release( batch->pkt[i] );
+}
+
+/* Reads the receive date and the drop counter of a datagram */
+static void ParseControl( access_t *access, struct msghdr *hdr, block_t *pkt,
+                          mtime_t now, const struct timespec *realtime )
+{
+    access_sys_t *sys = access->p_sys;
+
+    pkt->i_dts = now;
+#ifdef UDP_CMSG_SIZE
+    for( struct cmsghdr *cmsg = CMSG_FIRSTHDR( hdr ); cmsg != NULL;
+         cmsg = CMSG_NXTHDR( hdr, cmsg ) )
+    {
+        if( cmsg->cmsg_level != SOL_SOCKET )
+            continue;
+# ifdef SO_TIMESTAMPNS
+        if( cmsg->cmsg_type == SCM_TIMESTAMPNS )
+        {
+            struct timespec ts;
+            memcpy( &ts, CMSG_DATA( cmsg ), sizeof( ts ) );
+
+            /* Convert from the real time clock to the monotonic one */
+            mtime_t age = (realtime->tv_sec - ts.tv_sec) * CLOCK_FREQ
+                        + (realtime->tv_nsec - ts.tv_nsec) / 1000;
+            if( age >= 0 )
+                pkt->i_dts = now - age;
+        }
+# endif
+# ifdef SO_RXQ_OVFL
+        if( cmsg->cmsg_type == SO_RXQ_OVFL )
+        {
+            uint32_t drops;
+            memcpy( &drops, CMSG_DATA( cmsg ), sizeof( drops ) );
+
+            if( drops != sys->drops )
+            {
+                if( now - sys->drops_date >= CLOCK_FREQ )
+                {
+                    msg_Warn( access, "%"PRIu32" datagrams dropped by the "
+                              "kernel (%"PRIu32" total), receive buffer too "
+                              "small or CPU overloaded", drops - sys->drops,
+                              drops );
+                    sys->drops_date = now;
+                }
+                sys->drops = drops;
+                pkt->i_flags |= BLOCK_FLAG_DISCONTINUITY;
+            }
+        }
+# endif
+    }
+#else
+    VLC_UNUSED(access); VLC_UNUSED(hdr); VLC_UNUSED(realtime);
+    VLC_UNUSED(sys);
+#endif
+}
+
 static void* ThreadRead( void *data )
 {
     access_t *access = data;
     access_sys_t *sys = access->p_sys;
+    struct udp_batch batch;
+
+    for( unsigned i = 0; i < UDP_BATCH; i++ )
+    {
+        batch.pkt[i] = NULL;
+        memset( &batch.msg[i], 0, sizeof( batch.msg[i] ) );
+        batch.msg[i].msg_hdr.msg_iov = &batch.iov[i];
+        batch.msg[i].msg_hdr.msg_iovlen = 1;
+    }
 
+    vlc_cleanup_push( ReleaseBatch, &batch );
     for(;;)
     {
-        block_t *pkt = block_Alloc(sys->mtu);
-        if (unlikely(pkt == NULL))
+        unsigned count = 0;
+
+        /* Refill the slots consumed by the previous batch */
+        while( count < UDP_BATCH )
+        {
+            if( batch.pkt[count] == NULL )
+            {
+                batch.pkt[count] = udp_pool_Get( sys->pool );
+                if( unlikely(batch.pkt[count] == NULL) )
+                    break;
+            }
+            batch.iov[count].iov_base = batch.pkt[count]->p_buffer;
+            batch.iov[count].iov_len = sys->mtu;
+#ifdef UDP_CMSG_SIZE
+            batch.msg[count].msg_hdr.msg_control = batch.cmsg[count].buf;
+            batch.msg[count].msg_hdr.msg_controllen = sizeof( batch.cmsg[count].buf );
+#endif
+            batch.msg[count].msg_hdr.msg_flags = 0;
+            count++;
+        }
+
+        if (unlikely(count == 0))
         {   /* OOM - dequeue and discard one packet */
             char dummy;
             recv(sys->fd, &dummy, 1, 0);
             continue;
         }
 
-        struct iovec iov = {
-            .iov_base = pkt->p_buffer,
-            .iov_len = sys->mtu,
-        };
-        struct msghdr msg = {
-            .msg_iov = &iov,
-            .msg_iovlen = 1,
-#ifdef __linux__
-            .msg_flags = MSG_TRUNC,
+        int poll_return=0;
+        struct pollfd ufd[1];
+        ufd[0].fd = sys->fd;
+        ufd[0].events = POLLIN;
+
+        while ((poll_return = poll(ufd, 1, sys->timeout)) < 0); /* cancellation point */
+        if (unlikely( poll_return == 0))
+        {
+            msg_Err( access, "Timeout on receiving, timeout %d seconds", sys->timeout/1000 );
+            atomic_store(&sys->timeout_reached, true);
+            vlc_sem_post(&sys->semaphore);
+            continue;
+        }
+
+#ifdef HAVE_RECVMMSG
+        int n = recvmmsg(sys->fd, batch.msg, count,
+                         MSG_DONTWAIT | UDP_RECV_FLAGS, NULL);
+#else
+        ssize_t len = recvmsg(sys->fd, &batch.msg[0].msg_hdr, UDP_RECV_FLAGS);
+        int n = len >= 0;
+        if (n)
+            batch.msg[0].msg_len = len;
 #endif
-        };
-        ssize_t len;
+        if (n <= 0)
+            continue;
+
+        int canc = vlc_savecancel();
+        const mtime_t now = mdate();
+        struct timespec realtime = { 0, 0 };
+#ifdef SO_TIMESTAMPNS
+        clock_gettime(CLOCK_REALTIME, &realtime);
+#endif
+        size_t mtu = sys->mtu;
+        size_t bytes = 0;
+        block_t *chain = NULL, **pp = &chain;
 
-        block_cleanup_push(pkt);
-        do
+        for (int i = 0; i < n; i++)
         {
-            int poll_return=0;
-            struct pollfd ufd[1];
-            ufd[0].fd = sys->fd;
-            ufd[0].events = POLLIN;
+            block_t *pkt = batch.pkt[i];
+            struct msghdr *hdr = &batch.msg[i].msg_hdr;
+            size_t len = batch.msg[i].msg_len;
 
-            while ((poll_return = poll(ufd, 1, sys->timeout)) < 0); /* cancellation point */
-            if (unlikely( poll_return == 0))
+            batch.pkt[i] = NULL;
+            ParseControl(access, hdr, pkt, now, &realtime);
+#ifdef MSG_TRUNC
+            if (hdr->msg_flags & MSG_TRUNC)
             {
-                msg_Err( access, "Timeout on receiving, timeout %d seconds", sys->timeout/1000 );
-                atomic_store(&sys->timeout_reached, true);
-                len=0;
-                break;
+                msg_Err(access, "%zu bytes packet truncated (MTU was %zu)",
+                        len, sys->mtu);
+                pkt->i_flags |= BLOCK_FLAG_CORRUPTED;
+                if (len > mtu)
+                    mtu = len;
+                len = sys->mtu;
             }
-            len = recvmsg(sys->fd, &msg, 0);
+#endif
+            pkt->i_buffer = len;
+            bytes += len;
+            *pp = pkt;
+            pp = &pkt->p_next;
         }
-        while (len == -1);
-        vlc_cleanup_pop();
 
-#ifdef MSG_TRUNC
-        if (msg.msg_flags & MSG_TRUNC)
+        /* Move the unused slots to the front, for the next batch */
+        for (int i = n; i < UDP_BATCH; i++)
         {
-            msg_Err(access, "%zd bytes packet truncated (MTU was %zu)",
-                    len, sys->mtu);
-            pkt->i_flags |= BLOCK_FLAG_CORRUPTED;
-            sys->mtu = len;
+            batch.pkt[i - n] = batch.pkt[i];
+            batch.pkt[i] = NULL;
+        }
+
+        if (mtu != sys->mtu)
+        {   /* Larger datagrams need larger blocks */
+            udp_pool_t *pool = udp_pool_New(mtu);
+            if (likely(pool != NULL))
+            {
+                ReleaseBatch(&batch);
+                for (unsigned i = 0; i < UDP_BATCH; i++)
+                    batch.pkt[i] = NULL;
+                udp_pool_Unref(sys->pool);
+                sys->pool = pool;
+                sys->mtu = mtu;
+            }
         }
-        else
-#endif
-            pkt->i_buffer = len;
 
-        vlc_fifo_Lock(sys->fifo);
         /* Discard old buffers on overflow */
-        while (vlc_fifo_GetBytes(sys->fifo) + len > sys->fifo_size)
+        if (vlc_fifo_GetBytes(sys->fifo) + bytes > sys->fifo_size)
         {
-            int canc = vlc_savecancel();
-            block_Release(vlc_fifo_DequeueUnlocked(sys->fifo));
-            vlc_restorecancel(canc);
+            vlc_fifo_Lock(sys->fifo);
+            while (vlc_fifo_GetBytes(sys->fifo) > 0 &&
+                   vlc_fifo_GetBytes(sys->fifo) + bytes > sys->fifo_size)
+                block_Release(vlc_fifo_DequeueUnlocked(sys->fifo));
+            vlc_fifo_Unlock(sys->fifo);
         }
 
-        vlc_fifo_QueueUnlocked(sys->fifo, pkt);
-        vlc_fifo_Unlock(sys->fifo);
-        vlc_sem_post(&sys->semaphore);
+        /* Queued without locking: BlockUDP() dequeues with the lock, so
+         * that the above can drop blocks from this thread */
+        block_FifoPut(sys->fifo, chain);
+        for (int i = 0; i < n; i++)
+            vlc_sem_post(&sys->semaphore);
+        vlc_restorecancel(canc);
     }
+    vlc_cleanup_pop();
 
     return NULL;
 }
@@ -46,11 +46,20 @@
 #else
 #   include <sys/socket.h>
 #endif
+#if defined (__linux__) && defined (SO_TXTIME)
+#   include <linux/net_tstamp.h>
+#   define HAVE_TXTIME 1
+#endif
 
 #include <vlc_network.h>
 
 #define MAX_EMPTY_BLOCKS 200
 
+/* Batched output: datagrams due within that long are sent together by the
+ * userspace pacer, or handed in advance to the kernel pacer */
+#define PACER_SLACK  (CLOCK_FREQ / 20000)
+#define KERNEL_AHEAD (CLOCK_FREQ / 500)
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -71,6 +80,20 @@ static void Close( vlc_object_t * );
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
 
+#define BATCH_TEXT N_("Batched output")
+#define BATCH_LONGTEXT N_("Maximum number of packets handed to the kernel " \
+                          "at once, each packet being paced at its own " \
+                          "time rather than by group. " \
+                          "0 sends the packets one by one." )
+
+#define TXTIME_TEXT N_("Kernel pacing")
+#define TXTIME_LONGTEXT N_("Hand batched packets to the kernel ahead of " \
+                           "time, with their departure time, for the " \
+                           "fq or etf queueing discipline of the interface " \
+                           "to pace them. Packets leave at once with other " \
+                           "disciplines. Packets are paced by VLC if the " \
+                           "kernel does not support it." )
+
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
     set_shortname( "UDP" )
@@ -79,6 +102,10 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_integer_with_range( SOUT_CFG_PREFIX "batch", 0, 0, 1024,
+                            BATCH_TEXT, BATCH_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "txtime", false, TXTIME_TEXT, TXTIME_LONGTEXT,
+              true )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -92,6 +119,8 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "batch",
+    "txtime",
     NULL
 };
 
@@ -108,7 +137,13 @@ static int  Seek    ( sout_access_out_t *, off_t  );
 static int Control( sout_access_out_t *, int, va_list );
 
 static void* ThreadWrite( void * );
+static void* ThreadWriteBatch( void * );
 static block_t *NewUDPPacket( sout_access_out_t *, mtime_t );
+static void ReportJitter( sout_access_out_t * );
+
+/* Departure jitter histogram, in microseconds */
+static const mtime_t jitter_bounds[] = { 50, 100, 250, 500, 1000, 2000, 5000 };
+#define JITTER_BUCKETS (ARRAY_SIZE(jitter_bounds) + 1)
 
 struct sout_access_out_sys_t
 {
@@ -122,6 +157,12 @@ struct sout_access_out_sys_t
     block_t      *p_buffer;
 
     vlc_thread_t  thread;
+
+    /* Batched output, owned by the thread */
+    unsigned      i_batch;
+    bool          b_txtime;
+    uint64_t      jitter[JITTER_BUCKETS];
+    mtime_t       i_jitter_date;
 };
 
 #define DEFAULT_PORT 1234
@@ -210,12 +251,31 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_handle = i_handle;
     p_sys->i_mtu = var_CreateGetInteger( p_this, "mtu" );
     p_sys->b_mtu_warning = false;
-    p_sys->p_fifo = block_FifoNew();
+    p_sys->p_fifo = block_FifoNewSPSC( 4096 );
     p_sys->p_empty_blocks = block_FifoNew();
     p_sys->p_buffer = NULL;
 
-    if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
-                           VLC_THREAD_PRIORITY_HIGHEST ) )
+    p_sys->i_batch = var_GetInteger( p_access, SOUT_CFG_PREFIX "batch" );
+    p_sys->b_txtime = false;
+    memset( p_sys->jitter, 0, sizeof( p_sys->jitter ) );
+    p_sys->i_jitter_date = mdate();
+#ifdef HAVE_TXTIME
+    if( p_sys->i_batch > 0 && var_GetBool( p_access, SOUT_CFG_PREFIX "txtime" ) )
+    {
+        const struct sock_txtime txtime = { .clockid = CLOCK_MONOTONIC };
+
+        if( setsockopt( i_handle, SOL_SOCKET, SO_TXTIME, &txtime,
+                        sizeof( txtime ) ) == 0 )
+            p_sys->b_txtime = true;
+        else
+            msg_Warn( p_access, "kernel pacing not supported (%s), "
+                      "pacing packets in VLC", vlc_strerror_c(errno) );
+    }
+#endif
+
+    if( vlc_clone( &p_sys->thread,
+                   p_sys->i_batch > 0 ? ThreadWriteBatch : ThreadWrite,
+                   p_access, VLC_THREAD_PRIORITY_HIGHEST ) )
     {
         msg_Err( p_access, "cannot spawn sout access thread" );
         block_FifoRelease( p_sys->p_fifo );
@@ -242,6 +302,8 @@ static void Close( vlc_object_t * p_this )
 
     vlc_cancel( p_sys->thread );
     vlc_join( p_sys->thread, NULL );
+    if( p_sys->i_batch > 0 )
+        ReportJitter( p_access );
     block_FifoRelease( p_sys->p_fifo );
     block_FifoRelease( p_sys->p_empty_blocks );
 
@@ -270,6 +332,19 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
 /*****************************************************************************
  * Write: standard write on a file descriptor.
  *****************************************************************************/
+static void QueueUDPPacket( sout_access_out_t *p_access, mtime_t now )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( p_sys->p_buffer->i_dts + p_sys->i_caching < now )
+    {
+        msg_Dbg( p_access, "late packet for UDP input (%"PRId64 ")",
+                 now - p_sys->p_buffer->i_dts - p_sys->i_caching );
+    }
+    block_FifoPut( p_sys->p_fifo, p_sys->p_buffer );
+    p_sys->p_buffer = NULL;
+}
+
 static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
@@ -281,7 +356,15 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
         int i_packets = 0;
         mtime_t now = mdate();
 
-        if( !p_sys->b_mtu_warning && p_buffer->i_buffer > p_sys->i_mtu )
+        /* The TS muxer writes runs of packets: they are split back into
+         * packets, so that every datagram is filled with whole packets */
+        const bool b_ts_run = p_buffer->i_buffer > 188
+                           && p_buffer->i_buffer % 188 == 0
+                           && p_buffer->p_buffer[0] == 0x47
+                           && p_sys->i_mtu >= 188;
+        const size_t i_unit = b_ts_run ? 188 : p_buffer->i_buffer;
+
+        if( !p_sys->b_mtu_warning && i_unit > p_sys->i_mtu )
         {
             msg_Warn( p_access, "packet size > MTU, you should probably "
                       "increase the MTU" );
@@ -290,23 +373,13 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 
         /* Check if there is enough space in the buffer */
         if( p_sys->p_buffer &&
-            p_sys->p_buffer->i_buffer + p_buffer->i_buffer > p_sys->i_mtu )
-        {
-            if( p_sys->p_buffer->i_dts + p_sys->i_caching < now )
-            {
-                msg_Dbg( p_access, "late packet for UDP input (%"PRId64 ")",
-                         now - p_sys->p_buffer->i_dts
-                          - p_sys->i_caching );
-            }
-            block_FifoPut( p_sys->p_fifo, p_sys->p_buffer );
-            p_sys->p_buffer = NULL;
-        }
+            p_sys->p_buffer->i_buffer + i_unit > p_sys->i_mtu )
+            QueueUDPPacket( p_access, now );
 
         i_len += p_buffer->i_buffer;
         while( p_buffer->i_buffer )
         {
-            size_t i_payload_size = p_sys->i_mtu;
-            size_t i_write = __MIN( p_buffer->i_buffer, i_payload_size );
+            size_t i_write;
 
             i_packets++;
 
@@ -316,31 +389,32 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
                 if( !p_sys->p_buffer ) break;
             }
 
+            if( b_ts_run )
+            {
+                size_t i_room = p_sys->i_mtu - p_sys->p_buffer->i_buffer;
+                i_write = __MIN( p_buffer->i_buffer, i_room / 188 * 188 );
+            }
+            else
+                i_write = __MIN( p_buffer->i_buffer, p_sys->i_mtu );
+
             memcpy( p_sys->p_buffer->p_buffer + p_sys->p_buffer->i_buffer,
                     p_buffer->p_buffer, i_write );
 
             p_sys->p_buffer->i_buffer += i_write;
             p_buffer->p_buffer += i_write;
             p_buffer->i_buffer -= i_write;
-            if ( p_buffer->i_flags & BLOCK_FLAG_CLOCK )
+            /* The clock reference, if any, is carried by the run start */
+            if ( p_buffer->i_flags & BLOCK_FLAG_CLOCK && i_packets == 1 )
             {
                 if ( p_sys->p_buffer->i_flags & BLOCK_FLAG_CLOCK )
                     msg_Warn( p_access, "putting two PCRs at once" );
                 p_sys->p_buffer->i_flags |= BLOCK_FLAG_CLOCK;
             }
 
-            if( p_sys->p_buffer->i_buffer == p_sys->i_mtu || i_packets > 1 )
-            {
-                /* Flush */
-                if( p_sys->p_buffer->i_dts + p_sys->i_caching < now )
-                {
-                    msg_Dbg( p_access, "late packet for udp input (%"PRId64 ")",
-                             mdate() - p_sys->p_buffer->i_dts
-                              - p_sys->i_caching );
-                }
-                block_FifoPut( p_sys->p_fifo, p_sys->p_buffer );
-                p_sys->p_buffer = NULL;
-            }
+            if( p_sys->p_buffer->i_buffer + ( b_ts_run ? 188 : 1 )
+                    > p_sys->i_mtu
+             || ( !b_ts_run && i_packets > 1 ) )
+                QueueUDPPacket( p_access, now ); /* Flush */
         }
 
         p_next = p_buffer->p_next;
@@ -369,21 +443,22 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     block_t *p_buffer;
 
-    while ( block_FifoCount( p_sys->p_empty_blocks ) > MAX_EMPTY_BLOCKS )
-    {
-        p_buffer = block_FifoGet( p_sys->p_empty_blocks );
-        block_Release( p_buffer );
-    }
+    vlc_fifo_Lock( p_sys->p_empty_blocks );
+    p_buffer = vlc_fifo_DequeueUnlocked( p_sys->p_empty_blocks );
+    vlc_fifo_Unlock( p_sys->p_empty_blocks );
 
-    if( block_FifoCount( p_sys->p_empty_blocks ) == 0 )
+    if( p_buffer == NULL )
     {
         p_buffer = block_Alloc( p_sys->i_mtu );
+        if( unlikely(p_buffer == NULL) )
+            return NULL;
     }
     else
     {
-        p_buffer = block_FifoGet(p_sys->p_empty_blocks );
         p_buffer->i_flags = 0;
         p_buffer = block_Realloc( p_buffer, 0, p_sys->i_mtu );
+        if( unlikely(p_buffer == NULL) )
+            return NULL;
     }
 
     p_buffer->i_dts = i_dts;
@@ -392,6 +467,20 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
     return p_buffer;
 }
 
+/*****************************************************************************
+ * RecyclePackets: give sent packets back to NewUDPPacket
+ *****************************************************************************/
+static void RecyclePackets( sout_access_out_sys_t *p_sys, block_t *p_chain )
+{
+    block_fifo_t *p_empty = p_sys->p_empty_blocks;
+
+    vlc_fifo_Lock( p_empty );
+    vlc_fifo_QueueUnlocked( p_empty, p_chain );
+    while( vlc_fifo_GetCount( p_empty ) > MAX_EMPTY_BLOCKS )
+        block_Release( vlc_fifo_DequeueUnlocked( p_empty ) );
+    vlc_fifo_Unlock( p_empty );
+}
+
 /*****************************************************************************
  * ThreadWrite: Write a packet on the network at the good time.
  *****************************************************************************/
@@ -419,7 +508,7 @@ static void* ThreadWrite( void *data )
                     msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
                              i_date - i_date_last );
 
-                block_FifoPut( p_sys->p_empty_blocks, p_pk );
+                RecyclePackets( p_sys, p_pk );
 
                 i_date_last = i_date;
                 i_dropped_packets++;
@@ -459,9 +548,316 @@ static void* ThreadWrite( void *data )
         }
 #endif
 
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
+        RecyclePackets( p_sys, p_pk );
 
         i_date_last = i_date;
     }
     return NULL;
 }
+
+/*****************************************************************************
+ * ThreadWriteBatch: Write packets by batches, paced either by this thread or
+ * by the kernel (SO_TXTIME, with the fq or etf queuing discipline).
+ *****************************************************************************/
+#ifdef HAVE_SENDMMSG
+typedef struct mmsghdr udp_msg_t;
+# define MSG_HDR(m) (&(m)->msg_hdr)
+#else
+typedef struct msghdr udp_msg_t;
+# define MSG_HDR(m) (m)
+#endif
+#ifdef HAVE_TXTIME
+# define TXTIME_CMSG_SIZE CMSG_SPACE(sizeof (uint64_t))
+#endif
+
+struct udp_batch
+{
+    block_t  *pending; /* dequeued, not yet due */
+    block_t **pp_last;
+    block_t **pkts;    /* being sent */
+    mtime_t  *dates;
+    struct iovec *iov;
+    udp_msg_t *msgs;
+#ifdef HAVE_TXTIME
+    uint8_t  *cmsgs;
+#endif
+    unsigned  count;
+
+    /* Kept out of the registers across the cancellation points */
+    mtime_t   date_last;    /* date of the last dequeued packet */
+    mtime_t   sent_last;    /* departure of the last sent packet */
+    mtime_t   planned_last; /* date of the last sent packet */
+    unsigned  dropped;      /* packets dropped since the last send */
+};
+
+static void ReleaseBatch( void *data )
+{
+    struct udp_batch *b = data;
+
+    block_ChainRelease( b->pending );
+    for( unsigned i = 0; i < b->count; i++ )
+        block_Release( b->pkts[i] );
+    free( b->pkts );
+    free( b->dates );
+    free( b->iov );
+    free( b->msgs );
+#ifdef HAVE_TXTIME
+    free( b->cmsgs );
+#endif
+}
+
+static void ReportJitter( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    char psz_report[256];
+    size_t i_len = 0;
+
+    for( size_t i = 0; i < JITTER_BUCKETS; i++ )
+    {
+        int n;
+
+        if( i < ARRAY_SIZE(jitter_bounds) )
+            n = snprintf( psz_report + i_len, sizeof(psz_report) - i_len,
+                          " <%"PRId64"us:%"PRIu64, jitter_bounds[i],
+                          p_sys->jitter[i] );
+        else
+            n = snprintf( psz_report + i_len, sizeof(psz_report) - i_len,
+                          " more:%"PRIu64, p_sys->jitter[i] );
+        if( n < 0 || (size_t)n >= sizeof(psz_report) - i_len )
+            break;
+        i_len += n;
+    }
+    msg_Dbg( p_access, "departure jitter%s", psz_report );
+}
+
+static void CountJitter( sout_access_out_sys_t *p_sys, mtime_t i_deviation )
+{
+    size_t i = 0;
+
+    if( i_deviation < 0 )
+        i_deviation = -i_deviation;
+    while( i < ARRAY_SIZE(jitter_bounds) && i_deviation >= jitter_bounds[i] )
+        i++;
+    p_sys->jitter[i]++;
+}
+
+/* Drops the pending packets following a hole, as ThreadWrite does */
+static void DropHoles( sout_access_out_t *p_access, struct udp_batch *b )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    block_t *p_drop = NULL, **pp_drop = &p_drop;
+
+    while( b->pending != NULL && b->date_last > 0 )
+    {
+        block_t *p_pk = b->pending;
+        mtime_t i_date = p_sys->i_caching + p_pk->i_dts;
+
+        if( i_date - b->date_last <= 2000000 )
+            break;
+        if( !b->dropped )
+            msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
+                     i_date - b->date_last );
+        b->pending = p_pk->p_next;
+        p_pk->p_next = NULL;
+        block_ChainLastAppend( &pp_drop, p_pk );
+        b->date_last = i_date;
+        b->dropped++;
+    }
+    if( b->pending == NULL )
+        b->pp_last = &b->pending;
+    if( p_drop != NULL )
+        RecyclePackets( p_sys, p_drop );
+}
+
+static void* ThreadWriteBatch( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const unsigned i_max = p_sys->i_batch;
+    const mtime_t i_ahead = p_sys->b_txtime ? KERNEL_AHEAD : PACER_SLACK;
+    struct udp_batch b;
+
+    b.pending = NULL;
+    b.pp_last = &b.pending;
+    b.pkts = malloc( i_max * sizeof (*b.pkts) );
+    b.dates = malloc( i_max * sizeof (*b.dates) );
+    b.iov = malloc( i_max * sizeof (*b.iov) );
+    b.msgs = calloc( i_max, sizeof (*b.msgs) );
+#ifdef HAVE_TXTIME
+    b.cmsgs = calloc( i_max, TXTIME_CMSG_SIZE );
+#endif
+    b.count = 0;
+    b.date_last = -1;
+    b.sent_last = -1;
+    b.planned_last = -1;
+    b.dropped = 0;
+    vlc_cleanup_push( ReleaseBatch, &b );
+
+    if( unlikely(b.pkts == NULL || b.dates == NULL || b.iov == NULL
+              || b.msgs == NULL) )
+        goto error;
+#ifdef HAVE_TXTIME
+    if( unlikely(b.cmsgs == NULL) )
+        goto error;
+#endif
+
+    for( unsigned i = 0; i < i_max; i++ )
+    {
+        struct msghdr *hdr = MSG_HDR(&b.msgs[i]);
+
+        hdr->msg_iov = &b.iov[i];
+        hdr->msg_iovlen = 1;
+#ifdef HAVE_TXTIME
+        if( p_sys->b_txtime )
+        {
+            struct cmsghdr *cmsg;
+
+            hdr->msg_control = b.cmsgs + i * TXTIME_CMSG_SIZE;
+            hdr->msg_controllen = TXTIME_CMSG_SIZE;
+            cmsg = CMSG_FIRSTHDR( hdr );
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_TXTIME;
+            cmsg->cmsg_len = CMSG_LEN( sizeof (uint64_t) );
+        }
+#endif
+    }
+
+    for (;;)
+    {
+        block_fifo_t *p_fifo = p_sys->p_fifo;
+        block_t *p_chain;
+
+        /* Take everything queued so far, with a single lock */
+        vlc_fifo_Lock( p_fifo );
+        if( b.pending == NULL )
+        {
+            vlc_fifo_CleanupPush( p_fifo );
+            while( vlc_fifo_IsEmpty( p_fifo ) )
+                vlc_fifo_Wait( p_fifo );
+            vlc_cleanup_pop();
+        }
+        p_chain = vlc_fifo_DequeueAllUnlocked( p_fifo );
+        vlc_fifo_Unlock( p_fifo );
+        if( p_chain != NULL )
+            block_ChainLastAppend( &b.pp_last, p_chain );
+
+        DropHoles( p_access, &b );
+        if( b.pending == NULL )
+            continue;
+
+        /* Wait for the first packet, then take all those due within the
+         * pacer slack, or handed early to the kernel */
+        mwait( p_sys->i_caching + b.pending->i_dts - i_ahead );
+
+        const mtime_t i_deadline = mdate() + i_ahead;
+        while( b.pending != NULL && b.count < i_max )
+        {
+            block_t *p_pk = b.pending;
+            mtime_t i_date = p_sys->i_caching + p_pk->i_dts;
+
+            if( b.count > 0 && (i_date > i_deadline
+                             || i_date - b.date_last > 2000000) )
+                break;
+            if( b.date_last > 0 && i_date - b.date_last < -1000
+             && !b.dropped )
+                msg_Dbg( p_access, "mmh, packets in the past (%"PRId64")",
+                         b.date_last - i_date );
+
+            b.pending = p_pk->p_next;
+            p_pk->p_next = NULL;
+
+            b.pkts[b.count] = p_pk;
+            b.dates[b.count] = i_date;
+            b.iov[b.count].iov_base = p_pk->p_buffer;
+            b.iov[b.count].iov_len = p_pk->i_buffer;
+            b.count++;
+            b.date_last = i_date;
+        }
+        if( b.pending == NULL )
+            b.pp_last = &b.pending;
+
+#ifdef HAVE_TXTIME
+        if( p_sys->b_txtime )
+        {
+            const mtime_t i_submit = mdate();
+
+            for( unsigned i = 0; i < b.count; i++ )
+            {
+                /* A departure time in the past is dropped by etf */
+                uint64_t txtime = __MAX( b.dates[i], i_submit ) * INT64_C(1000);
+                memcpy( CMSG_DATA( CMSG_FIRSTHDR( MSG_HDR(&b.msgs[i]) ) ),
+                        &txtime, sizeof (txtime) );
+            }
+        }
+#endif
+
+        int canc = vlc_savecancel();
+#ifdef HAVE_SENDMMSG
+        for( unsigned i = 0; i < b.count; )
+        {
+            int val = sendmmsg( p_sys->i_handle, b.msgs + i, b.count - i, 0 );
+
+            if( val > 0 )
+                i += val;
+            else
+            {   /* Skip the failing datagram */
+                if( errno != EINTR )
+                {
+                    msg_Warn( p_access, "send error: %s",
+                              vlc_strerror_c(errno) );
+                    i++;
+                }
+            }
+        }
+#else
+        for( unsigned i = 0; i < b.count; i++ )
+            if( sendmsg( p_sys->i_handle, MSG_HDR(&b.msgs[i]), 0 ) == -1 )
+                msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+#endif
+        vlc_restorecancel( canc );
+
+        if( b.dropped )
+        {
+            msg_Dbg( p_access, "dropped %u packets", b.dropped );
+            b.dropped = 0;
+        }
+
+        /* Departure: when sendmmsg() returned. With SO_TXTIME, the packets
+         * leave later, at a time the kernel does not report: no jitter. */
+        mtime_t i_sent = mdate();
+        if( !p_sys->b_txtime )
+        {
+            for( unsigned i = 0; i < b.count; i++ )
+            {
+                if( b.sent_last >= 0 )
+                    CountJitter( p_sys, (i_sent - b.sent_last)
+                                      - (b.dates[i] - b.planned_last) );
+                b.sent_last = i_sent;
+                b.planned_last = b.dates[i];
+            }
+            if( i_sent > p_sys->i_jitter_date + 10 * CLOCK_FREQ )
+            {
+                ReportJitter( p_access );
+                p_sys->i_jitter_date = i_sent;
+            }
+        }
+        if ( i_sent > b.dates[0] + 20000 )
+            msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
+                     i_sent - b.dates[0] );
+
+        /* Give the whole batch back at once */
+        p_chain = NULL;
+        for( unsigned i = b.count; i-- > 0; )
+        {
+            b.pkts[i]->p_next = p_chain;
+            p_chain = b.pkts[i];
+        }
+        b.count = 0;
+        RecyclePackets( p_sys, p_chain );
+    }
+error:
+    msg_Err( p_access, "cannot allocate batch of %u packets", i_max );
+    vlc_cleanup_pop();
+    ReleaseBatch( &b );
+    return NULL;
+}
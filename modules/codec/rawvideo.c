@@ -54,6 +54,7 @@ struct decoder_sys_t
  * Local prototypes
  ****************************************************************************/
 static int  OpenDecoder   ( vlc_object_t * );
+static int  OpenV210Decoder( vlc_object_t * );
 static int  OpenPacketizer( vlc_object_t * );
 static void CloseCommon   ( vlc_object_t * );
 
@@ -67,6 +68,14 @@ vlc_module_begin ()
     set_subcategory( SUBCAT_INPUT_VCODEC )
     set_callbacks( OpenDecoder, CloseCommon )
 
+    /* Only when requested (--codec=v210), so that v210 reaches the DeckLink
+     * video output without being unpacked; libavcodec is used otherwise */
+    add_submodule ()
+    set_description( N_("v210 raw video decoder") )
+    set_capability( "decoder", 0 )
+    set_callbacks( OpenV210Decoder, CloseCommon )
+    add_shortcut( "v210" )
+
     add_submodule ()
     set_description( N_("Pseudo raw video packetizer") )
     set_capability( "packetizer", 100 )
@@ -117,6 +126,8 @@ static int OpenCommon( decoder_t *p_dec )
     {
         unsigned pitch = p_dec->fmt_in.video.i_width * dsc->pixel_size
                          * dsc->p[i].w.num / dsc->p[i].w.den;
+        if( p_dec->fmt_in.i_codec == VLC_CODEC_V210 )
+            pitch = ( p_dec->fmt_in.video.i_width + 47 ) / 48 * 128;
         unsigned lines = p_dec->fmt_in.video.i_height
                          * dsc->p[i].h.num / dsc->p[i].h.den;
 
@@ -202,10 +213,16 @@ static void FillPicture( decoder_t *p_dec, block_t *p_block, picture_t *p_pic )
     for( int i = 0; i < p_pic->i_planes; i++ )
     {
         uint8_t *p_dst = p_pic->p[i].p_pixels;
+        size_t i_visible_pitch = p_pic->p[i].i_visible_pitch;
+
+        /* v210 is made of 16 bytes blocks of 6 pixels */
+        if( p_dec->fmt_in.i_codec == VLC_CODEC_V210 )
+            i_visible_pitch = ( p_pic->format.i_x_offset
+                              + p_pic->format.i_visible_width + 5 ) / 6 * 16;
 
         for( int x = 0; x < p_pic->p[i].i_visible_lines; x++ )
         {
-            memcpy( p_dst, p_src, p_pic->p[i].i_visible_pitch );
+            memcpy( p_dst, p_src, i_visible_pitch );
             p_src += p_sys->pitches[i];
             p_dst += p_pic->p[i].i_pitch;
         }
@@ -271,6 +288,16 @@ static int OpenDecoder( vlc_object_t *p_this )
     return ret;
 }
 
+static int OpenV210Decoder( vlc_object_t *p_this )
+{
+    decoder_t *p_dec = (decoder_t *)p_this;
+
+    if( p_dec->fmt_in.i_codec != VLC_CODEC_V210 )
+        return VLC_EGENERIC;
+
+    return OpenDecoder( p_this );
+}
+
 /*****************************************************************************
  * SendFrame: send a video frame to the stream output.
  *****************************************************************************/
@@ -34,6 +34,7 @@
 #include <vlc_plugin.h>
 #include <vlc_access.h>    /* DVB-specific things */
 #include <vlc_demux.h>
+#include <vlc_input.h>     /* input_GetItem() */
 
 #include "ts_pid.h"
 #include "ts_streams.h"
@@ -44,6 +45,8 @@
 
 #include "ts_hotfixes.h"
 #include "ts_sl.h"
+#include "ts_workers.h"
+#include "ts_monitor.h"
 #include "sections.h"
 #include "pes.h"
 #include "timestamps.h"
@@ -112,6 +115,17 @@ static void Close ( vlc_object_t * );
 #define PCR_TEXT N_("Trust in-stream PCR")
 #define PCR_LONGTEXT N_("Use the stream PCR as a reference.")
 
+#define WORKERS_TEXT N_("Program worker threads")
+#define WORKERS_LONGTEXT N_( \
+    "Gather and output the streams of the programs on that many threads, " \
+    "each program always on the same one. This helps demuxing all the " \
+    "programs of a full multiplex. 0 keeps everything on the input thread." )
+
+#define MONITOR_TEXT N_("Measure TR 101 290 errors")
+#define MONITOR_LONGTEXT N_( \
+    "Count the priority 1 and 2 errors of ETSI TR 101 290 and the bitrate " \
+    "of every PID, and show them in the media information." )
+
 static const char *const ts_standards_list[] =
     { "auto", "mpeg", "dvb", "arib", "atsc", "tdmb" };
 static const char *const ts_standards_list_text[] =
@@ -146,6 +160,9 @@ vlc_module_begin ()
 
     add_bool( "ts-split-es", true, SPLIT_ES_TEXT, SPLIT_ES_LONGTEXT, false )
     add_bool( "ts-seek-percent", false, SEEK_PERCENT_TEXT, SEEK_PERCENT_LONGTEXT, true )
+    add_integer_with_range( "ts-workers", 0, 0, 64, WORKERS_TEXT,
+                            WORKERS_LONGTEXT, true )
+    add_bool( "ts-monitor", true, MONITOR_TEXT, MONITOR_LONGTEXT, true )
 
     add_obsolete_bool( "ts-silent" );
 
@@ -167,21 +184,29 @@ static bool PIDReferencedByProgram( const ts_pmt_t *, uint16_t );
 void UpdatePESFilters( demux_t *p_demux, bool b_all );
 static inline void FlushESBuffer( ts_pes_t *p_pes );
 static void UpdatePIDScrambledState( demux_t *p_demux, ts_pid_t *p_pid, bool );
-static inline int PIDGet( block_t *p )
+static inline int PIDGet( const uint8_t *p )
 {
-    return ( (p->p_buffer[1]&0x1f)<<8 )|p->p_buffer[2];
+    return ( (p[1]&0x1f)<<8 )|p[2];
 }
-static mtime_t GetPCR( const block_t * );
+static mtime_t GetPCR( const uint8_t * );
 
-static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt );
-static bool GatherPESData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk, size_t, bool );
+static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, uint8_t *p_pkt );
+static bool GatherPESData( demux_t *p_demux, ts_pid_t *pid, const uint8_t *,
+                           size_t, bool, uint32_t );
 static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_prg, mtime_t i_pcr );
 
-static block_t* ReadTSPacket( demux_t *p_demux );
+static uint8_t *ReadTSPacket( demux_t *p_demux );
+static int SeekTS( demux_sys_t *p_sys, uint64_t i_pos );
+static uint64_t TellTS( demux_sys_t *p_sys );
 static int SeekToTime( demux_t *p_demux, const ts_pmt_t *, int64_t time );
 static void ReadyQueuesPostSeek( demux_t *p_demux );
 static void PCRHandle( demux_t *p_demux, ts_pid_t *, mtime_t );
 static void PCRFixHandle( demux_t *, ts_pmt_t *, block_t * );
+static void PCRFixApply( demux_t *, ts_pmt_t * );
+static void PCRCheckDTS( demux_t *p_demux, ts_pmt_t *p_pmt, mtime_t i_pcr);
+static void ProgramPCR( demux_t *, ts_pmt_t *, ts_pid_t *, mtime_t );
+static void ProcessWorkerItem( demux_t *, ts_worker_item_t * );
+static void UpdateWorkerGroups( demux_t * );
 
 #define TS_PACKET_SIZE_188 188
 #define TS_PACKET_SIZE_192 192
@@ -189,6 +214,11 @@ static void PCRFixHandle( demux_t *, ts_pmt_t *, block_t * );
 #define TS_PACKET_SIZE_MAX 204
 #define TS_HEADER_SIZE 4
 
+/* Packets read at once from the stream */
+#define TS_CHUNK_PACKETS 128
+/* Packets read per Demux() call when programs are handed to workers */
+#define TS_WORKERS_READ 500
+
 static int DetectPacketSize( demux_t *p_demux, unsigned *pi_header_size, int i_offset )
 {
     const uint8_t *p_peek;
@@ -383,6 +413,10 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_packet_size = i_packet_size;
     p_sys->i_packet_header_size = i_packet_header_size;
     p_sys->i_ts_read = 50;
+    p_sys->chunk.i_size = TS_CHUNK_PACKETS * i_packet_size;
+    p_sys->chunk.p_buffer = malloc( p_sys->chunk.i_size );
+    p_sys->chunk.i_offset = 0;
+    p_sys->chunk.i_length = 0;
     p_sys->csa = NULL;
     p_sys->b_start_record = false;
 
@@ -392,9 +426,10 @@ static int Open( vlc_object_t *p_this )
 
     /* Init PAT handler */
     patpid = GetPID(p_sys, 0);
-    if ( !PIDSetup( p_demux, TYPE_PAT, patpid, NULL ) )
+    if ( !p_sys->chunk.p_buffer || !PIDSetup( p_demux, TYPE_PAT, patpid, NULL ) )
     {
         vlc_mutex_destroy( &p_sys->csa_lock );
+        free( p_sys->chunk.p_buffer );
         free( p_sys );
         return VLC_ENOMEM;
     }
@@ -402,6 +437,7 @@ static int Open( vlc_object_t *p_this )
     {
         PIDRelease( p_demux, patpid );
         vlc_mutex_destroy( &p_sys->csa_lock );
+        free( p_sys->chunk.p_buffer );
         free( p_sys );
         return VLC_EGENERIC;
     }
@@ -517,6 +553,22 @@ static int Open( vlc_object_t *p_this )
     else
         p_sys->es_creation = ( p_sys->b_access_control ? CREATE_ES : DELAY_ES );
 
+    unsigned i_workers = var_InheritInteger( p_demux, "ts-workers" );
+    if( i_workers > 0 )
+    {
+        p_sys->p_workers = ts_workers_New( p_demux, i_workers,
+                                           ProcessWorkerItem );
+        if( p_sys->p_workers )
+        {
+            msg_Dbg( p_demux, "gathering programs on %u threads", i_workers );
+            p_sys->i_ts_read = TS_WORKERS_READ;
+            UpdateWorkerGroups( p_demux ); /* user PMT */
+        }
+    }
+
+    if( var_InheritBool( p_demux, "ts-monitor" ) )
+        p_sys->p_monitor = ts_monitor_New();
+
     return VLC_SUCCESS;
 }
 
@@ -528,6 +580,11 @@ static void Close( vlc_object_t *p_this )
     demux_t     *p_demux = (demux_t*)p_this;
     demux_sys_t *p_sys = p_demux->p_sys;
 
+    if( p_sys->p_workers )
+        ts_workers_Delete( p_sys->p_workers );
+    if( p_sys->p_monitor )
+        ts_monitor_Delete( p_sys->p_monitor );
+
     PIDRelease( p_demux, GetPID(p_sys, 0) );
 
     vlc_mutex_lock( &p_sys->csa_lock );
@@ -557,6 +614,7 @@ static void Close( vlc_object_t *p_this )
     /* Release all non default pids */
     ts_pid_list_Release( p_demux, &p_sys->pids );
 
+    free( p_sys->chunk.p_buffer );
     free( p_sys );
 }
 
@@ -590,9 +648,29 @@ static int Demux( demux_t *p_demux )
     demux_sys_t *p_sys = p_demux->p_sys;
     bool b_wait_es = p_sys->i_pmt_es <= 0;
 
+    /* Apply the changes the workers asked for */
+    if( p_sys->p_workers && ts_workers_SyncRequested( p_sys->p_workers ) )
+    {
+        ts_workers_Drain( p_sys->p_workers );
+        ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
+        bool b_filters = false;
+        for( int i = 0; i < p_pat->programs.i_size; i++ )
+        {
+            ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
+            if( p_pmt->pcr.b_fix_pending )
+                PCRFixApply( p_demux, p_pmt );
+            b_filters |= p_pmt->b_filters_pending;
+            p_pmt->b_filters_pending = false;
+        }
+        if( b_filters )
+            UpdatePESFilters( p_demux, p_sys->b_es_all );
+    }
+
     /* If we had no PAT within MIN_PAT_INTERVAL, create PAT/PMT from probed streams */
     if( p_sys->i_pmt_es == 0 && !SEEN(GetPID(p_sys, 0)) && p_sys->patfix.status == PAT_MISSING )
     {
+        if( p_sys->p_workers )
+            ts_workers_Drain( p_sys->p_workers );
         MissingPATPMTFixup( p_demux );
         p_sys->patfix.status = PAT_FIXTRIED;
     }
@@ -601,9 +679,11 @@ static int Demux( demux_t *p_demux )
     for( unsigned i_pkt = 0; i_pkt < p_sys->i_ts_read; i_pkt++ )
     {
         bool         b_frame = false;
-        block_t     *p_pkt;
+        uint8_t     *p_pkt;
         if( !(p_pkt = ReadTSPacket( p_demux )) )
         {
+            if( p_sys->p_workers )
+                ts_workers_Flush( p_sys->p_workers );
             return VLC_DEMUXER_EOF;
         }
 
@@ -618,10 +698,18 @@ static int Demux( demux_t *p_demux )
         /* Parse the TS packet */
         ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p_pkt ) );
 
-        if( (p_pkt->p_buffer[1] & 0x40) && (p_pkt->p_buffer[3] & 0x10) &&
-            !SCRAMBLED(*p_pid) != !(p_pkt->p_buffer[3] & 0x80) )
+        if( p_sys->p_monitor )
+            ts_monitor_Packet( p_sys->p_monitor, p_pkt,
+                               p_pid->type == TYPE_PMT ? TS_MONITOR_PID_PMT :
+                               p_pid->type == TYPE_PES ? TS_MONITOR_PID_PES :
+                                                         TS_MONITOR_PID_OTHER );
+
+        if( (p_pkt[1] & 0x40) && (p_pkt[3] & 0x10) &&
+            !SCRAMBLED(*p_pid) != !(p_pkt[3] & 0x80) )
         {
-            UpdatePIDScrambledState( p_demux, p_pid, p_pkt->p_buffer[3] & 0x80 );
+            if( p_sys->p_workers )
+                ts_workers_Drain( p_sys->p_workers );
+            UpdatePIDScrambledState( p_demux, p_pid, p_pkt[3] & 0x80 );
         }
 
         if( !SEEN(p_pid) )
@@ -639,27 +727,23 @@ static int Demux( demux_t *p_demux )
             PCRHandle( p_demux, p_pid, i_pcr );
 
         if ( SCRAMBLED(*p_pid) && !p_demux->p_sys->csa && p_sys->b_valid_scrambling )
-        {
-            block_Release( p_pkt );
             continue;
-        }
 
         /* Probe streams to build PAT/PMT after MIN_PAT_INTERVAL in case we don't see any PAT */
         if( !SEEN( GetPID( p_sys, 0 ) ) &&
             (p_pid->probed.i_type == 0 || p_pid->i_pid == p_sys->patfix.i_timesourcepid) &&
-            (p_pkt->p_buffer[1] & 0xC0) == 0x40 && /* Payload start but not corrupt */
-            (p_pkt->p_buffer[3] & 0xD0) == 0x10 )  /* Has payload but is not encrypted */
+            (p_pkt[1] & 0xC0) == 0x40 && /* Payload start but not corrupt */
+            (p_pkt[3] & 0xD0) == 0x10 )  /* Has payload but is not encrypted */
         {
-            ProbePES( p_demux, p_pid, p_pkt->p_buffer + TS_HEADER_SIZE,
-                      p_pkt->i_buffer - TS_HEADER_SIZE, p_pkt->p_buffer[3] & 0x20 /* Adaptation field */);
+            ProbePES( p_demux, p_pid, p_pkt + TS_HEADER_SIZE,
+                      TS_PACKET_SIZE_188 - TS_HEADER_SIZE, p_pkt[3] & 0x20 /* Adaptation field */);
         }
 
         switch( p_pid->type )
         {
         case TYPE_PAT:
         case TYPE_PMT:
-            ts_psi_Packet_Push( p_pid, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_psi_Packet_Push( p_pid, p_pkt );
             break;
 
         case TYPE_PES:
@@ -668,6 +752,8 @@ static int Demux( demux_t *p_demux )
             if( p_sys->es_creation == DELAY_ES ) /* No longer delay ES since that pid's program sends data */
             {
                 msg_Dbg( p_demux, "Creating delayed ES" );
+                if( p_sys->p_workers )
+                    ts_workers_Drain( p_sys->p_workers );
                 AddAndCreateES( p_demux, p_pid, true );
             }
 
@@ -675,27 +761,37 @@ static int Demux( demux_t *p_demux )
             if( !p_sys->b_access_control && !(p_pid->i_flags & FLAG_FILTERED) )
             {
                 /* That packet is for an unselected ES, don't waste time/memory gathering its data */
-                block_Release( p_pkt );
                 continue;
             }
 
+            if( p_sys->p_workers && p_pid->u.p_pes->p_es->p_program )
+            {
+                ts_worker_item_t *p_item =
+                    ts_workers_Item( p_sys->p_workers,
+                                     p_pid->u.p_pes->p_es->p_program->i_worker );
+                if( likely(p_item != NULL) )
+                {
+                    p_item->p_pid = p_pid;
+                    p_item->p_pmt = NULL;
+                    memcpy( p_item->p_packet, p_pkt, TS_PACKET_SIZE_188 );
+                }
+                break;
+            }
+
             b_frame = ProcessTSPacket( p_demux, p_pid, p_pkt );
             break;
 
         case TYPE_SI:
-            ts_si_Packet_Push( p_pid, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_si_Packet_Push( p_pid, p_pkt );
             break;
 
         case TYPE_PSIP:
-            ts_psip_Packet_Push( p_pid, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_psip_Packet_Push( p_pid, p_pkt );
             break;
 
         case TYPE_CAT:
         default:
             /* We have to handle PCR if present */
-            block_Release( p_pkt );
             break;
         }
 
@@ -703,6 +799,13 @@ static int Demux( demux_t *p_demux )
             break;
     }
 
+    if( p_sys->p_workers )
+        ts_workers_Flush( p_sys->p_workers );
+
+    if( p_sys->p_monitor && p_demux->p_input )
+        ts_monitor_Export( p_sys->p_monitor, input_GetItem( p_demux->p_input ),
+                           mdate() );
+
     demux_UpdateTitleFromStream( p_demux );
     return VLC_DEMUXER_SUCCESS;
 }
@@ -744,11 +847,86 @@ static inline void HasSelectedES( es_out_t *out, const ts_pes_es_t *p_es,
     }
 }
 
+/* Union-find over the programs of the PAT */
+static int FindWorkerGroup( int *pi_group, int i )
+{
+    while( pi_group[i] != i )
+        i = pi_group[i] = pi_group[pi_group[i]];
+    return i;
+}
+
+static void LinkWorkerGroup( int *pi_group, int *pi_owner, int i_pid, int i )
+{
+    if( pi_owner[i_pid] < 0 )
+    {
+        pi_owner[i_pid] = i;
+        return;
+    }
+
+    int a = FindWorkerGroup( pi_group, pi_owner[i_pid] );
+    int b = FindWorkerGroup( pi_group, i );
+    if( a < b )
+        pi_group[b] = a;
+    else
+        pi_group[a] = b;
+}
+
+/* Programs sharing a PID, as ES or PCR, are gathered by the same worker: the
+ * packets of the PID and the PCRs of all those programs then stay in order,
+ * and only that worker touches their state. Runs on the reader thread, with
+ * the workers drained. */
+static void UpdateWorkerGroups( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
+    const int i_count = p_pat->programs.i_size;
+    int *pi_group = malloc( i_count * sizeof (*pi_group) );
+    int *pi_owner = malloc( 8192 * sizeof (*pi_owner) );
+
+    if( unlikely(pi_group == NULL || pi_owner == NULL) )
+    {
+        /* Everything on one worker is slower, but still in order */
+        for( int i = 0; i < i_count; i++ )
+            p_pat->programs.p_elems[i]->u.p_pmt->i_worker = 0;
+        free( pi_group );
+        free( pi_owner );
+        return;
+    }
+
+    for( int i = 0; i < 8192; i++ )
+        pi_owner[i] = -1;
+    for( int i = 0; i < i_count; i++ )
+    {
+        const ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
+
+        pi_group[i] = i;
+        for( int j = 0; j < p_pmt->e_streams.i_size; j++ )
+            LinkWorkerGroup( pi_group, pi_owner,
+                             p_pmt->e_streams.p_elems[j]->i_pid, i );
+        if( p_pmt->i_pid_pcr != 0x1FFF )
+            LinkWorkerGroup( pi_group, pi_owner, p_pmt->i_pid_pcr, i );
+    }
+
+    for( int i = 0; i < i_count; i++ )
+    {
+        const int i_group = FindWorkerGroup( pi_group, i );
+        p_pat->programs.p_elems[i]->u.p_pmt->i_worker =
+            p_pat->programs.p_elems[i_group]->u.p_pmt->i_number;
+    }
+
+    free( pi_group );
+    free( pi_owner );
+}
+
 void UpdatePESFilters( demux_t *p_demux, bool b_all )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
     ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
 
+    /* The programs may have new PIDs */
+    if( p_sys->p_workers )
+        UpdateWorkerGroups( p_demux );
+
     /* We need 3 pass to avoid loss on deselect/relesect with hw filters and
        because pid could be shared and its state altered by another unselected pmt
        First clear flag on every referenced pid
@@ -836,6 +1014,9 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     const ts_pmt_t *p_pmt = NULL;
     const ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
 
+    if( p_sys->p_workers )
+        ts_workers_Drain( p_sys->p_workers );
+
     for( int i=0; i<p_pat->programs.i_size && !p_pmt; i++ )
     {
         if( p_pat->programs.p_elems[i]->u.p_pmt->b_selected )
@@ -880,7 +1061,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         if( (i64 = stream_Size( p_sys->stream) ) > 0 )
         {
-            int64_t offset = vlc_stream_Tell( p_sys->stream );
+            int64_t offset = TellTS( p_sys );
             *pf = (double)offset / (double)i64;
             return VLC_SUCCESS;
         }
@@ -926,7 +1107,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         i64 = stream_Size( p_sys->stream );
         if( i64 > 0 &&
-            vlc_stream_Seek( p_sys->stream, (int64_t)(i64 * f) ) == VLC_SUCCESS )
+            SeekTS( p_sys, (int64_t)(i64 * f) ) == VLC_SUCCESS )
         {
             ReadyQueuesPostSeek( p_demux );
             return VLC_SUCCESS;
@@ -1057,9 +1238,12 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     }
 
     case DEMUX_SET_TITLE:
+        /* The stream moves: drop what was read ahead, as SeekTS() does */
+        p_sys->chunk.i_offset = p_sys->chunk.i_length = 0;
         return vlc_stream_vaControl( p_sys->stream, STREAM_SET_TITLE, args );
 
     case DEMUX_SET_SEEKPOINT:
+        p_sys->chunk.i_offset = p_sys->chunk.i_length = 0;
         return vlc_stream_vaControl( p_sys->stream, STREAM_SET_SEEKPOINT,
                                      args );
 
@@ -1573,35 +1757,120 @@ static void ParsePESDataChain( demux_t *p_demux, ts_pid_t *pid )
     if(!p_datachain)
         return;
 
-    /* remove the pes from pid */
+    /* remove the pes from pid, and size the next unbounded one alike */
     pid->u.p_pes->p_data = NULL;
+    if( pid->u.p_pes->i_data_size == 0 )
+        pid->u.p_pes->i_data_alloc = pid->u.p_pes->i_data_gathered;
     pid->u.p_pes->i_data_size = 0;
     pid->u.p_pes->i_data_gathered = 0;
-    pid->u.p_pes->pp_last = &pid->u.p_pes->p_data;
 
     ParsePES( p_demux, pid, p_datachain );
 }
 
-static block_t* ReadTSPacket( demux_t *p_demux )
+/* Makes at least i_want bytes available from the chunk read offset, moving
+ * the remainder of the previous read to the front of the buffer. Returns the
+ * number of bytes available, less than i_want only at end of stream. */
+static size_t FillChunk( demux_t *p_demux, size_t i_want )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
+    uint8_t *p_buffer = p_sys->chunk.p_buffer;
+    size_t i_length = p_sys->chunk.i_length - p_sys->chunk.i_offset;
 
-    block_t     *p_pkt;
+    assert( i_want <= p_sys->chunk.i_size );
+    if( i_length >= i_want )
+        return i_length;
 
-    /* Get a new TS packet */
-    if( !( p_pkt = vlc_stream_Block( p_sys->stream, p_sys->i_packet_size ) ) )
+    memmove( p_buffer, &p_buffer[p_sys->chunk.i_offset], i_length );
+    p_sys->chunk.i_offset = 0;
+
+    while( i_length < i_want )
     {
-        int64_t size = stream_Size( p_sys->stream );
-        if( size >= 0 && (uint64_t)size == vlc_stream_Tell( p_sys->stream ) )
-            msg_Dbg( p_demux, "EOF at %"PRId64, vlc_stream_Tell( p_sys->stream ) );
-        else
-            msg_Dbg( p_demux, "Can't read TS packet at %"PRId64, vlc_stream_Tell(p_sys->stream) );
-        return NULL;
+        ssize_t i_read = vlc_stream_ReadPartial( p_sys->stream,
+                                                 &p_buffer[i_length],
+                                                 p_sys->chunk.i_size - i_length );
+        if( i_read == 0 )
+            break;
+        if( i_read > 0 ) /* else retry, as vlc_stream_Read() does */
+            i_length += i_read;
+    }
+    p_sys->chunk.i_length = i_length;
+    return i_length;
+}
+
+static int SeekTS( demux_sys_t *p_sys, uint64_t i_pos )
+{
+    p_sys->chunk.i_offset = p_sys->chunk.i_length = 0;
+    return vlc_stream_Seek( p_sys->stream, i_pos );
+}
+
+/* Position of the next packet, not of the stream which is read ahead */
+static uint64_t TellTS( demux_sys_t *p_sys )
+{
+    return vlc_stream_Tell( p_sys->stream )
+         - ( p_sys->chunk.i_length - p_sys->chunk.i_offset );
+}
+
+/* Skips to the next pair of sync bytes one packet apart. The candidates are
+ * looked up with memchr(), which the C library vectorises. */
+static bool ResyncTS( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const size_t i_packet_size = p_sys->i_packet_size;
+    const size_t i_header = p_sys->i_packet_header_size;
+    uint64_t i_skipped = 0;
+
+    for( ;; )
+    {
+        size_t i_peek = FillChunk( p_demux, i_packet_size * 10 );
+        if( i_peek < i_packet_size + i_header + 1 )
+        {
+            msg_Dbg( p_demux, "eof ?" );
+            return false;
+        }
+
+        const uint8_t *p_peek = &p_sys->chunk.p_buffer[p_sys->chunk.i_offset];
+        const size_t i_end = i_peek - i_packet_size - i_header;
+        size_t i_skip = 0;
+
+        while( i_skip < i_end )
+        {
+            const uint8_t *p_sync = memchr( &p_peek[i_skip + i_header], 0x47,
+                                            i_end - i_skip );
+            if( p_sync == NULL )
+            {
+                i_skip = i_end;
+                break;
+            }
+            i_skip = p_sync - p_peek - i_header;
+            if( p_sync[i_packet_size] == 0x47 )
+                break;
+            i_skip++;
+        }
+
+        p_sys->chunk.i_offset += i_skip;
+        i_skipped += i_skip;
+        if( i_skip < i_end )
+            break;
     }
+    msg_Dbg( p_demux, "skipping %"PRIu64" bytes of garbage", i_skipped );
+    return true;
+}
 
-    if( p_pkt->i_buffer < TS_HEADER_SIZE + p_sys->i_packet_header_size )
+/* Returns the next packet, past its header (BluRay streams), in the chunk
+ * buffer. It is valid and can be modified until the next read or seek. */
+static uint8_t *ReadTSPacket( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    uint8_t *p_pkt;
+
+    /* Get a new TS packet */
+    if( FillChunk( p_demux, p_sys->i_packet_size ) < p_sys->i_packet_size )
     {
-        block_Release( p_pkt );
+        int64_t size = stream_Size( p_sys->stream );
+        if( size >= 0 && (uint64_t)size == TellTS( p_sys ) )
+            msg_Dbg( p_demux, "EOF at %"PRIu64, TellTS( p_sys ) );
+        else
+            msg_Dbg( p_demux, "Can't read TS packet at %"PRIu64, TellTS( p_sys ) );
         return NULL;
     }
 
@@ -1609,63 +1878,38 @@ static block_t* ReadTSPacket( demux_t *p_demux )
      * re-sync logic would do this (by adjusting packet start), but this would result in losing first and last ts packets.
      * First packet is usually PAT, and losing it means losing whole first GOP. This is fatal with still-image based menus.
      */
-    p_pkt->p_buffer += p_sys->i_packet_header_size;
-    p_pkt->i_buffer -= p_sys->i_packet_header_size;
+    p_pkt = &p_sys->chunk.p_buffer[p_sys->chunk.i_offset]
+          + p_sys->i_packet_header_size;
 
     /* Check sync byte and re-sync if needed */
-    if( p_pkt->p_buffer[0] != 0x47 )
+    if( p_pkt[0] != 0x47 )
     {
         msg_Warn( p_demux, "lost synchro" );
-        block_Release( p_pkt );
-        for( ;; )
-        {
-            const uint8_t *p_peek;
-            int i_peek = 0;
-            unsigned i_skip = 0;
-
-            i_peek = vlc_stream_Peek( p_sys->stream, &p_peek,
-                    p_sys->i_packet_size * 10 );
-            if( i_peek < 0 || (unsigned)i_peek < p_sys->i_packet_size + 1 )
-            {
-                msg_Dbg( p_demux, "eof ?" );
-                return NULL;
-            }
-
-            while( i_skip < i_peek - p_sys->i_packet_size )
-            {
-                if( p_peek[i_skip + p_sys->i_packet_header_size] == 0x47 &&
-                        p_peek[i_skip + p_sys->i_packet_header_size + p_sys->i_packet_size] == 0x47 )
-                {
-                    break;
-                }
-                i_skip++;
-            }
-            msg_Dbg( p_demux, "skipping %d bytes of garbage", i_skip );
-            if (vlc_stream_Read( p_sys->stream, NULL, i_skip ) != i_skip)
-                return NULL;
-
-            if( i_skip < i_peek - p_sys->i_packet_size )
-            {
-                break;
-            }
-        }
-        if( !( p_pkt = vlc_stream_Block( p_sys->stream, p_sys->i_packet_size ) ) )
+        const uint64_t i_lost = TellTS( p_sys );
+        p_sys->chunk.i_offset++;
+        if( !ResyncTS( p_demux ) )
+            return NULL;
+        if( p_sys->p_monitor )
+            ts_monitor_SyncError( p_sys->p_monitor,
+                                  TellTS( p_sys ) - i_lost >= p_sys->i_packet_size );
+        if( FillChunk( p_demux, p_sys->i_packet_size ) < p_sys->i_packet_size )
         {
             msg_Dbg( p_demux, "eof ?" );
             return NULL;
         }
+        p_pkt = &p_sys->chunk.p_buffer[p_sys->chunk.i_offset]
+              + p_sys->i_packet_header_size;
     }
+
+    p_sys->chunk.i_offset += p_sys->i_packet_size;
     return p_pkt;
 }
 
-static mtime_t GetPCR( const block_t *p_pkt )
+static mtime_t GetPCR( const uint8_t *p )
 {
-    const uint8_t *p = p_pkt->p_buffer;
-
     mtime_t i_pcr = -1;
 
-    if( likely(p_pkt->i_buffer > 11) &&
-        ( p[3]&0x20 ) && /* adaptation */
+    if( ( p[3]&0x20 ) && /* adaptation */
         ( p[5]&0x10 ) &&
         ( p[4] >= 7 ) )
     {
@@ -1712,9 +1956,8 @@ static inline void FlushESBuffer( ts_pes_t *p_pes )
     if( p_pes->p_data )
     {
         p_pes->i_data_gathered = p_pes->i_data_size = 0;
-        block_ChainRelease( p_pes->p_data );
+        block_Release( p_pes->p_data );
         p_pes->p_data = NULL;
-        p_pes->pp_last = &p_pes->p_data;
     }
 
     if( p_pes->sl.p_data )
@@ -1776,12 +2019,12 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
 
     /* Deal with common but worst binary search case */
     if( p_pmt->pcr.i_first == i_scaledtime && p_sys->b_canseek )
-        return vlc_stream_Seek( p_sys->stream, 0 );
+        return SeekTS( p_sys, 0 );
 
     if( !p_sys->b_canfastseek )
         return VLC_EGENERIC;
 
-    int64_t i_initial_pos = vlc_stream_Tell( p_sys->stream );
+    int64_t i_initial_pos = TellTS( p_sys );
 
     /* Find the time position by using binary search algorithm. */
     int64_t i_head_pos = 0;
@@ -1797,46 +2040,43 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
         int64_t i_div = i_splitpos % p_sys->i_packet_size;
         i_splitpos -= i_div;
 
-        if ( vlc_stream_Seek( p_sys->stream, i_splitpos ) != VLC_SUCCESS )
+        if ( SeekTS( p_sys, i_splitpos ) != VLC_SUCCESS )
             break;
 
         int64_t i_pos = i_splitpos;
         while( i_pos > -1 && i_pos < i_tail_pos )
         {
             int64_t i_pcr = -1;
-            block_t *p_pkt = ReadTSPacket( p_demux );
+            const uint8_t *p_pkt = ReadTSPacket( p_demux );
             if( !p_pkt )
             {
                 i_head_pos = i_tail_pos;
                 break;
             }
             else
-                i_pos = vlc_stream_Tell( p_sys->stream );
+                i_pos = TellTS( p_sys );
 
             int i_pid = PIDGet( p_pkt );
             ts_pid_t *p_pid = GetPID(p_sys, i_pid);
             if( i_pid != 0x1FFF && p_pid->type == TYPE_PES &&
                 ts_pes_Find_es( p_pid->u.p_pes, p_pmt ) &&
-               (p_pkt->p_buffer[1] & 0xC0) == 0x40 && /* Payload start but not corrupt */
-               (p_pkt->p_buffer[3] & 0xD0) == 0x10    /* Has payload but is not encrypted */
+               (p_pkt[1] & 0xC0) == 0x40 && /* Payload start but not corrupt */
+               (p_pkt[3] & 0xD0) == 0x10    /* Has payload but is not encrypted */
             )
             {
                 unsigned i_skip = 4;
-                if ( p_pkt->p_buffer[3] & 0x20 ) // adaptation field
+                if ( p_pkt[3] & 0x20 ) // adaptation field
                 {
-                    if( p_pkt->i_buffer >= 4 + 2 + 5 )
-                    {
-                        i_pcr = GetPCR( p_pkt );
-                        i_skip += 1 + p_pkt->p_buffer[4];
-                    }
+                    i_pcr = GetPCR( p_pkt );
+                    i_skip += 1 + p_pkt[4];
                 }
                 else
                 {
                     mtime_t i_dts = -1;
                     mtime_t i_pts = -1;
                     uint8_t i_stream_id;
-                    if ( VLC_SUCCESS == ParsePESHeader( VLC_OBJECT(p_demux), &p_pkt->p_buffer[i_skip],
-                                                        p_pkt->i_buffer - i_skip, &i_skip,
+                    if ( VLC_SUCCESS == ParsePESHeader( VLC_OBJECT(p_demux), &p_pkt[i_skip],
+                                                        TS_PACKET_SIZE_188 - i_skip, &i_skip,
                                                         &i_dts, &i_pts, &i_stream_id, NULL ) )
                     {
                         if( i_dts > -1 )
@@ -1844,7 +2084,6 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
                     }
                 }
             }
-            block_Release( p_pkt );
 
             if( i_pcr != -1 )
             {
@@ -1866,7 +2105,7 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
     if( !b_found )
     {
         msg_Dbg( p_demux, "Seek():cannot find a time position." );
-        vlc_stream_Seek( p_sys->stream, i_initial_pos );
+        SeekTS( p_sys, i_initial_pos );
         return VLC_EGENERIC;
     }
     return VLC_SUCCESS;
@@ -1878,7 +2117,7 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
 {
     demux_sys_t *p_sys = p_demux->p_sys;
     int i_count = 0;
-    block_t *p_pkt = NULL;
+    const uint8_t *p_pkt = NULL;
 
     for( ;; )
     {
@@ -1894,17 +2133,17 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
 
         p_pid->i_flags |= FLAG_SEEN;
 
-        if( i_pid != 0x1FFF && (p_pkt->p_buffer[1] & 0x80) == 0 ) /* not corrupt */
+        if( i_pid != 0x1FFF && (p_pkt[1] & 0x80) == 0 ) /* not corrupt */
         {
             bool b_pcrresult = true;
-            bool b_adaptfield = p_pkt->p_buffer[3] & 0x20;
+            bool b_adaptfield = p_pkt[3] & 0x20;
 
-            if( b_adaptfield && p_pkt->i_buffer >= 4 + 2 + 5 )
+            if( b_adaptfield )
                 *pi_pcr = GetPCR( p_pkt );
 
             if( *pi_pcr == -1 &&
-                (p_pkt->p_buffer[1] & 0xC0) == 0x40 && /* payload start */
-                (p_pkt->p_buffer[3] & 0xD0) == 0x10 && /* Has payload but is not encrypted */
+                (p_pkt[1] & 0xC0) == 0x40 && /* payload start */
+                (p_pkt[3] & 0xD0) == 0x10 && /* Has payload but is not encrypted */
                 p_pid->type == TYPE_PES &&
                 p_pid->u.p_pes->p_es->fmt.i_cat != UNKNOWN_ES
               )
@@ -1915,10 +2154,10 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
                 uint8_t i_stream_id;
                 unsigned i_skip = 4;
                 if ( b_adaptfield ) // adaptation field
-                    i_skip += 1 + p_pkt->p_buffer[4];
+                    i_skip += 1 + p_pkt[4];
 
-                if ( VLC_SUCCESS == ParsePESHeader( VLC_OBJECT(p_demux), &p_pkt->p_buffer[i_skip],
-                                                    p_pkt->i_buffer - i_skip, &i_skip,
+                if ( VLC_SUCCESS == ParsePESHeader( VLC_OBJECT(p_demux), &p_pkt[i_skip],
+                                                    TS_PACKET_SIZE_188 - i_skip, &i_skip,
                                                     &i_dts, &i_pts, &i_stream_id, NULL ) )
                 {
                     if( i_dts != -1 )
@@ -1959,8 +2198,6 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
                 }
             }
         }
-
-        block_Release( p_pkt );
     }
 
     return i_count;
@@ -1969,7 +2206,7 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
 int ProbeStart( demux_t *p_demux, int i_program )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    const int64_t i_initial_pos = vlc_stream_Tell( p_sys->stream );
+    const int64_t i_initial_pos = TellTS( p_sys );
     int64_t i_stream_size = stream_Size( p_sys->stream );
 
     int i_probe_count = 0;
@@ -1982,7 +2219,7 @@ int ProbeStart( demux_t *p_demux, int i_program )
         i_pos = p_sys->i_packet_size * i_probe_count;
         i_pos = __MIN( i_pos, i_stream_size );
 
-        if( vlc_stream_Seek( p_sys->stream, i_pos ) )
+        if( SeekTS( p_sys, i_pos ) )
             return VLC_EGENERIC;
 
         ProbeChunk( p_demux, i_program, false, &i_pcr, &b_found );
@@ -1991,7 +2228,7 @@ int ProbeStart( demux_t *p_demux, int i_program )
         i_probe_count += PROBE_CHUNK_COUNT;
     } while( i_pos > 0 && (i_pcr == -1 || !b_found) && i_probe_count < (2 * PROBE_CHUNK_COUNT) );
 
-    if( vlc_stream_Seek( p_sys->stream, i_initial_pos ) )
+    if( SeekTS( p_sys, i_initial_pos ) )
         return VLC_EGENERIC;
 
     return (b_found) ? VLC_SUCCESS : VLC_EGENERIC;
@@ -2000,7 +2237,7 @@ int ProbeStart( demux_t *p_demux, int i_program )
 int ProbeEnd( demux_t *p_demux, int i_program )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    const int64_t i_initial_pos = vlc_stream_Tell( p_sys->stream );
+    const int64_t i_initial_pos = TellTS( p_sys );
     int64_t i_stream_size = stream_Size( p_sys->stream );
 
     int i_probe_count = PROBE_CHUNK_COUNT;
@@ -2013,7 +2250,7 @@ int ProbeEnd( demux_t *p_demux, int i_program )
         i_pos = i_stream_size - (p_sys->i_packet_size * i_probe_count);
         i_pos = __MAX( i_pos, 0 );
 
-        if( vlc_stream_Seek( p_sys->stream, i_pos ) )
+        if( SeekTS( p_sys, i_pos ) )
             return VLC_EGENERIC;
 
         ProbeChunk( p_demux, i_program, true, &i_pcr, &b_found );
@@ -2022,7 +2259,7 @@ int ProbeEnd( demux_t *p_demux, int i_program )
         i_probe_count += PROBE_CHUNK_COUNT;
     } while( i_pos > 0 && (i_pcr == -1 || !b_found) && i_probe_count < (6 * PROBE_CHUNK_COUNT) );
 
-    if( vlc_stream_Seek( p_sys->stream, i_initial_pos ) )
+    if( SeekTS( p_sys, i_initial_pos ) )
         return VLC_EGENERIC;
 
     return (b_found) ? VLC_SUCCESS : VLC_EGENERIC;
@@ -2031,6 +2268,7 @@ int ProbeEnd( demux_t *p_demux, int i_program )
 static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_pmt, mtime_t i_pcr )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
+    ts_pmt_t *p_self = p_pmt;
 
     /* Check if we have enqueued blocks waiting the/before the
        PCR barrier, and then adapt pcr so they have valid PCR when dequeuing */
@@ -2042,6 +2280,9 @@ static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_pmt, mtime_t i_pcr )
         for( int i=0; i< p_pat->programs.i_size; i++ )
         {
             ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
+            /* gathered by another worker */
+            if( p_sys->p_workers && p_pmt->i_worker != p_self->i_worker )
+                continue;
             for( int j=0; j<p_pmt->e_streams.i_size; j++ )
             {
                 ts_pid_t *p_pid = p_pmt->e_streams.p_elems[j];
@@ -2076,24 +2317,15 @@ static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_pmt, mtime_t i_pcr )
 
 static int IsVideoEnd( ts_pid_t *p_pid )
 {
-    /* jump to near end of PES packet */
-    block_t *p = p_pid->u.p_pes->p_data;
-    if( !p || !p->p_next )
-        return 0;
-    while( p->p_next->p_next )
-        p = p->p_next;
-    if( p->p_next->i_buffer > 4)
-        p = p->p_next;
-
-    /* extract last bytes */
-    uint8_t tail[ 188 ];
-    const int i_tail = block_ChainExtract( p, tail, sizeof( tail ) );
-    if( i_tail < 4 )
+    /* jump to end of PES packet, once more than a packet was gathered */
+    const block_t *p = p_pid->u.p_pes->p_data;
+    if( !p || p->i_buffer <= TS_PACKET_SIZE_188 - TS_HEADER_SIZE )
         return 0;
+    const uint8_t *tail = &p->p_buffer[p->i_buffer - 4];
 
     /* check for start code at end */
-    return ( tail[ i_tail - 4 ] == 0 && tail[ i_tail - 3 ] == 0 && tail[ i_tail - 2 ] == 1 &&
-             ( tail[ i_tail - 1 ] == 0xb7 ||  tail[ i_tail - 1 ] == 0x0a ) );
+    return ( tail[ 0 ] == 0 && tail[ 1 ] == 0 && tail[ 2 ] == 1 &&
+             ( tail[ 3 ] == 0xb7 ||  tail[ 3 ] == 0x0a ) );
 }
 
 static void PCRCheckDTS( demux_t *p_demux, ts_pmt_t *p_pmt, mtime_t i_pcr)
@@ -2174,28 +2406,55 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, mtime_t i_pcr )
     for( int i = 0; i < p_pat->programs.i_size; i++ )
     {
         ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
-        mtime_t i_program_pcr = TimeStampWrapAround( p_pmt->pcr.i_first, i_pcr );
 
         if( p_pmt->i_pid_pcr == 0x1FFF ) /* That program has no dedicated PCR pid ISO/IEC 13818-1 2.4.4.9 */
         {
-            if( PIDReferencedByProgram( p_pmt, pid->i_pid ) ) /* PCR shall be on pid itself */
-            {
-                /* ? update PCR for the whole group program ? */
-                ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
-            }
+            if( !PIDReferencedByProgram( p_pmt, pid->i_pid ) ) /* PCR shall be on pid itself */
+                continue;
         }
-        else /* set PCR provided by current pid to program(s) referencing it */
+        /* set PCR provided by current pid to program(s) referencing it */
+        /* Can be dedicated PCR pid (no owned then) or another pid (owner == pmt) */
+        else if( p_pmt->i_pid_pcr != pid->i_pid )
+            continue;
+
+        if( p_sys->p_workers )
         {
-            /* Can be dedicated PCR pid (no owned then) or another pid (owner == pmt) */
-            if( p_pmt->i_pid_pcr == pid->i_pid ) /* If that program references current pid as PCR */
+            /* Keep the PCR in order with the program packets */
+            ts_worker_item_t *p_item = ts_workers_Item( p_sys->p_workers,
+                                                        p_pmt->i_worker );
+            if( likely(p_item != NULL) )
             {
-                /* We've found a target group for update */
-                PCRCheckDTS( p_demux, p_pmt, i_pcr );
-                ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
+                p_item->p_pid = pid;
+                p_item->p_pmt = p_pmt;
+                p_item->i_pcr = i_pcr;
             }
         }
+        else
+            ProgramPCR( p_demux, p_pmt, pid, i_pcr );
+    }
+}
 
+/* Sets the PCR of a program, once all the packets before it were gathered */
+static void ProgramPCR( demux_t *p_demux, ts_pmt_t *p_pmt, ts_pid_t *pid,
+                        mtime_t i_pcr )
+{
+    mtime_t i_program_pcr = TimeStampWrapAround( p_pmt->pcr.i_first, i_pcr );
+
+    if( p_pmt->i_pid_pcr == pid->i_pid ) /* If that program references current pid as PCR */
+    {
+        /* We've found a target group for update */
+        PCRCheckDTS( p_demux, p_pmt, i_pcr );
     }
+    /* ? update PCR for the whole group program ? */
+    ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
+}
+
+static void ProcessWorkerItem( demux_t *p_demux, ts_worker_item_t *p_item )
+{
+    if( p_item->p_pmt )
+        ProgramPCR( p_demux, p_item->p_pmt, p_item->p_pid, p_item->i_pcr );
+    else
+        ProcessTSPacket( p_demux, p_item->p_pid, p_item->p_packet );
 }
 
 int FindPCRCandidate( ts_pmt_t *p_pmt )
@@ -2251,24 +2510,37 @@ static void PCRFixHandle( demux_t *p_demux, ts_pmt_t *p_pmt, block_t *p_block )
     }
     else if( p_block->i_dts - p_pmt->pcr.i_first_dts > CLOCK_FREQ / 2 ) /* "PCR repeat rate shall not exceed 100ms" */
     {
-        if( p_pmt->pcr.i_current < 0 &&
-            GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count == 0 )
+        demux_sys_t *p_sys = p_demux->p_sys;
+        if( !p_sys->p_workers )
+            PCRFixApply( p_demux, p_pmt );
+        else if( !p_pmt->pcr.b_fix_pending )
         {
-            int i_cand = FindPCRCandidate( p_pmt );
-            p_pmt->i_pid_pcr = i_cand;
-            if ( GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count == 0 )
-                p_pmt->pcr.b_disable = true;
-            msg_Warn( p_demux, "No PCR received for program %d, set up workaround using pid %d",
-                      p_pmt->i_number, i_cand );
-            UpdatePESFilters( p_demux, p_demux->p_sys->b_es_all );
+            /* PID lookups and filters belong to the reader */
+            p_pmt->pcr.b_fix_pending = true;
+            ts_workers_RequestSync( p_sys->p_workers );
         }
-        p_pmt->pcr.b_fix_done = true;
     }
 }
 
-static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt )
+static void PCRFixApply( demux_t *p_demux, ts_pmt_t *p_pmt )
+{
+    if( p_pmt->pcr.i_current < 0 &&
+        GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count == 0 )
+    {
+        int i_cand = FindPCRCandidate( p_pmt );
+        p_pmt->i_pid_pcr = i_cand;
+        if ( GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count == 0 )
+            p_pmt->pcr.b_disable = true;
+        msg_Warn( p_demux, "No PCR received for program %d, set up workaround using pid %d",
+                  p_pmt->i_number, i_cand );
+        UpdatePESFilters( p_demux, p_demux->p_sys->b_es_all );
+    }
+    p_pmt->pcr.b_fix_pending = false;
+    p_pmt->pcr.b_fix_done = true;
+}
+
+static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, uint8_t *p )
 {
-    const uint8_t *p = p_pkt->p_buffer;
     const bool b_unit_start = p[1]&0x40;
     const bool b_adaptation = p[3]&0x20;
     const bool b_payload    = p[3]&0x10;
@@ -2278,6 +2550,7 @@ static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt )
     /* transport_scrambling_control is ignored */
     int         i_skip = 0;
     bool        i_ret  = false;
+    uint32_t    i_flags = 0;
 
 #if 0
     msg_Dbg( p_demux, "pid=%d unit_start=%d adaptation=%d payload=%d "
@@ -2287,7 +2560,6 @@ static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt )
 
     /* For now, ignore additional error correction
      * TODO: handle Reed-Solomon 204,188 error correction */
-    p_pkt->i_buffer = TS_PACKET_SIZE_188;
 
     if( p[1]&0x80 )
     {
@@ -2302,12 +2574,12 @@ static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt )
         if( p_demux->p_sys->csa )
         {
             vlc_mutex_lock( &p_demux->p_sys->csa_lock );
-            csa_Decrypt( p_demux->p_sys->csa, p_pkt->p_buffer, p_demux->p_sys->i_csa_pkt_size );
+            csa_Decrypt( p_demux->p_sys->csa, p, p_demux->p_sys->i_csa_pkt_size );
             vlc_mutex_unlock( &p_demux->p_sys->csa_lock );
         }
         else if( p_demux->p_sys->b_valid_scrambling )
         {
-            p_pkt->i_flags |= BLOCK_FLAG_SCRAMBLED;
+            i_flags |= BLOCK_FLAG_SCRAMBLED;
         }
     }
 
@@ -2375,83 +2647,100 @@ static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt )
     }
 
     if( i_skip >= 188 )
-    {
-        block_Release( p_pkt );
         return i_ret;
-    }
 
     if( pid->u.p_pes->transport == TS_TRANSPORT_PES )
     {
-        return GatherPESData( p_demux, pid, p_pkt, i_skip, b_unit_start );
+        return GatherPESData( p_demux, pid, &p[i_skip],
+                              TS_PACKET_SIZE_188 - i_skip, b_unit_start,
+                              i_flags );
     }
     else if( pid->u.p_pes->transport == TS_TRANSPORT_SECTIONS &&
-            !(p_pkt->i_flags & BLOCK_FLAG_SCRAMBLED) )
+            !(i_flags & BLOCK_FLAG_SCRAMBLED) )
     {
-        ts_sections_processor_Push( pid->u.p_pes->p_sections_proc, p_pkt );
+        ts_sections_processor_Push( pid->u.p_pes->p_sections_proc, p );
         return VLC_DEMUXER_SUCCESS;
     }
     else // pid->u.p_pes->transport == TS_TRANSPORT_IGNORE
     {
-        block_Release( p_pkt );
         return VLC_DEMUXER_SUCCESS;
     }
 }
 
-static bool GatherPESData( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt,
-                           size_t i_skip, bool b_unit_start )
+/* Appends a packet payload to the PES being gathered, growing its single
+ * block geometrically rather than chaining one block per packet. */
+static block_t *AppendPESData( block_t *p_data, const uint8_t *p_payload,
+                               size_t i_payload )
 {
-    bool i_ret = false;
+    const size_t i_buffer = p_data->i_buffer;
 
-    /* We have to gather it */
-    p_pkt->p_buffer += i_skip;
-    p_pkt->i_buffer -= i_skip;
+    if( &p_data->p_buffer[i_buffer + i_payload] > &p_data->p_start[p_data->i_size] )
+    {
+        p_data = block_Realloc( p_data, 0, __MAX(2 * i_buffer, i_buffer + i_payload) );
+        if( unlikely(p_data == NULL) )
+            return NULL;
+        p_data->i_buffer = i_buffer;
+    }
+    memcpy( &p_data->p_buffer[i_buffer], p_payload, i_payload );
+    p_data->i_buffer += i_payload;
+    return p_data;
+}
+
+static bool GatherPESData( demux_t *p_demux, ts_pid_t *pid,
+                           const uint8_t *p_payload, size_t i_payload,
+                           bool b_unit_start, uint32_t i_flags )
+{
+    ts_pes_t *p_pes = pid->u.p_pes;
+    bool i_ret = false;
 
     if( b_unit_start )
     {
-        if( pid->u.p_pes->p_data )
+        if( p_pes->p_data )
         {
             ParsePESDataChain( p_demux, pid );
             i_ret = true;
         }
 
-        block_ChainLastAppend( &pid->u.p_pes->pp_last, p_pkt );
-
-        if( p_pkt->i_buffer > 6 )
+        if( i_payload > 6 )
         {
-            pid->u.p_pes->i_data_size = GetWBE( &p_pkt->p_buffer[4] );
-            if( pid->u.p_pes->i_data_size > 0 )
+            p_pes->i_data_size = GetWBE( &p_payload[4] );
+            if( p_pes->i_data_size > 0 )
             {
-                pid->u.p_pes->i_data_size += 6;
+                p_pes->i_data_size += 6;
             }
         }
 
-        pid->u.p_pes->i_data_gathered += p_pkt->i_buffer;
-        if( pid->u.p_pes->i_data_size > 0 &&
-            pid->u.p_pes->i_data_gathered >= pid->u.p_pes->i_data_size )
+        /* Allocate once for the whole PES when its size is known */
+        size_t i_alloc = p_pes->i_data_size > 0 ? (size_t)p_pes->i_data_size
+                                                : p_pes->i_data_alloc;
+        p_pes->p_data = block_Alloc( __MAX(i_alloc, i_payload) );
+        if( unlikely(p_pes->p_data == NULL) )
         {
-            ParsePESDataChain( p_demux, pid );
-            i_ret = true;
+            p_pes->i_data_size = 0;
+            return i_ret;
         }
+        p_pes->p_data->i_buffer = 0;
+        p_pes->p_data->i_flags = i_flags;
     }
-    else
+    else if( p_pes->p_data == NULL )
     {
-        if( pid->u.p_pes->p_data == NULL )
-        {
-            /* msg_Dbg( p_demux, "broken packet" ); */
-            block_Release( p_pkt );
-        }
-        else
-        {
-            block_ChainLastAppend( &pid->u.p_pes->pp_last, p_pkt );
-            pid->u.p_pes->i_data_gathered += p_pkt->i_buffer;
+        /* msg_Dbg( p_demux, "broken packet" ); */
+        return i_ret;
+    }
 
-            if( pid->u.p_pes->i_data_size > 0 &&
-                pid->u.p_pes->i_data_gathered >= pid->u.p_pes->i_data_size )
-            {
-                ParsePESDataChain( p_demux, pid );
-                i_ret = true;
-            }
-        }
+    p_pes->p_data = AppendPESData( p_pes->p_data, p_payload, i_payload );
+    if( unlikely(p_pes->p_data == NULL) )
+    {
+        p_pes->i_data_size = p_pes->i_data_gathered = 0;
+        return i_ret;
+    }
+    p_pes->i_data_gathered += i_payload;
+
+    if( p_pes->i_data_size > 0 &&
+        p_pes->i_data_gathered >= p_pes->i_data_size )
+    {
+        ParsePESDataChain( p_demux, pid );
+        i_ret = true;
     }
 
     return i_ret;
@@ -24,6 +24,8 @@
     typedef struct arib_instance_t arib_instance_t;
 #endif
 typedef struct csa_t csa_t;
+typedef struct ts_workers_t ts_workers_t;
+typedef struct ts_monitor_t ts_monitor_t;
 
 #define TS_USER_PMT_NUMBER (0)
 
@@ -60,6 +62,21 @@ struct demux_sys_t
     /* how many TS packet we read at once */
     unsigned    i_ts_read;
 
+    /* Input read by large chunks, packets are parsed in place */
+    struct
+    {
+        uint8_t *p_buffer;
+        size_t   i_size;
+        size_t   i_offset; /* start of the next packet */
+        size_t   i_length; /* bytes read */
+    } chunk;
+
+    /* Per program gathering threads, or NULL */
+    ts_workers_t *p_workers;
+
+    /* TR 101 290 measurements, or NULL */
+    ts_monitor_t *p_monitor;
+
     bool        b_force_seek_per_percent;
 
     ts_standards_e standard;
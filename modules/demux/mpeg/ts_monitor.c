@@ -0,0 +1,475 @@
+/*****************************************************************************
+ * ts_monitor.c: TS Demux ETSI TR 101 290 measurements
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_input_item.h>
+
+#include "ts_monitor.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/* Intervals in 27 MHz ticks */
+#define MON_CLOCK           INT64_C(27000000)
+#define MON_PCR_WRAP        ((INT64_C(1) << 33) * 300)
+#define MON_PSI_INTERVAL    (MON_CLOCK / 2)          /* 1.3a, 1.5a */
+#define MON_PCR_INTERVAL    (MON_CLOCK * 40 / 1000)  /* 2.3a */
+#define MON_PCR_JUMP        (MON_CLOCK * 100 / 1000) /* 2.3b */
+#define MON_PCR_ACCURACY    500                      /* 2.4, ns */
+#define MON_PTS_INTERVAL    (MON_CLOCK * 700 / 1000) /* 2.5 */
+
+#define MON_PID_COUNT       8192
+#define MON_INVALID         INT64_C(-1)
+
+typedef struct
+{
+    uint64_t i_packets;
+    uint64_t i_packets_exported;
+    uint64_t i_cc_errors;
+    uint8_t  i_cc;          /* 0xff until the first packet */
+    uint8_t  i_dup;
+    bool     b_scrambled;
+    bool     b_exported;
+
+    /* PCR, at packet i_pcr_packet */
+    int64_t  i_pcr;
+    uint64_t i_pcr_packet;
+    int64_t  i_tpp;         /* ticks per packet, 1/16 units, 0 unknown */
+
+    int64_t  i_last_table;  /* PMT arrival */
+    int64_t  i_last_pts;
+    bool     b_table_late;
+    bool     b_pts_late;
+} ts_monitor_pid_t;
+
+struct ts_monitor_t
+{
+    uint64_t i_packet;
+    int      i_ref_pid;     /* clock of the measurements, -1 none yet */
+    int64_t  i_last_pat;
+    bool     b_pat_late;
+    bool     b_cat;
+    bool     b_scrambled;   /* scrambled packets since the last export */
+
+    struct
+    {
+        uint64_t sync_loss;
+        uint64_t sync_byte;
+        uint64_t pat;
+        uint64_t cc;
+        uint64_t pmt;
+        uint64_t transport;
+        uint64_t pcr_repetition;
+        uint64_t pcr_discontinuity;
+        uint64_t pcr_accuracy;
+        uint64_t pts;
+        uint64_t cat;
+    } errors;
+    int64_t  i_pcr_accuracy_max; /* ns */
+
+    mtime_t  i_last_export;
+
+    ts_monitor_pid_t pids[MON_PID_COUNT];
+};
+
+ts_monitor_t *ts_monitor_New( void )
+{
+    ts_monitor_t *p_mon = calloc( 1, sizeof(*p_mon) );
+    if( unlikely(p_mon == NULL) )
+        return NULL;
+
+    p_mon->i_ref_pid = -1;
+    p_mon->i_last_pat = MON_INVALID;
+    p_mon->i_last_export = VLC_TS_INVALID;
+    for( int i = 0; i < MON_PID_COUNT; i++ )
+    {
+        ts_monitor_pid_t *p_pid = &p_mon->pids[i];
+        p_pid->i_cc = 0xff;
+        p_pid->i_pcr = MON_INVALID;
+        p_pid->i_last_table = MON_INVALID;
+        p_pid->i_last_pts = MON_INVALID;
+    }
+    return p_mon;
+}
+
+void ts_monitor_Delete( ts_monitor_t *p_mon )
+{
+    free( p_mon );
+}
+
+void ts_monitor_SyncError( ts_monitor_t *p_mon, bool b_loss )
+{
+    p_mon->errors.sync_byte++;
+    if( b_loss )
+        p_mon->errors.sync_loss++;
+}
+
+/* Arrival time of the current packet on the reference clock */
+static int64_t MonitorNow( const ts_monitor_t *p_mon )
+{
+    if( p_mon->i_ref_pid < 0 )
+        return MON_INVALID;
+    const ts_monitor_pid_t *p_ref = &p_mon->pids[p_mon->i_ref_pid];
+    if( p_ref->i_pcr == MON_INVALID )
+        return MON_INVALID;
+    return p_ref->i_pcr + (int64_t)(p_mon->i_packet - p_ref->i_pcr_packet)
+                        * p_ref->i_tpp / 16;
+}
+
+/* Whether an event at i_now arrived too late after i_last */
+static bool MonitorLate( int64_t i_now, int64_t i_last, int64_t i_max )
+{
+    return i_now != MON_INVALID && i_last != MON_INVALID &&
+           i_now - i_last > i_max;
+}
+
+static int64_t MonitorGetPCR( const uint8_t *p )
+{
+    if( !(p[3] & 0x20) || p[4] < 7 || !(p[5] & 0x10) )
+        return MON_INVALID;
+    const int64_t i_base = ( (int64_t)p[6] << 25 ) | ( (int64_t)p[7] << 17 ) |
+                           ( (int64_t)p[8] << 9 ) | ( (int64_t)p[9] << 1 ) |
+                           ( (int64_t)p[10] >> 7 );
+    return i_base * 300 + ( ((p[10] & 0x01) << 8) | p[11] );
+}
+
+static void MonitorPCR( ts_monitor_t *p_mon, int i_pid, int64_t i_pcr,
+                        bool b_discontinuity )
+{
+    ts_monitor_pid_t *p_pid = &p_mon->pids[i_pid];
+
+    if( p_mon->i_ref_pid < 0 )
+        p_mon->i_ref_pid = i_pid;
+
+    if( p_pid->i_pcr != MON_INVALID && !b_discontinuity )
+    {
+        const int64_t i_packets = p_mon->i_packet - p_pid->i_pcr_packet;
+        int64_t i_delta = i_pcr - p_pid->i_pcr;
+        if( i_delta < -MON_PCR_WRAP / 2 )
+            i_delta += MON_PCR_WRAP;
+
+        /* 2.3a: interval of arrival, the stream rate once known */
+        const int64_t i_arrival = p_pid->i_tpp
+                                ? i_packets * p_pid->i_tpp / 16 : i_delta;
+        if( i_arrival > MON_PCR_INTERVAL )
+            p_mon->errors.pcr_repetition++;
+
+        /* 2.3b */
+        if( i_delta <= 0 || i_delta > MON_PCR_JUMP )
+        {
+            p_mon->errors.pcr_discontinuity++;
+        }
+        else if( i_packets > 0 )
+        {
+            /* 2.4: the PCR against its position in a constant rate */
+            if( p_pid->i_tpp )
+            {
+                int64_t i_ns = ( i_delta - i_packets * p_pid->i_tpp / 16 )
+                             * 1000 / 27;
+                if( i_ns < 0 )
+                    i_ns = -i_ns;
+                if( i_ns > p_mon->i_pcr_accuracy_max )
+                    p_mon->i_pcr_accuracy_max = i_ns;
+                if( i_ns > MON_PCR_ACCURACY )
+                    p_mon->errors.pcr_accuracy++;
+            }
+
+            const int64_t i_tpp = i_delta * 16 / i_packets;
+            if( p_pid->i_tpp == 0 )
+                p_pid->i_tpp = i_tpp;
+            else
+                p_pid->i_tpp += ( i_tpp - p_pid->i_tpp ) / 16;
+        }
+    }
+
+    const bool b_first_time = MonitorNow( p_mon ) == MON_INVALID;
+    p_pid->i_pcr = i_pcr;
+    p_pid->i_pcr_packet = p_mon->i_packet;
+
+    /* Start measuring the table intervals */
+    if( b_first_time && MonitorNow( p_mon ) != MON_INVALID &&
+        p_mon->i_last_pat == MON_INVALID )
+        p_mon->i_last_pat = i_pcr;
+}
+
+/* Returns the table_id starting in the payload, or -1 */
+static int MonitorTableId( const uint8_t *p_payload, int i_payload )
+{
+    if( i_payload < 2 || 1 + p_payload[0] >= i_payload )
+        return -1;
+    return p_payload[1 + p_payload[0]];
+}
+
+static void MonitorPTS( ts_monitor_t *p_mon, ts_monitor_pid_t *p_pid,
+                        const uint8_t *p, int i_payload, int64_t i_now )
+{
+    if( i_payload < 14 || p[0] != 0 || p[1] != 0 || p[2] != 1 )
+        return;
+    switch( p[3] )
+    {
+        case 0xBC: case 0xBE: case 0xBF:
+        case 0xF0: case 0xF1: case 0xF2: case 0xF8: case 0xFF:
+            return; /* no PES header */
+    }
+    if( (p[6] & 0xC0) != 0x80 || !(p[7] & 0x80) )
+        return;
+
+    if( MonitorLate( i_now, p_pid->i_last_pts, MON_PTS_INTERVAL ) )
+        p_mon->errors.pts++;
+    p_pid->i_last_pts = i_now;
+    p_pid->b_pts_late = false;
+}
+
+void ts_monitor_Packet( ts_monitor_t *p_mon, const uint8_t *p, int i_kind )
+{
+    const int i_pid = ( (p[1] & 0x1f) << 8 ) | p[2];
+    ts_monitor_pid_t *p_pid = &p_mon->pids[i_pid];
+    const bool b_tei = p[1] & 0x80;
+    const bool b_unit_start = p[1] & 0x40;
+    const bool b_adaptation = p[3] & 0x20;
+    const bool b_payload = p[3] & 0x10;
+    const int  i_cc = p[3] & 0x0f;
+    const bool b_discontinuity = b_adaptation && p[4] > 0 && (p[5] & 0x80);
+
+    p_mon->i_packet++;
+    p_pid->i_packets++;
+
+    /* 2.1 */
+    if( b_tei )
+    {
+        p_mon->errors.transport++;
+        return;
+    }
+
+    /* 1.4 */
+    if( i_pid != 0x1FFF )
+    {
+        if( p_pid->i_cc == 0xff || b_discontinuity )
+            p_pid->i_dup = 0;
+        else if( !b_payload )
+        {
+            if( i_cc != p_pid->i_cc )
+            {
+                p_mon->errors.cc++;
+                p_pid->i_cc_errors++;
+            }
+        }
+        else if( i_cc == p_pid->i_cc )
+        {
+            if( ++p_pid->i_dup > 1 )
+            {
+                p_mon->errors.cc++;
+                p_pid->i_cc_errors++;
+            }
+        }
+        else
+        {
+            if( i_cc != ( (p_pid->i_cc + 1) & 0x0f ) )
+            {
+                p_mon->errors.cc++;
+                p_pid->i_cc_errors++;
+            }
+            p_pid->i_dup = 0;
+        }
+        p_pid->i_cc = i_cc;
+    }
+
+    const int64_t i_pcr = MonitorGetPCR( p );
+    if( i_pcr != MON_INVALID )
+        MonitorPCR( p_mon, i_pid, i_pcr, b_discontinuity );
+
+    const bool b_scrambled = p[3] & 0xc0;
+    if( b_payload )
+        p_pid->b_scrambled = b_scrambled;
+    if( b_scrambled )
+        p_mon->b_scrambled = true;
+
+    if( !b_payload )
+        return;
+
+    int i_skip = 4;
+    if( b_adaptation )
+        i_skip += 1 + p[4];
+    if( i_skip >= 188 )
+        return;
+    const uint8_t *p_payload = &p[i_skip];
+    const int i_payload = 188 - i_skip;
+    const int64_t i_now = MonitorNow( p_mon );
+
+    if( i_pid == 0x00 )
+    {
+        /* 1.3 */
+        if( b_scrambled )
+            p_mon->errors.pat++;
+        else if( b_unit_start )
+        {
+            const int i_table = MonitorTableId( p_payload, i_payload );
+            if( i_table == 0x00 )
+            {
+                if( MonitorLate( i_now, p_mon->i_last_pat, MON_PSI_INTERVAL ) )
+                    p_mon->errors.pat++;
+                if( i_now != MON_INVALID )
+                    p_mon->i_last_pat = i_now;
+                p_mon->b_pat_late = false;
+            }
+            else if( i_table >= 0 && i_table != 0xff )
+                p_mon->errors.pat++;
+        }
+    }
+    else if( i_pid == 0x01 )
+    {
+        /* 2.6 */
+        if( b_unit_start && !b_scrambled )
+        {
+            const int i_table = MonitorTableId( p_payload, i_payload );
+            if( i_table == 0x01 )
+                p_mon->b_cat = true;
+            else if( i_table >= 0 && i_table != 0xff )
+                p_mon->errors.cat++;
+        }
+    }
+    else if( i_kind == TS_MONITOR_PID_PMT )
+    {
+        /* 1.5 */
+        if( b_scrambled )
+            p_mon->errors.pmt++;
+        else if( b_unit_start &&
+                 MonitorTableId( p_payload, i_payload ) == 0x02 )
+        {
+            if( MonitorLate( i_now, p_pid->i_last_table, MON_PSI_INTERVAL ) )
+                p_mon->errors.pmt++;
+            if( i_now != MON_INVALID )
+                p_pid->i_last_table = i_now;
+            p_pid->b_table_late = false;
+        }
+    }
+    else if( i_kind == TS_MONITOR_PID_PES && b_unit_start && !b_scrambled )
+    {
+        /* 2.5 */
+        MonitorPTS( p_mon, p_pid, p_payload, i_payload, i_now );
+    }
+}
+
+/* Counts once the tables or timestamps that are still missing */
+static void MonitorCheckLate( ts_monitor_t *p_mon )
+{
+    const int64_t i_now = MonitorNow( p_mon );
+
+    if( !p_mon->b_pat_late &&
+        MonitorLate( i_now, p_mon->i_last_pat, MON_PSI_INTERVAL ) )
+    {
+        p_mon->errors.pat++;
+        p_mon->b_pat_late = true;
+    }
+
+    for( int i = 0; i < MON_PID_COUNT; i++ )
+    {
+        ts_monitor_pid_t *p_pid = &p_mon->pids[i];
+        if( p_pid->i_packets == 0 )
+            continue;
+        if( !p_pid->b_table_late &&
+            MonitorLate( i_now, p_pid->i_last_table, MON_PSI_INTERVAL ) )
+        {
+            p_mon->errors.pmt++;
+            p_pid->b_table_late = true;
+        }
+        if( !p_pid->b_pts_late && !p_pid->b_scrambled &&
+            MonitorLate( i_now, p_pid->i_last_pts, MON_PTS_INTERVAL ) )
+        {
+            p_mon->errors.pts++;
+            p_pid->b_pts_late = true;
+        }
+    }
+
+    /* 2.6: scrambled packets without any CAT */
+    if( p_mon->b_scrambled && !p_mon->b_cat )
+        p_mon->errors.cat++;
+    p_mon->b_scrambled = false;
+}
+
+void ts_monitor_Export( ts_monitor_t *p_mon, input_item_t *p_item,
+                        mtime_t i_now )
+{
+    if( p_mon->i_last_export != VLC_TS_INVALID &&
+        i_now - p_mon->i_last_export < CLOCK_FREQ )
+        return;
+    p_mon->i_last_export = i_now;
+
+    MonitorCheckLate( p_mon );
+
+    const char *psz_cat = _("TR 101 290");
+
+    /* Rate of the reference clock */
+    uint64_t i_rate = 0;
+    if( p_mon->i_ref_pid >= 0 && p_mon->pids[p_mon->i_ref_pid].i_tpp > 0 )
+        i_rate = 188 * 8 * 16 * MON_CLOCK / p_mon->pids[p_mon->i_ref_pid].i_tpp;
+    if( i_rate )
+        input_item_AddInfo( p_item, psz_cat, _("Transport rate"),
+                            _("%"PRIu64" kb/s"), i_rate / 1000 );
+
+#define EXPORT(name, counter) \
+    input_item_AddInfo( p_item, psz_cat, name, "%"PRIu64, p_mon->errors.counter )
+    EXPORT( "1.1 TS_sync_loss", sync_loss );
+    EXPORT( "1.2 Sync_byte_error", sync_byte );
+    EXPORT( "1.3 PAT_error", pat );
+    EXPORT( "1.4 Continuity_count_error", cc );
+    EXPORT( "1.5 PMT_error", pmt );
+    EXPORT( "2.1 Transport_error", transport );
+    EXPORT( "2.3a PCR_repetition_error", pcr_repetition );
+    EXPORT( "2.3b PCR_discontinuity_indicator_error", pcr_discontinuity );
+    EXPORT( "2.4 PCR_accuracy_error", pcr_accuracy );
+    EXPORT( "2.5 PTS_error", pts );
+    EXPORT( "2.6 CAT_error", cat );
+#undef EXPORT
+    input_item_AddInfo( p_item, psz_cat, _("Maximum PCR inaccuracy"),
+                        _("%"PRId64" ns"), p_mon->i_pcr_accuracy_max );
+
+    /* Bitrate of each PID, as its share of the packets since the last time */
+    uint64_t i_total = 0;
+    for( int i = 0; i < MON_PID_COUNT; i++ )
+        i_total += p_mon->pids[i].i_packets - p_mon->pids[i].i_packets_exported;
+
+    for( int i = 0; i < MON_PID_COUNT; i++ )
+    {
+        ts_monitor_pid_t *p_pid = &p_mon->pids[i];
+        const uint64_t i_packets = p_pid->i_packets - p_pid->i_packets_exported;
+        p_pid->i_packets_exported = p_pid->i_packets;
+
+        char psz_name[16];
+        snprintf( psz_name, sizeof(psz_name), _("PID %d"), i );
+
+        if( i_packets == 0 )
+        {
+            if( p_pid->b_exported )
+                input_item_DelInfo( p_item, psz_cat, psz_name );
+            p_pid->b_exported = false;
+            continue;
+        }
+
+        input_item_AddInfo( p_item, psz_cat, psz_name,
+                            _("%"PRIu64" kb/s%s, %"PRIu64" CC errors"),
+                            i_rate * i_packets / i_total / 1000,
+                            p_pid->b_scrambled ? _(", scrambled") : "",
+                            p_pid->i_cc_errors );
+        p_pid->b_exported = true;
+    }
+}
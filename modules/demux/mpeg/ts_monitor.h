@@ -0,0 +1,50 @@
+/*****************************************************************************
+ * ts_monitor.h: TS Demux ETSI TR 101 290 measurements
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef VLC_TS_MONITOR_H
+#define VLC_TS_MONITOR_H
+
+/* Priority 1 and 2 error counters of ETSI TR 101 290 5.2, the bitrate and
+ * the scrambling of every PID, measured on all the packets read.
+ * Time intervals are measured on the clock of the first PCR PID,
+ * extrapolated to each packet from the rate between its PCRs, which is the
+ * arrival time of a constant bitrate multiplex. */
+typedef struct ts_monitor_t ts_monitor_t;
+
+enum
+{
+    TS_MONITOR_PID_OTHER = 0,
+    TS_MONITOR_PID_PMT,
+    TS_MONITOR_PID_PES,
+};
+
+ts_monitor_t *ts_monitor_New( void );
+void ts_monitor_Delete( ts_monitor_t * );
+
+/* Sync byte error, b_loss when more than a packet was skipped to resync */
+void ts_monitor_SyncError( ts_monitor_t *, bool b_loss );
+
+/* Measures a 188 bytes packet, i_kind is the TS_MONITOR_PID_* type of its
+ * PID as known by the demux */
+void ts_monitor_Packet( ts_monitor_t *, const uint8_t *p_pkt, int i_kind );
+
+/* Updates the "TR 101 290" information of the input item, at most once per
+ * second of i_now */
+void ts_monitor_Export( ts_monitor_t *, input_item_t *, mtime_t i_now );
+
+#endif
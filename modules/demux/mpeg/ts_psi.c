@@ -51,6 +51,7 @@
 #include "ts_scte.h"
 #include "ts_psip.h"
 #include "ts_si.h"
+#include "ts_workers.h"
 
 #include "../access/dtv/en50221_capmt.h"
 
@@ -105,6 +106,10 @@ static void PATCallBack( void *data, dvbpsi_pat_t *p_dvbpsipat )
         return;
     }
 
+    /* Programs are about to change under the workers */
+    if( p_sys->p_workers )
+        ts_workers_Drain( p_sys->p_workers );
+
     msg_Dbg( p_demux, "new PAT ts_id=%d version=%d current_next=%d",
              p_dvbpsipat->i_ts_id, p_dvbpsipat->i_version, p_dvbpsipat->b_current_next );
 
@@ -1453,6 +1458,9 @@ static void PMTCallBack( void *data, dvbpsi_pmt_t *p_dvbpsipmt )
         return;
     }
 
+    if( p_sys->p_workers )
+        ts_workers_Drain( p_sys->p_workers );
+
     /* Save old es array */
     DECL_ARRAY(ts_pid_t *) pid_to_decref;
     pid_to_decref.i_alloc = p_pmt->e_streams.i_alloc;
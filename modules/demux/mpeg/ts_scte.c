@@ -32,6 +32,8 @@
 #include "ts_pid.h"
 #include "ts_scte.h"
 #include "ts_streams_private.h"
+#include "ts.h"
+#include "ts_workers.h"
 #include "timestamps.h"
 
 #include <assert.h>
@@ -55,6 +57,10 @@ void SCTE18_Section_Callback( dvbpsi_t *p_handle, const dvbpsi_psi_section_t* p_
         if( i_priority != EAS_PRIORITY_HIGH && i_priority != EAS_PRIORITY_MAX )
             continue;
 
+        /* The program clock is kept by its worker */
+        if( p_demux->p_sys->p_workers )
+            ts_workers_Drain( p_demux->p_sys->p_workers );
+
         for( ts_pes_es_t *p_es = p_psip->p_eas_es; p_es; p_es = p_es->p_next )
         {
             if( !p_es->id && !(p_es->id = es_out_Add( p_demux->out, &p_es->fmt )) )
@@ -27,6 +27,7 @@
 #include "ts_pid.h"
 #include "ts_streams_private.h"
 #include "ts.h"
+#include "ts_workers.h"
 
 #include "ts_sl.h"
 
@@ -201,7 +202,17 @@ void SLPackets_Section_Handler( demux_t *p_demux,
         }
 
         if( b_changed )
-            UpdatePESFilters( p_demux, p_demux->p_sys->b_es_all );
+        {
+            demux_sys_t *p_sys = p_demux->p_sys;
+            if( p_sys->p_workers )
+            {
+                /* The filters of all the programs belong to the reader */
+                p_pmt->b_filters_pending = true;
+                ts_workers_RequestSync( p_sys->p_workers );
+            }
+            else
+                UpdatePESFilters( p_demux, p_sys->b_es_all );
+        }
     }
 }
 
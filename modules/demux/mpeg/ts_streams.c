@@ -116,6 +116,8 @@ ts_pmt_t *ts_pmt_New( demux_t *p_demux )
     pmt->i_number   = -1;
     pmt->i_pid_pcr  = 0x1FFF;
     pmt->b_selected = false;
+    pmt->i_worker   = 0;
+    pmt->b_filters_pending = false;
     pmt->iod        = NULL;
     pmt->od.i_version = -1;
     ARRAY_INIT( pmt->od.objects );
@@ -132,6 +134,7 @@ ts_pmt_t *ts_pmt_New( demux_t *p_demux )
     pmt->pcr.i_pcroffset = -1;
 
     pmt->pcr.b_fix_done = false;
+    pmt->pcr.b_fix_pending = false;
 
     pmt->eit.i_event_length = 0;
     pmt->eit.i_event_start = 0;
@@ -274,7 +277,7 @@ ts_pes_t *ts_pes_New( demux_t *p_demux, ts_pmt_t *p_program )
     pes->i_data_size = 0;
     pes->i_data_gathered = 0;
     pes->p_data = NULL;
-    pes->pp_last = &pes->p_data;
+    pes->i_data_alloc = 0;
     pes->b_always_receive = false;
     pes->p_sections_proc = NULL;
     pes->p_prepcr_outqueue = NULL;
@@ -289,7 +292,7 @@ void ts_pes_Del( demux_t *p_demux, ts_pes_t *pes )
     ts_pes_ChainDelete_es( p_demux, pes->p_es );
 
     if( pes->p_data )
-        block_ChainRelease( pes->p_data );
+        block_Release( pes->p_data );
 
     if( pes->p_sections_proc )
         ts_sections_processor_ChainDelete( pes->p_sections_proc );
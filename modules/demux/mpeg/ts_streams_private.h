@@ -43,6 +43,8 @@ struct ts_pmt_t
     int             i_number;
     int             i_pid_pcr;
     bool            b_selected;
+    int             i_worker; /* same for the programs sharing a PID */
+    bool            b_filters_pending; /* waiting for the reader thread */
     /* IOD stuff (mpeg4) */
     od_descriptor_t *iod;
     od_descriptors_t od;
@@ -63,6 +65,7 @@ struct ts_pmt_t
         mtime_t i_pcroffset;
         bool    b_disable; /* ignore PCR field, use dts */
         bool    b_fix_done;
+        bool    b_fix_pending; /* waiting for the reader thread */
     } pcr;
 
     struct
@@ -103,8 +106,8 @@ struct ts_pes_t
     ts_transport_type_t transport;
     int         i_data_size;
     int         i_data_gathered;
-    block_t     *p_data;
-    block_t     **pp_last;
+    block_t     *p_data; /* single block, grown as packets are gathered */
+    size_t      i_data_alloc; /* initial size of unbounded PES */
     bool        b_always_receive;
     ts_sections_processor_t *p_sections_proc;
 
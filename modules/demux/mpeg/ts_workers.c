@@ -0,0 +1,216 @@
+/*****************************************************************************
+ * ts_workers.c: TS Demux per program worker threads
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_block.h>
+#include <vlc_atomic.h>
+
+#include "ts_workers.h"
+
+#include <assert.h>
+
+/* Items per queued block */
+#define WORKER_BATCH 32
+
+typedef struct
+{
+    vlc_thread_t  thread;
+    block_fifo_t *p_fifo;
+    vlc_cond_t    idle;
+    bool          b_busy;   /* processing a dequeued batch, fifo lock */
+    block_t      *p_batch;  /* being filled by the reader */
+    demux_t      *p_demux;
+    ts_worker_callback_t pf_callback;
+} ts_worker_t;
+
+struct ts_workers_t
+{
+    atomic_bool  b_sync;
+    unsigned     i_count;
+    ts_worker_t  workers[];
+};
+
+static void *Run( void *data )
+{
+    ts_worker_t *p_worker = data;
+    block_fifo_t *p_fifo = p_worker->p_fifo;
+
+    for( ;; )
+    {
+        block_t *p_chain;
+
+        vlc_fifo_Lock( p_fifo );
+        p_worker->b_busy = false;
+        vlc_cond_broadcast( &p_worker->idle );
+        vlc_fifo_CleanupPush( p_fifo );
+        while( vlc_fifo_IsEmpty( p_fifo ) )
+            vlc_fifo_Wait( p_fifo );
+        vlc_cleanup_pop();
+        p_chain = vlc_fifo_DequeueAllUnlocked( p_fifo );
+        p_worker->b_busy = true;
+        vlc_fifo_Unlock( p_fifo );
+
+        int canc = vlc_savecancel();
+        while( p_chain != NULL )
+        {
+            block_t *p_next = p_chain->p_next;
+            ts_worker_item_t *p_items = (ts_worker_item_t *) p_chain->p_buffer;
+            size_t i_items = p_chain->i_buffer / sizeof (*p_items);
+
+            for( size_t i = 0; i < i_items; i++ )
+                p_worker->pf_callback( p_worker->p_demux, &p_items[i] );
+            block_Release( p_chain );
+            p_chain = p_next;
+        }
+        vlc_restorecancel( canc );
+    }
+    vlc_assert_unreachable();
+}
+
+ts_workers_t *ts_workers_New( demux_t *p_demux, unsigned i_count,
+                              ts_worker_callback_t pf_callback )
+{
+    ts_workers_t *p_workers = malloc( sizeof (*p_workers)
+                                    + i_count * sizeof (ts_worker_t) );
+    if( unlikely(p_workers == NULL) )
+        return NULL;
+
+    atomic_init( &p_workers->b_sync, false );
+    p_workers->i_count = 0;
+
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_workers->workers[i];
+
+        p_worker->p_fifo = block_FifoNew();
+        if( unlikely(p_worker->p_fifo == NULL) )
+            break;
+        vlc_cond_init( &p_worker->idle );
+        p_worker->b_busy = false;
+        p_worker->p_batch = NULL;
+        p_worker->p_demux = p_demux;
+        p_worker->pf_callback = pf_callback;
+
+        if( vlc_clone( &p_worker->thread, Run, p_worker,
+                       VLC_THREAD_PRIORITY_INPUT ) )
+        {
+            vlc_cond_destroy( &p_worker->idle );
+            block_FifoRelease( p_worker->p_fifo );
+            break;
+        }
+        p_workers->i_count++;
+    }
+
+    if( p_workers->i_count == 0 )
+    {
+        free( p_workers );
+        return NULL;
+    }
+    if( p_workers->i_count < i_count )
+        msg_Warn( p_demux, "only %u of %u workers started",
+                  p_workers->i_count, i_count );
+    return p_workers;
+}
+
+void ts_workers_Delete( ts_workers_t *p_workers )
+{
+    for( unsigned i = 0; i < p_workers->i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_workers->workers[i];
+
+        vlc_cancel( p_worker->thread );
+        vlc_join( p_worker->thread, NULL );
+        vlc_cond_destroy( &p_worker->idle );
+        block_FifoRelease( p_worker->p_fifo );
+        if( p_worker->p_batch )
+            block_Release( p_worker->p_batch );
+    }
+    free( p_workers );
+}
+
+ts_worker_item_t *ts_workers_Item( ts_workers_t *p_workers, unsigned i_worker )
+{
+    ts_worker_t *p_worker = &p_workers->workers[i_worker % p_workers->i_count];
+    block_t *p_batch = p_worker->p_batch;
+
+    if( p_batch != NULL
+     && p_batch->i_buffer == WORKER_BATCH * sizeof (ts_worker_item_t) )
+    {
+        block_FifoPut( p_worker->p_fifo, p_batch );
+        p_batch = p_worker->p_batch = NULL;
+    }
+
+    if( p_batch == NULL )
+    {
+        p_batch = block_Alloc( WORKER_BATCH * sizeof (ts_worker_item_t) );
+        if( unlikely(p_batch == NULL) )
+            return NULL;
+        p_batch->i_buffer = 0;
+        p_worker->p_batch = p_batch;
+    }
+
+    ts_worker_item_t *p_item =
+        (ts_worker_item_t *) &p_batch->p_buffer[p_batch->i_buffer];
+    p_batch->i_buffer += sizeof (*p_item);
+    return p_item;
+}
+
+void ts_workers_Flush( ts_workers_t *p_workers )
+{
+    for( unsigned i = 0; i < p_workers->i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_workers->workers[i];
+
+        if( p_worker->p_batch != NULL )
+        {
+            block_FifoPut( p_worker->p_fifo, p_worker->p_batch );
+            p_worker->p_batch = NULL;
+        }
+    }
+}
+
+void ts_workers_Drain( ts_workers_t *p_workers )
+{
+    ts_workers_Flush( p_workers );
+
+    for( unsigned i = 0; i < p_workers->i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_workers->workers[i];
+        block_fifo_t *p_fifo = p_worker->p_fifo;
+
+        vlc_fifo_Lock( p_fifo );
+        while( !vlc_fifo_IsEmpty( p_fifo ) || p_worker->b_busy )
+            vlc_fifo_WaitCond( p_fifo, &p_worker->idle );
+        vlc_fifo_Unlock( p_fifo );
+    }
+}
+
+void ts_workers_RequestSync( ts_workers_t *p_workers )
+{
+    atomic_store( &p_workers->b_sync, true );
+}
+
+bool ts_workers_SyncRequested( ts_workers_t *p_workers )
+{
+    return atomic_exchange( &p_workers->b_sync, false );
+}
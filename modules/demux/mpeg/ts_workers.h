@@ -0,0 +1,57 @@
+/*****************************************************************************
+ * ts_workers.h: TS Demux per program worker threads
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef VLC_TS_WORKERS_H
+#define VLC_TS_WORKERS_H
+
+#include "ts_pid_fwd.h"
+#include "ts_streams.h"
+
+/* The reader thread keeps PID filtering and PSI/SI parsing. It hands the
+ * packets of each program, and its PCR, to the worker of that program, which
+ * gathers the PES and sends them to the es_out in stream order.
+ * Structures shared with the workers (programs, PES PIDs) are only changed
+ * by the reader once the workers are drained. */
+typedef struct ts_workers_t ts_workers_t;
+
+typedef struct
+{
+    ts_pid_t *p_pid;  /* packet PID, or PCR PID */
+    ts_pmt_t *p_pmt;  /* program the PCR is for, NULL for a packet */
+    mtime_t   i_pcr;
+    uint8_t   p_packet[188];
+} ts_worker_item_t;
+
+typedef void (*ts_worker_callback_t)( demux_t *, ts_worker_item_t * );
+
+ts_workers_t *ts_workers_New( demux_t *, unsigned i_count, ts_worker_callback_t );
+void ts_workers_Delete( ts_workers_t * );
+
+/* Returns a slot to fill, queued after all the previous ones of the worker */
+ts_worker_item_t *ts_workers_Item( ts_workers_t *, unsigned i_worker );
+/* Hands the items filled so far to the workers */
+void ts_workers_Flush( ts_workers_t * );
+/* Flushes and waits until the workers are idle */
+void ts_workers_Drain( ts_workers_t * );
+
+/* Lets a worker ask the reader for a drain and a call back, for the changes
+ * it cannot do itself */
+void ts_workers_RequestSync( ts_workers_t * );
+bool ts_workers_SyncRequested( ts_workers_t * );
+
+#endif
@@ -27,6 +27,14 @@
 #endif
 
 #include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#ifdef HAVE_SSE2_INTRINSICS
+# include <emmintrin.h>
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+# include <immintrin.h>
+#endif
 
 #include "csa.h"
 
@@ -121,6 +129,18 @@ int csa_SetCW( vlc_object_t *p_caller, csa_t *c, char *psz_ck, bool set_odd )
     }
 }
 
+/*****************************************************************************
+ * csa_CopyKeys:
+ *****************************************************************************/
+void csa_CopyKeys( csa_t *dst, const csa_t *src )
+{
+    memcpy( dst->o_ck, src->o_ck, sizeof(dst->o_ck) );
+    memcpy( dst->e_ck, src->e_ck, sizeof(dst->e_ck) );
+    memcpy( dst->o_kk, src->o_kk, sizeof(dst->o_kk) );
+    memcpy( dst->e_kk, src->e_kk, sizeof(dst->e_kk) );
+    dst->use_odd = src->use_odd;
+}
+
 /*****************************************************************************
  * csa_UseKey:
  *****************************************************************************/
@@ -610,3 +630,320 @@ static void csa_BlockCypher( uint8_t kk[57], uint8_t bd[8], uint8_t ib[8] )
     }
 }
 
+/*****************************************************************************
+ * Bitsliced batch encryption
+ *****************************************************************************
+ * The stream cypher runs bitsliced on up to CSA_BS_MAX packets at once.
+ * The block cypher, with its 8 bits S-box, runs bytewise, but on all the
+ * packets round by round so that their chains overlap.
+ *****************************************************************************/
+#define CSA_BS_MAX 256
+/* Below that, the scalar code is faster */
+#define CSA_BS_MIN 4
+
+typedef struct
+{
+    int       i_count;
+    uint8_t  *pp_pkt[CSA_BS_MAX];
+    int       i_hdr[CSA_BS_MAX];
+    int       i_blocks[CSA_BS_MAX];
+    int       i_residue[CSA_BS_MAX];
+    int       i_pkt_size;
+
+    /* Block cypher registers, byte i of the block for each lane */
+    uint8_t   rows[8][CSA_BS_MAX];
+    /* Bit p of a block, for each lane */
+    uint64_t  planes[64][CSA_BS_MAX / 64] __attribute__ ((aligned (32)));
+} csa_batch_t;
+
+/* Truth tables of the output bits of sbox1..sbox7, bit i for input i */
+static const uint32_t csa_bs_sbox[7][2] =
+{
+    { 0x78C6B16C, 0x4B368771 }, { 0xE41B4B63, 0x58B98679 },
+    { 0xE41B1BE4, 0x69D25879 }, { 0x92AD994B, 0x66B492AD },
+    { 0x35E29E58, 0x9C274CF1 }, { 0x66D2E61A, 0x691BB46C },
+    { 0x266D9D92, 0xB38C691E },
+};
+
+/* 64x64 bit matrix transposition, bit j of a[i] swaps with bit i of a[j] */
+static void csa_Transpose64( uint64_t a[64] )
+{
+    uint64_t m = UINT64_C(0x00000000FFFFFFFF);
+
+    for( unsigned j = 32; j != 0; j >>= 1, m ^= m << j )
+        for( unsigned k = 0; k < 64; k = ((k | j) + 1) & ~j )
+        {
+            const uint64_t t = ( (a[k] >> j) ^ a[k | j] ) & m;
+            a[k] ^= t << j;
+            a[k | j] ^= t;
+        }
+}
+
+/* XORs the keystream block i_block, the 2nd and following ones go to the
+ * blocks 3.., after the clear first block and the second one the stream
+ * cypher was initialised with */
+static void csa_batch_Apply( csa_batch_t *p_batch, int i_block )
+{
+    for( int g = 0; g * 64 < p_batch->i_count; g++ )
+    {
+        uint64_t t[64];
+        for( int p = 0; p < 64; p++ )
+            t[p] = p_batch->planes[p][g];
+        csa_Transpose64( t );
+
+        const int i_end = __MIN( 64, p_batch->i_count - g * 64 );
+        for( int l = 0; l < i_end; l++ )
+        {
+            const int i = g * 64 + l;
+            uint8_t *pkt = p_batch->pp_pkt[i];
+
+            if( i_block + 2 <= p_batch->i_blocks[i] )
+            {
+                uint8_t *p = &pkt[p_batch->i_hdr[i] + 8 * (i_block + 1)];
+                SetQWLE( p, GetQWLE( p ) ^ t[l] );
+            }
+            else if( i_block + 2 == p_batch->i_blocks[i] + 1 )
+            {
+                const int i_residue = p_batch->i_residue[i];
+                uint8_t *p = &pkt[p_batch->i_pkt_size - i_residue];
+                for( int j = 0; j < i_residue; j++ )
+                    p[j] ^= t[l] >> (8 * j);
+            }
+        }
+    }
+}
+
+#define BS_WORD         uint64_t
+#define BS_LANES        64
+#define BS_LOAD(p)      (*(const uint64_t *)(p))
+#define BS_STORE(p, w)  (*(uint64_t *)(p) = (w))
+#define BS_AND(a, b)    ((a) & (b))
+#define BS_OR(a, b)     ((a) | (b))
+#define BS_XOR(a, b)    ((a) ^ (b))
+#define BS_ZERO         UINT64_C(0)
+#define BS_ONES         UINT64_MAX
+#define VLC_TARGET
+#define RENAME(a)       a ## _64
+#include "csa_bs_template.h"
+#undef BS_WORD
+#undef BS_LANES
+#undef BS_LOAD
+#undef BS_STORE
+#undef BS_AND
+#undef BS_OR
+#undef BS_XOR
+#undef BS_ZERO
+#undef BS_ONES
+#undef VLC_TARGET
+#undef RENAME
+
+#ifdef HAVE_SSE2_INTRINSICS
+#define BS_WORD         __m128i
+#define BS_LANES        128
+#define BS_LOAD(p)      _mm_load_si128( (const __m128i *)(p) )
+#define BS_STORE(p, w)  _mm_store_si128( (__m128i *)(p), w )
+#define BS_AND(a, b)    _mm_and_si128( a, b )
+#define BS_OR(a, b)     _mm_or_si128( a, b )
+#define BS_XOR(a, b)    _mm_xor_si128( a, b )
+#define BS_ZERO         _mm_setzero_si128()
+#define BS_ONES         _mm_set1_epi32( -1 )
+#define VLC_TARGET      __attribute__ ((__target__ ("sse2")))
+#define RENAME(a)       a ## _sse2
+#include "csa_bs_template.h"
+#undef BS_WORD
+#undef BS_LANES
+#undef BS_LOAD
+#undef BS_STORE
+#undef BS_AND
+#undef BS_OR
+#undef BS_XOR
+#undef BS_ZERO
+#undef BS_ONES
+#undef VLC_TARGET
+#undef RENAME
+#endif
+
+#ifdef HAVE_AVX2_INTRINSICS
+#define BS_WORD         __m256i
+#define BS_LANES        256
+#define BS_LOAD(p)      _mm256_load_si256( (const __m256i *)(p) )
+#define BS_STORE(p, w)  _mm256_store_si256( (__m256i *)(p), w )
+#define BS_AND(a, b)    _mm256_and_si256( a, b )
+#define BS_OR(a, b)     _mm256_or_si256( a, b )
+#define BS_XOR(a, b)    _mm256_xor_si256( a, b )
+#define BS_ZERO         _mm256_setzero_si256()
+#define BS_ONES         _mm256_set1_epi32( -1 )
+#define VLC_TARGET      __attribute__ ((__target__ ("avx2")))
+#define RENAME(a)       a ## _avx2
+#include "csa_bs_template.h"
+#undef BS_WORD
+#undef BS_LANES
+#undef BS_LOAD
+#undef BS_STORE
+#undef BS_AND
+#undef BS_OR
+#undef BS_XOR
+#undef BS_ZERO
+#undef BS_ONES
+#undef VLC_TARGET
+#undef RENAME
+#endif
+
+/* csa_BlockCypher() on the block i_block of every lane, chained with the
+ * previous output in p_batch->rows */
+static void csa_batch_BlockCypher( csa_batch_t *p_batch, const uint8_t kk[57],
+                                   int i_block )
+{
+    const int i_count = p_batch->i_count;
+    uint8_t (*rows)[CSA_BS_MAX] = p_batch->rows;
+
+    for( int l = 0; l < i_count; l++ )
+    {
+        if( i_block > p_batch->i_blocks[l] )
+            continue;
+        const uint8_t *p = &p_batch->pp_pkt[l][p_batch->i_hdr[l] + 8 * (i_block - 1)];
+        const bool b_last = i_block == p_batch->i_blocks[l];
+        for( int i = 0; i < 8; i++ )
+            rows[i][l] = b_last ? p[i] : p[i] ^ rows[i][l];
+    }
+
+    /* R[j] of csa_BlockCypher() is rows[(i - 1 + j - 1) % 8] at round i,
+     * the shifts become a rotation of the rows */
+    for( int i = 1; i <= 56; i++ )
+    {
+        uint8_t *r1 = rows[(i - 1) & 7];
+        uint8_t *r3 = rows[(i + 1) & 7];
+        uint8_t *r4 = rows[(i + 2) & 7];
+        uint8_t *r5 = rows[(i + 3) & 7];
+        uint8_t *r7 = rows[(i + 5) & 7];
+        const uint8_t *r8 = rows[(i + 6) & 7];
+        const uint8_t k = kk[i];
+
+        for( int l = 0; l < i_count; l++ )
+        {
+            const uint8_t sbox_out = block_sbox[ k ^ r8[l] ];
+            const uint8_t R1 = r1[l];
+            r3[l] ^= R1;
+            r4[l] ^= R1;
+            r5[l] ^= R1;
+            r7[l] ^= block_perm[sbox_out];
+            r1[l] = R1 ^ sbox_out;
+        }
+    }
+
+    for( int l = 0; l < i_count; l++ )
+    {
+        if( i_block > p_batch->i_blocks[l] )
+            continue;
+        uint8_t *p = &p_batch->pp_pkt[l][p_batch->i_hdr[l] + 8 * (i_block - 1)];
+        for( int i = 0; i < 8; i++ )
+            p[i] = rows[i][l];
+    }
+}
+
+typedef void (*csa_bs_cypher_t)( csa_batch_t *, const uint8_t ck[8], int );
+
+/* Encrypts up to i_lanes packets with the given stream cypher */
+static void csa_EncryptLanes( csa_t *c, uint8_t **pp_pkt, int i_count,
+                              int i_pkt_size, csa_bs_cypher_t pf_cypher )
+{
+    const uint8_t *ck = c->use_odd ? c->o_ck : c->e_ck;
+    const uint8_t *kk = c->use_odd ? c->o_kk : c->e_kk;
+    csa_batch_t batch;
+    int i_blocks = 0, i_max = 0;
+
+    batch.i_count = 0;
+    batch.i_pkt_size = i_pkt_size;
+
+    for( int i = 0; i < i_count; i++ )
+    {
+        uint8_t *pkt = pp_pkt[i];
+
+        /* set transport scrambling control */
+        pkt[3] |= c->use_odd ? 0xc0 : 0x80;
+
+        int i_hdr = 4;
+        if( pkt[3]&0x20 )
+        {
+            /* skip adaption field */
+            i_hdr += pkt[4] + 1;
+        }
+        const int n = (i_pkt_size - i_hdr) / 8;
+        if( n <= 0 )
+        {
+            pkt[3] &= 0x3f;
+            continue;
+        }
+
+        const int i_lane = batch.i_count++;
+        batch.pp_pkt[i_lane] = pkt;
+        batch.i_hdr[i_lane] = i_hdr;
+        batch.i_blocks[i_lane] = n;
+        batch.i_residue[i_lane] = (i_pkt_size - i_hdr) % 8;
+
+        /* keystream blocks after the one of the initialisation */
+        const int i_needed = n - 1 + (batch.i_residue[i_lane] > 0);
+        if( i_needed > i_blocks )
+            i_blocks = i_needed;
+        if( n > i_max )
+            i_max = n;
+    }
+    if( batch.i_count == 0 )
+        return;
+
+    /* block cypher chains, from the last block, in place */
+    for( int k = i_max; k > 0; k-- )
+        csa_batch_BlockCypher( &batch, kk, k );
+
+    /* the first block initialises the stream cypher */
+    for( int g = 0; g * 64 < batch.i_count; g++ )
+    {
+        uint64_t t[64];
+        for( int l = 0; l < 64; l++ )
+        {
+            const int i = g * 64 + l;
+            t[l] = i < batch.i_count
+                 ? GetQWLE( &batch.pp_pkt[i][batch.i_hdr[i]] ) : 0;
+        }
+        csa_Transpose64( t );
+        for( int p = 0; p < 64; p++ )
+            batch.planes[p][g] = t[p];
+    }
+
+    pf_cypher( &batch, ck, i_blocks );
+}
+
+/*****************************************************************************
+ * csa_EncryptBatch:
+ *****************************************************************************/
+void csa_EncryptBatch( csa_t *c, uint8_t **pp_pkt, int i_count, int i_pkt_size )
+{
+    while( i_count >= CSA_BS_MIN )
+    {
+        /* The narrowest words holding the packets are the fastest */
+        csa_bs_cypher_t pf_cypher = csa_bs_StreamCypher_64;
+        int i_lanes = 64;
+#ifdef HAVE_AVX2_INTRINSICS
+        if( i_count > 128 && vlc_CPU_AVX2() )
+        {
+            pf_cypher = csa_bs_StreamCypher_avx2;
+            i_lanes = 256;
+        }
+        else
+#endif
+#ifdef HAVE_SSE2_INTRINSICS
+        if( i_count > 64 && vlc_CPU_SSE2() )
+        {
+            pf_cypher = csa_bs_StreamCypher_sse2;
+            i_lanes = 128;
+        }
+#endif
+
+        const int i_batch = __MIN( i_count, i_lanes );
+        csa_EncryptLanes( c, pp_pkt, i_batch, i_pkt_size, pf_cypher );
+        pp_pkt += i_batch;
+        i_count -= i_batch;
+    }
+    for( int i = 0; i < i_count; i++ )
+        csa_Encrypt( c, pp_pkt[i], i_pkt_size );
+}
@@ -31,6 +31,8 @@ typedef struct csa_t csa_t;
 #define csa_UseKey  __csa_UseKey
 #define csa_Decrypt __csa_decrypt
 #define csa_Encrypt __csa_encrypt
+#define csa_EncryptBatch __csa_encrypt_batch
+#define csa_CopyKeys __csa_copy_keys
 
 csa_t *csa_New( void );
 void   csa_Delete( csa_t * );
@@ -41,4 +43,10 @@ int    csa_UseKey( vlc_object_t *p_caller, csa_t *, bool use_odd );
 void   csa_Decrypt( csa_t *, uint8_t *pkt, int i_pkt_size );
 void   csa_Encrypt( csa_t *, uint8_t *pkt, int i_pkt_size );
 
+/* Same as csa_Encrypt() on each packet, many packets at once */
+void   csa_EncryptBatch( csa_t *, uint8_t **pp_pkt, int i_pkt, int i_pkt_size );
+
+/* Copies the keys in use, to encrypt with them outside of a lock */
+void   csa_CopyKeys( csa_t *dst, const csa_t *src );
+
 #endif /* _CSA_H */
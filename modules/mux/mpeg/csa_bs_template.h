@@ -0,0 +1,205 @@
+/*****************************************************************************
+ * csa_bs_template.h: bitsliced CSA stream cypher
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Included by csa.c once per word size, with BS_WORD, BS_LANES, BS_LOAD,
+ * BS_STORE, BS_AND, BS_OR, BS_XOR, BS_ZERO, BS_ONES, VLC_TARGET and RENAME
+ * defined.
+ *
+ * Bit k of every register of the stream cypher is a word holding that bit
+ * for BS_LANES packets, so that each step of csa_StreamCypher() runs once
+ * for all of them. */
+
+#define BS_MASK(c)     ( (c) ? BS_ONES : BS_ZERO )
+/* s ? b : a */
+#define BS_MUX(a, b, s) BS_XOR( a, BS_AND( BS_XOR( a, b ), s ) )
+
+typedef struct
+{
+    BS_WORD A[11][4];
+    BS_WORD B[11][4];
+    BS_WORD X[4], Y[4], Z[4];
+    BS_WORD D[4], E[4], F[4];
+    BS_WORD p, q, r;
+} RENAME(csa_bs_state_t);
+
+/* 5 to 1 bit S-box from its truth table, as a tree of multiplexers on the
+ * inputs. The table is constant, so most of it folds away. */
+#define BS_SBOX_LEAF(t, i, x0) \
+    BS_XOR( BS_MASK( ((t) >> (2 * (i))) & 1 ), \
+            BS_AND( BS_MASK( (((t) >> (2 * (i))) ^ ((t) >> (2 * (i) + 1))) & 1 ), x0 ) )
+VLC_TARGET
+static inline __attribute__ ((always_inline))
+BS_WORD RENAME(csa_bs_Sbox)( const uint32_t t, BS_WORD x4, BS_WORD x3,
+                             BS_WORD x2, BS_WORD x1, BS_WORD x0 )
+{
+    const BS_WORD v0 = BS_MUX( BS_SBOX_LEAF( t, 0, x0 ), BS_SBOX_LEAF( t, 1, x0 ), x1 );
+    const BS_WORD v1 = BS_MUX( BS_SBOX_LEAF( t, 2, x0 ), BS_SBOX_LEAF( t, 3, x0 ), x1 );
+    const BS_WORD v2 = BS_MUX( BS_SBOX_LEAF( t, 4, x0 ), BS_SBOX_LEAF( t, 5, x0 ), x1 );
+    const BS_WORD v3 = BS_MUX( BS_SBOX_LEAF( t, 6, x0 ), BS_SBOX_LEAF( t, 7, x0 ), x1 );
+    const BS_WORD v4 = BS_MUX( BS_SBOX_LEAF( t, 8, x0 ), BS_SBOX_LEAF( t, 9, x0 ), x1 );
+    const BS_WORD v5 = BS_MUX( BS_SBOX_LEAF( t, 10, x0 ), BS_SBOX_LEAF( t, 11, x0 ), x1 );
+    const BS_WORD v6 = BS_MUX( BS_SBOX_LEAF( t, 12, x0 ), BS_SBOX_LEAF( t, 13, x0 ), x1 );
+    const BS_WORD v7 = BS_MUX( BS_SBOX_LEAF( t, 14, x0 ), BS_SBOX_LEAF( t, 15, x0 ), x1 );
+
+    const BS_WORD w0 = BS_MUX( BS_MUX( v0, v1, x2 ), BS_MUX( v2, v3, x2 ), x3 );
+    const BS_WORD w1 = BS_MUX( BS_MUX( v4, v5, x2 ), BS_MUX( v6, v7, x2 ), x3 );
+    return BS_MUX( w0, w1, x4 );
+}
+#undef BS_SBOX_LEAF
+
+/* One step of csa_StreamCypher(), 2 output bits. in_a and in_b are the
+ * input nibbles during initialisation, NULL otherwise. */
+VLC_TARGET
+static inline __attribute__ ((always_inline))
+void RENAME(csa_bs_Clock)( RENAME(csa_bs_state_t) *s,
+                                         const BS_WORD *in_a,
+                                         const BS_WORD *in_b,
+                                         BS_WORD *p_hi, BS_WORD *p_lo )
+{
+    BS_WORD (*A)[4] = s->A;
+    BS_WORD (*B)[4] = s->B;
+    BS_WORD s0[7], s1[7];
+
+#define SBOX(n, a, b, c, d, e) \
+    s0[n] = RENAME(csa_bs_Sbox)( csa_bs_sbox[n][0], a, b, c, d, e ); \
+    s1[n] = RENAME(csa_bs_Sbox)( csa_bs_sbox[n][1], a, b, c, d, e )
+    SBOX( 0, A[4][0], A[1][2], A[6][1], A[7][3], A[9][0] );
+    SBOX( 1, A[2][1], A[3][2], A[6][3], A[7][0], A[9][1] );
+    SBOX( 2, A[1][3], A[2][0], A[5][1], A[5][3], A[6][2] );
+    SBOX( 3, A[3][3], A[1][1], A[2][3], A[4][2], A[8][0] );
+    SBOX( 4, A[5][2], A[4][3], A[6][0], A[8][1], A[9][2] );
+    SBOX( 5, A[3][1], A[4][1], A[5][0], A[7][2], A[9][3] );
+    SBOX( 6, A[2][2], A[3][0], A[7][1], A[8][2], A[8][3] );
+#undef SBOX
+
+    BS_WORD extra_B[4];
+    extra_B[3] = BS_XOR( BS_XOR( B[3][0], B[6][1] ), BS_XOR( B[7][2], B[9][3] ) );
+    extra_B[2] = BS_XOR( BS_XOR( B[6][0], B[8][1] ), BS_XOR( B[3][3], B[4][2] ) );
+    extra_B[1] = BS_XOR( BS_XOR( B[5][3], B[8][2] ), BS_XOR( B[4][0], B[5][1] ) );
+    extra_B[0] = BS_XOR( BS_XOR( B[9][2], B[6][3] ), BS_XOR( B[3][1], B[8][0] ) );
+
+    BS_WORD next_A1[4], next_B1[4], rot[4];
+    for( int k = 0; k < 4; k++ )
+    {
+        next_A1[k] = BS_XOR( A[10][k], s->X[k] );
+        next_B1[k] = BS_XOR( BS_XOR( B[7][k], B[10][k] ), s->Y[k] );
+        if( in_a )
+        {
+            next_A1[k] = BS_XOR( next_A1[k], BS_XOR( s->D[k], in_a[k] ) );
+            next_B1[k] = BS_XOR( next_B1[k], in_b[k] );
+        }
+    }
+    /* rotate left if p */
+    for( int k = 0; k < 4; k++ )
+        rot[k] = next_B1[(k + 3) % 4];
+    for( int k = 0; k < 4; k++ )
+        next_B1[k] = BS_MUX( next_B1[k], rot[k], s->p );
+
+    for( int k = 0; k < 4; k++ )
+        s->D[k] = BS_XOR( BS_XOR( s->E[k], s->Z[k] ), extra_B[k] );
+
+    /* F = q ? Z + E + r : E, r is the carry */
+    BS_WORD carry = s->r;
+    for( int k = 0; k < 4; k++ )
+    {
+        const BS_WORD ze = BS_XOR( s->Z[k], s->E[k] );
+        const BS_WORD sum = BS_XOR( ze, carry );
+        carry = BS_OR( BS_AND( s->Z[k], s->E[k] ), BS_AND( carry, ze ) );
+
+        const BS_WORD next_E = s->F[k];
+        s->F[k] = BS_MUX( s->E[k], sum, s->q );
+        s->E[k] = next_E;
+    }
+    s->r = BS_MUX( s->r, carry, s->q );
+
+    for( int i = 10; i > 1; i-- )
+        for( int k = 0; k < 4; k++ )
+        {
+            A[i][k] = A[i-1][k];
+            B[i][k] = B[i-1][k];
+        }
+    for( int k = 0; k < 4; k++ )
+    {
+        A[1][k] = next_A1[k];
+        B[1][k] = next_B1[k];
+    }
+
+    s->X[0] = s1[0]; s->X[1] = s1[1]; s->X[2] = s0[2]; s->X[3] = s0[3];
+    s->Y[0] = s1[2]; s->Y[1] = s1[3]; s->Y[2] = s0[4]; s->Y[3] = s0[5];
+    s->Z[0] = s1[4]; s->Z[1] = s1[5]; s->Z[2] = s0[0]; s->Z[3] = s0[1];
+    s->p = s1[6];
+    s->q = s0[6];
+
+    *p_hi = BS_XOR( s->D[2], s->D[3] );
+    *p_lo = BS_XOR( s->D[0], s->D[1] );
+}
+
+/* Initialises the stream cypher of every lane with the first block in
+ * p_batch->planes, then produces i_blocks blocks of keystream into
+ * p_batch->planes, applying each one with csa_batch_Apply() */
+VLC_TARGET
+static void RENAME(csa_bs_StreamCypher)( csa_batch_t *p_batch,
+                                         const uint8_t ck[8], int i_blocks )
+{
+    RENAME(csa_bs_state_t) s;
+    memset( &s, 0, sizeof(s) ); /* all other registers are 0 */
+
+    for( int i = 0; i < 4; i++ )
+        for( int k = 0; k < 4; k++ )
+        {
+            s.A[1+2*i+0][k] = BS_MASK( (ck[i] >> (4 + k)) & 1 );
+            s.A[1+2*i+1][k] = BS_MASK( (ck[i] >> k) & 1 );
+            s.B[1+2*i+0][k] = BS_MASK( (ck[4+i] >> (4 + k)) & 1 );
+            s.B[1+2*i+1][k] = BS_MASK( (ck[4+i] >> k) & 1 );
+        }
+
+    for( int i = 0; i < 8; i++ )
+    {
+        BS_WORD in1[4], in2[4], hi, lo;
+        for( int k = 0; k < 4; k++ )
+        {
+            in1[k] = BS_LOAD( p_batch->planes[8*i + 4 + k] );
+            in2[k] = BS_LOAD( p_batch->planes[8*i + k] );
+        }
+        for( int j = 0; j < 4; j++ )
+        {
+            if( j % 2 )
+                RENAME(csa_bs_Clock)( &s, in2, in1, &hi, &lo );
+            else
+                RENAME(csa_bs_Clock)( &s, in1, in2, &hi, &lo );
+        }
+    }
+
+    for( int i_block = 0; i_block < i_blocks; i_block++ )
+    {
+        for( int i = 0; i < 8; i++ )
+            for( int j = 0; j < 4; j++ )
+            {
+                BS_WORD hi, lo;
+                RENAME(csa_bs_Clock)( &s, NULL, NULL, &hi, &lo );
+                BS_STORE( p_batch->planes[8*i + 7 - 2*j], hi );
+                BS_STORE( p_batch->planes[8*i + 6 - 2*j], lo );
+            }
+        csa_batch_Apply( p_batch, i_block );
+    }
+}
+
+#undef BS_MUX
+#undef BS_MASK
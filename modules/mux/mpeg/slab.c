@@ -0,0 +1,208 @@
+/*****************************************************************************
+ * slab.c: recycled TS packet buffers
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_atomic.h>
+
+#include "slab.h"
+
+#define SLAB_PACKET_SIZE 188
+/* Empty slabs kept for reuse */
+#define SLAB_POOL_MAX 16
+
+typedef struct
+{
+    block_t    self;
+    ts_slab_t *p_slab;
+} ts_slab_block_t;
+
+struct ts_slab_t
+{
+    ts_slab_pool_t  *p_pool;
+    atomic_uint      refs;
+    unsigned         i_used;
+    ts_slab_t       *p_next;
+    uint8_t         *p_data;
+    ts_slab_block_t  blocks[];
+};
+
+struct ts_slab_pool_t
+{
+    vlc_mutex_t lock;
+    ts_slab_t  *p_free;
+    unsigned    i_free;
+    unsigned    i_out; /* slabs not in the free list */
+    unsigned    i_packets;
+    bool        b_deleted;
+};
+
+static void PoolDestroy( ts_slab_pool_t *p_pool )
+{
+    vlc_mutex_destroy( &p_pool->lock );
+    free( p_pool );
+}
+
+ts_slab_pool_t *ts_slab_pool_New( unsigned i_packets )
+{
+    ts_slab_pool_t *p_pool = malloc( sizeof(*p_pool) );
+    if( unlikely(p_pool == NULL) )
+        return NULL;
+
+    vlc_mutex_init( &p_pool->lock );
+    p_pool->p_free = NULL;
+    p_pool->i_free = 0;
+    p_pool->i_out = 0;
+    p_pool->i_packets = i_packets;
+    p_pool->b_deleted = false;
+    return p_pool;
+}
+
+void ts_slab_pool_Delete( ts_slab_pool_t *p_pool )
+{
+    vlc_mutex_lock( &p_pool->lock );
+    while( p_pool->p_free )
+    {
+        ts_slab_t *p_slab = p_pool->p_free;
+        p_pool->p_free = p_slab->p_next;
+        free( p_slab );
+    }
+    p_pool->i_free = 0;
+    p_pool->b_deleted = true;
+
+    /* The slabs still in flight will destroy the pool */
+    bool b_destroy = p_pool->i_out == 0;
+    vlc_mutex_unlock( &p_pool->lock );
+
+    if( b_destroy )
+        PoolDestroy( p_pool );
+}
+
+ts_slab_t *ts_slab_Get( ts_slab_pool_t *p_pool )
+{
+    vlc_mutex_lock( &p_pool->lock );
+    ts_slab_t *p_slab = p_pool->p_free;
+    if( p_slab )
+    {
+        p_pool->p_free = p_slab->p_next;
+        p_pool->i_free--;
+    }
+    p_pool->i_out++;
+    vlc_mutex_unlock( &p_pool->lock );
+
+    if( p_slab == NULL )
+    {
+        const unsigned i_packets = p_pool->i_packets;
+        size_t i_header = sizeof(*p_slab) + i_packets * sizeof(ts_slab_block_t);
+        i_header = (i_header + 63) & ~(size_t)63;
+
+        p_slab = malloc( i_header + i_packets * SLAB_PACKET_SIZE );
+        if( unlikely(p_slab == NULL) )
+        {
+            vlc_mutex_lock( &p_pool->lock );
+            p_pool->i_out--;
+            vlc_mutex_unlock( &p_pool->lock );
+            return NULL;
+        }
+        p_slab->p_pool = p_pool;
+        p_slab->p_data = (uint8_t *)p_slab + i_header;
+    }
+
+    atomic_init( &p_slab->refs, 1 );
+    p_slab->i_used = 0;
+    p_slab->p_next = NULL;
+    return p_slab;
+}
+
+void ts_slab_Release( ts_slab_t *p_slab )
+{
+    if( atomic_fetch_sub( &p_slab->refs, 1 ) != 1 )
+        return;
+
+    ts_slab_pool_t *p_pool = p_slab->p_pool;
+    bool b_destroy = false;
+
+    vlc_mutex_lock( &p_pool->lock );
+    assert( p_pool->i_out > 0 );
+    p_pool->i_out--;
+    if( !p_pool->b_deleted && p_pool->i_free < SLAB_POOL_MAX )
+    {
+        p_slab->p_next = p_pool->p_free;
+        p_pool->p_free = p_slab;
+        p_pool->i_free++;
+        p_slab = NULL;
+    }
+    else
+        b_destroy = p_pool->b_deleted && p_pool->i_out == 0;
+    vlc_mutex_unlock( &p_pool->lock );
+
+    free( p_slab );
+    if( b_destroy )
+        PoolDestroy( p_pool );
+}
+
+static void SlabBlockRelease( block_t *p_block )
+{
+    ts_slab_block_t *p_sb = (ts_slab_block_t *)p_block;
+    ts_slab_Release( p_sb->p_slab );
+}
+
+block_t *ts_slab_Packet( ts_slab_t *p_slab )
+{
+    if( p_slab->i_used >= p_slab->p_pool->i_packets )
+        return NULL;
+
+    ts_slab_block_t *p_sb = &p_slab->blocks[p_slab->i_used];
+    block_Init( &p_sb->self, &p_slab->p_data[p_slab->i_used * SLAB_PACKET_SIZE],
+                SLAB_PACKET_SIZE );
+    p_sb->self.pf_release = SlabBlockRelease;
+    p_sb->p_slab = p_slab;
+    p_slab->i_used++;
+
+    atomic_fetch_add( &p_slab->refs, 1 );
+    return &p_sb->self;
+}
+
+bool ts_slab_Merge( block_t *p_run, block_t *p_next )
+{
+    if( p_run->pf_release != SlabBlockRelease ||
+        p_next->pf_release != SlabBlockRelease ||
+        &p_run->p_buffer[p_run->i_buffer] != p_next->p_buffer )
+        return false;
+
+    ts_slab_t *p_slab = ((ts_slab_block_t *)p_next)->p_slab;
+    if( ((ts_slab_block_t *)p_run)->p_slab != p_slab )
+        return false;
+
+    p_run->i_buffer += p_next->i_buffer;
+    p_run->i_size = &p_run->p_buffer[p_run->i_buffer] - p_run->p_start;
+    p_run->i_length += p_next->i_length;
+    p_run->i_flags |= p_next->i_flags;
+
+    /* The run holds the slab for both */
+    ts_slab_Release( p_slab );
+    return true;
+}
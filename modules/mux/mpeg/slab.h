@@ -0,0 +1,46 @@
+/*****************************************************************************
+ * slab.h: recycled TS packet buffers
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_MPEG_SLAB_H_
+#define VLC_MPEG_SLAB_H_
+
+/* A slab is a contiguous buffer of TS packets, with a block per packet.
+ * The muxer writes the packets in place, and sends runs of consecutive
+ * packets as a single block pointing into the slab. Slabs go back to their
+ * pool once the muxer and all the sent blocks are done with them, and they
+ * can outlive the pool. */
+typedef struct ts_slab_pool_t ts_slab_pool_t;
+typedef struct ts_slab_t ts_slab_t;
+
+ts_slab_pool_t *ts_slab_pool_New( unsigned i_packets );
+void ts_slab_pool_Delete( ts_slab_pool_t * );
+
+/* Returns an empty slab, held by the caller */
+ts_slab_t *ts_slab_Get( ts_slab_pool_t * );
+void ts_slab_Release( ts_slab_t * );
+
+/* Returns the block of the next free packet of the slab, 188 bytes long,
+ * holding a reference to the slab. NULL if the slab is full. */
+block_t *ts_slab_Packet( ts_slab_t * );
+
+/* Merges the packet p_next into p_run if it directly follows it in the same
+ * slab, and drops its reference. */
+bool ts_slab_Merge( block_t *p_run, block_t *p_next );
+
+#endif
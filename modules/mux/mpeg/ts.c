@@ -47,6 +47,8 @@
 #include "pes.h"
 #include "csa.h"
 #include "tsutil.h"
+#include "slab.h"
+#include "tstd.h"
 #include "streams.h"
 
 # include <dvbpsi/dvbpsi.h>
@@ -173,6 +175,11 @@ static void    Close  ( vlc_object_t * );
 #define CU_LONGTEXT N_("CSA encryption key used. It can be the odd/first/1 " \
   "(default) or the even/second/2 one.")
 
+#define MUXRATE_TEXT N_("Constant mux rate (bits/s)")
+#define MUXRATE_LONGTEXT N_("Output a constant bitrate stream, stuffed with " \
+  "null packets, with PCR every 40 ms at most and within the buffers of " \
+  "the transport system target decoder. 0 outputs a variable bitrate.")
+
 #define CPKT_TEXT N_("Packet size in bytes to encrypt")
 #define CPKT_LONGTEXT N_("Size of the TS packet to encrypt. " \
     "The encryption routines subtract the TS-header from the value before " \
@@ -181,6 +188,12 @@ static void    Close  ( vlc_object_t * );
 #define SOUT_CFG_PREFIX "sout-ts-"
 #define MAX_PMT 64       /* Maximum number of programs. FIXME: I just chose an arbitrary number. Where is the maximum in the spec? */
 #define MAX_PMT_PID 64       /* Maximum pids in each pmt.  FIXME: I just chose an arbitrary number. Where is the maximum in the spec? */
+#define TS_PACKETS_PER_WRITE 7 /* 1316 bytes, one datagram on a 1500 bytes MTU */
+/* Packets per recycled output buffer, so that full runs never straddle two */
+#define TS_SLAB_PACKETS (36 * TS_PACKETS_PER_WRITE)
+#define TS_CSA_BATCH 256 /* packets scrambled at once */
+#define CBR_PCR_INTERVAL 40000 /* TR 101 290 PCR_repetition_error */
+#define CBR_REPORT_INTERVAL (10 * CLOCK_FREQ)
 #if MAX_SDT_DESC < MAX_PMT
   #error "MAX_SDT_DESC < MAX_PMT"
 #endif
@@ -216,6 +229,8 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "bmin", 0, BMIN_TEXT, BMIN_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmax", 0, BMAX_TEXT, BMAX_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "dts-delay", 400, DTS_TEXT, DTS_LONGTEXT, true)
+    add_integer( SOUT_CFG_PREFIX "muxrate", 0, MUXRATE_TEXT, MUXRATE_LONGTEXT, true)
+        change_integer_range( 0, 200000000 )
 
     add_bool( SOUT_CFG_PREFIX "crypt-audio", true, ACRYPT_TEXT, ACRYPT_LONGTEXT, true)
     add_bool( SOUT_CFG_PREFIX "crypt-video", true, VCRYPT_TEXT, VCRYPT_LONGTEXT, true)
@@ -235,7 +250,7 @@ static const char *const ppsz_sout_options[] = {
     "netid", "sdtdesc",
     "es-id-pid", "shaping", "pcr", "bmin", "bmax", "use-key-frames",
     "dts-delay", "csa-ck", "csa2-ck", "csa-use", "csa-pkt", "crypt-audio", "crypt-video",
-    "muxpmt", "program-pmt", "alignment",
+    "muxpmt", "program-pmt", "alignment", "muxrate",
     NULL
 };
 
@@ -326,6 +341,16 @@ typedef struct
     pes_state_t  state;
 } sout_input_sys_t;
 
+/* Packets waiting for an output slot, with the decoder buffers they go to */
+typedef struct
+{
+    int                 i_pid;
+    int                 i_cc; /* last one sent with payload, -1 if none */
+    bool                b_model; /* ES, not PSI */
+    sout_buffer_chain_t queue;
+    tstd_buffer_t       tstd;
+} ts_cbr_pid_t;
+
 struct sout_mux_sys_t
 {
     int             i_pcr_pid;
@@ -371,6 +396,34 @@ struct sout_mux_sys_t
     int             i_csa_pkt_size;
     bool            b_crypt_audio;
     bool            b_crypt_video;
+    /* Packets held until the scrambled ones among them are encrypted, with
+     * a copy of the keys taken under csa_lock */
+    csa_t           *csa_batch;
+    block_t         *pp_csa_out[TS_CSA_BATCH];
+    int             i_csa_out;
+
+    /* TS packets are written in place in recycled slabs */
+    ts_slab_pool_t  *p_slabs;
+    ts_slab_t       *p_slab;
+    block_t         *p_run; /* consecutive packets not written yet */
+    int             i_run;
+
+    /* Constant bitrate output */
+    struct
+    {
+        int64_t     i_rate; /* bits/s, 0 for variable bitrate */
+        bool        b_started;
+        int64_t     i_base; /* 27MHz date of the slot 0 */
+        int64_t     i_slot;
+        int64_t     i_last_pcr; /* 27MHz */
+        mtime_t     i_report;
+        int         i_queued;
+        uint64_t    i_packets;
+        uint64_t    i_nulls;
+        uint64_t    i_pcr_only;
+        int         i_pids;
+        ts_cbr_pid_t *p_pids;
+    } cbr;
 };
 
 
@@ -467,6 +520,14 @@ static void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 
 static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream, bool b_pcr );
+static block_t *TSPacketNew( sout_mux_t *p_mux );
+static void TSWrite( sout_mux_t *p_mux, block_t *p_ts );
+static void TSWriteFlush( sout_mux_t *p_mux );
+static void TSOutput( sout_mux_t *p_mux, block_t *p_ts );
+static void TSOutputFlush( sout_mux_t *p_mux );
+static void CBRSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+                         mtime_t i_pcr_length, mtime_t i_pcr_dts );
+static void CBRReport( sout_mux_t *p_mux );
 static void TSSetPCR( block_t *p_ts, mtime_t i_dts );
 
 static csa_t *csaSetup( vlc_object_t *p_this )
@@ -478,11 +539,14 @@ static csa_t *csaSetup( vlc_object_t *p_this )
         return NULL;
 
     csa_t *csa = csa_New();
+    p_sys->csa_batch = csa_New();
+    p_sys->i_csa_out = 0;
 
-    if( csa_SetCW( p_this, csa, csack, true ) )
+    if( !csa || !p_sys->csa_batch || csa_SetCW( p_this, csa, csack, true ) )
     {
         free(csack);
         csa_Delete( csa );
+        csa_Delete( p_sys->csa_batch );
         return NULL;
     }
 
@@ -536,9 +600,17 @@ static int Open( vlc_object_t *p_this )
         return VLC_ENOMEM;
     p_sys->i_num_pmt = 1;
 
+    p_sys->p_slabs = ts_slab_pool_New( TS_SLAB_PACKETS );
+    if( !p_sys->p_slabs )
+    {
+        free( p_sys );
+        return VLC_ENOMEM;
+    }
+
     p_sys->p_dvbpsi = dvbpsi_new( &dvbpsi_messages, DVBPSI_MSG_DEBUG );
     if( !p_sys->p_dvbpsi )
     {
+        ts_slab_pool_Delete( p_sys->p_slabs );
         free( p_sys );
         return VLC_ENOMEM;
     }
@@ -713,6 +785,19 @@ static int Open( vlc_object_t *p_this )
     var_Get( p_mux, SOUT_CFG_PREFIX "dts-delay", &val );
     p_sys->i_dts_delay = val.i_int * 1000;
 
+    p_sys->cbr.i_rate = var_GetInteger( p_mux, SOUT_CFG_PREFIX "muxrate" );
+    if( p_sys->cbr.i_rate > 0 )
+    {
+        msg_Dbg( p_mux, "constant mux rate %"PRId64" bit/s", p_sys->cbr.i_rate );
+
+        /* Output and T-STD counters, updated at each report */
+        var_Create( p_mux, SOUT_CFG_PREFIX "cbr-packets", VLC_VAR_INTEGER );
+        var_Create( p_mux, SOUT_CFG_PREFIX "cbr-nulls", VLC_VAR_INTEGER );
+        var_Create( p_mux, SOUT_CFG_PREFIX "cbr-pcr-only", VLC_VAR_INTEGER );
+        var_Create( p_mux, SOUT_CFG_PREFIX "tstd-late", VLC_VAR_INTEGER );
+        var_Create( p_mux, SOUT_CFG_PREFIX "tstd-overflow", VLC_VAR_INTEGER );
+    }
+
     msg_Dbg( p_mux, "shaping=%"PRId64" pcr=%"PRId64" dts_delay=%"PRId64,
              p_sys->i_shaping_delay, p_sys->i_pcr_delay, p_sys->i_dts_delay );
 
@@ -747,6 +832,7 @@ static void Close( vlc_object_t * p_this )
         var_DelCallback( p_mux, SOUT_CFG_PREFIX "csa2-ck", ChangeKeyCallback, NULL );
         var_DelCallback( p_mux, SOUT_CFG_PREFIX "csa-use", ActiveKeyCallback, NULL );
         csa_Delete( p_sys->csa );
+        csa_Delete( p_sys->csa_batch );
         vlc_mutex_destroy( &p_sys->csa_lock );
     }
 
@@ -756,6 +842,16 @@ static void Close( vlc_object_t * p_this )
         free( p_sys->sdt.desc[i].psz_provider );
     }
 
+    if( p_sys->cbr.i_rate > 0 && p_sys->cbr.b_started )
+        CBRReport( p_mux );
+    for( int i = 0; i < p_sys->cbr.i_pids; i++ )
+        BufferChainClean( &p_sys->cbr.p_pids[i].queue );
+    free( p_sys->cbr.p_pids );
+
+    if( p_sys->p_slab )
+        ts_slab_Release( p_sys->p_slab );
+    ts_slab_pool_Delete( p_sys->p_slabs );
+
     free( p_sys );
 }
 
@@ -1570,7 +1666,10 @@ static bool MuxStreams(sout_mux_t *p_mux )
     }
 
     /* 4: date and send */
-    TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
+    if( p_sys->cbr.i_rate > 0 )
+        CBRSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
+    else
+        TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
     return false;
 }
 
@@ -1797,24 +1896,427 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
             /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
             TSSetPCR( p_ts, p_ts->i_dts - p_sys->first_dts );
         }
-        if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
-        {
-            vlc_mutex_lock( &p_sys->csa_lock );
-            csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
-            vlc_mutex_unlock( &p_sys->csa_lock );
-        }
 
         /* latency */
         p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
 
-        sout_AccessOutWrite( p_mux->p_access, p_ts );
+        TSOutput( p_mux, p_ts );
+    }
+    TSOutputFlush( p_mux );
+}
+
+/* Holds the packets back while scrambled ones are among them, to encrypt
+ * them together */
+static void TSOutput( sout_mux_t *p_mux, block_t *p_ts )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( p_sys->i_csa_out == 0 && !(p_ts->i_flags & BLOCK_FLAG_SCRAMBLED) )
+    {
+        TSWrite( p_mux, p_ts );
+        return;
+    }
+
+    p_sys->pp_csa_out[p_sys->i_csa_out++] = p_ts;
+    if( p_sys->i_csa_out == TS_CSA_BATCH )
+        TSOutputFlush( p_mux );
+}
+
+/* Encrypts the packets held back, then writes everything out */
+static void TSOutputFlush( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( p_sys->i_csa_out > 0 )
+    {
+        uint8_t *pp_pkt[TS_CSA_BATCH];
+        int i_pkt = 0;
+
+        for( int i = 0; i < p_sys->i_csa_out; i++ )
+            if( p_sys->pp_csa_out[i]->i_flags & BLOCK_FLAG_SCRAMBLED )
+                pp_pkt[i_pkt++] = p_sys->pp_csa_out[i]->p_buffer;
+
+        vlc_mutex_lock( &p_sys->csa_lock );
+        csa_CopyKeys( p_sys->csa_batch, p_sys->csa );
+        vlc_mutex_unlock( &p_sys->csa_lock );
+
+        csa_EncryptBatch( p_sys->csa_batch, pp_pkt, i_pkt,
+                          p_sys->i_csa_pkt_size );
+
+        for( int i = 0; i < p_sys->i_csa_out; i++ )
+            TSWrite( p_mux, p_sys->pp_csa_out[i] );
+        p_sys->i_csa_out = 0;
+    }
+    TSWriteFlush( p_mux );
+}
+
+/* Sends consecutive packets at once, but starts a new write at headers so
+ * that segmenters can still cut there */
+static void TSWrite( sout_mux_t *p_mux, block_t *p_ts )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( p_sys->p_run && p_sys->i_run < TS_PACKETS_PER_WRITE &&
+        !(p_ts->i_flags & BLOCK_FLAG_HEADER) &&
+        ts_slab_Merge( p_sys->p_run, p_ts ) )
+    {
+        p_sys->i_run++;
+        return;
+    }
+    TSWriteFlush( p_mux );
+    p_sys->p_run = p_ts;
+    p_sys->i_run = 1;
+}
+
+static void TSWriteFlush( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( p_sys->p_run )
+        sout_AccessOutWrite( p_mux->p_access, p_sys->p_run );
+    p_sys->p_run = NULL;
+    p_sys->i_run = 0;
+}
+
+/*****************************************************************************
+ * Constant bitrate output
+ *****************************************************************************
+ * Output slots are spaced by the packet duration at the mux rate. Each slot
+ * carries the queued packet with the earliest decoding time among those
+ * fitting in the T-STD buffers of their stream, a PCR when one is due, or a
+ * null packet. PCRs are computed from the slot dates in 27MHz units.
+ *****************************************************************************/
+#define CBR_SLOT_27MHZ INT64_C(40608000000) /* 188 * 8 * 27000000 */
+
+static ts_cbr_pid_t *CBRPid( sout_mux_t *p_mux, int i_pid )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    for( int i = 0; i < p_sys->cbr.i_pids; i++ )
+        if( p_sys->cbr.p_pids[i].i_pid == i_pid )
+            return &p_sys->cbr.p_pids[i];
+
+    ts_cbr_pid_t *p_pids = realloc( p_sys->cbr.p_pids,
+                                    (p_sys->cbr.i_pids + 1) * sizeof(*p_pids) );
+    if( unlikely(p_pids == NULL) )
+        return NULL;
+    p_sys->cbr.p_pids = p_pids;
+
+    ts_cbr_pid_t *p_pid = &p_pids[p_sys->cbr.i_pids++];
+    p_pid->i_pid = i_pid;
+    p_pid->i_cc = -1;
+    p_pid->b_model = false;
+    BufferChainInit( &p_pid->queue );
+    memset( &p_pid->tstd, 0, sizeof(p_pid->tstd) );
+
+    for( int i = 0; i < p_mux->i_nb_inputs; i++ )
+    {
+        sout_input_t *p_input = p_mux->pp_inputs[i];
+        if( ((sout_input_sys_t *)p_input->p_sys)->ts.i_pid == i_pid )
+        {
+            tstd_Init( &p_pid->tstd, p_input->p_fmt );
+            p_pid->b_model = true;
+            break;
+        }
+    }
+    return p_pid;
+}
+
+static size_t TSPayloadSize( const block_t *p_ts )
+{
+    const uint8_t *p = p_ts->p_buffer;
+
+    if( !(p[3] & 0x10) )
+        return 0;
+    if( p[3] & 0x20 )
+        return p[4] < 183 ? 183 - p[4] : 0;
+    return 184;
+}
+
+static void TSSetPCR27( block_t *p_ts, int64_t i_pcr )
+{
+    if( i_pcr < 0 )
+        i_pcr = 0;
+    int64_t i_base = i_pcr / 300;
+    int i_ext = i_pcr % 300;
+
+    p_ts->p_buffer[6]  = ( i_base >> 25 )&0xff;
+    p_ts->p_buffer[7]  = ( i_base >> 17 )&0xff;
+    p_ts->p_buffer[8]  = ( i_base >> 9  )&0xff;
+    p_ts->p_buffer[9]  = ( i_base >> 1  )&0xff;
+    p_ts->p_buffer[10] = ( ( i_base << 7 )&0x80 ) | 0x7e | ( i_ext >> 8 );
+    p_ts->p_buffer[11] = i_ext & 0xff;
+}
+
+/* Adaptation field only packet, carrying a PCR */
+static block_t *CBRNewPCR( sout_mux_t *p_mux, ts_cbr_pid_t *p_pid )
+{
+    block_t *p_ts = TSPacketNew( p_mux );
+    if( unlikely(p_ts == NULL) )
+        return NULL;
+
+    int i_cc = p_pid->i_cc;
+    if( i_cc < 0 ) /* not incremented without payload */
+        i_cc = p_pid->queue.p_first ? (p_pid->queue.p_first->p_buffer[3] - 1) & 0x0f
+                                    : 0;
+    uint8_t *p = p_ts->p_buffer;
+    p[0] = 0x47;
+    p[1] = ( p_pid->i_pid >> 8 ) & 0x1f;
+    p[2] = p_pid->i_pid & 0xff;
+    p[3] = 0x20 | i_cc;
+    p[4] = 183;
+    p[5] = 0x10; /* PCR_flag */
+    memset( &p[12], 0xff, 188 - 12 );
+    p_ts->i_flags |= BLOCK_FLAG_CLOCK;
+    return p_ts;
+}
+
+static block_t *CBRNewNull( sout_mux_t *p_mux )
+{
+    block_t *p_ts = TSPacketNew( p_mux );
+    if( unlikely(p_ts == NULL) )
+        return NULL;
+
+    uint8_t *p = p_ts->p_buffer;
+    p[0] = 0x47;
+    p[1] = 0x1f;
+    p[2] = 0xff;
+    p[3] = 0x10;
+    memset( &p[4], 0xff, 188 - 4 );
+    return p_ts;
+}
+
+/* Queued packet with the earliest decoding time that fits now */
+static ts_cbr_pid_t *CBRSelect( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    ts_cbr_pid_t *p_best = NULL;
+
+    for( int i = 0; i < p_sys->cbr.i_pids; i++ )
+    {
+        ts_cbr_pid_t *p_pid = &p_sys->cbr.p_pids[i];
+        block_t *p_ts = p_pid->queue.p_first;
+
+        if( p_ts == NULL ||
+            ( p_pid->b_model &&
+              !tstd_CanSend( &p_pid->tstd, TSPayloadSize( p_ts ) ) ) )
+            continue;
+        if( p_best == NULL || p_ts->i_dts < p_best->queue.p_first->i_dts )
+            p_best = p_pid;
+    }
+    return p_best;
+}
+
+static void CBRSend( sout_mux_t *p_mux, ts_cbr_pid_t *p_pid, block_t *p_ts,
+                     int64_t i_date27 )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    const mtime_t i_date = i_date27 / 27;
+
+    if( p_pid != NULL )
+    {
+        const uint8_t *p = p_ts->p_buffer;
+        size_t i_payload = TSPayloadSize( p_ts );
+
+        if( p_pid->b_model )
+            tstd_Send( &p_pid->tstd, i_date, i_payload, p[1] & 0x40,
+                       p_ts->i_dts > VLC_TS_INVALID
+                           ? p_ts->i_dts + p_sys->i_dts_delay : VLC_TS_INVALID );
+        if( p[3] & 0x10 )
+            p_pid->i_cc = p[3] & 0x0f;
+    }
+
+    if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
+    {
+        TSSetPCR27( p_ts, i_date27 - p_sys->first_dts * 27 );
+        p_sys->cbr.i_last_pcr = i_date27;
+    }
+
+    /* latency */
+    p_ts->i_dts = i_date + p_sys->i_shaping_delay * 3 / 2;
+    p_ts->i_length = 188 * 8 * CLOCK_FREQ / p_sys->cbr.i_rate;
+
+    p_sys->cbr.i_packets++;
+    TSOutput( p_mux, p_ts );
+}
+
+static void CBRSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+                         mtime_t i_pcr_length, mtime_t i_pcr_dts )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    const int64_t i_rate = p_sys->cbr.i_rate;
+    const int64_t i_pcr_max = __MIN( p_sys->i_pcr_delay, CBR_PCR_INTERVAL ) * 27;
+
+    if( !p_sys->cbr.b_started )
+    {
+        p_sys->cbr.b_started = true;
+        p_sys->cbr.i_base = i_pcr_dts * 27;
+        p_sys->cbr.i_slot = 0;
+        p_sys->cbr.i_last_pcr = INT64_MIN / 2;
+        p_sys->cbr.i_report = i_pcr_dts + CBR_REPORT_INTERVAL;
+    }
+
+    block_t *p_ts;
+    while( ( p_ts = BufferChainGet( p_chain_ts ) ) )
+    {
+        ts_cbr_pid_t *p_pid = CBRPid( p_mux,
+                            ( (p_ts->p_buffer[1] & 0x1f) << 8 ) | p_ts->p_buffer[2] );
+        if( unlikely(p_pid == NULL) )
+        {
+            block_Release( p_ts );
+            continue;
+        }
+        BufferChainAppend( &p_pid->queue, p_ts );
+        p_sys->cbr.i_queued++;
+    }
+
+    ts_cbr_pid_t *p_pcr = CBRPid( p_mux, p_sys->i_pcr_pid );
+    const mtime_t i_end = i_pcr_dts + i_pcr_length;
+    for( ;; )
+    {
+        const int64_t i_date27 = p_sys->cbr.i_base +
+                                 p_sys->cbr.i_slot * CBR_SLOT_27MHZ / i_rate;
+        const mtime_t i_date = i_date27 / 27;
+        if( i_date >= i_end )
+            break;
+
+        for( int i = 0; i < p_sys->cbr.i_pids; i++ )
+            if( p_sys->cbr.p_pids[i].b_model )
+                tstd_Update( &p_sys->cbr.p_pids[i].tstd, i_date );
+
+        ts_cbr_pid_t *p_pid = NULL;
+        p_ts = NULL;
+        if( p_pcr && i_date27 - p_sys->cbr.i_last_pcr >= i_pcr_max )
+        {
+            block_t *p_head = p_pcr->queue.p_first;
+            if( p_head && (p_head->i_flags & BLOCK_FLAG_CLOCK) &&
+                ( !p_pcr->b_model ||
+                  tstd_CanSend( &p_pcr->tstd, TSPayloadSize( p_head ) ) ) )
+                p_pid = p_pcr;
+            else if( ( p_ts = CBRNewPCR( p_mux, p_pcr ) ) )
+                p_sys->cbr.i_pcr_only++;
+        }
+        if( p_ts == NULL && p_pid == NULL )
+            p_pid = CBRSelect( p_mux );
+
+        if( p_pid )
+        {
+            p_ts = BufferChainGet( &p_pid->queue );
+            p_sys->cbr.i_queued--;
+        }
+        else if( p_ts == NULL )
+        {
+            p_ts = CBRNewNull( p_mux );
+            p_sys->cbr.i_nulls++;
+        }
+
+        if( likely(p_ts != NULL) )
+            CBRSend( p_mux, p_pid, p_ts, i_date27 );
+
+        if( ++p_sys->cbr.i_slot == i_rate )
+        {
+            /* Rebase before i_slot * CBR_SLOT_27MHZ overflows */
+            p_sys->cbr.i_base += CBR_SLOT_27MHZ;
+            p_sys->cbr.i_slot = 0;
+        }
+
+        if( i_date >= p_sys->cbr.i_report )
+        {
+            CBRReport( p_mux );
+            p_sys->cbr.i_report = i_date + CBR_REPORT_INTERVAL;
+        }
+    }
+    TSOutputFlush( p_mux );
+
+    /* More than a second of packets could not be sent in time */
+    if( p_sys->cbr.i_queued > i_rate / (188 * 8) )
+        msg_Warn( p_mux, "mux rate too low, %d packets late",
+                  p_sys->cbr.i_queued );
+}
+
+static void CBRReport( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( p_sys->cbr.i_packets == 0 )
+        return;
+    msg_Dbg( p_mux, "mux rate %"PRId64" bit/s: %"PRIu64" packets, "
+             "%"PRIu64" null, %"PRIu64" PCR only", p_sys->cbr.i_rate,
+             p_sys->cbr.i_packets, p_sys->cbr.i_nulls, p_sys->cbr.i_pcr_only );
+
+    int64_t i_late = 0, i_overflow = 0;
+    for( int i = 0; i < p_sys->cbr.i_pids; i++ )
+    {
+        tstd_buffer_t *p_b = &p_sys->cbr.p_pids[i].tstd;
+        if( !p_sys->cbr.p_pids[i].b_model )
+            continue;
+
+        msg_Dbg( p_mux, "pid %d: B max %zu/%zu bytes, TB max %u/%d bytes, "
+                 "%u late, %u overflow", p_sys->cbr.p_pids[i].i_pid,
+                 p_b->i_fill_max, p_b->i_size, p_b->i_tb_max, TSTD_TB_SIZE,
+                 p_b->i_late, p_b->i_overflow );
+        p_b->i_fill_max = p_b->i_fill;
+        p_b->i_tb_max = 0;
+        i_late += p_b->i_late;
+        i_overflow += p_b->i_overflow;
+    }
+
+    var_SetInteger( p_mux, SOUT_CFG_PREFIX "cbr-packets", p_sys->cbr.i_packets );
+    var_SetInteger( p_mux, SOUT_CFG_PREFIX "cbr-nulls", p_sys->cbr.i_nulls );
+    var_SetInteger( p_mux, SOUT_CFG_PREFIX "cbr-pcr-only", p_sys->cbr.i_pcr_only );
+    var_SetInteger( p_mux, SOUT_CFG_PREFIX "tstd-late", i_late );
+    var_SetInteger( p_mux, SOUT_CFG_PREFIX "tstd-overflow", i_overflow );
+}
+
+/* Returns a 188 bytes packet, in place in the current slab */
+static block_t *TSPacketNew( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    block_t *p_ts = p_sys->p_slab ? ts_slab_Packet( p_sys->p_slab ) : NULL;
+
+    if( p_ts == NULL )
+    {
+        if( p_sys->p_slab )
+            ts_slab_Release( p_sys->p_slab );
+        p_sys->p_slab = ts_slab_Get( p_sys->p_slabs );
+        if( p_sys->p_slab )
+            p_ts = ts_slab_Packet( p_sys->p_slab );
+        else
+            p_ts = block_Alloc( 188 );
+    }
+    return p_ts;
+}
+
+/* Moves the PSI packets to the slab, so that they are sent along */
+static void BufferChainAppendPSI( sout_mux_t *p_mux, sout_buffer_chain_t *c,
+                                  block_t *p_psi )
+{
+    while( p_psi )
+    {
+        block_t *p_next = p_psi->p_next;
+        block_t *p_ts = TSPacketNew( p_mux );
+
+        p_psi->p_next = NULL;
+        if( likely(p_ts != NULL) && p_psi->i_buffer == 188 )
+        {
+            memcpy( p_ts->p_buffer, p_psi->p_buffer, 188 );
+            p_ts->i_flags  = p_psi->i_flags;
+            p_ts->i_dts    = p_psi->i_dts;
+            p_ts->i_pts    = p_psi->i_pts;
+            p_ts->i_length = p_psi->i_length;
+            block_Release( p_psi );
+            p_psi = p_ts;
+        }
+        else if( p_ts )
+            block_Release( p_ts );
+        BufferChainAppend( c, p_psi );
+        p_psi = p_next;
     }
 }
 
 static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
                        bool b_pcr )
 {
-    VLC_UNUSED(p_mux);
     block_t *p_pes = p_stream->state.chain_pes.p_first;
 
     bool b_new_pes = false;
@@ -1834,7 +2336,7 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
         b_adaptation_field = true;
     }
 
-    block_t *p_ts = block_Alloc( 188 );
+    block_t *p_ts = TSPacketNew( p_mux );
 
     if (b_new_pes && !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) && p_pes->i_flags & BLOCK_FLAG_TYPE_I)
     {
@@ -1930,12 +2432,15 @@ static void TSSetPCR( block_t *p_ts, mtime_t i_dts )
 void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
 {
     sout_mux_sys_t       *p_sys = p_mux->p_sys;
+    sout_buffer_chain_t psi;
 
+    BufferChainInit( &psi );
     BuildPAT( p_sys->p_dvbpsi,
-              c, (PEStoTSCallback)BufferChainAppend,
+              &psi, (PEStoTSCallback)BufferChainAppend,
               p_sys->i_tsid, p_sys->i_pat_version_number,
               &p_sys->pat,
               p_sys->i_num_pmt, p_sys->pmt, p_sys->i_pmt_program_number );
+    BufferChainAppendPSI( p_mux, c, psi.p_first );
 }
 
 static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
@@ -1959,11 +2464,14 @@ static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
         mappeds[i_stream].ts = &p_stream->ts;
     }
 
+    sout_buffer_chain_t psi;
+    BufferChainInit( &psi );
     BuildPMT( p_sys->p_dvbpsi, VLC_OBJECT(p_mux),
-              c, (PEStoTSCallback)BufferChainAppend,
+              &psi, (PEStoTSCallback)BufferChainAppend,
               p_sys->i_tsid, p_sys->i_pmt_version_number,
               p_sys->i_pcr_pid,
               &p_sys->sdt,
               p_sys->i_num_pmt, p_sys->pmt, p_sys->i_pmt_program_number,
               p_mux->i_nb_inputs, mappeds );
+    BufferChainAppendPSI( p_mux, c, psi.p_first );
 }
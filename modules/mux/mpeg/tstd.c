@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * tstd.c: MPEG-2 transport system target decoder buffer model
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_es.h>
+
+#include "tstd.h"
+
+#define TSTD_PACKET_BITS (188 * 8)
+
+/* H.264 MaxCPB in 1200 bits units (ISO/IEC 14496-10 Table A-1) */
+static const struct
+{
+    int      i_level;
+    unsigned i_cpb;
+} h264_cpb[] = {
+    { 10, 175 }, { 11, 500 }, { 12, 1000 }, { 13, 2000 },
+    { 20, 2000 }, { 21, 4000 }, { 22, 4000 },
+    { 30, 10000 }, { 31, 14000 }, { 32, 20000 },
+    { 40, 25000 }, { 41, 62500 }, { 42, 62500 },
+    { 50, 135000 }, { 51, 240000 }, { 52, 240000 },
+};
+
+static size_t H264BufferSize( int i_level )
+{
+    unsigned i_cpb = 62500; /* 4.1 when unknown */
+    for( size_t i = 0; i < ARRAY_SIZE(h264_cpb); i++ )
+        if( h264_cpb[i].i_level == i_level )
+            i_cpb = h264_cpb[i].i_cpb;
+    /* EBn is CpbNalSize, plus the multiplex buffer, 2.14.3.1 */
+    return (size_t)i_cpb * 1200 / 8 + i_cpb * 1200 / 8 / 100;
+}
+
+void tstd_Init( tstd_buffer_t *p_b, const es_format_t *p_fmt )
+{
+    memset( p_b, 0, sizeof(*p_b) );
+
+    switch( p_fmt->i_cat )
+    {
+        case AUDIO_ES:
+            /* 2.4.2.3: Rx is 2 Mbit/s, BSn is 3584 bytes */
+            p_b->i_rx = 2000000;
+            if( p_fmt->i_codec == VLC_CODEC_A52 ||
+                p_fmt->i_codec == VLC_CODEC_EAC3 )
+                p_b->i_size = 5696; /* ATSC A/52 Annex A */
+            else
+                p_b->i_size = 3584;
+            break;
+
+        case VIDEO_ES:
+            /* Rx depends on the profile and level maximum rate, the input
+             * never exceeds the mux rate anyway */
+            switch( p_fmt->i_codec )
+            {
+                case VLC_CODEC_MPGV:
+                case VLC_CODEC_MP2V:
+                    /* vbv_buffer_size of Main profile, plus BSmux and BSoh */
+                    p_b->i_size = ( p_fmt->video.i_width > 720 ? 1222656
+                                                                : 229376 ) + 4096;
+                    break;
+                case VLC_CODEC_H264:
+                    p_b->i_size = H264BufferSize( p_fmt->i_level );
+                    break;
+                default:
+                    break;
+            }
+            break;
+
+        default:
+            /* Systems and private data, 2.4.2.3 */
+            p_b->i_rx = p_fmt->i_codec == VLC_CODEC_TELETEXT ? 6750000
+                                                             : 1000000;
+            break;
+    }
+}
+
+void tstd_Update( tstd_buffer_t *p_b, mtime_t i_date )
+{
+    if( p_b->i_rx > 0 && p_b->i_tb > 0 )
+    {
+        mtime_t i_delta = i_date - p_b->i_tb_date;
+        if( i_delta >= CLOCK_FREQ )
+            p_b->i_tb = 0;
+        else if( i_delta > 0 )
+            p_b->i_tb = __MAX( 0, p_b->i_tb - p_b->i_rx * i_delta );
+    }
+    p_b->i_tb_date = i_date;
+
+    while( p_b->i_au_count > 0 && p_b->au[p_b->i_au_first].i_date <= i_date )
+    {
+        p_b->i_fill -= p_b->au[p_b->i_au_first].i_bytes;
+        p_b->i_au_first = (p_b->i_au_first + 1) % TSTD_AU_MAX;
+        p_b->i_au_count--;
+    }
+}
+
+bool tstd_CanSend( const tstd_buffer_t *p_b, size_t i_payload )
+{
+    if( p_b->i_rx > 0 &&
+        p_b->i_tb + (int64_t)TSTD_PACKET_BITS * CLOCK_FREQ >
+            (int64_t)TSTD_TB_SIZE * 8 * CLOCK_FREQ )
+        return false;
+
+    if( p_b->i_size > 0 )
+    {
+        if( p_b->i_au_count >= TSTD_AU_MAX )
+            return false;
+        /* An access unit larger than the buffer still has to go through */
+        if( p_b->i_fill > 0 && p_b->i_fill + i_payload > p_b->i_size )
+            return false;
+    }
+    return true;
+}
+
+void tstd_Send( tstd_buffer_t *p_b, mtime_t i_date, size_t i_payload,
+                bool b_unit_start, mtime_t i_decode )
+{
+    if( p_b->i_rx > 0 )
+    {
+        p_b->i_tb += (int64_t)TSTD_PACKET_BITS * CLOCK_FREQ;
+        unsigned i_tb = p_b->i_tb / ( 8 * CLOCK_FREQ );
+        if( i_tb > p_b->i_tb_max )
+            p_b->i_tb_max = i_tb;
+    }
+
+    if( i_decode > VLC_TS_INVALID && i_decode < i_date && i_payload > 0 )
+        p_b->i_late++;
+
+    if( p_b->i_size == 0 || i_payload == 0 )
+        return;
+
+    unsigned i_last = (p_b->i_au_first + p_b->i_au_count + TSTD_AU_MAX - 1)
+                      % TSTD_AU_MAX;
+    if( p_b->i_au_count == 0 ||
+        ( ( b_unit_start || p_b->au[i_last].i_date != i_decode ) &&
+          p_b->i_au_count < TSTD_AU_MAX ) )
+    {
+        i_last = (p_b->i_au_first + p_b->i_au_count) % TSTD_AU_MAX;
+        p_b->au[i_last].i_date = i_decode;
+        p_b->au[i_last].i_bytes = 0;
+        p_b->i_au_count++;
+    }
+    p_b->au[i_last].i_bytes += i_payload;
+
+    p_b->i_fill += i_payload;
+    if( p_b->i_fill > p_b->i_size )
+        p_b->i_overflow++;
+    if( p_b->i_fill > p_b->i_fill_max )
+        p_b->i_fill_max = p_b->i_fill;
+}
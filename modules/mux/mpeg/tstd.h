@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * tstd.h: MPEG-2 transport system target decoder buffer model
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_MPEG_TSTD_H_
+#define VLC_MPEG_TSTD_H_
+
+#define TSTD_TB_SIZE 512
+#define TSTD_AU_MAX  512
+
+/* Buffers of an elementary stream in the T-STD (ISO/IEC 13818-1 2.4.2):
+ * the transport buffer TB, leaking at Rx, and the main buffer B, from which
+ * each access unit is removed at its decoding time. The main buffer is
+ * modeled as one, without the separate multiplex buffer of video. */
+typedef struct
+{
+    /* TB, fullness in bits * CLOCK_FREQ, 0 rate if not modeled */
+    int64_t  i_rx;
+    int64_t  i_tb;
+    mtime_t  i_tb_date;
+
+    /* B, 0 size if not modeled */
+    size_t   i_size;
+    size_t   i_fill;
+    struct
+    {
+        mtime_t i_date;
+        size_t  i_bytes;
+    } au[TSTD_AU_MAX];
+    unsigned i_au_first;
+    unsigned i_au_count;
+
+    /* Statistics */
+    size_t   i_fill_max;
+    unsigned i_tb_max;
+    unsigned i_late;     /* data arrived after its decoding time */
+    unsigned i_overflow; /* packets beyond B, for access units larger than it */
+} tstd_buffer_t;
+
+void tstd_Init( tstd_buffer_t *, const es_format_t * );
+
+/* Leaks the transport buffer and removes the decoded access units */
+void tstd_Update( tstd_buffer_t *, mtime_t i_date );
+
+/* Whether a packet carrying that payload fits now */
+bool tstd_CanSend( const tstd_buffer_t *, size_t i_payload );
+
+/* Accounts a packet, with the decoding time of the access unit it belongs
+ * to. b_unit_start marks the first packet of an access unit. */
+void tstd_Send( tstd_buffer_t *, mtime_t i_date, size_t i_payload,
+                bool b_unit_start, mtime_t i_decode );
+
+#endif
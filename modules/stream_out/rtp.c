@@ -144,6 +144,24 @@
 #define PROTO_LONGTEXT N_( \
     "This selects which transport protocol to use for RTP." )
 
+#define FEC_COLS_TEXT N_("FEC columns")
+#define FEC_COLS_LONGTEXT N_( \
+    "Number of columns (L) of the SMPTE 2022-1 FEC matrix. Column FEC " \
+    "packets are sent two ports above the RTP port. This only applies " \
+    "to muxed streams over UDP. 0 disables FEC." )
+#define FEC_ROWS_TEXT N_("FEC rows")
+#define FEC_ROWS_LONGTEXT N_( \
+    "Number of rows (D) of the SMPTE 2022-1 FEC matrix. L x D must not " \
+    "exceed 100, and L must be at least 4 with row FEC." )
+#define FEC_2D_TEXT N_("Row FEC")
+#define FEC_2D_LONGTEXT N_( \
+    "Also send row FEC packets, four ports above the RTP port." )
+#define REDUNDANT_TEXT N_("Redundant destination")
+#define REDUNDANT_LONGTEXT N_( \
+    "Send an identical copy of the RTP session, with the same sequence " \
+    "numbers, to this second destination (SMPTE 2022-7). Use a " \
+    "destination routed through another interface." )
+
 #define SRTP_KEY_TEXT N_("SRTP key (hexadecimal)")
 #define SRTP_KEY_LONGTEXT N_( \
     "RTP packets will be integrity-protected and ciphered "\
@@ -232,6 +250,15 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000,
                  CACHING_TEXT, CACHING_LONGTEXT, true )
 
+    add_integer_with_range( SOUT_CFG_PREFIX "fec-l", 0, 0, 20,
+                            FEC_COLS_TEXT, FEC_COLS_LONGTEXT, true )
+    add_integer_with_range( SOUT_CFG_PREFIX "fec-d", 4, 4, 20,
+                            FEC_ROWS_TEXT, FEC_ROWS_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "fec-2d", false,
+              FEC_2D_TEXT, FEC_2D_LONGTEXT, true )
+    add_string( SOUT_CFG_PREFIX "redundant-dst", "",
+                REDUNDANT_TEXT, REDUNDANT_LONGTEXT, true )
+
 #ifdef HAVE_SRTP
     add_string( SOUT_CFG_PREFIX "key", "",
                 SRTP_KEY_TEXT, SRTP_KEY_LONGTEXT, false )
@@ -267,7 +294,8 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "dst", "name", "cat", "port", "port-audio", "port-video", "*sdp", "ttl",
     "mux", "sap", "description", "url", "email", "phone",
-    "proto", "rtcp-mux", "caching",
+    "proto", "rtcp-mux", "caching", "fec-l", "fec-d", "fec-2d",
+    "redundant-dst",
 #ifdef HAVE_SRTP
     "key", "salt",
 #endif
@@ -285,6 +313,7 @@ static int               MuxSend( sout_stream_t *, sout_stream_id_sys_t *,
 
 static sout_access_out_t *GrabberCreate( sout_stream_t *p_sout );
 static void* ThreadSend( void * );
+static void RedundancySetup( sout_stream_t *, sout_stream_id_sys_t *, bool );
 static void *rtp_listen_thread( void * );
 
 static void SDPHandleUrl( sout_stream_t *, const char * );
@@ -331,6 +360,12 @@ struct sout_stream_sys_t
     bool      rtcp_mux;
     bool      b_latm;
 
+    /* SMPTE 2022-1 FEC and 2022-7 redundant output */
+    char     *psz_redundant;
+    unsigned  i_fec_cols;
+    unsigned  i_fec_rows;
+    bool      b_fec_rows;
+
     /* VoD */
     vod_media_t *p_vod_media;
     char     *psz_vod_session;
@@ -387,6 +422,10 @@ struct sout_stream_id_sys_t
         vlc_thread_t  thread;
     } listen;
 
+    /* SMPTE 2022-1 FEC, column and row sockets for each path */
+    rtp_fec_encoder_t *fec;
+    int               fec_fd[2][2];
+
     block_fifo_t     *p_fifo;
     int64_t           i_caching;
 };
@@ -415,11 +454,17 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_port_audio = var_GetInteger( p_stream, SOUT_CFG_PREFIX "port-audio" );
     p_sys->i_port_video = var_GetInteger( p_stream, SOUT_CFG_PREFIX "port-video" );
     p_sys->rtcp_mux     = var_GetBool( p_stream, SOUT_CFG_PREFIX "rtcp-mux" );
+    p_sys->psz_redundant = var_GetNonEmptyString( p_stream,
+                                                  SOUT_CFG_PREFIX "redundant-dst" );
+    p_sys->i_fec_cols   = var_GetInteger( p_stream, SOUT_CFG_PREFIX "fec-l" );
+    p_sys->i_fec_rows   = var_GetInteger( p_stream, SOUT_CFG_PREFIX "fec-d" );
+    p_sys->b_fec_rows   = var_GetBool( p_stream, SOUT_CFG_PREFIX "fec-2d" );
 
     if( p_sys->i_port_audio && p_sys->i_port_video == p_sys->i_port_audio )
     {
         msg_Err( p_stream, "audio and video RTP port must be distinct" );
         free( p_sys->psz_destination );
+        free( p_sys->psz_redundant );
         free( p_sys );
         return VLC_EGENERIC;
     }
@@ -511,6 +556,7 @@ static int Open( vlc_object_t *p_this )
         && p_sys->p_vod_media == NULL )
     {
         msg_Err( p_stream, "missing destination and not in RTSP mode" );
+        free( p_sys->psz_redundant );
         free( p_sys );
         return VLC_EGENERIC;
     }
@@ -565,6 +611,7 @@ static int Open( vlc_object_t *p_this )
             vlc_mutex_destroy( &p_sys->lock_es );
             free( p_sys->psz_vod_session );
             free( p_sys->psz_destination );
+            free( p_sys->psz_redundant );
             free( p_sys );
             return VLC_EGENERIC;
         }
@@ -582,6 +629,7 @@ static int Open( vlc_object_t *p_this )
             vlc_mutex_destroy( &p_sys->lock_es );
             free( p_sys->psz_vod_session );
             free( p_sys->psz_destination );
+            free( p_sys->psz_redundant );
             free( p_sys );
             return VLC_EGENERIC;
         }
@@ -688,6 +736,7 @@ static void Close( vlc_object_t * p_this )
     }
     free( p_sys->psz_vod_session );
     free( p_sys->psz_destination );
+    free( p_sys->psz_redundant );
     free( p_sys );
 }
 
@@ -981,6 +1030,9 @@ static sout_stream_id_sys_t *Add( sout_stream_t *p_stream,
     id->rtsp_id = NULL;
     id->p_fifo = NULL;
     id->listen.fd = NULL;
+    id->fec = NULL;
+    for( unsigned i = 0; i < 2; i++ )
+        id->fec_fd[i][0] = id->fec_fd[i][1] = -1;
 
     id->b_first_packet = true;
     id->i_caching =
@@ -1142,6 +1194,10 @@ static sout_stream_id_sys_t *Add( sout_stream_t *p_stream,
                 rtp_add_sink( id, fd, p_sys->rtcp_mux, NULL );
                 /* FIXME: test if this is multicast  */
                 mcast_fd = fd;
+
+                if( p_sys->psz_redundant != NULL
+                 || p_sys->i_fec_cols > 0 )
+                    RedundancySetup( p_stream, id, p_fmt == NULL );
             }
         }
     }
@@ -1184,7 +1240,7 @@ static sout_stream_id_sys_t *Add( sout_stream_t *p_stream,
         id->rtsp_id = RtspAddId( p_sys->rtsp, id, GetDWBE( id->ssrc ),
                                  id->rtp_fmt.clock_rate, mcast_fd );
 
-    id->p_fifo = block_FifoNew();
+    id->p_fifo = block_FifoNewSPSC( 4096 );
     if( unlikely(id->p_fifo == NULL) )
         goto error;
     if( vlc_clone( &id->thread, ThreadSend, id, VLC_THREAD_PRIORITY_HIGHEST ) )
@@ -1219,6 +1275,80 @@ error:
     return NULL;
 }
 
+static int FecConnect( sout_stream_t *p_stream, const char *psz_dst,
+                       int i_port )
+{
+    int fd = net_ConnectDgram( p_stream, psz_dst, i_port, -1, IPPROTO_UDP );
+    if( fd != -1 )
+        setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &(int){ 0 }, sizeof (int));
+    return fd;
+}
+
+/*****************************************************************************
+ * RedundancySetup: SMPTE 2022-7 second path and 2022-1 FEC streams
+ *****************************************************************************/
+static void RedundancySetup( sout_stream_t *p_stream,
+                             sout_stream_id_sys_t *id, bool b_muxed )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    const char *dstv[2] = { p_sys->psz_destination, p_sys->psz_redundant };
+
+    /* Every sink sends the same packets, so both paths carry identical
+     * sequence numbers */
+    if( p_sys->psz_redundant != NULL )
+    {
+        int fd = net_ConnectDgram( p_stream, p_sys->psz_redundant,
+                                   id->i_port, -1, p_sys->proto );
+        if( fd == -1 )
+            msg_Err( p_stream, "cannot create redundant RTP socket" );
+        else
+        {
+            setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &(int){ 0 },
+                        sizeof (int));
+            rtp_add_sink( id, fd, p_sys->rtcp_mux, NULL );
+        }
+    }
+
+    if( p_sys->i_fec_cols == 0 )
+        return;
+    if( !b_muxed || p_sys->proto != IPPROTO_UDP )
+    {
+        msg_Warn( p_stream, "FEC only applies to muxed streams over UDP" );
+        return;
+    }
+    /* SMPTE 2022-1 limits: L <= 20, 4 <= D <= 20, L x D <= 100, and
+     * L >= 4 with row FEC. Larger matrices also exceed what receivers
+     * (including ours) keep around for recovery. */
+    if( p_sys->i_fec_cols > 20
+     || p_sys->i_fec_rows < 4 || p_sys->i_fec_rows > 20
+     || p_sys->i_fec_cols * p_sys->i_fec_rows > 100
+     || (p_sys->b_fec_rows && p_sys->i_fec_cols < 4) )
+    {
+        msg_Err( p_stream, "invalid %ux%u FEC matrix%s, FEC disabled",
+                 p_sys->i_fec_cols, p_sys->i_fec_rows,
+                 p_sys->b_fec_rows ? " with rows" : "" );
+        return;
+    }
+
+    id->fec = rtp_fec_encoder_New( p_sys->i_fec_cols, p_sys->i_fec_rows,
+                                   p_sys->b_fec_rows, id->i_mtu - 12 );
+    if( unlikely(id->fec == NULL) )
+        return;
+
+    for( unsigned i = 0; i < 2 && dstv[i] != NULL; i++ )
+    {
+        id->fec_fd[i][0] = FecConnect( p_stream, dstv[i], id->i_port + 2 );
+        if( p_sys->b_fec_rows )
+            id->fec_fd[i][1] = FecConnect( p_stream, dstv[i],
+                                           id->i_port + 4 );
+        if( id->fec_fd[i][0] == -1
+         || (p_sys->b_fec_rows && id->fec_fd[i][1] == -1) )
+            msg_Err( p_stream, "cannot create FEC socket for %s", dstv[i] );
+    }
+    msg_Dbg( p_stream, "%ux%u FEC%s", p_sys->i_fec_cols, p_sys->i_fec_rows,
+             p_sys->b_fec_rows ? ", with rows" : "" );
+}
+
 static void Del( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
@@ -1246,6 +1376,12 @@ static void Del( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
         vlc_join( id->listen.thread, NULL );
         net_ListenClose( id->listen.fd );
     }
+    for( unsigned i = 0; i < 2; i++ )
+        for( unsigned j = 0; j < 2; j++ )
+            if( id->fec_fd[i][j] != -1 )
+                net_Close( id->fec_fd[i][j] );
+    if( id->fec != NULL )
+        rtp_fec_encoder_Delete( id->fec );
     /* Delete remaining sinks (incoming connections or explicit
      * outgoing dst=) */
     while( id->sinkc > 0 )
@@ -1470,6 +1606,22 @@ static void* ThreadSend( void *data )
         }
         id->i_seq_sent_next = ntohs(((uint16_t *) out->p_buffer)[1]) + 1;
         vlc_mutex_unlock( &id->lock_sink );
+
+        if( id->fec != NULL )
+        {   /* FEC follows the last media packet of its column or row */
+            block_t *fecv[2];
+            fecv[0] = rtp_fec_encoder_Add( id->fec, out, &fecv[1] );
+            for( unsigned j = 0; j < 2; j++ )
+            {
+                if( fecv[j] == NULL )
+                    continue;
+                for( unsigned i = 0; i < 2; i++ )
+                    if( id->fec_fd[i][j] != -1 )
+                        send( id->fec_fd[i][j], fecv[j]->p_buffer,
+                              fecv[j]->i_buffer, 0 );
+                block_Release( fecv[j] );
+            }
+        }
         block_Release( out );
 
         for( unsigned i = 0; i < deadc; i++ )
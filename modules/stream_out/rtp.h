@@ -111,3 +111,12 @@ int vod_init_id(vod_media_t *p_media, const char *psz_session, int es_id,
 void vod_detach_id(vod_media_t *p_media, const char *psz_session,
                    sout_stream_id_sys_t *sout_id);
 
+
+/* SMPTE 2022-1 FEC */
+typedef struct rtp_fec_encoder_t rtp_fec_encoder_t;
+
+rtp_fec_encoder_t *rtp_fec_encoder_New( unsigned i_cols, unsigned i_rows,
+                                        bool b_rows, size_t i_max );
+void rtp_fec_encoder_Delete( rtp_fec_encoder_t * );
+block_t *rtp_fec_encoder_Add( rtp_fec_encoder_t *, const block_t *p_rtp,
+                              block_t **pp_row );
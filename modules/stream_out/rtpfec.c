@@ -0,0 +1,281 @@
+/*****************************************************************************
+ * rtpfec.c: SMPTE 2022-1 FEC generation for the RTP stream output
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_cpu.h>
+#include <vlc_rand.h>
+
+#include <vlc_sout.h>
+#include "rtp.h"
+
+#ifdef HAVE_SSE2_INTRINSICS
+# include <emmintrin.h>
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+# include <immintrin.h>
+#endif
+
+#include <assert.h>
+
+#define FEC_HEADER_SIZE 16
+#define FEC_PAYLOAD_TYPE 96
+
+/*
+ * Each media packet is XORed into the FEC packet of its column and, in 2D
+ * mode, of its row. Both are updated in a single pass over the packet, so
+ * that it is read once from memory.
+ */
+typedef void (*fec_xor_t)( uint8_t *, uint8_t *, const uint8_t *, size_t );
+
+static void fec_xor_c( uint8_t *a, uint8_t *b, const uint8_t *src, size_t n )
+{
+    for( size_t i = 0; i < n; i++ )
+    {
+        a[i] ^= src[i];
+        b[i] ^= src[i];
+    }
+}
+
+#ifdef HAVE_SSE2_INTRINSICS
+__attribute__ ((__target__ ("sse2")))
+static void fec_xor_sse2( uint8_t *a, uint8_t *b, const uint8_t *src,
+                          size_t n )
+{
+    size_t i = 0;
+    for( ; i + 16 <= n; i += 16 )
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i) );
+        __m128i *pa = (__m128i *)(a + i), *pb = (__m128i *)(b + i);
+        _mm_storeu_si128( pa, _mm_xor_si128( _mm_loadu_si128( pa ), s ) );
+        _mm_storeu_si128( pb, _mm_xor_si128( _mm_loadu_si128( pb ), s ) );
+    }
+    fec_xor_c( a + i, b + i, src + i, n - i );
+}
+#endif
+
+#ifdef HAVE_AVX2_INTRINSICS
+__attribute__ ((__target__ ("avx2")))
+static void fec_xor_avx2( uint8_t *a, uint8_t *b, const uint8_t *src,
+                          size_t n )
+{
+    size_t i = 0;
+    for( ; i + 32 <= n; i += 32 )
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        __m256i *pa = (__m256i *)(a + i), *pb = (__m256i *)(b + i);
+        _mm256_storeu_si256( pa, _mm256_xor_si256( _mm256_loadu_si256( pa ), s ) );
+        _mm256_storeu_si256( pb, _mm256_xor_si256( _mm256_loadu_si256( pb ), s ) );
+    }
+    fec_xor_c( a + i, b + i, src + i, n - i );
+}
+#endif
+
+/* FEC packet being accumulated */
+typedef struct
+{
+    uint16_t i_base;    /* first media sequence number */
+    uint16_t i_length;  /* length recovery */
+    uint8_t  i_flags;   /* P, X, CC and M recovery */
+    uint8_t  i_pt;      /* PT recovery */
+    uint32_t i_ts;      /* TS recovery */
+    size_t   i_size;    /* payload bytes, the longest media payload */
+    uint8_t *p_payload;
+} fec_group_t;
+
+struct rtp_fec_encoder_t
+{
+    unsigned i_cols;    /* L */
+    unsigned i_rows;    /* D */
+    bool     b_rows;    /* 2D: row FEC as well */
+    unsigned i_pos;     /* position of the next packet in the matrix */
+    size_t   i_max;     /* largest media payload */
+    uint16_t i_seq_col;
+    uint16_t i_seq_row;
+    fec_xor_t pf_xor;
+
+    fec_group_t row;
+    uint8_t    *p_scratch; /* row payload in 1D mode */
+    fec_group_t cols[];
+};
+
+/**
+ * Creates a L x D matrix FEC generator, for media payloads of up to i_max
+ * bytes.
+ */
+rtp_fec_encoder_t *rtp_fec_encoder_New( unsigned i_cols, unsigned i_rows,
+                                        bool b_rows, size_t i_max )
+{
+    assert( i_cols > 0 && i_rows > 0 && i_cols < 256 && i_rows < 256 );
+
+    rtp_fec_encoder_t *p_enc = malloc( sizeof(*p_enc)
+                                       + i_cols * sizeof(fec_group_t) );
+    if( unlikely(p_enc == NULL) )
+        return NULL;
+
+    /* All the payloads in one allocation: the row, then the columns */
+    uint8_t *p_buf = malloc( (i_cols + 1) * i_max );
+    if( unlikely(p_buf == NULL) )
+    {
+        free( p_enc );
+        return NULL;
+    }
+
+    p_enc->i_cols = i_cols;
+    p_enc->i_rows = i_rows;
+    p_enc->b_rows = b_rows;
+    p_enc->i_pos = 0;
+    p_enc->i_max = i_max;
+    p_enc->i_seq_col = vlc_mrand48();
+    p_enc->i_seq_row = vlc_mrand48();
+
+    p_enc->pf_xor = fec_xor_c;
+#ifdef HAVE_SSE2_INTRINSICS
+    if( vlc_CPU_SSE2() )
+        p_enc->pf_xor = fec_xor_sse2;
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+    if( vlc_CPU_AVX2() )
+        p_enc->pf_xor = fec_xor_avx2;
+#endif
+
+    p_enc->row.p_payload = p_buf;
+    p_enc->p_scratch = p_buf;
+    for( unsigned i = 0; i < i_cols; i++ )
+        p_enc->cols[i].p_payload = p_buf + (i + 1) * i_max;
+    return p_enc;
+}
+
+void rtp_fec_encoder_Delete( rtp_fec_encoder_t *p_enc )
+{
+    free( p_enc->row.p_payload );
+    free( p_enc );
+}
+
+static void fec_group_Start( fec_group_t *g, uint16_t i_seq )
+{
+    g->i_base = i_seq;
+    g->i_length = 0;
+    g->i_flags = 0;
+    g->i_pt = 0;
+    g->i_ts = 0;
+    g->i_size = 0;
+}
+
+/* Adds the header fields of a media packet, and pads the payload with zeroes
+ * up to its length */
+static void fec_group_Header( fec_group_t *g, const uint8_t *p, size_t i_len )
+{
+    g->i_length ^= i_len;
+    g->i_flags ^= (p[0] & 0x3F) | (p[1] & 0x80);
+    g->i_pt ^= p[1] & 0x7F;
+    g->i_ts ^= GetDWBE( p + 4 );
+    if( i_len > g->i_size )
+    {
+        memset( g->p_payload + g->i_size, 0, i_len - g->i_size );
+        g->i_size = i_len;
+    }
+}
+
+static block_t *fec_group_Packet( const fec_group_t *g, uint16_t i_seq,
+                                  bool b_row, unsigned i_offset,
+                                  unsigned i_count )
+{
+    block_t *p_fec = block_Alloc( 12 + FEC_HEADER_SIZE + g->i_size );
+    if( unlikely(p_fec == NULL) )
+        return NULL;
+
+    uint8_t *p = p_fec->p_buffer;
+    p[0] = 0x80 | (g->i_flags & 0x3F);
+    p[1] = (g->i_flags & 0x80) | FEC_PAYLOAD_TYPE;
+    SetWBE( p + 2, i_seq );
+    SetDWBE( p + 4, 0 ); /* timestamp and SSRC are not used */
+    SetDWBE( p + 8, 0 );
+
+    uint8_t *h = p + 12;
+    SetWBE( h, g->i_base );
+    SetWBE( h + 2, g->i_length );
+    h[4] = 0x80 /* E */ | g->i_pt;
+    h[5] = h[6] = h[7] = 0; /* mask */
+    SetDWBE( h + 8, g->i_ts );
+    h[12] = b_row ? 0x40 : 0x00; /* N = 0, D, type = XOR, index = 0 */
+    h[13] = i_offset;
+    h[14] = i_count;
+    h[15] = 0; /* SNBase ext */
+
+    memcpy( h + FEC_HEADER_SIZE, g->p_payload, g->i_size );
+    return p_fec;
+}
+
+/**
+ * Adds a media RTP packet, as sent.
+ * @param pp_row row FEC packet completed by this one, or NULL
+ * @return column FEC packet completed by this one, or NULL
+ */
+block_t *rtp_fec_encoder_Add( rtp_fec_encoder_t *p_enc, const block_t *p_rtp,
+                              block_t **pp_row )
+{
+    *pp_row = NULL;
+    if( p_rtp->i_buffer < 12 )
+        return NULL;
+
+    const uint8_t *p = p_rtp->p_buffer;
+    const uint16_t i_seq = GetWBE( p + 2 );
+    size_t i_len = p_rtp->i_buffer - 12;
+    if( i_len > p_enc->i_max )
+        i_len = p_enc->i_max; /* cannot be recovered, but keeps the matrix */
+
+    const unsigned i_row = p_enc->i_pos / p_enc->i_cols;
+    const unsigned i_col = p_enc->i_pos % p_enc->i_cols;
+    fec_group_t *col = &p_enc->cols[i_col];
+    fec_group_t *row = &p_enc->row;
+
+    if( i_row == 0 )
+        fec_group_Start( col, i_seq );
+    if( i_col == 0 )
+        fec_group_Start( row, i_seq );
+
+    fec_group_Header( col, p, i_len );
+    if( p_enc->b_rows )
+        fec_group_Header( row, p, i_len );
+    /* in 1D mode, the row XOR goes to scratch space */
+    p_enc->pf_xor( col->p_payload, p_enc->b_rows ? row->p_payload
+                                                 : p_enc->p_scratch,
+                   p + 12, i_len );
+
+    block_t *p_col = NULL;
+    if( i_row == p_enc->i_rows - 1 )
+        p_col = fec_group_Packet( col, p_enc->i_seq_col++, false,
+                                  p_enc->i_cols, p_enc->i_rows );
+    if( p_enc->b_rows && i_col == p_enc->i_cols - 1 )
+        *pp_row = fec_group_Packet( row, p_enc->i_seq_row++, true,
+                                    1, p_enc->i_cols );
+
+    p_enc->i_pos = (p_enc->i_pos + 1) % (p_enc->i_cols * p_enc->i_rows);
+    return p_col;
+}
@@ -0,0 +1,195 @@
+/*****************************************************************************
+ * pipeline.c: transcoding stream output module (pipeline stages)
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#include "transcode.h"
+
+#include <assert.h>
+
+static void *StageThread( void *data )
+{
+    transcode_stage_t *p_stage = data;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_stage->lock );
+    for( ;; )
+    {
+        while( p_stage->i_count == 0 && !p_stage->b_closing )
+            vlc_cond_wait( &p_stage->wait, &p_stage->lock );
+        if( p_stage->i_count == 0 )
+            break;
+
+        picture_t *p_pic = p_stage->pp_queue[p_stage->i_first];
+        const mtime_t i_wait = mdate() - p_stage->p_dates[p_stage->i_first];
+        p_stage->i_first = (p_stage->i_first + 1) % p_stage->i_size;
+        p_stage->i_count--;
+        vlc_cond_signal( &p_stage->room );
+        vlc_mutex_unlock( &p_stage->lock );
+
+        const mtime_t i_start = mdate();
+        p_stage->pf_process( p_stage, p_pic );
+        const mtime_t i_busy = mdate() - i_start;
+
+        vlc_mutex_lock( &p_stage->lock );
+        p_stage->stats.i_pictures++;
+        p_stage->stats.i_wait += i_wait;
+        p_stage->stats.i_wait_max = __MAX( p_stage->stats.i_wait_max, i_wait );
+        p_stage->stats.i_busy += i_busy;
+        p_stage->stats.i_busy_max = __MAX( p_stage->stats.i_busy_max, i_busy );
+
+        if( i_start + i_busy >= p_stage->i_report )
+        {
+            const transcode_stage_stats_t stats = p_stage->stats;
+
+            p_stage->i_report = i_start + i_busy + TRANSCODE_REPORT_INTERVAL;
+            vlc_mutex_unlock( &p_stage->lock );
+            transcode_stage_LogStats( p_stage->p_obj, p_stage->psz_name,
+                                      &stats, p_stage->i_size );
+            vlc_mutex_lock( &p_stage->lock );
+        }
+    }
+    vlc_mutex_unlock( &p_stage->lock );
+
+    /* Let the stage output what it still holds */
+    p_stage->pf_process( p_stage, NULL );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/**
+ * Starts a stage thread, processing up to i_size queued pictures in order.
+ * pf_process is called with NULL once all of them were processed, when the
+ * stage is stopped. The counters are logged on behalf of p_obj periodically
+ * and when the stage is stopped.
+ */
+int transcode_stage_Start( vlc_object_t *p_obj, transcode_stage_t *p_stage,
+                           const char *psz_name,
+                           unsigned i_size, int i_priority,
+                           void (*pf_process)( transcode_stage_t *, picture_t * ),
+                           void *p_sys )
+{
+    assert( i_size > 0 );
+
+    p_stage->pp_queue = malloc( i_size * sizeof(*p_stage->pp_queue) );
+    p_stage->p_dates = malloc( i_size * sizeof(*p_stage->p_dates) );
+    if( !p_stage->pp_queue || !p_stage->p_dates )
+    {
+        free( p_stage->pp_queue );
+        free( p_stage->p_dates );
+        return VLC_ENOMEM;
+    }
+
+    p_stage->p_obj = p_obj;
+    p_stage->psz_name = psz_name;
+    p_stage->i_size = i_size;
+    p_stage->i_first = 0;
+    p_stage->i_count = 0;
+    p_stage->b_closing = false;
+    p_stage->pf_process = pf_process;
+    p_stage->p_sys = p_sys;
+    memset( &p_stage->stats, 0, sizeof(p_stage->stats) );
+    p_stage->i_report = mdate() + TRANSCODE_REPORT_INTERVAL;
+    vlc_mutex_init( &p_stage->lock );
+    vlc_cond_init( &p_stage->wait );
+    vlc_cond_init( &p_stage->room );
+
+    if( vlc_clone( &p_stage->thread, StageThread, p_stage, i_priority ) )
+    {
+        vlc_cond_destroy( &p_stage->room );
+        vlc_cond_destroy( &p_stage->wait );
+        vlc_mutex_destroy( &p_stage->lock );
+        free( p_stage->pp_queue );
+        free( p_stage->p_dates );
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/**
+ * Queues a picture, waiting while the stage is full.
+ */
+void transcode_stage_Push( transcode_stage_t *p_stage, picture_t *p_pic )
+{
+    vlc_mutex_lock( &p_stage->lock );
+    if( p_stage->i_count >= p_stage->i_size )
+    {
+        const mtime_t i_start = mdate();
+        do
+            vlc_cond_wait( &p_stage->room, &p_stage->lock );
+        while( p_stage->i_count >= p_stage->i_size );
+        p_stage->stats.i_stalls++;
+        p_stage->stats.i_stall += mdate() - i_start;
+    }
+
+    const unsigned i_last = (p_stage->i_first + p_stage->i_count) % p_stage->i_size;
+    p_stage->pp_queue[i_last] = p_pic;
+    p_stage->p_dates[i_last] = mdate();
+    p_stage->i_count++;
+    p_stage->stats.i_backlog_max = __MAX( p_stage->stats.i_backlog_max,
+                                          p_stage->i_count );
+    vlc_cond_signal( &p_stage->wait );
+    vlc_mutex_unlock( &p_stage->lock );
+}
+
+void transcode_stage_LogStats( vlc_object_t *p_obj, const char *psz_name,
+                               const transcode_stage_stats_t *p_stats,
+                               unsigned i_size )
+{
+    if( p_stats->i_pictures == 0 )
+        return;
+
+    msg_Dbg( p_obj, "stage %s: %"PRIu64" pictures, latency %"PRId64
+             "/%"PRId64" us (avg/max), processing %"PRId64"/%"PRId64
+             " us, backlog %u/%u, %"PRIu64" stalls (%"PRId64" ms)",
+             psz_name, p_stats->i_pictures,
+             p_stats->i_wait / (mtime_t)p_stats->i_pictures,
+             p_stats->i_wait_max,
+             p_stats->i_busy / (mtime_t)p_stats->i_pictures,
+             p_stats->i_busy_max,
+             p_stats->i_backlog_max, i_size,
+             p_stats->i_stalls, p_stats->i_stall / 1000 );
+}
+
+/**
+ * Processes the queued pictures, then stops the stage and logs its counters.
+ */
+void transcode_stage_Stop( vlc_object_t *p_obj, transcode_stage_t *p_stage )
+{
+    vlc_mutex_lock( &p_stage->lock );
+    p_stage->b_closing = true;
+    vlc_cond_signal( &p_stage->wait );
+    vlc_mutex_unlock( &p_stage->lock );
+
+    vlc_join( p_stage->thread, NULL );
+    assert( p_stage->i_count == 0 );
+
+    transcode_stage_LogStats( p_obj, p_stage->psz_name, &p_stage->stats,
+                              p_stage->i_size );
+
+    vlc_cond_destroy( &p_stage->room );
+    vlc_cond_destroy( &p_stage->wait );
+    vlc_mutex_destroy( &p_stage->lock );
+    free( p_stage->pp_queue );
+    free( p_stage->p_dates );
+}
@@ -0,0 +1,415 @@
+/*****************************************************************************
+ * rendition.c: transcoding stream output module (multiple video sizes)
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#include "transcode.h"
+
+#include <vlc_modules.h>
+
+/*
+ * Renditions are encoded from the pictures sent to the main video encoder,
+ * each one being scaled from the previous, larger, one. They share the
+ * encoder options, and are given the same pictures, so that a fixed GOP
+ * gives keyframes on the same pictures in all of them.
+ */
+
+static int rendition_cfg_cmp( const void *a, const void *b )
+{
+    const transcode_rendition_cfg_t *p_a = a, *p_b = b;
+
+    return (p_a->i_width < p_b->i_width) - (p_a->i_width > p_b->i_width);
+}
+
+/**
+ * Parses a comma-separated list of width[xheight][:bitrate] renditions.
+ */
+int transcode_renditions_parse( sout_stream_t *p_stream,
+                                sout_stream_sys_t *p_sys, const char *psz )
+{
+    p_sys->p_rendition_cfg = NULL;
+    p_sys->i_renditions = 0;
+    if( psz == NULL || *psz == '\0' )
+        return VLC_SUCCESS;
+
+    unsigned i_max = 1;
+    for( const char *p = psz; (p = strchr( p, ',' )) != NULL; p++ )
+        i_max++;
+
+    p_sys->p_rendition_cfg = malloc( i_max * sizeof(*p_sys->p_rendition_cfg) );
+    if( unlikely(p_sys->p_rendition_cfg == NULL) )
+        return VLC_ENOMEM;
+
+    while( *psz != '\0' )
+    {
+        transcode_rendition_cfg_t cfg = { 0, 0, 0 };
+        char *end;
+
+        cfg.i_width = strtoul( psz, &end, 10 );
+        if( *end == 'x' )
+            cfg.i_height = strtoul( end + 1, &end, 10 );
+        if( *end == ':' )
+        {
+            cfg.i_bitrate = strtoul( end + 1, &end, 10 );
+            if( cfg.i_bitrate < 16000 )
+                cfg.i_bitrate *= 1000;
+        }
+
+        if( cfg.i_width < 2 || (*end != ',' && *end != '\0') )
+        {
+            msg_Err( p_stream, "invalid rendition `%.*s'",
+                     (int)strcspn( psz, "," ), psz );
+            end += strcspn( end, "," );
+        }
+        else
+            p_sys->p_rendition_cfg[p_sys->i_renditions++] = cfg;
+
+        psz = (*end == ',') ? end + 1 : end;
+    }
+
+    /* Each rendition is scaled from the previous one */
+    qsort( p_sys->p_rendition_cfg, p_sys->i_renditions,
+           sizeof(*p_sys->p_rendition_cfg), rendition_cfg_cmp );
+    return VLC_SUCCESS;
+}
+
+static picture_t *transcode_rendition_buffer_new( filter_t *p_filter )
+{
+    p_filter->fmt_out.video.i_chroma = p_filter->fmt_out.i_codec;
+    return picture_NewFromFormat( &p_filter->fmt_out.video );
+}
+
+static void RenditionAppend( transcode_rendition_t *p_rend, block_t *p_block )
+{
+    vlc_mutex_lock( &p_rend->lock );
+    for( block_t *p = p_block; p != NULL; p = p->p_next )
+        if( p->i_flags & BLOCK_FLAG_TYPE_I )
+            p_rend->i_keyframes++;
+    block_ChainAppend( &p_rend->p_out, p_block );
+    vlc_mutex_unlock( &p_rend->lock );
+}
+
+static void RenditionDrain( transcode_rendition_t *p_rend )
+{
+    block_t *p_block;
+
+    do {
+        p_block = p_rend->p_encoder->pf_encode_video( p_rend->p_encoder, NULL );
+        RenditionAppend( p_rend, p_block );
+    } while( p_block );
+}
+
+static void RenditionProcess( transcode_stage_t *p_stage, picture_t *p_pic )
+{
+    transcode_rendition_t *p_rend = p_stage->p_sys;
+
+    if( p_pic == NULL )
+    {
+        RenditionDrain( p_rend );
+        return;
+    }
+
+    RenditionAppend( p_rend,
+                     p_rend->p_encoder->pf_encode_video( p_rend->p_encoder,
+                                                         p_pic ) );
+    picture_Release( p_pic );
+}
+
+static void RenditionDelete( sout_stream_t *p_stream,
+                             transcode_rendition_t *p_rend )
+{
+    encoder_t *p_enc = p_rend->p_encoder;
+
+    if( p_rend->id )
+        sout_StreamIdDel( p_stream->p_next, p_rend->id );
+    if( p_enc->p_module )
+        module_unneed( p_enc, p_enc->p_module );
+    if( p_rend->p_chain )
+        filter_chain_Delete( p_rend->p_chain );
+    es_format_Clean( &p_enc->fmt_in );
+    es_format_Clean( &p_enc->fmt_out );
+    vlc_object_release( p_enc );
+}
+
+/**
+ * Opens the rendition encoders, once the main one is opened.
+ */
+void transcode_renditions_open( sout_stream_t *p_stream,
+                                sout_stream_id_sys_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    const encoder_t *p_main = id->p_encoder;
+
+    if( p_sys->i_renditions == 0 )
+        return;
+
+    id->p_renditions = calloc( p_sys->i_renditions,
+                               sizeof(*id->p_renditions) );
+    if( unlikely(id->p_renditions == NULL) )
+        return;
+
+    unsigned i_main_width = p_main->fmt_in.video.i_visible_width;
+    unsigned i_main_height = p_main->fmt_in.video.i_visible_height;
+    if( i_main_width == 0 || i_main_height == 0 )
+    {
+        i_main_width = p_main->fmt_in.video.i_width;
+        i_main_height = p_main->fmt_in.video.i_height;
+    }
+    int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
+                       VLC_THREAD_PRIORITY_VIDEO;
+
+    for( unsigned i = 0; i < p_sys->i_renditions; i++ )
+    {
+        const transcode_rendition_cfg_t *p_cfg = &p_sys->p_rendition_cfg[i];
+        transcode_rendition_t *p_rend = &id->p_renditions[id->i_renditions];
+        const unsigned i_width = p_cfg->i_width & ~1;
+        unsigned i_height = p_cfg->i_height;
+
+        if( i_height == 0 )
+            i_height = (uint64_t)i_width * i_main_height / i_main_width;
+        i_height &= ~1;
+        if( i_height == 0 )
+            continue;
+
+        encoder_t *p_enc = sout_EncoderCreate( p_stream );
+        if( unlikely(p_enc == NULL) )
+            break;
+        p_rend->p_encoder = p_enc;
+        p_enc->p_module = NULL;
+
+        es_format_Copy( &p_enc->fmt_in, &p_main->fmt_in );
+        video_format_t *p_vfmt = &p_enc->fmt_in.video;
+        p_vfmt->i_width = p_vfmt->i_visible_width = i_width;
+        p_vfmt->i_height = p_vfmt->i_visible_height = i_height;
+        p_vfmt->i_x_offset = p_vfmt->i_y_offset = 0;
+        /* Keep the display aspect ratio of the main encoder */
+        p_vfmt->i_sar_num = p_main->fmt_out.video.i_sar_num;
+        p_vfmt->i_sar_den = p_main->fmt_out.video.i_sar_den;
+        if( p_vfmt->i_sar_num && p_vfmt->i_sar_den )
+            vlc_ureduce( &p_vfmt->i_sar_num, &p_vfmt->i_sar_den,
+                         (uint64_t)p_vfmt->i_sar_num * i_main_width * i_height,
+                         (uint64_t)p_vfmt->i_sar_den * i_main_height * i_width,
+                         0 );
+
+        es_format_Init( &p_enc->fmt_out, VIDEO_ES, p_sys->i_vcodec );
+        video_format_Copy( &p_enc->fmt_out.video, p_vfmt );
+        p_enc->fmt_out.i_id = p_main->fmt_out.i_id + 1000 * (i + 1);
+        p_enc->fmt_out.i_group = p_main->fmt_out.i_group;
+        if( p_main->fmt_out.psz_language )
+            p_enc->fmt_out.psz_language = strdup( p_main->fmt_out.psz_language );
+        p_enc->fmt_out.i_bitrate = p_cfg->i_bitrate;
+        if( p_enc->fmt_out.i_bitrate == 0 )
+            p_enc->fmt_out.i_bitrate = (uint64_t)p_sys->i_vbitrate
+                * i_width * i_height / (i_main_width * i_main_height);
+        p_enc->p_cfg = p_sys->p_video_cfg;
+
+        p_enc->p_module = module_need( p_enc, "encoder", p_sys->psz_venc, true );
+        if( !p_enc->p_module )
+        {
+            msg_Err( p_stream, "cannot open %ux%u video encoder",
+                     i_width, i_height );
+            RenditionDelete( p_stream, p_rend );
+            break;
+        }
+        p_enc->fmt_in.video.i_chroma = p_enc->fmt_in.i_codec;
+        p_enc->fmt_out.i_codec =
+            vlc_fourcc_GetCodec( VIDEO_ES, p_enc->fmt_out.i_codec );
+
+        p_rend->id = sout_StreamIdAdd( p_stream->p_next, &p_enc->fmt_out );
+        if( !p_rend->id )
+        {
+            msg_Err( p_stream, "cannot add %ux%u video stream",
+                     i_width, i_height );
+            RenditionDelete( p_stream, p_rend );
+            break;
+        }
+
+        vlc_mutex_init( &p_rend->lock );
+        snprintf( p_rend->psz_name, sizeof(p_rend->psz_name),
+                  "encode %ux%u", i_width, i_height );
+        if( p_sys->i_threads > 0 )
+            p_rend->b_stage =
+                !transcode_stage_Start( VLC_OBJECT(p_stream), &p_rend->stage,
+                                        p_rend->psz_name,
+                                        p_sys->pool_size, i_priority,
+                                        RenditionProcess, p_rend );
+
+        msg_Dbg( p_stream, "rendition %ux%u at %d kb/s, ES %d",
+                 i_width, i_height, p_enc->fmt_out.i_bitrate / 1000,
+                 p_enc->fmt_out.i_id );
+        id->i_renditions++;
+    }
+
+    transcode_renditions_filters_init( p_stream, id );
+}
+
+/**
+ * (Re)builds the scaling chains, from the main encoder input format.
+ */
+void transcode_renditions_filters_init( sout_stream_t *p_stream,
+                                        sout_stream_id_sys_t *id )
+{
+    filter_owner_t owner = {
+        .sys = p_stream->p_sys,
+        .video = {
+            .buffer_new = transcode_rendition_buffer_new,
+        },
+    };
+    const es_format_t *p_fmt_in = &id->p_encoder->fmt_in;
+
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+        const es_format_t *p_fmt_out = &p_rend->p_encoder->fmt_in;
+
+        if( p_rend->p_chain )
+            filter_chain_Delete( p_rend->p_chain );
+        p_rend->p_chain = filter_chain_NewVideo( p_stream, false, &owner );
+        if( unlikely(p_rend->p_chain == NULL) )
+            break;
+        filter_chain_Reset( p_rend->p_chain, p_fmt_in, p_fmt_out );
+
+        if( ( p_fmt_in->video.i_chroma != p_fmt_out->video.i_chroma ) ||
+            ( p_fmt_in->video.i_width != p_fmt_out->video.i_width ) ||
+            ( p_fmt_in->video.i_height != p_fmt_out->video.i_height ) )
+        {
+            if( filter_chain_AppendFilter( p_rend->p_chain, NULL, NULL,
+                                           p_fmt_in, p_fmt_out ) == NULL )
+            {
+                /* This and the smaller renditions get no pictures */
+                msg_Err( p_stream, "cannot scale to %ux%u",
+                         p_fmt_out->video.i_width,
+                         p_fmt_out->video.i_height );
+                filter_chain_Delete( p_rend->p_chain );
+                p_rend->p_chain = NULL;
+                break;
+            }
+        }
+        p_fmt_in = p_fmt_out;
+    }
+}
+
+/**
+ * Scales a picture given to the main encoder down the renditions, and
+ * encodes it (or queues it for encoding) for each of them.
+ */
+void transcode_renditions_feed( sout_stream_id_sys_t *id, picture_t *p_pic )
+{
+    picture_t *p_prev = picture_Hold( p_pic );
+
+    for( unsigned i = 0; i < id->i_renditions && p_prev != NULL; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+
+        if( p_rend->p_chain == NULL )
+            break;
+
+        picture_t *p_scaled = filter_chain_VideoFilter( p_rend->p_chain,
+                                                        p_prev );
+        p_prev = p_scaled;
+        if( p_scaled == NULL )
+            break;
+
+        if( p_rend->b_stage )
+            transcode_stage_Push( &p_rend->stage, picture_Hold( p_scaled ) );
+        else
+            RenditionAppend( p_rend,
+                p_rend->p_encoder->pf_encode_video( p_rend->p_encoder,
+                                                    p_scaled ) );
+    }
+
+    if( p_prev != NULL )
+        picture_Release( p_prev );
+}
+
+/**
+ * Encodes what the renditions still hold, stopping their threads.
+ */
+void transcode_renditions_flush( sout_stream_t *p_stream,
+                                 sout_stream_id_sys_t *id )
+{
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+
+        if( p_rend->b_stage )
+        {
+            transcode_stage_Stop( VLC_OBJECT(p_stream), &p_rend->stage );
+            p_rend->b_stage = false;
+        }
+        else
+            RenditionDrain( p_rend );
+    }
+}
+
+/**
+ * Sends the encoded renditions, along with p_main from the main encoder.
+ */
+void transcode_renditions_send( sout_stream_t *p_stream,
+                                sout_stream_id_sys_t *id,
+                                const block_t *p_main )
+{
+    if( id->i_renditions == 0 )
+        return;
+
+    for( const block_t *p = p_main; p != NULL; p = p->p_next )
+        if( p->i_flags & BLOCK_FLAG_TYPE_I )
+            id->i_keyframes++;
+
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+
+        vlc_mutex_lock( &p_rend->lock );
+        block_t *p_out = p_rend->p_out;
+        p_rend->p_out = NULL;
+        vlc_mutex_unlock( &p_rend->lock );
+
+        if( p_out )
+            sout_StreamIdSend( p_stream->p_next, p_rend->id, p_out );
+    }
+}
+
+void transcode_renditions_close( sout_stream_t *p_stream,
+                                 sout_stream_id_sys_t *id )
+{
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        transcode_rendition_t *p_rend = &id->p_renditions[i];
+
+        if( p_rend->b_stage )
+            transcode_stage_Stop( VLC_OBJECT(p_stream), &p_rend->stage );
+        block_ChainRelease( p_rend->p_out );
+
+        if( p_rend->i_keyframes != id->i_keyframes )
+            msg_Warn( p_stream, "%s: %u keyframes, %u in the main video, "
+                      "segments are not aligned", p_rend->psz_name,
+                      p_rend->i_keyframes, id->i_keyframes );
+
+        vlc_mutex_destroy( &p_rend->lock );
+        RenditionDelete( p_stream, p_rend );
+    }
+
+    free( id->p_renditions );
+    id->p_renditions = NULL;
+    id->i_renditions = 0;
+}
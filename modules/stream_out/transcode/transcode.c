@@ -67,6 +67,14 @@
 #define WIDTH_TEXT N_("Video width")
 #define WIDTH_LONGTEXT N_( \
     "Output video width." )
+#define RENDITIONS_TEXT N_("Video renditions")
+#define RENDITIONS_LONGTEXT N_( \
+    "Comma-separated list of additional sizes to encode the video at, as " \
+    "width[xheight][:bitrate], e.g. 960x540:1800,640x360:800. The video is " \
+    "decoded and filtered once, then scaled from each size to the next " \
+    "smaller one. Each size is an additional video stream, with the ID of " \
+    "the video plus 1000 times its rank. Use encoder options with a fixed " \
+    "GOP to get keyframes on the same pictures." )
 #define HEIGHT_TEXT N_("Video height")
 #define HEIGHT_LONGTEXT N_( \
     "Output video height." )
@@ -134,6 +142,10 @@
 #define POOL_TEXT N_("Picture pool size")
 #define POOL_LONGTEXT N_( "Defines how many pictures we allow to be in pool "\
     "between decoder/encoder threads when threads > 0" )
+#define PIPELINE_TEXT N_("Pipelined video filters")
+#define PIPELINE_LONGTEXT N_( \
+    "Runs deinterlacing, user filters and scaling/conversion on their own " \
+    "threads, each with a queue of pool size pictures, when threads > 0." )
 
 
 static const char *const ppsz_deinterlace_type[] =
@@ -182,6 +194,8 @@ vlc_module_begin ()
                  MAXHEIGHT_LONGTEXT, true )
     add_module_list( SOUT_CFG_PREFIX "vfilter", "video filter",
                      NULL, VFILTER_TEXT, VFILTER_LONGTEXT, false )
+    add_string( SOUT_CFG_PREFIX "renditions", NULL, RENDITIONS_TEXT,
+                RENDITIONS_LONGTEXT, true )
 
     set_section( N_("Audio"), NULL )
     add_module( SOUT_CFG_PREFIX "aenc", "encoder", NULL, AENC_TEXT,
@@ -223,6 +237,8 @@ vlc_module_begin ()
         change_integer_range( 1, 1000 )
     add_bool( SOUT_CFG_PREFIX "high-priority", false, HP_TEXT, HP_LONGTEXT,
               true )
+    add_bool( SOUT_CFG_PREFIX "pipeline", false, PIPELINE_TEXT,
+              PIPELINE_LONGTEXT, true )
 
 vlc_module_end ()
 
@@ -232,7 +248,7 @@ static const char *const ppsz_sout_options[] = {
     "deinterlace-module", "threads", "aenc", "acodec", "ab", "alang",
     "afilter", "samplerate", "channels", "senc", "scodec", "soverlay",
     "sfilter", "osd", "high-priority", "maxwidth", "maxheight", "pool-size",
-    NULL
+    "pipeline", "renditions", NULL
 };
 
 /*****************************************************************************
@@ -356,6 +372,10 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->i_maxheight = var_GetInteger( p_stream, SOUT_CFG_PREFIX "maxheight" );
 
+    psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "renditions" );
+    transcode_renditions_parse( p_stream, p_sys, psz_string );
+    free( psz_string );
+
     psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "vfilter" );
     if( psz_string && *psz_string )
         p_sys->psz_vf2 = strdup(psz_string );
@@ -381,6 +401,12 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_threads = var_GetInteger( p_stream, SOUT_CFG_PREFIX "threads" );
     p_sys->pool_size = var_GetInteger( p_stream, SOUT_CFG_PREFIX "pool-size" );
     p_sys->b_high_priority = var_GetBool( p_stream, SOUT_CFG_PREFIX "high-priority" );
+    p_sys->b_pipeline = var_GetBool( p_stream, SOUT_CFG_PREFIX "pipeline" );
+    if( p_sys->b_pipeline && p_sys->i_threads <= 0 )
+    {
+        msg_Warn( p_stream, "pipelined video filters need threads" );
+        p_sys->b_pipeline = false;
+    }
 
     if( p_sys->i_vcodec )
     {
@@ -491,6 +517,7 @@ static void Close( vlc_object_t * p_this )
     free( p_sys->psz_alang );
 
     free( p_sys->psz_vf2 );
+    free( p_sys->p_rendition_cfg );
 
     config_ChainDestroy( p_sys->p_video_cfg );
     free( p_sys->psz_venc );
@@ -14,6 +14,70 @@
 /*100ms is around the limit where people are noticing lipsync issues*/
 #define MASTER_SYNC_MAX_DRIFT 100000
 
+/* Video stages before the encoder: deinterlace, user filters, conversion */
+#define TRANSCODE_STAGES 3
+
+typedef struct
+{
+    uint64_t        i_pictures;
+    mtime_t         i_wait;         /**< Time spent in the queue */
+    mtime_t         i_wait_max;
+    mtime_t         i_busy;         /**< Time spent processing */
+    mtime_t         i_busy_max;
+    unsigned        i_backlog_max;  /**< Largest number of queued pictures */
+    uint64_t        i_stalls;       /**< Pushes that waited for room */
+    mtime_t         i_stall;
+} transcode_stage_stats_t;
+
+/* Interval of the periodic reports of the counters */
+#define TRANSCODE_REPORT_INTERVAL (10 * CLOCK_FREQ)
+
+/* Worker thread with a bounded queue of pictures */
+typedef struct transcode_stage_t transcode_stage_t;
+struct transcode_stage_t
+{
+    vlc_object_t    *p_obj;
+    const char      *psz_name;
+    vlc_thread_t    thread;
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait;
+    vlc_cond_t      room;
+    picture_t       **pp_queue;
+    mtime_t         *p_dates;
+    unsigned        i_size;
+    unsigned        i_first;
+    unsigned        i_count;
+    bool            b_closing;
+
+    void            (*pf_process)( transcode_stage_t *, picture_t * );
+    void            *p_sys;
+
+    transcode_stage_stats_t stats;
+    mtime_t         i_report;       /**< Date of the next report */
+};
+
+/* Additional encoded size of the video, sharing its decoder and filters */
+typedef struct
+{
+    unsigned        i_width;
+    unsigned        i_height;       /**< 0 to keep the aspect ratio */
+    int             i_bitrate;      /**< 0 to scale the video bitrate */
+} transcode_rendition_cfg_t;
+
+typedef struct
+{
+    encoder_t       *p_encoder;
+    filter_chain_t  *p_chain;       /**< Scaling from the previous rendition */
+    void            *id;
+    char            psz_name[32];
+    transcode_stage_t stage;        /**< Encoder thread, if threads > 0 */
+    bool            b_stage;
+
+    vlc_mutex_t     lock;
+    block_t         *p_out;         /**< Encoded and not sent yet */
+    unsigned        i_keyframes;
+} transcode_rendition_t;
+
 struct sout_stream_sys_t
 {
     sout_stream_id_sys_t *id_video;
@@ -25,6 +89,16 @@ struct sout_stream_sys_t
     vlc_sem_t       picture_pool_has_room;
     uint32_t        pool_size;
     vlc_thread_t    thread;
+    mtime_t         *p_pics_dates;  /**< Queuing dates of pp_pics */
+    unsigned        i_pics_first;
+    unsigned        i_pics;
+    transcode_stage_stats_t encoder_stats;
+    mtime_t         i_encoder_report;
+
+    /* Video pipeline */
+    bool            b_pipeline;
+    unsigned        i_stages;
+    transcode_stage_t stages[TRANSCODE_STAGES];
 
     /* Audio */
     vlc_fourcc_t    i_acodec;   /* codec audio (0 if not transcode) */
@@ -45,6 +119,8 @@ struct sout_stream_sys_t
     double          f_scale;
     unsigned int    i_width, i_maxwidth;
     unsigned int    i_height, i_maxheight;
+    transcode_rendition_cfg_t *p_rendition_cfg;
+    unsigned        i_renditions;
     bool            b_deinterlace;
     char            *psz_deinterlace;
     config_chain_t  *p_deinterlace_cfg;
@@ -93,7 +169,11 @@ struct sout_stream_id_sys_t
          {
              filter_chain_t  *p_f_chain; /**< Video filters */
              filter_chain_t  *p_uf_chain; /**< User-specified video filters */
+             filter_chain_t  *p_conv_chain; /**< Scaling and conversion */
              video_format_t  fmt_input_video;
+             transcode_rendition_t *p_renditions; /**< Largest first */
+             unsigned        i_renditions;
+             unsigned        i_keyframes; /**< Sent by the main encoder */
          };
          struct
          {
@@ -112,6 +192,29 @@ struct sout_stream_id_sys_t
 
 };
 
+/* Pipeline */
+
+int  transcode_stage_Start( vlc_object_t *, transcode_stage_t *, const char *psz_name,
+                            unsigned i_size, int i_priority,
+                            void (*)( transcode_stage_t *, picture_t * ),
+                            void *p_sys );
+void transcode_stage_Push ( transcode_stage_t *, picture_t * );
+void transcode_stage_Stop ( vlc_object_t *, transcode_stage_t * );
+void transcode_stage_LogStats( vlc_object_t *, const char *psz_name,
+                               const transcode_stage_stats_t *, unsigned i_size );
+
+/* Renditions */
+
+int  transcode_renditions_parse( sout_stream_t *, sout_stream_sys_t *,
+                                 const char * );
+void transcode_renditions_open( sout_stream_t *, sout_stream_id_sys_t * );
+void transcode_renditions_filters_init( sout_stream_t *, sout_stream_id_sys_t * );
+void transcode_renditions_feed( sout_stream_id_sys_t *, picture_t * );
+void transcode_renditions_flush( sout_stream_t *, sout_stream_id_sys_t * );
+void transcode_renditions_send( sout_stream_t *, sout_stream_id_sys_t *,
+                                const block_t *p_main );
+void transcode_renditions_close( sout_stream_t *, sout_stream_id_sys_t * );
+
 /* OSD */
 
 int transcode_osd_new( sout_stream_t *p_stream, sout_stream_id_sys_t *id );
@@ -35,6 +35,8 @@
 #include <vlc_spu.h>
 #include <vlc_modules.h>
 
+#include <assert.h>
+
 #define ENC_FRAMERATE (25 * 1000)
 #define ENC_FRAMERATE_BASE 1000
 
@@ -43,6 +45,8 @@ struct decoder_owner_sys_t
     sout_stream_sys_t *p_sys;
 };
 
+static void transcode_video_pipeline_stop( sout_stream_t * );
+
 static int video_update_format_decoder( decoder_t *p_dec )
 {
     p_dec->fmt_out.video.i_chroma = p_dec->fmt_out.i_codec;
@@ -66,6 +70,41 @@ static picture_t *transcode_video_filter_buffer_new( filter_t *p_filter )
     return picture_NewFromFormat( &p_filter->fmt_out.video );
 }
 
+/* Encoder thread counters, the same as the pipeline stages; called with
+ * lock_out held */
+static void EncoderQueued( sout_stream_sys_t *p_sys )
+{
+    if( p_sys->i_pics >= p_sys->pool_size )
+        return;
+    p_sys->p_pics_dates[(p_sys->i_pics_first + p_sys->i_pics)
+                        % p_sys->pool_size] = mdate();
+    p_sys->i_pics++;
+    p_sys->encoder_stats.i_backlog_max =
+        __MAX( p_sys->encoder_stats.i_backlog_max, p_sys->i_pics );
+}
+
+static mtime_t EncoderDequeued( sout_stream_sys_t *p_sys )
+{
+    if( p_sys->i_pics == 0 )
+        return 0;
+    const mtime_t i_wait = mdate() - p_sys->p_pics_dates[p_sys->i_pics_first];
+    p_sys->i_pics_first = (p_sys->i_pics_first + 1) % p_sys->pool_size;
+    p_sys->i_pics--;
+    return i_wait;
+}
+
+static void EncoderStats( sout_stream_sys_t *p_sys, mtime_t i_wait,
+                          mtime_t i_busy )
+{
+    transcode_stage_stats_t *p_stats = &p_sys->encoder_stats;
+
+    p_stats->i_pictures++;
+    p_stats->i_wait += i_wait;
+    p_stats->i_wait_max = __MAX( p_stats->i_wait_max, i_wait );
+    p_stats->i_busy += i_busy;
+    p_stats->i_busy_max = __MAX( p_stats->i_busy_max, i_busy );
+}
+
 static void* EncoderThread( void *obj )
 {
     sout_stream_sys_t *p_sys = (sout_stream_sys_t*)obj;
@@ -85,12 +124,17 @@ static void* EncoderThread( void *obj )
 
         if( p_pic )
         {
+            const mtime_t i_wait = EncoderDequeued( p_sys );
+
             /* release lock while encoding */
             vlc_mutex_unlock( &p_sys->lock_out );
+            const mtime_t i_start = mdate();
             p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
+            const mtime_t i_busy = mdate() - i_start;
             picture_Release( p_pic );
             vlc_mutex_lock( &p_sys->lock_out );
 
+            EncoderStats( p_sys, i_wait, i_busy );
             block_ChainAppend( &p_sys->p_buffers, p_block );
         }
 
@@ -102,7 +146,10 @@ static void* EncoderThread( void *obj )
     while( (p_pic = picture_fifo_Pop( p_sys->pp_pics )) != NULL )
     {
         vlc_sem_post( &p_sys->picture_pool_has_room );
+        const mtime_t i_wait = EncoderDequeued( p_sys );
+        const mtime_t i_start = mdate();
         p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
+        EncoderStats( p_sys, i_wait, mdate() - i_start );
         picture_Release( p_pic );
         block_ChainAppend( &p_sys->p_buffers, p_block );
     }
@@ -221,9 +268,14 @@ int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
                        VLC_THREAD_PRIORITY_VIDEO;
     p_sys->id_video = id;
     p_sys->pp_pics = picture_fifo_New();
-    if( p_sys->pp_pics == NULL )
+    p_sys->p_pics_dates = malloc( p_sys->pool_size
+                                  * sizeof(*p_sys->p_pics_dates) );
+    if( p_sys->pp_pics == NULL || p_sys->p_pics_dates == NULL )
     {
         msg_Err( p_stream, "cannot create picture fifo" );
+        if( p_sys->pp_pics != NULL )
+            picture_fifo_Delete( p_sys->pp_pics );
+        free( p_sys->p_pics_dates );
         module_unneed( id->p_decoder, id->p_decoder->p_module );
         id->p_decoder->p_module = NULL;
         free( id->p_decoder->p_owner );
@@ -235,12 +287,16 @@ int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
     vlc_cond_init( &p_sys->cond );
     p_sys->p_buffers = NULL;
     p_sys->b_abort = false;
+    p_sys->i_pics_first = p_sys->i_pics = 0;
+    memset( &p_sys->encoder_stats, 0, sizeof(p_sys->encoder_stats) );
+    p_sys->i_encoder_report = mdate() + TRANSCODE_REPORT_INTERVAL;
     if( vlc_clone( &p_sys->thread, EncoderThread, p_sys, i_priority ) )
     {
         msg_Err( p_stream, "cannot spawn encoder thread" );
         vlc_mutex_destroy( &p_sys->lock_out );
         vlc_cond_destroy( &p_sys->cond );
         picture_fifo_Delete( p_sys->pp_pics );
+        free( p_sys->p_pics_dates );
         module_unneed( id->p_decoder, id->p_decoder->p_module );
         id->p_decoder->p_module = NULL;
         free( id->p_decoder->p_owner );
@@ -324,8 +380,10 @@ static void transcode_video_filter_init( sout_stream_t *p_stream,
     id->p_encoder->fmt_in.video.b_color_range_full = id->p_decoder->fmt_out.video.b_color_range_full;
 }
 
-/* Take care of the scaling and chroma conversions. */
-static void conversion_video_filter_append( sout_stream_id_sys_t *id )
+/* Take care of the scaling and chroma conversions, in a chain of their own
+ * so that they can run on their own pipeline stage. */
+static int conversion_video_filter_append( sout_stream_t *p_stream,
+                                           sout_stream_id_sys_t *id )
 {
     const es_format_t *p_fmt_out = &id->p_decoder->fmt_out;
     if( id->p_f_chain )
@@ -338,11 +396,60 @@ static void conversion_video_filter_append( sout_stream_id_sys_t *id )
         ( p_fmt_out->video.i_width != id->p_encoder->fmt_in.video.i_width ) ||
         ( p_fmt_out->video.i_height != id->p_encoder->fmt_in.video.i_height ) )
     {
-        filter_chain_AppendFilter( id->p_uf_chain ? id->p_uf_chain : id->p_f_chain,
+        filter_owner_t owner = {
+            .sys = p_stream->p_sys,
+            .video = {
+                .buffer_new = transcode_video_filter_buffer_new,
+            },
+        };
+
+        id->p_conv_chain = filter_chain_NewVideo( p_stream, false, &owner );
+        if( !id->p_conv_chain )
+            return VLC_ENOMEM;
+        filter_chain_Reset( id->p_conv_chain, p_fmt_out,
+                            &id->p_encoder->fmt_in );
+        filter_chain_AppendFilter( id->p_conv_chain,
                                    NULL, NULL,
                                    p_fmt_out,
                                    &id->p_encoder->fmt_in );
     }
+    return VLC_SUCCESS;
+}
+
+/* Filter chains in processing order, skipping the empty ones */
+static unsigned transcode_video_chains( sout_stream_id_sys_t *id,
+                                        filter_chain_t **pp_chains,
+                                        const char **ppsz_names )
+{
+    filter_chain_t *const chains[TRANSCODE_STAGES] = {
+        id->p_f_chain, id->p_uf_chain, id->p_conv_chain,
+    };
+    static const char *const names[TRANSCODE_STAGES] = {
+        "deinterlace", "filter", "convert",
+    };
+    unsigned i_count = 0;
+
+    for( unsigned i = 0; i < TRANSCODE_STAGES; i++ )
+    {
+        if( chains[i] == NULL || filter_chain_GetLength( chains[i] ) == 0 )
+            continue;
+        pp_chains[i_count] = chains[i];
+        if( ppsz_names )
+            ppsz_names[i_count] = names[i];
+        i_count++;
+    }
+    return i_count;
+}
+
+static void transcode_video_filters_delete( sout_stream_id_sys_t *id )
+{
+    if( id->p_f_chain )
+        filter_chain_Delete( id->p_f_chain );
+    if( id->p_uf_chain )
+        filter_chain_Delete( id->p_uf_chain );
+    if( id->p_conv_chain )
+        filter_chain_Delete( id->p_conv_chain );
+    id->p_f_chain = id->p_uf_chain = id->p_conv_chain = NULL;
 }
 
 static void transcode_video_framerate_init( sout_stream_t *p_stream,
@@ -614,6 +721,8 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
 void transcode_video_close( sout_stream_t *p_stream,
                                    sout_stream_id_sys_t *id )
 {
+    transcode_video_pipeline_stop( p_stream );
+
     if( p_stream->p_sys->i_threads >= 1 && !p_stream->p_sys->b_abort )
     {
         vlc_mutex_lock( &p_stream->p_sys->lock_out );
@@ -622,6 +731,9 @@ void transcode_video_close( sout_stream_t *p_stream,
         vlc_mutex_unlock( &p_stream->p_sys->lock_out );
 
         vlc_join( p_stream->p_sys->thread, NULL );
+        transcode_stage_LogStats( VLC_OBJECT(p_stream), "encode",
+                                  &p_stream->p_sys->encoder_stats,
+                                  p_stream->p_sys->pool_size );
 
         picture_fifo_Delete( p_stream->p_sys->pp_pics );
         block_ChainRelease( p_stream->p_sys->p_buffers );
@@ -631,8 +743,11 @@ void transcode_video_close( sout_stream_t *p_stream,
     {
         vlc_mutex_destroy( &p_stream->p_sys->lock_out );
         vlc_cond_destroy( &p_stream->p_sys->cond );
+        free( p_stream->p_sys->p_pics_dates );
     }
 
+    transcode_renditions_close( p_stream, id );
+
     /* Close decoder */
     if( id->p_decoder->p_module )
         module_unneed( id->p_decoder, id->p_decoder->p_module );
@@ -646,10 +761,7 @@ void transcode_video_close( sout_stream_t *p_stream,
         module_unneed( id->p_encoder, id->p_encoder->p_module );
 
     /* Close filters */
-    if( id->p_f_chain )
-        filter_chain_Delete( id->p_f_chain );
-    if( id->p_uf_chain )
-        filter_chain_Delete( id->p_uf_chain );
+    transcode_video_filters_delete( id );
 }
 
 static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_id_sys_t *id, block_t **out )
@@ -679,7 +791,8 @@ static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_
         /* Overlay subpicture */
         if( p_subpic )
         {
-            if( picture_IsReferenced( p_pic ) && !filter_chain_GetLength( id->p_f_chain ) )
+            if( picture_IsReferenced( p_pic ) &&
+                !filter_chain_GetLength( id->p_f_chain ) && !id->p_conv_chain )
             {
                 /* We can't modify the picture, we need to duplicate it,
                  * in this point the picture is already p_encoder->fmt.in format*/
@@ -699,6 +812,9 @@ static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_
         }
     }
 
+    if( id->i_renditions > 0 )
+        transcode_renditions_feed( id, p_pic );
+
     if( p_sys->i_threads == 0 )
     {
         block_t *p_block;
@@ -712,6 +828,7 @@ static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_
         vlc_sem_wait( &p_sys->picture_pool_has_room );
         vlc_mutex_lock( &p_sys->lock_out );
         picture_fifo_Push( p_sys->pp_pics, p_pic );
+        EncoderQueued( p_sys );
         vlc_cond_signal( &p_sys->cond );
         vlc_mutex_unlock( &p_sys->lock_out );
     }
@@ -722,6 +839,98 @@ static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_
         picture_Release( p_pic );
 }
 
+/* Run the filter chains and output; each chain first with the picture,
+ * and then with NULL as many times as we need until it stops outputting
+ * frames. */
+static void transcode_video_filter_run( sout_stream_t *p_stream,
+                                        sout_stream_id_sys_t *id,
+                                        filter_chain_t **pp_chains,
+                                        unsigned i_chains,
+                                        picture_t *p_pic, block_t **out )
+{
+    if( i_chains == 0 )
+    {
+        OutputFrame( p_stream, p_pic, id, out );
+        return;
+    }
+
+    while( (p_pic = filter_chain_VideoFilter( pp_chains[0], p_pic )) )
+    {
+        transcode_video_filter_run( p_stream, id, pp_chains + 1, i_chains - 1,
+                                    p_pic, out );
+        p_pic = NULL;
+    }
+}
+
+/* Runs the chain of a pipeline stage, feeding the next stage or the
+ * encoder */
+static void transcode_video_stage_process( transcode_stage_t *p_stage,
+                                           picture_t *p_pic )
+{
+    sout_stream_t *p_stream = p_stage->p_sys;
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    sout_stream_id_sys_t *id = p_sys->id_video;
+    const unsigned i_stage = p_stage - p_sys->stages;
+    filter_chain_t *chains[TRANSCODE_STAGES];
+
+    if( p_pic == NULL )
+        return;
+
+    transcode_video_chains( id, chains, NULL );
+    while( (p_pic = filter_chain_VideoFilter( chains[i_stage], p_pic )) )
+    {
+        if( i_stage + 1 < p_sys->i_stages )
+            transcode_stage_Push( &p_sys->stages[i_stage + 1], p_pic );
+        else
+            OutputFrame( p_stream, p_pic, id, NULL );
+        p_pic = NULL;
+    }
+}
+
+/* Starts one stage per non-empty filter chain, the sout thread being the
+ * decoding stage and the encoder thread the last one */
+static void transcode_video_pipeline_start( sout_stream_t *p_stream,
+                                            sout_stream_id_sys_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    filter_chain_t *chains[TRANSCODE_STAGES];
+    const char *names[TRANSCODE_STAGES];
+
+    assert( p_sys->i_stages == 0 );
+    if( !p_sys->b_pipeline )
+        return;
+
+    int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
+                       VLC_THREAD_PRIORITY_VIDEO;
+    const unsigned i_chains = transcode_video_chains( id, chains, names );
+
+    for( unsigned i = 0; i < i_chains; i++ )
+    {
+        if( transcode_stage_Start( VLC_OBJECT(p_stream), &p_sys->stages[i],
+                                   names[i],
+                                   p_sys->pool_size, i_priority,
+                                   transcode_video_stage_process,
+                                   p_stream ) )
+        {
+            msg_Warn( p_stream, "cannot spawn %s stage thread, "
+                      "filtering on the stream thread", names[i] );
+            transcode_video_pipeline_stop( p_stream );
+            return;
+        }
+        p_sys->i_stages++;
+    }
+}
+
+/* Stops the stages in order, each one flushing into the next one */
+static void transcode_video_pipeline_stop( sout_stream_t *p_stream )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    for( unsigned i = 0; i < p_sys->i_stages; i++ )
+        transcode_stage_Stop( VLC_OBJECT(p_stream), &p_sys->stages[i] );
+    p_sys->i_stages = 0;
+}
+
 int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                                     block_t *in, block_t **out )
 {
@@ -738,23 +947,30 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                 p_block = id->p_encoder->pf_encode_video(id->p_encoder, NULL );
                 block_ChainAppend( out, p_block );
             } while( p_block );
+            transcode_renditions_flush( p_stream, id );
         }
         else
         {
             msg_Dbg( p_stream, "Flushing thread and waiting that");
+            transcode_video_pipeline_stop( p_stream );
+
             vlc_mutex_lock( &p_stream->p_sys->lock_out );
             p_stream->p_sys->b_abort = true;
             vlc_cond_signal( &p_stream->p_sys->cond );
             vlc_mutex_unlock( &p_stream->p_sys->lock_out );
 
             vlc_join( p_stream->p_sys->thread, NULL );
+            transcode_stage_LogStats( VLC_OBJECT(p_stream), "encode",
+                                      &p_sys->encoder_stats, p_sys->pool_size );
             vlc_mutex_lock( &p_sys->lock_out );
             *out = p_sys->p_buffers;
             p_sys->p_buffers = NULL;
             vlc_mutex_unlock( &p_sys->lock_out );
 
+            transcode_renditions_flush( p_stream, id );
             msg_Dbg( p_stream, "Flushing done");
         }
+        transcode_renditions_send( p_stream, id, *out );
         return VLC_SUCCESS;
     }
 
@@ -773,12 +989,8 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                         id->fmt_input_video.i_sar_den, id->p_decoder->fmt_out.video.i_sar_den
                     );
             /* Close filters */
-            if( id->p_f_chain )
-                filter_chain_Delete( id->p_f_chain );
-            id->p_f_chain = NULL;
-            if( id->p_uf_chain )
-                filter_chain_Delete( id->p_uf_chain );
-            id->p_uf_chain = NULL;
+            transcode_video_pipeline_stop( p_stream );
+            transcode_video_filters_delete( id );
 
             /* Reinitialize filters */
             id->p_encoder->fmt_out.video.i_visible_width  = p_sys->i_width & ~1;
@@ -787,25 +999,30 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
 
             transcode_video_filter_init( p_stream, id );
             transcode_video_encoder_init( p_stream, id );
-            conversion_video_filter_append( id );
+            if( conversion_video_filter_append( p_stream, id ) )
+            {
+                picture_Release( p_pic );
+                block_Release( in );
+                transcode_video_close( p_stream, id );
+                id->b_transcode = false;
+                return VLC_EGENERIC;
+            }
+            transcode_renditions_filters_init( p_stream, id );
             memcpy( &id->fmt_input_video, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
+            transcode_video_pipeline_start( p_stream, id );
         }
 
 
         if( unlikely( !id->p_encoder->p_module ) )
         {
-            if( id->p_f_chain )
-                filter_chain_Delete( id->p_f_chain );
-            if( id->p_uf_chain )
-                filter_chain_Delete( id->p_uf_chain );
-            id->p_f_chain = id->p_uf_chain = NULL;
+            transcode_video_filters_delete( id );
 
             transcode_video_filter_init( p_stream, id );
             transcode_video_encoder_init( p_stream, id );
-            conversion_video_filter_append( id );
             memcpy( &id->fmt_input_video, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
 
-            if( transcode_video_encoder_open( p_stream, id ) != VLC_SUCCESS )
+            if( conversion_video_filter_append( p_stream, id ) != VLC_SUCCESS ||
+                transcode_video_encoder_open( p_stream, id ) != VLC_SUCCESS )
             {
                 picture_Release( p_pic );
                 block_Release( in );
@@ -813,48 +1030,45 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                 id->b_transcode = false;
                 return VLC_EGENERIC;
             }
+            transcode_renditions_open( p_stream, id );
+            transcode_video_pipeline_start( p_stream, id );
         }
 
-        /* Run the filter and output chains; first with the picture,
-         * and then with NULL as many times as we need until they
-         * stop outputting frames.
-         */
-        for ( ;; ) {
-            picture_t *p_filtered_pic = p_pic;
-
-            /* Run filter chain */
-            if( id->p_f_chain )
-                p_filtered_pic = filter_chain_VideoFilter( id->p_f_chain, p_filtered_pic );
-            if( !p_filtered_pic )
-                break;
-
-            for ( ;; ) {
-                picture_t *p_user_filtered_pic = p_filtered_pic;
-
-                /* Run user specified filter chain */
-                if( id->p_uf_chain )
-                    p_user_filtered_pic = filter_chain_VideoFilter( id->p_uf_chain, p_user_filtered_pic );
-                if( !p_user_filtered_pic )
-                    break;
-
-                OutputFrame( p_stream, p_user_filtered_pic, id, out );
-
-                p_filtered_pic = NULL;
-            }
-
-            p_pic = NULL;
+        if( p_sys->i_stages > 0 )
+        {
+            transcode_stage_Push( &p_sys->stages[0], p_pic );
+            continue;
         }
+
+        filter_chain_t *chains[TRANSCODE_STAGES];
+        const unsigned i_chains = transcode_video_chains( id, chains, NULL );
+        transcode_video_filter_run( p_stream, id, chains, i_chains, p_pic, out );
     }
 
     if( p_sys->i_threads >= 1 )
     {
+        transcode_stage_stats_t stats;
+        const mtime_t i_now = mdate();
+        bool b_report = false;
+
         /* Pick up any return data the encoder thread wants to output. */
         vlc_mutex_lock( &p_sys->lock_out );
         *out = p_sys->p_buffers;
         p_sys->p_buffers = NULL;
+        if( i_now >= p_sys->i_encoder_report )
+        {
+            stats = p_sys->encoder_stats;
+            p_sys->i_encoder_report = i_now + TRANSCODE_REPORT_INTERVAL;
+            b_report = true;
+        }
         vlc_mutex_unlock( &p_sys->lock_out );
+
+        if( b_report )
+            transcode_stage_LogStats( VLC_OBJECT(p_stream), "encode", &stats,
+                                      p_sys->pool_size );
     }
 
+    transcode_renditions_send( p_stream, id, *out );
     return VLC_SUCCESS;
 }
 
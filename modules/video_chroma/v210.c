@@ -0,0 +1,104 @@
+/*****************************************************************************
+ * v210.c : v210 to/from planar YUV 4:2:2 10 bits conversion module for vlc
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_filter.h>
+
+#include "../access/sdi.h"
+
+/*****************************************************************************
+ * Local and extern prototypes.
+ *****************************************************************************/
+static int  Activate ( vlc_object_t * );
+
+static void V210_I422_10L           ( filter_t *, picture_t *, picture_t * );
+static void I422_10L_V210           ( filter_t *, picture_t *, picture_t * );
+static picture_t *V210_I422_10L_Filter    ( filter_t *, picture_t * );
+static picture_t *I422_10L_V210_Filter    ( filter_t *, picture_t * );
+
+/*****************************************************************************
+ * Module descriptor
+ *****************************************************************************/
+vlc_module_begin ()
+    set_description( N_("v210 to/from planar YUV 4:2:2 10 bits conversions") )
+    set_capability( "video filter", 160 )
+    set_callbacks( Activate, NULL )
+vlc_module_end ()
+
+/*****************************************************************************
+ * Activate: allocate a chroma function
+ *****************************************************************************
+ * This function allocates and initializes a chroma function
+ *****************************************************************************/
+static int Activate( vlc_object_t *p_this )
+{
+    filter_t *p_filter = (filter_t *)p_this;
+
+    /* 4:2:2 is subsampled by 2 horizontally */
+    if( p_filter->fmt_in.video.i_width & 1 )
+        return -1;
+
+    /* resizing not supported */
+    if( p_filter->fmt_in.video.i_width != p_filter->fmt_out.video.i_width
+     || p_filter->fmt_in.video.i_height != p_filter->fmt_out.video.i_height
+     || p_filter->fmt_in.video.orientation != p_filter->fmt_out.video.orientation)
+        return -1;
+
+    if( p_filter->fmt_in.video.i_chroma == VLC_CODEC_V210
+     && p_filter->fmt_out.video.i_chroma == VLC_CODEC_I422_10L )
+        p_filter->pf_video_filter = V210_I422_10L_Filter;
+    else
+    if( p_filter->fmt_in.video.i_chroma == VLC_CODEC_I422_10L
+     && p_filter->fmt_out.video.i_chroma == VLC_CODEC_V210 )
+        p_filter->pf_video_filter = I422_10L_V210_Filter;
+    else
+        return -1;
+
+    return 0;
+}
+
+/* Following functions are local */
+
+VIDEO_FILTER_WRAPPER( V210_I422_10L )
+VIDEO_FILTER_WRAPPER( I422_10L_V210 )
+
+static void V210_I422_10L( filter_t *p_filter, picture_t *p_source,
+                                               picture_t *p_dest )
+{
+    VLC_UNUSED(p_filter);
+    v210_unpack_picture( p_dest, p_source->p[0].p_pixels,
+                         p_source->p[0].i_pitch );
+}
+
+static void I422_10L_V210( filter_t *p_filter, picture_t *p_source,
+                                               picture_t *p_dest )
+{
+    VLC_UNUSED(p_filter);
+    v210_pack( p_dest->p[0].p_pixels, p_source, p_dest->p[0].i_pitch );
+}
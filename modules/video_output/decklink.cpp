@@ -33,6 +33,7 @@
 #include <vlc_fixups.h>
 #include <cinttypes>
 #include <cassert>
+#include <atomic>
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
@@ -45,22 +46,31 @@
 #include <vlc_image.h>
 #include <vlc_network.h>
 #include <vlc_aout.h>
+#include <vlc_cpu.h>
 #include <arpa/inet.h>
 
+#ifdef HAVE_SSE2_INTRINSICS
+# include <emmintrin.h>
+#endif
+
 #include <DeckLinkAPI.h>
 #include <DeckLinkAPIDispatch.cpp>
 
+#include "../access/sdi.h"
+
 #define MAX_AUDIO_SOURCES 8
 
-/* Number of audio samples we hold in a queue, per stereo pair.
- * Queue them, then process all queues when there is sufficient
- * data from all audio upstream decoders.
- * 48000 samples per second * 16-bits per channel * 2 channels / 30 FPS
- * (i.e. 6400)
- */
-#define MIN_FIFO_SIZE (48000 * 2 * 2 / 30)
+/* Blocks queued per stereo pair, must be a power of two */
+#define AUDIO_RING_SIZE 64
+
+/* Number of output frames the other pairs may get ahead of a missing pair
+ * before its slot is played as silence */
+#define AUDIO_MAX_LATENESS 4
+
+/* Blocks starting this close to the end of the previous one are played
+ * contiguously, to absorb rounding of the decoder timestamps */
+#define AUDIO_JITTER (CLOCK_FREQ / 1000)
 
-static void initAudioSources();
 static void destroyAudioSources();
 
 #define FRAME_SIZE 1920
@@ -82,7 +92,8 @@ static const int pi_channels_maps[CHANNELS_MAX+1] =
 #define NOSIGNAL_INDEX_TEXT N_("Timelength after which we assume there is no signal.")
 #define NOSIGNAL_INDEX_LONGTEXT N_(\
     "Timelength after which we assume there is no signal.\n"\
-    "After this delay we black out the video."\
+    "Until then the last picture is repeated, after this delay we black "\
+    "out the video or show the no signal picture."\
     )
 
 #define CCLINE_INDEX_TEXT N_("Closed Captions line.")
@@ -124,6 +135,16 @@ static const int pi_channels_maps[CHANNELS_MAX+1] =
 #define AUDIO_CHANNEL_MAP_LONGTEXT N_(\
     "Channel mapping list for remapped channels.  Ex: G1P2:G2P1")
 
+#define AUDIO_BITS_TEXT N_("Audio sample size")
+#define AUDIO_BITS_LONGTEXT N_(\
+    "Bits per audio sample sent to the card. 24 bits audio is carried in " \
+    "32 bits samples.")
+
+static const int rgi_audio_bits[] = { 16, 32 };
+static const char *const ppsz_audio_bits_text[] = {
+    N_("16 bits"), N_("24/32 bits"),
+};
+
 #define VIDEO_CONNECTION_TEXT N_("Video connection")
 #define VIDEO_CONNECTION_LONGTEXT N_(\
     "Video connection for DeckLink output.")
@@ -145,12 +166,28 @@ static const char *const ppsz_videoconns_text[] = {
     N_("SDI"), N_("HDMI"), N_("Optical SDI"), N_("Component"), N_("Composite"), N_("S-video")
 };
 
+class DeckLinkFramePool;
+
+struct decklink_frame_t;
+
 struct vout_display_sys_t
 {
     picture_pool_t *pool;
+    DeckLinkFramePool *frames;
     bool tenbits;
     int nosignal_delay;
-    picture_t *pic_nosignal;
+
+    /* Fill frames, see FillVideo().
+     * Protected by <fill_lock>, held by PrepareVideo() while scheduling. */
+    vlc_mutex_t fill_lock;
+    vlc_timer_t fill_timer;
+    mtime_t fill_next;          /* card time the scheduled frames end at */
+    mtime_t fill_last;          /* date of the last picture */
+    decklink_frame_t *fill_source; /* last picture frame, pinned */
+    uint8_t *slate;             /* no signal frame, in the card format */
+    unsigned fills;
+
+    mtime_t frame_sync;         /* capture to output delay, 0 if unknown */
 };
 
 /* Only one audio output module and one video output module
@@ -171,14 +208,19 @@ struct decklink_sys_t
 
     //int i_channels;
     int i_rate;
+    int i_bits;
     int64_t i_max_audio_channels;
     int remap_table[MAX_AUDIO_SOURCES];
 
     BMDTimeScale timescale;
     BMDTimeValue frameduration;
 
-    /* XXX: workaround card clock drift */
-    mtime_t offset;
+    /* Card clock recovery, see UpdateClock().
+     * Protected by <lock>. */
+    mtime_t offset;         /* system time minus card stream time */
+    double drift;           /* card clock drift against the system clock */
+    mtime_t clock_date;     /* last measurement, 0 if none yet */
+    mtime_t stats_date;
 
     int fd;
 };
@@ -243,6 +285,9 @@ vlc_module_begin()
                 CHANNELS_TEXT, CHANNELS_LONGTEXT, true)
     add_string(AUDIO_CFG_PREFIX "channel-map", "",
                 AUDIO_CHANNEL_MAP_TEXT, AUDIO_CHANNEL_MAP_LONGTEXT, true)
+    add_integer(AUDIO_CFG_PREFIX "audio-bits", 16,
+                AUDIO_BITS_TEXT, AUDIO_BITS_LONGTEXT, true)
+        change_integer_list(rgi_audio_bits, ppsz_audio_bits_text)
 
 vlc_module_end ()
 
@@ -263,6 +308,9 @@ static struct decklink_sys_t *GetDLSys(vlc_object_t *obj)
         if (sys) {
             sys->p_output = NULL;
             sys->offset = 0;
+            sys->drift = 0.;
+            sys->clock_date = 0;
+            sys->stats_date = 0;
             sys->users = 0;
             sys->fd = -1;
             char *psz_address = var_InheritString(obj, CFG_PREFIX "udp-monitor");
@@ -284,6 +332,7 @@ static struct decklink_sys_t *GetDLSys(vlc_object_t *obj)
             sys->i_rate = var_InheritInteger(obj, AUDIO_CFG_PREFIX "audio-rate");
             if(sys->i_rate > 0)
                 sys->i_rate = -1;
+            sys->i_bits = var_InheritInteger(obj, AUDIO_CFG_PREFIX "audio-bits") == 32 ? 32 : 16;
             vlc_mutex_init(&sys->lock);
             vlc_cond_init(&sys->cond);
             var_Create(libvlc, "decklink-sys", VLC_VAR_ADDRESS);
@@ -291,7 +340,6 @@ static struct decklink_sys_t *GetDLSys(vlc_object_t *obj)
         }
     }
 
-    initAudioSources();
     vlc_mutex_unlock(&sys_lock);
     return sys;
 }
@@ -618,7 +666,12 @@ static struct decklink_sys_t *OpenDecklink(vout_display_t *vd)
         fmt->i_y_offset = 0;
         fmt->i_sar_num = 0;
         fmt->i_sar_den = 0;
-        fmt->i_chroma = !sys->tenbits ? VLC_CODEC_UYVY : VLC_CODEC_I422_10L; /* we will convert to v210 */
+        if (!sys->tenbits)
+            fmt->i_chroma = VLC_CODEC_UYVY;
+        else if (vd->source.i_chroma == VLC_CODEC_V210)
+            fmt->i_chroma = VLC_CODEC_V210; /* passed through untouched */
+        else
+            fmt->i_chroma = VLC_CODEC_I422_10L; /* we will convert to v210 */
         fmt->i_frame_rate = (unsigned) decklink_sys->frameduration;
         fmt->i_frame_rate_base = (unsigned) decklink_sys->timescale;
     }
@@ -634,7 +687,8 @@ static struct decklink_sys_t *OpenDecklink(vout_display_t *vd)
     {
         result = decklink_sys->p_output->EnableAudioOutput(
             decklink_sys->i_rate,
-            bmdAudioSampleType16bitInteger,
+            decklink_sys->i_bits == 32 ? bmdAudioSampleType32bitInteger
+                                       : bmdAudioSampleType16bitInteger,
             MAX_AUDIO_SOURCES * 2,
             bmdAudioOutputStreamTimestamped);
         CHECK("Could not start audio output");
@@ -684,78 +738,361 @@ error:
  * Video
  *****************************************************************************/
 
-static picture_pool_t *PoolVideo(vout_display_t *vd, unsigned requested_count)
+/* Card frames not backing a picture, used to copy or convert pictures which
+ * do not come from our pool: enough for the frames queued in the card. */
+#define SPARE_FRAMES 6
+/* Pictures held by the card, on top of what the vout core requested */
+#define CARD_FRAMES 4
+#define MAX_FRAMES 64
+
+struct decklink_frame_t
 {
-    vout_display_sys_t *sys = vd->sys;
-    if (!sys->pool)
-        sys->pool = picture_pool_NewFromFormat(&vd->fmt, requested_count);
-    return sys->pool;
+    IDeckLinkMutableVideoFrame *frame;
+    IDeckLinkVideoFrameAncillary *vanc;
+    bool pooled;        /* backs a picture of the vout pool */
+    bool busy;          /* being filled, or scheduled on the card */
+    bool done;          /* completed while pinned */
+    picture_t *held;    /* pool picture to release on completion */
+    mtime_t captured;   /* capture date of the picture, 0 if unknown */
+};
+
+struct picture_sys_t
+{
+    decklink_frame_t *frame;
+};
+
+/* Preallocated card frames, handed back by ScheduledFrameCompleted().
+ * It is reference counted since the SDK may call it after the vout is gone. */
+class DeckLinkFramePool : public IDeckLinkVideoOutputCallback
+{
+public:
+    DeckLinkFramePool(vout_display_t *vd, IDeckLinkOutput *output)
+        : vd_(vd), output_(output), pinned_(NULL), count_(0), late_(0),
+          dropped_(0), latency_sum_(0), latency_max_(0), latency_count_(0)
+    {
+        m_ref_.store(1);
+        vlc_mutex_init(&lock_);
+        vlc_cond_init(&wait_);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID *) { return E_NOINTERFACE; }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)
+    {
+        return m_ref_.fetch_add(1);
+    }
+
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        uintptr_t new_ref = m_ref_.fetch_sub(1);
+        if (new_ref == 1)
+            delete this;
+        return new_ref;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE ScheduledFrameCompleted(IDeckLinkVideoFrame *, BMDOutputFrameCompletionResult);
+
+    virtual HRESULT STDMETHODCALLTYPE ScheduledPlaybackHasStopped(void)
+    {
+        return S_OK;
+    }
+
+    decklink_frame_t *Add(int width, int height, BMDPixelFormat, bool pooled);
+    decklink_frame_t *Get(mtime_t deadline);
+    bool Reserve(decklink_frame_t *);
+    void Put(decklink_frame_t *);
+    void Hold(decklink_frame_t *, picture_t *);
+    void Pin(decklink_frame_t *);
+    bool Latency(mtime_t *average, mtime_t *max);
+    void Detach(unsigned *late, unsigned *dropped);
+
+private:
+    ~DeckLinkFramePool();
+    picture_t *Recycle(decklink_frame_t *);
+
+    std::atomic_uint m_ref_;
+    vlc_mutex_t lock_;
+    vlc_cond_t wait_;
+    vout_display_t *vd_; /* NULL once the vout is closed */
+    IDeckLinkOutput *output_;
+
+    decklink_frame_t frames_[MAX_FRAMES];
+    decklink_frame_t *pinned_;
+    unsigned count_;
+    unsigned late_;
+    unsigned dropped_;
+
+    /* Glass to glass latency since the last call to Latency() */
+    mtime_t latency_sum_;
+    mtime_t latency_max_;
+    unsigned latency_count_;
+};
+
+DeckLinkFramePool::~DeckLinkFramePool()
+{
+    for (unsigned i = 0; i < count_; i++) {
+        if (frames_[i].vanc)
+            frames_[i].vanc->Release();
+        frames_[i].frame->Release();
+    }
+    vlc_cond_destroy(&wait_);
+    vlc_mutex_destroy(&lock_);
 }
 
-static inline void put_le32(uint8_t **p, uint32_t d)
+decklink_frame_t *DeckLinkFramePool::Add(int width, int height,
+                                         BMDPixelFormat format, bool pooled)
 {
-    SetDWLE(*p, d);
-    (*p) += 4;
+    IDeckLinkMutableVideoFrame *frame;
+    IDeckLinkVideoFrameAncillary *vanc = NULL;
+    const int stride = format == bmdFormat10BitYUV ?
+        ((width + 47) / 48) * 128 : width * 2;
+
+    if (count_ >= MAX_FRAMES)
+        return NULL;
+
+    if (output_->CreateVideoFrame(width, height, stride, format,
+                                  bmdFrameFlagDefault, &frame) != S_OK)
+        return NULL;
+
+    if (format == bmdFormat10BitYUV) {
+        if (output_->CreateAncillaryData(format, &vanc) != S_OK ||
+            frame->SetAncillaryData(vanc) != S_OK) {
+            if (vanc)
+                vanc->Release();
+            frame->Release();
+            return NULL;
+        }
+    }
+
+    vlc_mutex_lock(&lock_);
+    decklink_frame_t *f = &frames_[count_++];
+    f->frame = frame;
+    f->vanc = vanc;
+    f->pooled = pooled;
+    f->busy = false;
+    f->done = false;
+    f->held = NULL;
+    f->captured = 0;
+    vlc_mutex_unlock(&lock_);
+    return f;
 }
 
-static inline int clip(int a)
+/* Waits for a spare frame until the deadline */
+decklink_frame_t *DeckLinkFramePool::Get(mtime_t deadline)
 {
-    if      (a < 4) return 4;
-    else if (a > 1019) return 1019;
-    else               return a;
+    decklink_frame_t *f = NULL;
+
+    vlc_mutex_lock(&lock_);
+    for (;;) {
+        for (unsigned i = 0; i < count_ && !f; i++)
+            if (!frames_[i].pooled && !frames_[i].busy)
+                f = &frames_[i];
+        if (f || vlc_cond_timedwait(&wait_, &lock_, deadline))
+            break;
+    }
+    if (f)
+        f->busy = true;
+    vlc_mutex_unlock(&lock_);
+    return f;
 }
 
-static void v210_convert(void *frame_bytes, picture_t *pic, int dst_stride)
-{
-    int width = pic->format.i_width;
-    int height = pic->format.i_height;
-    int line_padding = dst_stride - ((width * 8 + 11) / 12) * 4;
-    int h, w;
-    uint8_t *data = (uint8_t*)frame_bytes;
-
-    const uint16_t *y = (const uint16_t*)pic->p[0].p_pixels;
-    const uint16_t *u = (const uint16_t*)pic->p[1].p_pixels;
-    const uint16_t *v = (const uint16_t*)pic->p[2].p_pixels;
-
-#define WRITE_PIXELS(a, b, c)           \
-    do {                                \
-        val =   clip(*a++);             \
-        val |= (clip(*b++) << 10) |     \
-               (clip(*c++) << 20);      \
-        put_le32(&data, val);           \
-    } while (0)
-
-    for (h = 0; h < height; h++) {
-        uint32_t val = 0;
-        for (w = 0; w < width - 5; w += 6) {
-            WRITE_PIXELS(u, y, v);
-            WRITE_PIXELS(y, u, y);
-            WRITE_PIXELS(v, y, u);
-            WRITE_PIXELS(y, v, y);
-        }
-        if (w < width - 1) {
-            WRITE_PIXELS(u, y, v);
+/* Takes the frame backing a pool picture, unless it is still on the card,
+ * e.g. when the vout core displays the same picture again. */
+bool DeckLinkFramePool::Reserve(decklink_frame_t *f)
+{
+    vlc_mutex_lock(&lock_);
+    bool ok = !f->busy;
+    f->busy = true;
+    vlc_mutex_unlock(&lock_);
+    return ok;
+}
 
-            val = clip(*y++);
-            if (w == width - 2)
-                put_le32(&data, val);
-#undef WRITE_PIXELS
-        }
-        if (w < width - 3) {
-            val |= (clip(*u++) << 10) | (clip(*y++) << 20);
-            put_le32(&data, val);
+/* Makes the frame available again, returning the picture to release */
+picture_t *DeckLinkFramePool::Recycle(decklink_frame_t *f)
+{
+    picture_t *held = f->held;
+    f->held = NULL;
+    f->busy = false;
+    f->done = false;
+    f->captured = 0;
+    vlc_cond_signal(&wait_);
+    return held;
+}
+
+void DeckLinkFramePool::Put(decklink_frame_t *f)
+{
+    picture_t *held = NULL;
+
+    vlc_mutex_lock(&lock_);
+    if (f == pinned_)
+        f->done = true;
+    else
+        held = Recycle(f);
+    vlc_mutex_unlock(&lock_);
+
+    if (held)
+        picture_Release(held);
+}
+
+/* Keeps the contents of a scheduled frame, and its picture, past its
+ * completion, so that it can be repeated. Only one frame is pinned at a
+ * time: pinning another one, or NULL, unpins the previous one. */
+void DeckLinkFramePool::Pin(decklink_frame_t *f)
+{
+    picture_t *held = NULL;
+
+    vlc_mutex_lock(&lock_);
+    if (pinned_ && pinned_ != f && pinned_->done)
+        held = Recycle(pinned_);
+    pinned_ = f;
+    vlc_mutex_unlock(&lock_);
+
+    if (held)
+        picture_Release(held);
+}
+
+/* Keeps the picture alive while the card reads from its buffer */
+void DeckLinkFramePool::Hold(decklink_frame_t *f, picture_t *pic)
+{
+    vlc_mutex_lock(&lock_);
+    f->held = picture_Hold(pic);
+    vlc_mutex_unlock(&lock_);
+}
+
+HRESULT DeckLinkFramePool::ScheduledFrameCompleted(IDeckLinkVideoFrame *frame,
+                                                   BMDOutputFrameCompletionResult result)
+{
+    decklink_frame_t *f = NULL;
+
+    vlc_mutex_lock(&lock_);
+    for (unsigned i = 0; i < count_ && !f; i++)
+        if (frames_[i].frame == frame)
+            f = &frames_[i];
+
+    if (result == bmdOutputFrameDisplayedLate || result == bmdOutputFrameDropped) {
+        if (result == bmdOutputFrameDisplayedLate)
+            late_++;
+        else
+            dropped_++;
+        if (vd_)
+            vout_display_SendEventPicturesLost(vd_, 1);
+    }
 
-            val = clip(*v++) | (clip(*y++) << 10);
-            put_le32(&data, val);
+    /* The card completes a frame once it is fully sent, as the capture card
+     * delivers it once fully received: this is the delay from the first
+     * line in to the first line out. */
+    if (f && f->captured && result != bmdOutputFrameDropped) {
+        const mtime_t latency = mdate() - f->captured;
+        latency_sum_ += latency;
+        latency_max_ = __MAX(latency_max_, latency);
+        latency_count_++;
+    }
+    vlc_mutex_unlock(&lock_);
+
+    if (f)
+        Put(f);
+    return S_OK;
+}
+
+/* Gets and resets the glass to glass latency statistics */
+bool DeckLinkFramePool::Latency(mtime_t *average, mtime_t *max)
+{
+    vlc_mutex_lock(&lock_);
+    const bool ok = latency_count_ > 0;
+    if (ok) {
+        *average = latency_sum_ / latency_count_;
+        *max = latency_max_;
+    }
+    latency_sum_ = latency_max_ = 0;
+    latency_count_ = 0;
+    vlc_mutex_unlock(&lock_);
+    return ok;
+}
+
+/* Stops reporting to the vout, and gives back the pictures held by the card.
+ * The card only reads from the frames, which outlive the pictures. */
+void DeckLinkFramePool::Detach(unsigned *late, unsigned *dropped)
+{
+    vlc_mutex_lock(&lock_);
+    vd_ = NULL;
+    pinned_ = NULL;
+    *late = late_;
+    *dropped = dropped_;
+    for (unsigned i = 0; i < count_; i++) {
+        if (frames_[i].held) {
+            picture_Release(frames_[i].held);
+            frames_[i].held = NULL;
         }
+    }
+    vlc_mutex_unlock(&lock_);
+}
+
+/* Pictures pointing straight into card frames: the decoder output is
+ * scheduled without any copy. Only for chromas the card reads natively. */
+static picture_pool_t *NewCardPool(vout_display_t *vd, unsigned count)
+{
+    vout_display_sys_t *sys = vd->sys;
+    picture_t *pictures[MAX_FRAMES];
+    unsigned i;
+
+    if (vd->fmt.i_chroma != VLC_CODEC_UYVY && vd->fmt.i_chroma != VLC_CODEC_V210)
+        return NULL;
 
-        memset(data, 0, line_padding);
-        data += line_padding;
+    count += CARD_FRAMES;
+    if (count > MAX_FRAMES - SPARE_FRAMES)
+        return NULL;
 
-        y += pic->p[0].i_pitch / 2 - width;
-        u += pic->p[1].i_pitch / 2 - width / 2;
-        v += pic->p[2].i_pitch / 2 - width / 2;
+    for (i = 0; i < count; i++) {
+        decklink_frame_t *f = sys->frames->Add(vd->fmt.i_width, vd->fmt.i_height,
+            sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV, true);
+        if (!f)
+            goto error;
+
+        picture_sys_t *picsys = (picture_sys_t *)malloc(sizeof(*picsys));
+        if (!picsys)
+            goto error;
+        picsys->frame = f;
+
+        picture_resource_t rsc;
+        memset(&rsc, 0, sizeof(rsc));
+        rsc.p_sys = picsys;
+        f->frame->GetBytes((void **)&rsc.p[0].p_pixels);
+        rsc.p[0].i_lines = vd->fmt.i_height;
+        rsc.p[0].i_pitch = f->frame->GetRowBytes();
+
+        pictures[i] = picture_NewFromResource(&vd->fmt, &rsc);
+        if (!pictures[i]) {
+            free(picsys);
+            goto error;
+        }
     }
+
+    picture_pool_t *pool;
+    pool = picture_pool_New(count, pictures);
+    if (pool)
+        return pool;
+
+error:
+    /* the frames already added stay unused until the vout is closed */
+    while (i > 0)
+        picture_Release(pictures[--i]);
+    return NULL;
+}
+
+static picture_pool_t *PoolVideo(vout_display_t *vd, unsigned requested_count)
+{
+    vout_display_sys_t *sys = vd->sys;
+    if (!sys->pool)
+        sys->pool = NewCardPool(vd, requested_count);
+    if (!sys->pool)
+        sys->pool = picture_pool_NewFromFormat(&vd->fmt, requested_count);
+    return sys->pool;
+}
+
+static inline void put_le32(uint8_t **p, uint32_t d)
+{
+    SetDWLE(*p, d);
+    (*p) += 4;
 }
 
 static void report(vlc_object_t *obj, const char *str, uint64_t val)
@@ -961,75 +1298,255 @@ static void send_CC(vout_display_t *vd, cc_data_t *cc, uint8_t *buf)
     delete[] cdp;
 }
 
-static void PrepareVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
+/* Phase and frequency gains of the card clock PLL, per measurement.
+ * Measurements come once per frame and jitter by up to a few ms: this
+ * keeps the offset error around 0.1ms and the drift error within a few ppm,
+ * and locks in about a minute. */
+#define CLOCK_KP (1. / 64)
+#define CLOCK_KI (1. / 32768)
+/* Phase error beyond which the card clock is considered reset */
+#define CLOCK_MAX_ERROR (CLOCK_FREQ)
+
+/* Tracks the card stream time against the system clock, so that pictures
+ * and audio samples are scheduled on the card clock without latency
+ * building up, nor being corrected in large steps. */
+static void UpdateClock(vout_display_t *vd, struct decklink_sys_t *decklink_sys)
+{
+    BMDTimeValue card_now;
+    double speed;
+
+    if (decklink_sys->p_output->GetScheduledStreamTime(CLOCK_FREQ,
+            &card_now, &speed) != S_OK || speed == 0.)
+        return;
+
+    const mtime_t now = mdate();
+    const mtime_t phase = now - card_now;
+
+    vlc_mutex_lock(&decklink_sys->lock);
+    if (decklink_sys->clock_date == 0) {
+        decklink_sys->offset = phase;
+    } else {
+        const mtime_t dt = now - decklink_sys->clock_date;
+        const double predicted = decklink_sys->offset + decklink_sys->drift * dt;
+        const double error = phase - predicted;
+
+        if (dt <= 0 || error > CLOCK_MAX_ERROR || error < -CLOCK_MAX_ERROR) {
+            msg_Warn(vd, "Card clock jumped by %.0f us, resetting", error);
+            decklink_sys->offset = phase;
+        } else {
+            decklink_sys->offset = predicted + CLOCK_KP * error;
+            decklink_sys->drift += CLOCK_KI * error / dt;
+        }
+    }
+    decklink_sys->clock_date = now;
+
+    const bool stats = now - decklink_sys->stats_date >= CLOCK_FREQ;
+    const double ppm = decklink_sys->drift * 1e6;
+    const mtime_t offset = decklink_sys->offset;
+    if (stats)
+        decklink_sys->stats_date = now;
+    vlc_mutex_unlock(&decklink_sys->lock);
+
+    report(vd, "CARD TIME", (uint64_t)card_now);
+    report(vd, "VLC TIME", (uint64_t)now);
+
+    if (stats) {
+        uint32_t frames = 0, samples = 0;
+        decklink_sys->p_output->GetBufferedVideoFrameCount(&frames);
+        decklink_sys->p_output->GetBufferedAudioSampleFrameCount(&samples);
+
+        msg_Dbg(vd, "card clock drift %+.2f ppm, offset %" PRId64 " us, "
+                "buffered %" PRIu32 " frames, %" PRIu32 " audio samples",
+                ppm, offset, frames, samples);
+        report(vd, "CLOCK DRIFT PPB", (uint64_t)(int64_t)(ppm * 1000.));
+        report(vd, "CLOCK OFFSET", (uint64_t)offset);
+        report(vd, "VIDEO BUFFERED FRAMES", frames);
+
+        mtime_t average, max;
+        if (vd->sys->frames->Latency(&average, &max)) {
+            msg_Dbg(vd, "glass to glass latency %" PRId64 " us, "
+                    "max %" PRId64 " us", average, max);
+            report(vd, "GLASS TO GLASS LATENCY", (uint64_t)average);
+            report(vd, "GLASS TO GLASS LATENCY MAX", (uint64_t)max);
+        }
+    }
+}
+
+static mtime_t CardTime(struct decklink_sys_t *decklink_sys, mtime_t date)
+{
+    vlc_mutex_lock(&decklink_sys->lock);
+    date -= decklink_sys->offset;
+    vlc_mutex_unlock(&decklink_sys->lock);
+    return date;
+}
+
+static mtime_t SystemTime(struct decklink_sys_t *decklink_sys, mtime_t date)
+{
+    vlc_mutex_lock(&decklink_sys->lock);
+    date += decklink_sys->offset;
+    vlc_mutex_unlock(&decklink_sys->lock);
+    return date;
+}
+
+/* Frame duration in CLOCK_FREQ units */
+static mtime_t FrameLength(struct decklink_sys_t *decklink_sys)
+{
+    return (decklink_sys->frameduration * CLOCK_FREQ) / decklink_sys->timescale;
+}
+
+/* Scheduling slack of the fill timer, on top of the frame the card must
+ * already hold when a slot starts */
+#define FILL_SLACK (CLOCK_FREQ / 200)
+
+/* Fill frames are scheduled one frame plus FILL_SLACK before they are due.
+ * While pictures come in, the next one is waited for until it is half a frame
+ * late, as in PrepareVideo(), so that pictures on time always win. */
+static mtime_t FillDeadline(vout_display_sys_t *sys,
+                            struct decklink_sys_t *decklink_sys)
+{
+    const mtime_t length = FrameLength(decklink_sys);
+    mtime_t deadline = SystemTime(decklink_sys, sys->fill_next)
+                     - length - FILL_SLACK;
+
+    if (sys->fill_last)
+        deadline = __MAX(deadline, sys->fill_last + length + length / 2);
+    return deadline;
+}
+
+static void ArmFill(vout_display_t *vd, struct decklink_sys_t *decklink_sys)
+{
+    vout_display_sys_t *sys = vd->sys;
+    mtime_t deadline = FillDeadline(sys, decklink_sys);
+
+    vlc_timer_schedule(sys->fill_timer, true, __MAX(deadline, 1), 0);
+}
+
+/* The previous captions of a recycled frame must not be repeated */
+static void ClearCC(vout_display_t *vd, decklink_frame_t *frame)
+{
+    void *buf;
+    int line = var_InheritInteger(vd, VIDEO_CFG_PREFIX "cc-line");
+
+    if (frame->vanc &&
+        frame->vanc->GetBufferForVerticalBlankingLine(line, &buf) == S_OK)
+        memset(buf, 0, frame->frame->GetRowBytes());
+}
+
+/* Keeps feeding the card on its own clock when no picture comes in time:
+ * the last picture is repeated, then the slate is shown once the input has
+ * been missing for nosignal-delay. As soon as pictures come back, they take
+ * the next free slot. */
+static void FillVideo(void *data)
 {
+    vout_display_t *vd = (vout_display_t *)data;
     vout_display_sys_t *sys = vd->sys;
     struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(vd));
-    mtime_t now = mdate();
+    const mtime_t length = FrameLength(decklink_sys);
 
-    if (!picture)
+    vlc_mutex_lock(&sys->fill_lock);
+
+    const mtime_t now = mdate();
+    if (now < FillDeadline(sys, decklink_sys)) {
+        /* a picture was scheduled meanwhile, and has rearmed the timer */
+        vlc_mutex_unlock(&sys->fill_lock);
         return;
+    }
 
-    picture_t *orig_picture = picture;
+    /* skip the slots already missed */
+    const mtime_t card_now = CardTime(decklink_sys, now);
+    if (sys->fill_next < card_now)
+        sys->fill_next += (card_now - sys->fill_next + length - 1)
+                          / length * length;
 
-    if (now - picture->date > sys->nosignal_delay * CLOCK_FREQ) {
-        report(vd, "NO SIGNAL", picture->date);
+    const bool nosignal = now - sys->fill_last > sys->nosignal_delay * CLOCK_FREQ;
+    if (nosignal && sys->fill_source) {
         msg_Dbg(vd, "no signal");
-        if (sys->pic_nosignal) {
-            picture = sys->pic_nosignal;
-        } else {
-            if (sys->tenbits) { // I422_10L
-                plane_t *y = &picture->p[0];
-                memset(y->p_pixels, 0x0, y->i_lines * y->i_pitch);
-                for (int i = 1; i < picture->i_planes; i++) {
-                    plane_t *p = &picture->p[i];
-                    size_t len = p->i_lines * p->i_pitch / 2;
-                    int16_t *data = (int16_t*)p->p_pixels;
-                    for (size_t j = 0; j < len; j++) // XXX: SIMD
-                        data[j] = 0x200;
-                }
-            } else { // UYVY
-                size_t len = picture->p[0].i_lines * picture->p[0].i_pitch;
-                for (size_t i = 0; i < len; i+= 2) { // XXX: SIMD
-                    picture->p[0].p_pixels[i+0] = 0x80;
-                    picture->p[0].p_pixels[i+1] = 0;
-                }
-            }
-        }
-        picture->date = now;
+        report(vd, "NO SIGNAL", sys->fill_last);
+        sys->frames->Pin(NULL);
+        sys->fill_source = NULL;
     }
 
+    decklink_frame_t *frame = sys->frames->Get(now);
+    if (frame) {
+        const size_t size = frame->frame->GetRowBytes() * vd->fmt.i_height;
+        void *frame_bytes, *source;
+
+        frame->frame->GetBytes(&frame_bytes);
+        if (sys->fill_source)
+            sys->fill_source->frame->GetBytes(&source);
+        else
+            source = sys->slate;
+        memcpy(frame_bytes, source, size);
+        ClearCC(vd, frame);
+
+        if (decklink_sys->p_output->ScheduleVideoFrame(frame->frame,
+                sys->fill_next, length, CLOCK_FREQ) == S_OK) {
+            sys->fills++;
+            report(vd, "FILL", sys->fill_next);
+        } else
+            sys->frames->Put(frame);
+    } else
+        msg_Warn(vd, "No free card frame to fill in");
+
+    sys->fill_next += length;
+    ArmFill(vd, decklink_sys);
+
+    vlc_mutex_unlock(&sys->fill_lock);
+}
+
+static void PrepareVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
+{
+    vout_display_sys_t *sys = vd->sys;
+    struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(vd));
+    mtime_t now = mdate();
+
+    if (!picture)
+        return;
+
     HRESULT result;
-    int w, h, stride, length;
-    w = vd->fmt.i_width;
+    int h, stride;
+    mtime_t date;
     h = vd->fmt.i_height;
 
-    IDeckLinkMutableVideoFrame *pDLVideoFrame;
-    result = decklink_sys->p_output->CreateVideoFrame(w, h, w*3,
-        sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV,
-        bmdFrameFlagDefault, &pDLVideoFrame);
+    const mtime_t length = FrameLength(decklink_sys);
 
-    if (result != S_OK) {
-        msg_Err(vd, "Failed to create video frame: 0x%X", result);
-        report(vd, "ERROR PICTURE", (uint64_t)result);
-        pDLVideoFrame = NULL;
-        goto end;
+    vlc_mutex_lock(&sys->fill_lock);
+
+    UpdateClock(vd, decklink_sys);
+    date = CardTime(decklink_sys, picture->date);
+
+    if (sys->fill_next && date < sys->fill_next - length / 2) {
+        /* Its slot is taken, by a fill frame or a previous picture: this is
+         * a late or stale picture, e.g. redisplayed by the vout core while
+         * the input is stalled. */
+        report(vd, "PICTURE SKIPPED", picture->date);
+        vlc_mutex_unlock(&sys->fill_lock);
+        return;
+    }
+
+    decklink_frame_t *frame = NULL;
+    if (picture->p_sys && sys->frames->Reserve(picture->p_sys->frame)) {
+        frame = picture->p_sys->frame;
+        sys->frames->Hold(frame, picture);
+    } else {
+        frame = sys->frames->Get(now + length);
+        if (!frame) {
+            msg_Err(vd, "No free card frame, dropping picture");
+            report(vd, "ERROR PICTURE", 0);
+            vout_display_SendEventPicturesLost(vd, 1);
+            vlc_mutex_unlock(&sys->fill_lock);
+            return;
+        }
     }
 
     report(vd, "PICTURE", picture->date);
 
     void *frame_bytes;
-    pDLVideoFrame->GetBytes((void**)&frame_bytes);
-    stride = pDLVideoFrame->GetRowBytes();
+    frame->frame->GetBytes((void**)&frame_bytes);
+    stride = frame->frame->GetRowBytes();
 
     if (sys->tenbits) {
-        IDeckLinkVideoFrameAncillary *vanc;
-        result = decklink_sys->p_output->CreateAncillaryData(
-                sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV, &vanc);
-        if (result != S_OK) {
-            msg_Err(vd, "Failed to create vanc: %d", result);
-            goto end;
-        }
+        IDeckLinkVideoFrameAncillary *vanc = frame->vanc;
 
         int line = var_InheritInteger(vd, VIDEO_CFG_PREFIX "cc-line");
         void *buf;
@@ -1040,6 +1557,8 @@ static void PrepareVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
             //break;
         }
 
+        /* the frame is recycled, do not repeat its previous captions */
+        memset(buf, 0, stride);
         send_CC(vd, &picture->cc, (uint8_t*)buf);
 
         if (0 && picture->cc.i_data) {
@@ -1056,54 +1575,49 @@ static void PrepareVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
             goto end;
         }
         send_AFD(vd, (uint8_t*)buf);
-
-        v210_convert(frame_bytes, picture, stride);
-
-        result = pDLVideoFrame->SetAncillaryData(vanc);
-        vanc->Release();
-        if (result != S_OK) {
-            msg_Err(vd, "Failed to set vanc: %d", result);
-            goto end;
-        }
-
-    } else for(int y = 0; y < h; ++y) {
-        uint8_t *dst = (uint8_t *)frame_bytes + stride * y;
-        const uint8_t *src = (const uint8_t *)picture->p[0].p_pixels +
-            picture->p[0].i_pitch * y;
-        memcpy(dst, src, w * 2 /* bpp */);
     }
 
-
-    // compute frame duration in CLOCK_FREQ units
-    length = (decklink_sys->frameduration * CLOCK_FREQ) / decklink_sys->timescale;
-
-    picture->date -= decklink_sys->offset;
-    result = decklink_sys->p_output->ScheduleVideoFrame(pDLVideoFrame,
-        picture->date, length, CLOCK_FREQ);
+    if (frame_bytes == picture->p[0].p_pixels) {
+        /* pool picture: already in the card frame */
+    } else if (picture->format.i_chroma == VLC_CODEC_V210 ||
+               picture->format.i_chroma == VLC_CODEC_UYVY) {
+        const plane_t *p = &picture->p[0];
+        const size_t len = __MIN(stride, p->i_pitch);
+        if (stride == p->i_pitch)
+            memcpy(frame_bytes, p->p_pixels, stride * h);
+        else for (int y = 0; y < h; ++y)
+            memcpy((uint8_t *)frame_bytes + stride * y,
+                   p->p_pixels + p->i_pitch * y, len);
+    } else
+        v210_pack(frame_bytes, picture, stride);
+
+    if (sys->frame_sync)
+        frame->captured = picture->date - sys->frame_sync;
+
+    result = decklink_sys->p_output->ScheduleVideoFrame(frame->frame,
+        date, length, CLOCK_FREQ);
 
     if (result != S_OK) {
-        msg_Err(vd, "Dropped Video frame %" PRId64 ": 0x%x",
-            picture->date, result);
+        msg_Err(vd, "Dropped Video frame %" PRId64 ": 0x%x", date, result);
+        vout_display_SendEventPicturesLost(vd, 1);
         goto end;
     }
 
-    now = mdate() - decklink_sys->offset;
-
-    BMDTimeValue decklink_now;
-    double speed;
-    decklink_sys->p_output->GetScheduledStreamTime (CLOCK_FREQ, &decklink_now, &speed);
-    report(vd, "CARD TIME", (uint64_t)decklink_now);
-    report(vd, "VLC TIME", (uint64_t)now);
-
-    if ((now - decklink_now) > 400000) {
-        /* XXX: workaround card clock drift */
-        decklink_sys->offset += 50000;
-        msg_Err(vd, "Delaying: offset now %" PRId64, decklink_sys->offset);
+    if (sys->fills) {
+        msg_Dbg(vd, "picture back after %u fill frames", sys->fills);
+        sys->fills = 0;
     }
+    sys->frames->Pin(frame);
+    sys->fill_source = frame;
+    sys->fill_last = now;
+    sys->fill_next = date + length;
+    ArmFill(vd, decklink_sys);
+    frame = NULL; /* handed back by ScheduledFrameCompleted() */
 
 end:
-    if (pDLVideoFrame)
-        pDLVideoFrame->Release();
+    vlc_mutex_unlock(&sys->fill_lock);
+    if (frame)
+        sys->frames->Put(frame);
 }
 
 static void DisplayVideo(vout_display_t *, picture_t *picture, subpicture_t *)
@@ -1117,6 +1631,82 @@ static int ControlVideo(vout_display_t *vd, int query, va_list args)
     return VLC_EGENERIC;
 }
 
+/* Precomputes the frame shown on signal loss, in the card format, from the
+ * no signal picture if any. */
+static uint8_t *NewSlate(vout_display_t *vd, const picture_t *pic)
+{
+    vout_display_sys_t *sys = vd->sys;
+    const video_format_t *fmt = &vd->fmt;
+    const size_t stride = sys->tenbits ?
+        ((fmt->i_width + 47) / 48) * 128 : fmt->i_width * 2;
+    const size_t size = stride * fmt->i_height;
+    uint8_t *slate = (uint8_t *)malloc(size);
+
+    if (!slate)
+        return NULL;
+
+    if (pic && sys->tenbits) {
+        v210_pack(slate, pic, stride);
+    } else if (pic) { // UYVY
+        const plane_t *p = &pic->p[0];
+        for (unsigned y = 0; y < fmt->i_height; y++)
+            memcpy(&slate[stride * y], &p->p_pixels[p->i_pitch * y],
+                   __MIN(stride, (size_t)p->i_pitch));
+    } else if (sys->tenbits) {
+        /* Cb Y Cr Y | Cb Y Cr Y | Cb Y Cr Y as 3 x 10 bits words */
+        static const uint32_t black[4] = {
+            0x200 | (0x040 << 10) | (0x200 << 20),
+            0x040 | (0x200 << 10) | (0x040 << 20),
+            0x200 | (0x040 << 10) | (0x200 << 20),
+            0x040 | (0x200 << 10) | (0x040 << 20),
+        };
+        for (size_t i = 0; i < size; i += 16)
+            for (int j = 0; j < 4; j++)
+                SetDWLE(&slate[i + 4 * j], black[j]);
+    } else { // UYVY
+        for (size_t i = 0; i < size; i += 2) {
+            slate[i+0] = 0x80;
+            slate[i+1] = 0x10;
+        }
+    }
+    return slate;
+}
+
+static picture_t *LoadNoSignalPicture(vout_display_t *vd, const char *pic_file)
+{
+    video_format_t *fmt = &vd->fmt;
+    picture_t *pic = NULL;
+
+    image_handler_t *img = image_HandlerCreate(vd);
+    if (!img) {
+        msg_Err(vd, "Could not create image converter");
+        return NULL;
+    }
+
+    video_format_t in, dummy;
+
+    video_format_Init(&in, 0);
+    video_format_Setup(&in, 0, fmt->i_width, fmt->i_height,
+                       fmt->i_width, fmt->i_height, 1, 1);
+
+    video_format_Init(&dummy, 0);
+
+    /* NewSlate() packs planar pictures itself */
+    video_format_t out = *fmt;
+    if (out.i_chroma == VLC_CODEC_V210)
+        out.i_chroma = VLC_CODEC_I422_10L;
+
+    picture_t *png = image_ReadUrl(img, pic_file, &dummy, &in);
+    if (png) {
+        msg_Dbg(vd, "Converting");
+        pic = image_Convert(img, png, &in, &out);
+        picture_Release(png);
+    }
+
+    image_HandlerDelete(img);
+    return pic;
+}
+
 static int OpenVideo(vlc_object_t *p_this)
 {
     vout_display_t *vd = (vout_display_t *)p_this;
@@ -1130,49 +1720,64 @@ static int OpenVideo(vlc_object_t *p_this)
 
     sys->tenbits = var_InheritBool(p_this, VIDEO_CFG_PREFIX "tenbits");
     sys->nosignal_delay = var_InheritInteger(p_this, VIDEO_CFG_PREFIX "nosignal-delay");
-    sys->pic_nosignal = NULL;
+    sys->fill_next = 0;
+    sys->fill_last = 0;
+    sys->fill_source = NULL;
+    sys->slate = NULL;
+    sys->fills = 0;
+    vlc_mutex_init(&sys->fill_lock);
+    if (vlc_timer_create(&sys->fill_timer, FillVideo, vd)) {
+        vlc_mutex_destroy(&sys->fill_lock);
+        free(sys);
+        return VLC_ENOMEM;
+    }
 
     decklink_sys = OpenDecklink(vd);
     if (!decklink_sys) {
-        if (sys->pic_nosignal)
-            picture_Release(sys->pic_nosignal);
+        vlc_timer_destroy(sys->fill_timer);
+        vlc_mutex_destroy(&sys->fill_lock);
         free(sys);
         return VLC_EGENERIC;
     }
 
     sys->pool = NULL;
 
-    char *pic_file = var_InheritString(p_this, VIDEO_CFG_PREFIX "nosignal-image");
-    if (pic_file) {
-        image_handler_t *img = image_HandlerCreate(p_this);
-        if (!img) {
-            msg_Err(p_this, "Could not create image converter");
-        } else {
-            video_format_t in, dummy;
-
-            video_format_Init(&in, 0);
-            video_format_Setup(&in, 0, fmt->i_width, fmt->i_height,
-                               fmt->i_width, fmt->i_height, 1, 1);
-
-            video_format_Init(&dummy, 0);
+    /* Pictures captured in frame synchronous mode are due that long after
+     * their capture, the input running at the rate of the output */
+    const int64_t depth = var_InheritInteger(vd, "decklink-frame-sync");
+    sys->frame_sync = depth > 0 ? depth * FrameLength(decklink_sys) : 0;
 
-            picture_t *png = image_ReadUrl(img, pic_file, &dummy, &in);
-            if (png) {
-                msg_Err(p_this, "Converting");
-                sys->pic_nosignal = image_Convert(img, png, &in, fmt);
-                picture_Release(png);
-            }
-
-            image_HandlerDelete(img);
+    sys->frames = new DeckLinkFramePool(vd, decklink_sys->p_output);
+    for (int i = 0; i < SPARE_FRAMES; i++) {
+        if (!sys->frames->Add(fmt->i_width, fmt->i_height,
+                sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV, false)) {
+            msg_Err(vd, "Could not allocate card frames");
+            CloseVideo(p_this);
+            return VLC_EGENERIC;
         }
+    }
+    decklink_sys->p_output->SetScheduledFrameCompletionCallback(sys->frames);
 
+    picture_t *pic_nosignal = NULL;
+    char *pic_file = var_InheritString(p_this, VIDEO_CFG_PREFIX "nosignal-image");
+    if (pic_file) {
+        pic_nosignal = LoadNoSignalPicture(vd, pic_file);
         free(pic_file);
-        if (!sys->pic_nosignal) {
+        if (!pic_nosignal) {
             CloseVideo(p_this);
             msg_Err(p_this, "Could not create no signal picture");
             return VLC_EGENERIC;
         }
     }
+
+    sys->slate = NewSlate(vd, pic_nosignal);
+    if (pic_nosignal)
+        picture_Release(pic_nosignal);
+    if (!sys->slate) {
+        CloseVideo(p_this);
+        return VLC_ENOMEM;
+    }
+
     vd->info.has_hide_mouse = true;
     vd->pool    = PoolVideo;
     vd->prepare = PrepareVideo;
@@ -1188,13 +1793,24 @@ static void CloseVideo(vlc_object_t *p_this)
 {
     vout_display_t *vd = (vout_display_t *)p_this;
     vout_display_sys_t *sys = vd->sys;
+    struct decklink_sys_t *decklink_sys = GetDLSys(p_this);
+    unsigned late, dropped;
+
+    vlc_timer_destroy(sys->fill_timer);
+    vlc_mutex_destroy(&sys->fill_lock);
+
+    decklink_sys->p_output->SetScheduledFrameCompletionCallback(NULL);
+    sys->frames->Detach(&late, &dropped);
+    if (late || dropped)
+        msg_Warn(vd, "%u frames displayed late, %u dropped by the card",
+                 late, dropped);
 
     if (sys->pool)
         picture_pool_Release(sys->pool);
 
-    if (sys->pic_nosignal)
-        picture_Release(sys->pic_nosignal);
+    sys->frames->Release();
 
+    free(sys->slate);
     free(sys);
 
     ReleaseDLSys(p_this);
@@ -1204,111 +1820,124 @@ static void CloseVideo(vlc_object_t *p_this)
  * Audio
  *****************************************************************************/
 
+/* Each stereo pair is queued into its own ring of blocks. A ring has a single
+ * producer, the aout thread of its pair, and a single consumer, the mixer,
+ * which is run by whichever aout thread finds it idle (see MixAudio()). */
 static struct audio_source_s
 {
-	int		nr;		/* 1..MAX_AUDIO_SOURCES */
-	audio_output_t *aout;
-	block_fifo_t   *fifo;		/* PCM data for a given audio pair */
-	int             fifo_ready;	/* Flag: Whether the fifo contains 'enough' data to process */
+    audio_output_t *aout;           /* protected by g_audio_source_lock */
+    struct decklink_sys_t *decklink_sys;
+    std::atomic<bool> active;
+
+    block_t *ring[AUDIO_RING_SIZE];
+    std::atomic<unsigned> head;     /* written by the producer */
+    std::atomic<unsigned> tail;     /* written by the consumer */
+    std::atomic<unsigned> flush;    /* head at the last flush */
+    std::atomic<mtime_t> end;       /* date following the last queued sample */
+
+    /* Owned by the mixer */
+    block_t *block;                 /* block being played */
+    int64_t start;                  /* mixer position of its first sample */
+    int64_t stop;                   /* mixer position following it */
+    mtime_t next;                   /* date following it */
+    unsigned flushed;
 } audioSources[MAX_AUDIO_SOURCES];
 
 static vlc_mutex_t g_audio_source_lock = VLC_STATIC_MUTEX;
-static int g_audio_source_init = 1;
-static int g_audio_source_count = 0;
 
-static void initAudioSources()
+/* Mixer state, owned by the thread holding g_audio_mixing */
+static std::atomic_flag g_audio_mixing = ATOMIC_FLAG_INIT;
+static std::atomic<bool> g_audio_pending(false); /* samples queued */
+static std::atomic<bool> g_audio_reset(false);
+static bool g_audio_anchored;
+static date_t g_audio_date;         /* date of the next output sample */
+static int64_t g_audio_position;    /* number of output samples */
+
+static uint8_t g_audio_buffer[FRAME_SIZE * MAX_AUDIO_SOURCES * 8];
+static const uint8_t g_audio_silence[FRAME_SIZE * 8] = { 0 };
+
+typedef void (*audio_interleave_t)(uint8_t *, const uint8_t *const *, unsigned);
+
+static void DrainAudioSource(struct audio_source_s *s)
 {
-	if (g_audio_source_init) {
-		g_audio_source_init = 0;
-		g_audio_source_count = 0;
-		vlc_mutex_init(&g_audio_source_lock);
-		memset(audioSources, 0, sizeof(audioSources));
-	}
+    if (s->block) {
+        block_Release(s->block);
+        s->block = NULL;
+    }
+
+    unsigned tail = s->tail.load(std::memory_order_relaxed);
+    unsigned head = s->head.load(std::memory_order_acquire);
+    while (tail != head)
+        block_Release(s->ring[tail++ % AUDIO_RING_SIZE]);
+    s->tail.store(tail, std::memory_order_release);
 }
 
 static void destroyAudioSources()
 {
-	for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
-		struct audio_source_s *s = &audioSources[i];
-		if (s->nr == 0)
-			continue;
-
-		s->nr = 0;
-		block_FifoRelease(s->fifo);
-	}
+    for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
+        struct audio_source_s *s = &audioSources[i];
+        if (s->aout == NULL)
+            continue;
+
+        s->active.store(false, std::memory_order_relaxed);
+        DrainAudioSource(s);
+        s->aout = NULL;
+    }
 }
 
 static void destroyAudioSource(audio_output_t *aout)
 {
-	vlc_mutex_lock(&g_audio_source_lock);
-	for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
-		struct audio_source_s *s = &audioSources[i];
-		if (s->aout == aout) {
-			s->nr = 0;
-			s->aout = 0;
-			block_FifoRelease(s->fifo);
-			break;
-		}
-	}
-	vlc_mutex_unlock(&g_audio_source_lock);
-}
-static int createAudioSource(audio_output_t *aout)
-{
-	int ret = -1;
-
-	vlc_mutex_lock(&g_audio_source_lock);
-	for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
-		struct audio_source_s *s = &audioSources[i];
-		if (s->nr == 0) {
-			s->nr = ++g_audio_source_count;
-			s->aout = aout;
-			s->fifo = block_FifoNew();
-			//printf("Created Audio Source[%d] nr = %d aout=%p\n", i, s->nr, s->aout);
-			ret = 0;
-			break;
-		}
-	}
-	vlc_mutex_unlock(&g_audio_source_lock);
-
-	return ret;
-}
+    struct audio_source_s *s = (struct audio_source_s *)aout->sys;
+    if (!s)
+        return;
 
-static struct audio_source_s *findAudioSource(audio_output_t *aout)
-{
-	struct audio_source_s *ret = 0;
+    s->active.store(false, std::memory_order_release);
 
-	vlc_mutex_lock(&g_audio_source_lock);
-	for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
-		if (audioSources[i].aout == aout) {
-			ret = &audioSources[i];
-			break;
-		}
-	}
-	vlc_mutex_unlock(&g_audio_source_lock);
+    /* Wait for the mixer to let go of the ring before emptying it */
+    while (g_audio_mixing.test_and_set(std::memory_order_acquire))
+        msleep(CLOCK_FREQ / 1000);
+    DrainAudioSource(s);
+    g_audio_mixing.clear(std::memory_order_release);
 
-	return ret;
+    vlc_mutex_lock(&g_audio_source_lock);
+    s->aout = NULL;
+    vlc_mutex_unlock(&g_audio_source_lock);
 }
 
-static int sourcesReadyToRender()
+static int createAudioSource(audio_output_t *aout,
+                             struct decklink_sys_t *decklink_sys)
 {
-	int active_sources = 0, ready_sources = 0;
-
-	vlc_mutex_lock(&g_audio_source_lock);
-	for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
-		if (audioSources[i].nr > 0) {
-			active_sources++;
-			if (block_FifoSize(audioSources[i].fifo) >= MIN_FIFO_SIZE)
-				ready_sources++;
-		}
-	}
-	vlc_mutex_unlock(&g_audio_source_lock);
+    int ret = -1;
+
+    aout->sys = NULL;
+    vlc_mutex_lock(&g_audio_source_lock);
+    for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
+        struct audio_source_s *s = &audioSources[i];
+        if (s->aout == NULL) {
+            s->aout = aout;
+            s->decklink_sys = decklink_sys;
+            s->head.store(0, std::memory_order_relaxed);
+            s->tail.store(0, std::memory_order_relaxed);
+            s->flush.store(0, std::memory_order_relaxed);
+            s->end.store(VLC_TS_INVALID, std::memory_order_relaxed);
+            s->block = NULL;
+            s->next = VLC_TS_INVALID;
+            s->flushed = 0;
+            s->active.store(true, std::memory_order_release);
+            aout->sys = (aout_sys_t *)s;
+            ret = 0;
+            break;
+        }
+    }
+    vlc_mutex_unlock(&g_audio_source_lock);
 
-	return active_sources == ready_sources;
+    return ret;
 }
 
 static void Flush (audio_output_t *aout, bool drain)
 {
-    struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
+    struct audio_source_s *s = (struct audio_source_s *)aout->sys;
+    struct decklink_sys_t *decklink_sys = s->decklink_sys;
     vlc_mutex_lock(&decklink_sys->lock);
     IDeckLinkOutput *p_output = decklink_sys->p_output;
     vlc_mutex_unlock(&decklink_sys->lock);
@@ -1319,7 +1948,16 @@ static void Flush (audio_output_t *aout, bool drain)
         uint32_t samples;
         decklink_sys->p_output->GetBufferedAudioSampleFrameCount(&samples);
         msleep(CLOCK_FREQ * samples / decklink_sys->i_rate);
-    } else if (decklink_sys->p_output->FlushBufferedAudioSamples() == E_FAIL)
+        return;
+    }
+
+    /* The mixer drops what was queued so far */
+    s->end.store(VLC_TS_INVALID, std::memory_order_relaxed);
+    s->flush.store(s->head.load(std::memory_order_relaxed),
+                   std::memory_order_release);
+    g_audio_reset.store(true, std::memory_order_release);
+
+    if (decklink_sys->p_output->FlushBufferedAudioSamples() == E_FAIL)
         msg_Err(aout, "Flush failed");
 }
 
@@ -1331,8 +1969,7 @@ static int TimeGet(audio_output_t *, mtime_t* restrict)
 
 static int Start(audio_output_t *aout, audio_sample_format_t *restrict fmt)
 {
-    struct audio_source_s *s = findAudioSource(aout);
-    if (!s)
+    if (!aout->sys)
         return VLC_EGENERIC;
 
     struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
@@ -1340,11 +1977,11 @@ static int Start(audio_output_t *aout, audio_sample_format_t *restrict fmt)
     if (decklink_sys->i_rate == 0)
         return VLC_EGENERIC;
 
-    fmt->i_format = VLC_CODEC_S16N;
+    fmt->i_format = decklink_sys->i_bits == 32 ? VLC_CODEC_S32N : VLC_CODEC_S16N;
     fmt->i_channels = 2; //decklink_sys->i_channels;
     fmt->i_physical_channels = AOUT_CHANS_STEREO; //pi_channels_maps[fmt->i_channels];
     fmt->i_rate = decklink_sys->i_rate;
-    fmt->i_bitspersample = 16;
+    fmt->i_bitspersample = decklink_sys->i_bits;
     fmt->i_blockalign = fmt->i_channels * fmt->i_bitspersample /8 ;
     fmt->i_frame_length  = FRAME_SIZE;
 
@@ -1366,141 +2003,345 @@ static int groupPairStringToSlot(const char *grouppair)
   }
 }
 
-static void interleaveAudio(unsigned char *inbuf, unsigned char *out, int num_samples,
-			    int out_channel)
+/* Interleavers: src holds one pointer per output pair, each to <samples>
+ * stereo sample frames. */
+static void interleave16_C(uint8_t *dst, const uint8_t *const *src,
+                           unsigned samples)
+{
+    for (unsigned i = 0; i < samples; i++)
+        for (unsigned p = 0; p < MAX_AUDIO_SOURCES; p++, dst += 4)
+            memcpy(dst, &src[p][i * 4], 4);
+}
+
+static void interleave32_C(uint8_t *dst, const uint8_t *const *src,
+                           unsigned samples)
+{
+    for (unsigned i = 0; i < samples; i++)
+        for (unsigned p = 0; p < MAX_AUDIO_SOURCES; p++, dst += 8)
+            memcpy(dst, &src[p][i * 8], 8);
+}
+
+#ifdef HAVE_SSE2_INTRINSICS
+/* 4x4 transposes of 32 bits stereo frames, 4 frames at a time */
+__attribute__ ((__target__ ("sse2")))
+static void interleave16_SSE2(uint8_t *dst, const uint8_t *const *src,
+                              unsigned samples)
 {
-    int x = out_channel * 4;
-    for (int c = 0; c < num_samples * 4; c++) {
-       out[x] = inbuf[c++];
-       out[x+1] = inbuf[c++];
-       out[x+2] = inbuf[c++];
-       out[x+3] = inbuf[c];
-       x += (4 * MAX_AUDIO_SOURCES);
+    unsigned i = 0;
+
+    for (; i + 4 <= samples; i += 4) {
+        __m128i *out = (__m128i *)&dst[i * 4 * MAX_AUDIO_SOURCES];
+
+        for (unsigned p = 0; p < MAX_AUDIO_SOURCES; p += 4) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)&src[p + 0][i * 4]);
+            __m128i a1 = _mm_loadu_si128((const __m128i *)&src[p + 1][i * 4]);
+            __m128i a2 = _mm_loadu_si128((const __m128i *)&src[p + 2][i * 4]);
+            __m128i a3 = _mm_loadu_si128((const __m128i *)&src[p + 3][i * 4]);
+
+            __m128i t0 = _mm_unpacklo_epi32(a0, a1);
+            __m128i t1 = _mm_unpacklo_epi32(a2, a3);
+            __m128i t2 = _mm_unpackhi_epi32(a0, a1);
+            __m128i t3 = _mm_unpackhi_epi32(a2, a3);
+
+            _mm_storeu_si128(&out[0 + p / 4], _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128(&out[2 + p / 4], _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128(&out[4 + p / 4], _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128(&out[6 + p / 4], _mm_unpackhi_epi64(t2, t3));
+        }
     }
+
+    const uint8_t *tail[MAX_AUDIO_SOURCES];
+    for (unsigned p = 0; p < MAX_AUDIO_SOURCES; p++)
+        tail[p] = &src[p][i * 4];
+    interleave16_C(&dst[i * 4 * MAX_AUDIO_SOURCES], tail, samples - i);
 }
 
-/* Don't call this unless all the fifos are ready */
-static block_t *audioFramer(struct decklink_sys_t *decklink_sys, block_t *firstchan_block,
-			    int firstchan_num)
-{
-   block_t *final_block = block_Alloc(firstchan_block->i_buffer * MAX_AUDIO_SOURCES);
-   memset(final_block->p_buffer, 0, final_block->i_buffer);
-   final_block->i_pts = firstchan_block->i_pts;
-   final_block->i_nb_samples = firstchan_block->i_nb_samples;
-
-   vlc_mutex_lock(&g_audio_source_lock);
-
-   /* Handle the first channel differently than the others since we
-      already dequeued the block for it */
-   interleaveAudio(firstchan_block->p_buffer, final_block->p_buffer,
-		   firstchan_block->i_nb_samples,
-		   decklink_sys->remap_table[firstchan_num]);
-
-   /* Handle all the other channels */
-   for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
-      if (audioSources[i].nr == 0 || audioSources[i].nr == 1)
-	  continue;
-      block_t *blk = block_FifoShow(audioSources[i].fifo);
-      long int delta = firstchan_block->i_pts - blk->i_pts;
-
-      if (delta < -30000) {
-	/* Because the earliest block in this queue is much later than the
-	   PTS of the first channel, we're going to be putting out audio
-	   silence on this channel until we get to that block.  So let's
-	   keep the block on the queue until the first channel catches up
-	   to that point... */
-	continue;
-      }
-
-      /* Throw away samples that are way too old */
-      int found = 0;
-      while (block_FifoSize(audioSources[i].fifo) > MIN_FIFO_SIZE) {
-	blk = block_FifoShow(audioSources[i].fifo);
-	delta = firstchan_block->i_pts - blk->i_pts;
-	if (delta < 30000) {
-	  found = 1;
-	  break;
-	}
+/* 2x2 transposes of 64 bits stereo frames, 2 frames at a time */
+__attribute__ ((__target__ ("sse2")))
+static void interleave32_SSE2(uint8_t *dst, const uint8_t *const *src,
+                              unsigned samples)
+{
+    unsigned i = 0;
 
-	blk = block_FifoGet(audioSources[i].fifo);
-	block_Release(blk);
-      }
+    for (; i + 2 <= samples; i += 2) {
+        __m128i *out = (__m128i *)&dst[i * 8 * MAX_AUDIO_SOURCES];
 
-      /* Either we found a reasonably recent sample or we ran discarded all the
-	 available items in the FIFO and ran out of samples to look at */
-      if (found == 0)
-	continue;
+        for (unsigned p = 0; p < MAX_AUDIO_SOURCES; p += 2) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)&src[p + 0][i * 8]);
+            __m128i a1 = _mm_loadu_si128((const __m128i *)&src[p + 1][i * 8]);
 
-      blk = block_FifoGet(audioSources[i].fifo);
-      interleaveAudio(blk->p_buffer, final_block->p_buffer,
-		      firstchan_block->i_nb_samples,
-		      decklink_sys->remap_table[i]);
-      block_Release(blk);
-   }
+            _mm_storeu_si128(&out[p / 2], _mm_unpacklo_epi64(a0, a1));
+            _mm_storeu_si128(&out[p / 2 + MAX_AUDIO_SOURCES / 2],
+                             _mm_unpackhi_epi64(a0, a1));
+        }
+    }
 
-   vlc_mutex_unlock(&g_audio_source_lock);
+    const uint8_t *tail[MAX_AUDIO_SOURCES];
+    for (unsigned p = 0; p < MAX_AUDIO_SOURCES; p++)
+        tail[p] = &src[p][i * 8];
+    interleave32_C(&dst[i * 8 * MAX_AUDIO_SOURCES], tail, samples - i);
+}
+#endif
 
-   return final_block;
+static audio_interleave_t GetInterleaver(int bits)
+{
+#ifdef HAVE_SSE2_INTRINSICS
+    if (vlc_CPU_SSE2())
+        return bits == 32 ? interleave32_SSE2 : interleave16_SSE2;
+#endif
+    return bits == 32 ? interleave32_C : interleave16_C;
 }
 
-static void PlayAudio(audio_output_t *aout, block_t *audio)
+static mtime_t BlockEnd(const block_t *block, int rate)
 {
-    struct audio_source_s *s = findAudioSource(aout);
-    if (!s)
-        return;
+    return block->i_pts + CLOCK_FREQ * block->i_nb_samples / rate;
+}
 
-    struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
-    vlc_mutex_lock(&decklink_sys->lock);
-    IDeckLinkOutput *p_output = decklink_sys->p_output;
-    vlc_mutex_unlock(&decklink_sys->lock);
-    if (!p_output) {
-        block_Release(audio);
+/* Converts a date to a mixer position */
+static int64_t MixerPosition(mtime_t date, int rate)
+{
+    return g_audio_position
+         + (date - date_Get(&g_audio_date)) * rate / CLOCK_FREQ;
+}
+
+/* Drops what was queued before the last flush of the pair */
+static void FlushPair(struct audio_source_s *s)
+{
+    unsigned flush = s->flush.load(std::memory_order_acquire);
+    if (flush == s->flushed)
         return;
+
+    if (s->block) {
+        block_Release(s->block);
+        s->block = NULL;
     }
 
-    audio->i_pts -= decklink_sys->offset;
+    unsigned tail = s->tail.load(std::memory_order_relaxed);
+    while (tail != flush)
+        block_Release(s->ring[tail++ % AUDIO_RING_SIZE]);
+    s->tail.store(tail, std::memory_order_release);
+    s->flushed = flush;
+}
 
-    /* Push the current audio pair payload into its fifo */
-    block_FifoPut(s->fifo, audio);
+static block_t *PeekPair(struct audio_source_s *s)
+{
+    if (s->block)
+        return s->block;
 
-    /* We slave the entire output from a single pts, we'll use the pts from the
-     * first audio pair. If we're not currently the first audio pair, we're done.
-     */
-    if (s->nr != 1) {
-        return;
+    unsigned tail = s->tail.load(std::memory_order_relaxed);
+    if (tail == s->head.load(std::memory_order_acquire))
+        return NULL;
+    return s->ring[tail % AUDIO_RING_SIZE];
+}
+
+/* Makes the block of the pair the one that plays at <pos>, or the first one
+ * after it. Returns false if the pair has nothing left to play. */
+static bool SeekPair(struct audio_source_s *s, int64_t pos, int rate)
+{
+    for (;;) {
+        if (!s->block) {
+            unsigned tail = s->tail.load(std::memory_order_relaxed);
+            if (tail == s->head.load(std::memory_order_acquire))
+                return false;
+
+            block_t *block = s->ring[tail % AUDIO_RING_SIZE];
+            s->tail.store(tail + 1, std::memory_order_release);
+
+            if (block->i_nb_samples == 0) {
+                block_Release(block);
+                continue;
+            }
+
+            /* Sample accurate alignment only on discontinuities */
+            if (s->next == VLC_TS_INVALID
+             || llabs(block->i_pts - s->next) > AUDIO_JITTER)
+                s->start = MixerPosition(block->i_pts, rate);
+            else
+                s->start = s->stop;
+
+            s->block = block;
+            s->stop = s->start + block->i_nb_samples;
+            s->next = BlockEnd(block, rate);
+        }
+
+        if (s->stop > pos)
+            return true;
+
+        block_Release(s->block);
+        s->block = NULL;
     }
+}
 
-    /* Enumerate all the source fifos, check if they have enough data for us to output
-     * a buffer containing all audio for all pairs.
-     */
-    if (sourcesReadyToRender() == 0)
-        return;
+/* Interleaves output frames from all the pairs, as long as every pair mapped
+ * to the output has queued enough samples, or has been late for too long.
+ * Must be called with g_audio_mixing set. */
+static void MixFrames(audio_output_t *aout, struct decklink_sys_t *decklink_sys,
+                      IDeckLinkOutput *p_output)
+{
+    const int rate = decklink_sys->i_rate;
+    const mtime_t duration = CLOCK_FREQ * FRAME_SIZE / rate;
+    const size_t pair_size = decklink_sys->i_bits / 4;
+    const audio_interleave_t interleave = GetInterleaver(decklink_sys->i_bits);
+
+    if (g_audio_reset.exchange(false, std::memory_order_acquire))
+        g_audio_anchored = false;
 
-    block_t *firstchan_block = block_FifoGet(s->fifo);
+    for (;;) {
+        struct audio_source_s *pairs[MAX_AUDIO_SOURCES];
+        int slots[MAX_AUDIO_SOURCES];
+        unsigned count = 0;
+        mtime_t first = INT64_MAX;
+        mtime_t latest = VLC_TS_INVALID, earliest = INT64_MAX;
 
-    /* Walk the source fifos, prepare a combined buffer for delivery. */
-    block_t *p_final = audioFramer(decklink_sys, firstchan_block, s->nr - 1);
-    block_Release(firstchan_block);
+        for (int i = 0; i < MAX_AUDIO_SOURCES; i++) {
+            struct audio_source_s *s = &audioSources[i];
+            if (!s->active.load(std::memory_order_acquire))
+                continue;
 
-    uint32_t written;
-    HRESULT result = p_output->ScheduleAudioSamples(p_final->p_buffer, p_final->i_nb_samples, 
-						    p_final->i_pts, CLOCK_FREQ, &written);
+            FlushPair(s);
+            block_t *block = PeekPair(s);
+            if (block && block->i_pts < first)
+                first = block->i_pts;
 
-    report(aout, "PLAY AUDIO BYTES", (uint64_t)audio->i_buffer);
+            pairs[count] = s;
+            slots[count] = decklink_sys->remap_table[i];
+            if (slots[count++] < 0)
+                continue; /* discarded, never waited for */
 
-    uint32_t samples;
-    p_output->GetBufferedAudioSampleFrameCount(&samples);
-    report(aout, "AUDIO BUFFERED SAMPLES", samples);
+            mtime_t end = s->end.load(std::memory_order_acquire);
+            latest = __MAX(latest, end);
+            earliest = __MIN(earliest, end);
+        }
 
-    if (result != S_OK) {
-        msg_Err(aout, "Failed to schedule audio sample: 0x%X", result);
-        report(aout, "ERROR AUDIO", (uint64_t)result);
+        if (first == INT64_MAX)
+            break;
+
+        /* (Re)start the output timeline on the earliest queued sample */
+        if (!g_audio_anchored
+         || first > date_Get(&g_audio_date) + duration + CLOCK_FREQ
+         || (latest != VLC_TS_INVALID
+          && latest < date_Get(&g_audio_date) - CLOCK_FREQ)) {
+            date_Init(&g_audio_date, rate, 1);
+            date_Set(&g_audio_date, first);
+            g_audio_anchored = true;
+
+            for (unsigned k = 0; k < count; k++) {
+                struct audio_source_s *s = pairs[k];
+                s->next = VLC_TS_INVALID;
+                if (s->block) {
+                    s->start = MixerPosition(s->block->i_pts, rate);
+                    s->stop = s->start + s->block->i_nb_samples;
+                }
+            }
+        }
+
+        const mtime_t frame_end = date_Get(&g_audio_date) + duration;
+        if (latest < frame_end)
+            break;
+        if (earliest < frame_end
+         && latest < frame_end + AUDIO_MAX_LATENESS * duration)
+            break;
+
+        for (unsigned done = 0; done < FRAME_SIZE; ) {
+            const int64_t pos = g_audio_position + done;
+            unsigned samples = FRAME_SIZE - done;
+            const uint8_t *src[MAX_AUDIO_SOURCES];
+
+            for (unsigned p = 0; p < MAX_AUDIO_SOURCES; p++)
+                src[p] = g_audio_silence;
+
+            for (unsigned k = 0; k < count; k++) {
+                struct audio_source_s *s = pairs[k];
+                if (slots[k] < 0 || !SeekPair(s, pos, rate))
+                    continue;
+
+                if (s->start > pos) {
+                    samples = __MIN(samples, s->start - pos);
+                    continue;
+                }
+                samples = __MIN(samples, s->stop - pos);
+                src[slots[k]] = &s->block->p_buffer[(pos - s->start) * pair_size];
+            }
+
+            interleave(&g_audio_buffer[done * pair_size * MAX_AUDIO_SOURCES],
+                       src, samples);
+            done += samples;
+        }
+
+        /* Release what was played, and what was discarded */
+        for (unsigned k = 0; k < count; k++)
+            SeekPair(pairs[k], g_audio_position + FRAME_SIZE, rate);
+
+        uint32_t written;
+        HRESULT result = p_output->ScheduleAudioSamples(g_audio_buffer,
+                FRAME_SIZE, date_Get(&g_audio_date), CLOCK_FREQ, &written);
+        date_Increment(&g_audio_date, FRAME_SIZE);
+        g_audio_position += FRAME_SIZE;
+
+        uint32_t samples;
+        p_output->GetBufferedAudioSampleFrameCount(&samples);
+        report(VLC_OBJECT(aout), "AUDIO BUFFERED SAMPLES", samples);
+
+        if (result != S_OK) {
+            msg_Err(aout, "Failed to schedule audio sample: 0x%X", result);
+            report(VLC_OBJECT(aout), "ERROR AUDIO", (uint64_t)result);
+        }
+        else if (written != FRAME_SIZE) {
+            msg_Err(aout, "Written only %d samples out of %d", written, FRAME_SIZE);
+            report(VLC_OBJECT(aout), "ERROR AUDIO SAMPLES LOST",
+                   (uint64_t)(FRAME_SIZE - written));
+        }
+    }
+}
+
+/* Only one thread mixes at a time: the others just queue their samples and
+ * raise g_audio_pending. The mixer checks it again after letting go of
+ * g_audio_mixing, so that samples queued while it was finishing its run are
+ * not left waiting for the next PlayAudio() call. */
+static void MixAudio(audio_output_t *aout, struct decklink_sys_t *decklink_sys,
+                     IDeckLinkOutput *p_output)
+{
+    g_audio_pending.store(true);
+    do {
+        if (g_audio_mixing.test_and_set(std::memory_order_acquire))
+            return; /* the current mixer will see g_audio_pending */
+        g_audio_pending.store(false);
+
+        MixFrames(aout, decklink_sys, p_output);
+
+        g_audio_mixing.clear(std::memory_order_seq_cst);
+    } while (g_audio_pending.load());
+}
+
+static void PlayAudio(audio_output_t *aout, block_t *audio)
+{
+    struct audio_source_s *s = (struct audio_source_s *)aout->sys;
+    struct decklink_sys_t *decklink_sys = s->decklink_sys;
+
+    vlc_mutex_lock(&decklink_sys->lock);
+    IDeckLinkOutput *p_output = decklink_sys->p_output;
+    vlc_mutex_unlock(&decklink_sys->lock);
+    if (!p_output) {
+        block_Release(audio);
+        return;
     }
-    else if (p_final->i_nb_samples != written) {
-        msg_Err(aout, "Written only %d samples out of %d", written, p_final->i_nb_samples);
-        report(aout, "ERROR AUDIO SAMPLES LOST", (uint64_t)(p_final->i_nb_samples - written));
+
+    audio->i_pts = CardTime(decklink_sys, audio->i_pts);
+    report(VLC_OBJECT(aout), "PLAY AUDIO BYTES", (uint64_t)audio->i_buffer);
+
+    unsigned head = s->head.load(std::memory_order_relaxed);
+    if (head - s->tail.load(std::memory_order_acquire) == AUDIO_RING_SIZE) {
+        msg_Warn(aout, "Audio queue full, dropping %u samples",
+                 audio->i_nb_samples);
+        block_Release(audio);
+    } else {
+        mtime_t end = BlockEnd(audio, decklink_sys->i_rate);
+        s->ring[head % AUDIO_RING_SIZE] = audio;
+        s->head.store(head + 1, std::memory_order_release);
+        s->end.store(end, std::memory_order_release);
     }
-    block_Release(p_final);
+
+    MixAudio(aout, decklink_sys, p_output);
 }
 
 static int OpenAudio(vlc_object_t *p_this)
@@ -1508,7 +2349,7 @@ static int OpenAudio(vlc_object_t *p_this)
     audio_output_t *aout = (audio_output_t *)p_this;
     struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
 
-    createAudioSource((audio_output_t *)p_this);
+    createAudioSource(aout, decklink_sys);
 
     vlc_mutex_lock(&decklink_sys->lock);
     //decklink_sys->i_channels = var_InheritInteger(vd, AUDIO_CFG_PREFIX "audio-channels");
@@ -235,10 +235,12 @@ void input_clock_Delete( input_clock_t *cl )
  *
  *  i_ck_stream: date in stream clock
  *  i_ck_system: date in system clock
+ *  b_system_clock: i_ck_stream is itself the capture date in system clock
  *****************************************************************************/
 void input_clock_Update( input_clock_t *cl, vlc_object_t *p_log,
                          bool *pb_late,
                          bool b_can_pace_control, bool b_buffering_allowed,
+                         bool b_system_clock,
                          mtime_t i_ck_stream, mtime_t i_ck_system )
 {
     bool b_reset_reference = false;
@@ -273,16 +275,19 @@ void input_clock_Update( input_clock_t *cl, vlc_object_t *p_log,
         cl->i_next_drift_update = VLC_TS_INVALID;
         AvgReset( &cl->drift );
 
-        /* Feed synchro with a new reference point. */
+        /* Feed synchro with a new reference point. Capture dates are
+         * used as is, so that the output follows the capture exactly
+         * pts_delay later. */
         cl->b_has_reference = true;
-        cl->ref = clock_point_Create( i_ck_stream,
+        cl->ref = clock_point_Create( i_ck_stream, b_system_clock ? i_ck_stream :
                                       __MAX( cl->i_ts_max + CR_MEAN_PTS_GAP, i_ck_system ) );
         cl->b_has_external_clock = false;
     }
 
     /* Compute the drift between the stream clock and the system clock
      * when we don't control the source pace */
-    if( !b_can_pace_control && cl->i_next_drift_update < i_ck_system )
+    if( !b_can_pace_control && !b_system_clock &&
+        cl->i_next_drift_update < i_ck_system )
     {
         const mtime_t i_converted = ClockSystemToStream( cl, i_ck_system );
 
@@ -292,7 +297,7 @@ void input_clock_Update( input_clock_t *cl, vlc_object_t *p_log,
     }
 
     /* Update the extra buffering value */
-    if( !b_can_pace_control || b_reset_reference )
+    if( !b_can_pace_control || b_system_clock || b_reset_reference )
     {
         cl->i_buffering_duration = 0;
     }
@@ -316,8 +321,10 @@ void input_clock_Update( input_clock_t *cl, vlc_object_t *p_log,
      * the goal of the clock here */
     const mtime_t i_system_expected = ClockStreamToSystem( cl, i_ck_stream + AvgGet( &cl->drift ) );
     const mtime_t i_late = ( i_ck_system - cl->i_pts_delay ) - i_system_expected;
-    *pb_late = i_late > 0;
-    if( i_late > 0 )
+    /* The delay of capture dates is fixed: late data is dropped by the
+     * outputs rather than increasing the latency */
+    *pb_late = i_late > 0 && !b_system_clock;
+    if( *pb_late )
     {
         cl->late.pi_value[cl->late.i_index] = i_late;
         cl->late.i_index = ( cl->late.i_index + 1 ) % INPUT_CLOCK_LATE_COUNT;
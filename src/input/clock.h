@@ -53,10 +53,13 @@ void           input_clock_Delete( input_clock_t * );
  *
  * \param b_buffering_allowed tells if we are allowed to bufferize more data in
  * advanced (if possible).
+ * \param b_system_clock tells if i_clock is the capture date in system clock,
+ * in which case it is followed without drift estimation.
  */
 void    input_clock_Update( input_clock_t *, vlc_object_t *p_log,
                             bool *pb_late,
                             bool b_can_pace_control, bool b_buffering_allowed,
+                            bool b_system_clock,
                             mtime_t i_clock, mtime_t i_system );
 /**
  * This function will reset the drift of a input_clock_t.
@@ -1673,7 +1673,7 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
     es_format_Init( &p_owner->fmt, UNKNOWN_ES, 0 );
 
     /* decoder fifo */
-    p_owner->p_fifo = block_FifoNew();
+    p_owner->p_fifo = block_FifoNewSPSC( 1024 );
     if( unlikely(p_owner->p_fifo == NULL) )
     {
         free( p_owner );
@@ -1994,7 +1994,6 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
-    vlc_fifo_Lock( p_owner->p_fifo );
     if( !b_do_pace )
     {
         /* FIXME: ideally we would check the time amount of data
@@ -2004,10 +2003,14 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
         {
             msg_Warn( p_dec, "decoder/packetizer fifo full (data not "
                       "consumed quickly enough), resetting fifo!" );
-            block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_owner->p_fifo ) );
+            block_FifoEmpty( p_owner->p_fifo );
         }
+        /* The decoder thread is not disturbed: no locking on this path */
+        block_FifoPut( p_owner->p_fifo, p_block );
+        return;
     }
-    else
+
+    vlc_fifo_Lock( p_owner->p_fifo );
     if( !p_owner->b_waiting )
     {   /* The FIFO is not consumed when waiting, so pacing would deadlock VLC.
          * Locking is not necessary as b_waiting is only read, not written by
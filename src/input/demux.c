@@ -568,6 +568,7 @@ int demux_vaControlHelper( stream_t *s,
         case DEMUX_TEST_AND_CLEAR_FLAGS:
         case DEMUX_GET_TITLE:
         case DEMUX_GET_SEEKPOINT:
+        case DEMUX_IS_SYSTEM_CLOCK:
             return VLC_EGENERIC;
 
         case DEMUX_SET_TITLE:
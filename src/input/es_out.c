@@ -700,8 +700,11 @@ static void EsOutDecodersStopBuffering( es_out_t *out, bool b_forced )
     const mtime_t i_wakeup_delay = 10*1000; /* FIXME CLEANUP thread wake up time*/
     const mtime_t i_current_date = p_sys->b_paused ? p_sys->i_pause_date : mdate();
 
-    input_clock_ChangeSystemOrigin( p_sys->p_pgrm->p_clock, true,
-                                    i_current_date + i_wakeup_delay - i_buffering_duration );
+    /* Capture dates keep their fixed delay: the first, late, pictures are
+     * dropped rather than delaying the whole stream */
+    if( !p_sys->p_input->p->b_system_clock )
+        input_clock_ChangeSystemOrigin( p_sys->p_pgrm->p_clock, true,
+                                        i_current_date + i_wakeup_delay - i_buffering_duration );
 
     for( int i = 0; i < p_sys->i_es; i++ )
     {
@@ -2332,6 +2335,7 @@ static int EsOutControlLocked( es_out_t *out, int i_query, va_list args )
                             &b_late,
                             p_sys->p_input->p->b_can_pace_control || p_sys->b_buffering,
                             EsOutIsExtraBufferingAllowed( out ),
+                            p_sys->p_input->p->b_system_clock,
                             i_pcr, mdate() );
 
         if( !p_sys->p_pgrm )
@@ -82,6 +82,9 @@ enum es_out_query_private_e
 
     /* Set End Of Stream */
     ES_OUT_SET_EOS,                                 /* res=cannot fail */
+
+    /* Move inside the timeshift window, relative to its live edge */
+    ES_OUT_SEEK_TIMESHIFT,                          /* arg1=mtime_t i_offset    res=can fail */
 };
 
 static inline void es_out_SetMode( es_out_t *p_out, int i_mode )
@@ -134,6 +137,10 @@ static inline int es_out_SetTime( es_out_t *p_out, mtime_t i_date )
 {
     return es_out_Control( p_out, ES_OUT_SET_TIME, i_date );
 }
+static inline int es_out_SeekTimeshift( es_out_t *p_out, mtime_t i_offset )
+{
+    return es_out_Control( p_out, ES_OUT_SEEK_TIMESHIFT, i_offset );
+}
 static inline int es_out_SetFrameNext( es_out_t *p_out )
 {
     return es_out_Control( p_out, ES_OUT_SET_FRAME_NEXT );
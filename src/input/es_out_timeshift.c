@@ -37,6 +37,10 @@
 #endif
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#ifdef HAVE_MMAP
+#  include <sys/mman.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_fs.h>
@@ -46,6 +50,7 @@
 #include <vlc_input.h>
 #include <vlc_es_out.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include "input_internal.h"
 #include "es_out.h"
 #include "es_out_timeshift.h"
@@ -84,7 +89,7 @@ typedef struct attribute_packed
 {
     es_out_id_t *p_es;
     block_t *p_block;
-    int     i_offset;  /* We do not use file > INT_MAX */
+    uint64_t i_pos;     /* Payload position in the storage */
 } ts_cmd_send_t;
 
 typedef struct attribute_packed
@@ -156,25 +161,78 @@ typedef struct attribute_packed
     } u;
 } ts_cmd_t;
 
+/* Header of a payload in the storage, followed by the block data */
+typedef struct
+{
+    mtime_t  i_dts;
+    mtime_t  i_pts;
+    mtime_t  i_length;
+    uint32_t i_flags;
+    unsigned i_nb_samples;
+    size_t   i_buffer;
+} ts_payload_t;
+
+#define TS_PAYLOAD_ALIGN    16
+#define TS_PAYLOAD_HEADER   ((sizeof(ts_payload_t) + TS_PAYLOAD_ALIGN - 1) & ~(TS_PAYLOAD_ALIGN - 1))
+#define TS_POS_LOST         UINT64_MAX
+/* Payloads are mapped rather than copied from this size */
+#define TS_MAP_MIN          (64 * 1024)
+/* Granularity of the tracking of mapped payloads */
+#define TS_CHUNK_SIZE       (1024 * 1024)
+/* The mapped file is allocated by this much as the ring fills up */
+#define TS_GROW_SIZE        (16 * TS_CHUNK_SIZE)
+/* The ring of commands grows up to this fraction of the ring of payloads */
+#define TS_CMD_RATIO        8
+
+/* Number of mapped blocks per chunk of the storage. It is reference counted,
+ * as the blocks may outlive the storage. */
+typedef struct
+{
+    atomic_uint refs;
+    atomic_uint chunks[];
+} ts_holds_t;
+
+typedef struct
+{
+    block_t     self;
+    ts_holds_t  *p_holds;
+    size_t      i_chunk;
+    size_t      i_chunk_end;
+} ts_block_t;
+
+/* The storage is a ring of payloads in a temporary file, mapped in memory
+ * where mmap() is available and read and written otherwise, and a ring of
+ * commands.
+ * The commands already executed are kept as long as their payloads are not
+ * overwritten: they are the window in which the reader can seek, and the
+ * command dates are its time index.
+ * When either ring is full of unread data, the oldest data and clock commands
+ * are dropped and the reader moves forward: the other commands are kept, in
+ * order, as they change the state of the ES. */
 typedef struct ts_storage_t ts_storage_t;
 struct ts_storage_t
 {
-    ts_storage_t *p_next;
-
-    /* */
-#ifdef _WIN32
-    char    *psz_file;  /* Filename */
-#endif
-    size_t  i_file_max; /* Max size in bytes */
-    int64_t i_file_size;/* Current size in bytes */
-    FILE    *p_filew;   /* FILE handle for data writing */
-    FILE    *p_filer;   /* FILE handle for data reading */
-
-    /* */
-    int      i_cmd_r;
-    int      i_cmd_w;
-    int      i_cmd_max;
-    ts_cmd_t *p_cmd;
+    /* Payloads */
+    int         fd;
+    uint8_t     *p_map;     /* NULL without mmap() */
+    size_t      i_map_length;
+    size_t      i_map_size; /* Size of the ring, at most i_map_length */
+    size_t      i_file_size;/* Allocated part of the mapped file */
+    uint64_t    i_write;    /* End of the last payload written */
+    uint64_t    i_read;     /* Start of the unread payloads */
+    ts_holds_t  *p_holds;
+
+    /* Commands, indexed modulo i_cmd_max */
+    ts_cmd_t    *p_cmd;
+    size_t      i_cmd_max;
+    uint64_t    i_cmd_first;/* First command of the window */
+    uint64_t    i_cmd_r;    /* Next command to read */
+    uint64_t    i_cmd_live; /* First command never read */
+    uint64_t    i_cmd_skip; /* Commands to skip up to this one */
+    uint64_t    i_cmd_w;
+    uint64_t    i_cmd_dropped;/* Unread commands dropped so far */
+    mtime_t     i_date_r;   /* Date of the last command read */
+    mtime_t     i_window;   /* Maximal duration of the window, 0 if none */
 };
 
 typedef struct
@@ -183,6 +241,7 @@ typedef struct
     input_thread_t *p_input;
     es_out_t       *p_out;
     int64_t        i_tmp_size_max;
+    mtime_t        i_window;
     const char     *psz_tmp_path;
 
     /* Lock for all following fields */
@@ -203,8 +262,8 @@ typedef struct
     mtime_t        i_buffering_delay;
 
     /* */
-    ts_storage_t   *p_storage_r;
-    ts_storage_t   *p_storage_w;
+    ts_storage_t   *p_storage;
+    unsigned       i_seek;      /* Number of seeks */
 
     mtime_t        i_cmd_delay;
 
@@ -221,7 +280,8 @@ struct es_out_sys_t
     es_out_t       *p_out;
 
     /* Configuration */
-    int64_t        i_tmp_size_max;    /* Maximal temporary file size in byte */
+    int64_t        i_tmp_size_max;    /* Temporary file size in byte */
+    mtime_t        i_window;          /* Maximal duration of the window */
     char           *psz_tmp_path;     /* Path for temporary files */
 
     /* Lock for all following fields */
@@ -258,18 +318,21 @@ static bool         TsHasCmd( ts_thread_t * );
 static bool         TsIsUnused( ts_thread_t * );
 static int          TsChangePause( ts_thread_t *, bool b_source_paused, bool b_paused, mtime_t i_date );
 static int          TsChangeRate( ts_thread_t *, int i_src_rate, int i_rate );
+static int          TsSeek( ts_thread_t *, mtime_t i_offset );
+static void         TsMoveReader( ts_thread_t *, mtime_t i_date );
 
 static void         *TsRun( void * );
 
-static ts_storage_t *TsStorageNew( const char *psz_path, int64_t i_tmp_size_max );
+static ts_storage_t *TsStorageNew( const char *psz_path, int64_t i_tmp_size_max, mtime_t i_window );
 static void         TsStorageDelete( ts_storage_t * );
-static void         TsStoragePack( ts_storage_t *p_storage );
-static bool         TsStorageIsFull( ts_storage_t *, const ts_cmd_t *p_cmd );
 static bool         TsStorageIsEmpty( ts_storage_t * );
-static void         TsStoragePushCmd( ts_storage_t *, const ts_cmd_t *p_cmd, bool b_flush );
-static void         TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush );
+static int          TsStoragePushCmd( ts_storage_t *, const ts_cmd_t *p_cmd );
+static int          TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush );
+static mtime_t      TsStorageSeek( ts_storage_t *, mtime_t i_offset );
+static ts_cmd_t     *TsStorageCmd( ts_storage_t *, uint64_t i_cmd );
 
 static void CmdClean( ts_cmd_t * );
+static bool CmdIsReplayable( const ts_cmd_t * );
 static void cmd_cleanup_routine( void *p ) { CmdClean( p ); }
 
 static int  CmdInitAdd    ( ts_cmd_t *, es_out_id_t *, const es_format_t *, bool b_copy );
@@ -331,13 +394,17 @@ es_out_t *input_EsOutTimeshiftNew( input_thread_t *p_input, es_out_t *p_next_out
     TAB_INIT( p_sys->i_es, p_sys->pp_es );
 
     /* */
-    const int i_tmp_size_max = var_CreateGetInteger( p_input, "input-timeshift-granularity" );
+    const int64_t i_tmp_size_max = var_CreateGetInteger( p_input, "input-timeshift-granularity" );
+    /* Leave room for the rest of the address space (256 MiB on 32-bit) */
+    const int64_t i_tmp_size_limit = SIZE_MAX / 16;
     if( i_tmp_size_max < 0 )
-        p_sys->i_tmp_size_max = 50*1024*1024;
+        p_sys->i_tmp_size_max = __MIN( INT64_C(1024)*1024*1024, i_tmp_size_limit );
     else
-        p_sys->i_tmp_size_max = __MAX( i_tmp_size_max, 1*1024*1024 );
-    msg_Dbg( p_input, "using timeshift granularity of %d MiB",
-             (int)p_sys->i_tmp_size_max/(1024*1024) );
+        p_sys->i_tmp_size_max = VLC_CLIP( i_tmp_size_max, 1*1024*1024, i_tmp_size_limit );
+    msg_Dbg( p_input, "using timeshift buffer of %"PRId64" MiB",
+             p_sys->i_tmp_size_max/(1024*1024) );
+
+    p_sys->i_window = CLOCK_FREQ * __MAX( var_InheritInteger( p_input, "input-timeshift-window" ), 0 );
 
     p_sys->psz_tmp_path = var_InheritString( p_input, "input-timeshift-path" );
 #if defined (_WIN32) && !VLC_WINSTORE_APP
@@ -610,6 +677,16 @@ static int ControlLockedSetTime( es_out_t *p_out, mtime_t i_date )
     msg_Err( p_sys->p_input, "EsOutTimeshift does not yet support time change" );
     return VLC_EGENERIC;
 }
+static int ControlLockedSeekTimeshift( es_out_t *p_out, mtime_t i_offset )
+{
+    es_out_sys_t *p_sys = p_out->p_sys;
+
+    /* There is nothing to seek in without timeshift */
+    if( !p_sys->b_delayed )
+        return VLC_EGENERIC;
+
+    return TsSeek( p_sys->p_ts, i_offset );
+}
 static int ControlLockedSetFrameNext( es_out_t *p_out )
 {
     es_out_sys_t *p_sys = p_out->p_sys;
@@ -706,6 +783,12 @@ static int ControlLocked( es_out_t *p_out, int i_query, va_list args )
 
         return ControlLockedSetTime( p_out, i_date );
     }
+    case ES_OUT_SEEK_TIMESHIFT:
+    {
+        const mtime_t i_offset = (mtime_t)va_arg( args, mtime_t );
+
+        return ControlLockedSeekTimeshift( p_out, i_offset );
+    }
     case ES_OUT_SET_FRAME_NEXT:
     {
         return ControlLockedSetFrameNext( p_out );
@@ -786,6 +869,7 @@ static int TsStart( es_out_t *p_out )
         return VLC_EGENERIC;
 
     p_ts->i_tmp_size_max = p_sys->i_tmp_size_max;
+    p_ts->i_window = p_sys->i_window;
     p_ts->psz_tmp_path = p_sys->psz_tmp_path;
     p_ts->p_input = p_sys->p_input;
     p_ts->p_out = p_sys->p_out;
@@ -799,8 +883,8 @@ static int TsStart( es_out_t *p_out )
     p_ts->i_rate_delay = 0;
     p_ts->i_buffering_delay = 0;
     p_ts->i_cmd_delay = 0;
-    p_ts->p_storage_r = NULL;
-    p_ts->p_storage_w = NULL;
+    p_ts->p_storage = NULL;
+    p_ts->i_seek = 0;
 
     p_sys->b_delayed = true;
     if( vlc_clone( &p_ts->thread, TsRun, p_ts, VLC_THREAD_PRIORITY_INPUT ) )
@@ -842,9 +926,8 @@ static void TsStop( ts_thread_t *p_ts )
 
         CmdClean( &cmd );
     }
-    assert( !p_ts->p_storage_r || !p_ts->p_storage_r->p_next );
-    if( p_ts->p_storage_r )
-        TsStorageDelete( p_ts->p_storage_r );
+    if( p_ts->p_storage )
+        TsStorageDelete( p_ts->p_storage );
     vlc_mutex_unlock( &p_ts->lock );
 
     TsDestroy( p_ts );
@@ -853,32 +936,33 @@ static void TsPushCmd( ts_thread_t *p_ts, ts_cmd_t *p_cmd )
 {
     vlc_mutex_lock( &p_ts->lock );
 
-    if( !p_ts->p_storage_w || TsStorageIsFull( p_ts->p_storage_w, p_cmd ) )
+    if( !p_ts->p_storage )
     {
-        ts_storage_t *p_storage = TsStorageNew( p_ts->psz_tmp_path, p_ts->i_tmp_size_max );
-
-        if( !p_storage )
+        p_ts->p_storage = TsStorageNew( p_ts->psz_tmp_path, p_ts->i_tmp_size_max,
+                                        p_ts->i_window );
+        if( !p_ts->p_storage )
         {
             CmdClean( p_cmd );
             vlc_mutex_unlock( &p_ts->lock );
             /* TODO warn the user (but only once) */
             return;
         }
-
-        if( !p_ts->p_storage_w )
-        {
-            p_ts->p_storage_r = p_ts->p_storage_w = p_storage;
-        }
-        else
-        {
-            TsStoragePack( p_ts->p_storage_w );
-            p_ts->p_storage_w->p_next = p_storage;
-            p_ts->p_storage_w = p_storage;
-        }
     }
 
-    /* TODO return error and warn the user (but only once) */
-    TsStoragePushCmd( p_ts->p_storage_w, p_cmd, p_ts->p_storage_r == p_ts->p_storage_w );
+    ts_storage_t *p_storage = p_ts->p_storage;
+    const uint64_t i_dropped = p_storage->i_cmd_dropped;
+
+    if( TsStoragePushCmd( p_storage, p_cmd ) )
+        msg_Err( p_ts->p_input, "es out timeshift: cannot store a command" );
+
+    if( p_storage->i_cmd_dropped != i_dropped && !TsStorageIsEmpty( p_storage ) )
+    {
+        const mtime_t i_date = TsStorageCmd( p_storage, p_storage->i_cmd_r )->i_date;
+
+        msg_Warn( p_ts->p_input, "es out timeshift: storage full, %"PRIu64" commands dropped",
+                  p_storage->i_cmd_dropped - i_dropped );
+        TsMoveReader( p_ts, i_date );
+    }
 
     vlc_cond_signal( &p_ts->wait );
 
@@ -888,29 +972,17 @@ static int TsPopCmdLocked( ts_thread_t *p_ts, ts_cmd_t *p_cmd, bool b_flush )
 {
     vlc_assert_locked( &p_ts->lock );
 
-    if( TsStorageIsEmpty( p_ts->p_storage_r ) )
+    if( TsStorageIsEmpty( p_ts->p_storage ) )
         return VLC_EGENERIC;
 
-    TsStoragePopCmd( p_ts->p_storage_r, p_cmd, b_flush );
-
-    while( p_ts->p_storage_r && TsStorageIsEmpty( p_ts->p_storage_r ) )
-    {
-        ts_storage_t *p_next = p_ts->p_storage_r->p_next;
-        if( !p_next )
-            break;
-
-        TsStorageDelete( p_ts->p_storage_r );
-        p_ts->p_storage_r = p_next;
-    }
-
-    return VLC_SUCCESS;
+    return TsStoragePopCmd( p_ts->p_storage, p_cmd, b_flush );
 }
 static bool TsHasCmd( ts_thread_t *p_ts )
 {
     bool b_cmd;
 
     vlc_mutex_lock( &p_ts->lock );
-    b_cmd =  TsStorageIsEmpty( p_ts->p_storage_r );
+    b_cmd =  TsStorageIsEmpty( p_ts->p_storage );
     vlc_mutex_unlock( &p_ts->lock );
 
     return b_cmd;
@@ -922,7 +994,7 @@ static bool TsIsUnused( ts_thread_t *p_ts )
     vlc_mutex_lock( &p_ts->lock );
     b_unused = !p_ts->b_paused &&
                p_ts->i_rate == p_ts->i_rate_source &&
-               TsStorageIsEmpty( p_ts->p_storage_r );
+               TsStorageIsEmpty( p_ts->p_storage );
     vlc_mutex_unlock( &p_ts->lock );
 
     return b_unused;
@@ -976,6 +1048,46 @@ static int TsChangeRate( ts_thread_t *p_ts, int i_src_rate, int i_rate )
 
     return i_ret;
 }
+/* Resets the decoders, and plays the command at i_date, the next one to read,
+ * now (or on resume) */
+static void TsMoveReader( ts_thread_t *p_ts, mtime_t i_date )
+{
+    vlc_assert_locked( &p_ts->lock );
+
+    p_ts->p_storage->i_date_r = i_date;
+    es_out_SetTime( p_ts->p_out, -1 );
+
+    p_ts->i_cmd_delay = (p_ts->b_paused ? p_ts->i_pause_date : mdate()) - i_date;
+    p_ts->i_buffering_delay = 0;
+    p_ts->i_rate_date = -1;
+    p_ts->i_rate_delay = 0;
+    p_ts->i_seek++;
+}
+static int TsSeek( ts_thread_t *p_ts, mtime_t i_offset )
+{
+    vlc_mutex_lock( &p_ts->lock );
+
+    ts_storage_t *p_storage = p_ts->p_storage;
+    if( !p_storage || p_storage->i_date_r < 0 )
+    {
+        vlc_mutex_unlock( &p_ts->lock );
+        return VLC_EGENERIC;
+    }
+
+    const mtime_t i_date = TsStorageSeek( p_storage, i_offset );
+    if( i_date < 0 )
+    {
+        vlc_mutex_unlock( &p_ts->lock );
+        return VLC_EGENERIC;
+    }
+    msg_Dbg( p_ts->p_input, "es out timeshift: seek by %"PRId64" ms",
+             (i_date - p_storage->i_date_r) / 1000 );
+    TsMoveReader( p_ts, i_date );
+
+    vlc_cond_signal( &p_ts->wait );
+    vlc_mutex_unlock( &p_ts->lock );
+    return VLC_SUCCESS;
+}
 
 static void *TsRun( void *p_data )
 {
@@ -986,6 +1098,7 @@ static void *TsRun( void *p_data )
     {
         ts_cmd_t cmd;
         mtime_t  i_deadline;
+        unsigned i_seek;
         bool b_buffering;
 
         /* Pop a command to execute */
@@ -1055,6 +1168,7 @@ static void *TsRun( void *p_data )
             vlc_restorecancel( canc );
         }
         i_deadline = cmd.i_date + p_ts->i_cmd_delay + p_ts->i_rate_delay + p_ts->i_buffering_delay;
+        i_seek = p_ts->i_seek;
 
         vlc_cleanup_pop();
         vlc_mutex_unlock( &p_ts->lock );
@@ -1067,6 +1181,16 @@ static void *TsRun( void *p_data )
 
         vlc_cleanup_pop();
 
+        /* Drop the data popped before a seek */
+        vlc_mutex_lock( &p_ts->lock );
+        const bool b_stale = i_seek != p_ts->i_seek;
+        vlc_mutex_unlock( &p_ts->lock );
+        if( b_stale && CmdIsReplayable( &cmd ) )
+        {
+            CmdClean( &cmd );
+            continue;
+        }
+
         /* Execute the command  */
         const int canc = vlc_savecancel();
         switch( cmd.i_type )
@@ -1099,12 +1223,37 @@ static void *TsRun( void *p_data )
 /*****************************************************************************
  *
  *****************************************************************************/
-static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_max )
+static ts_holds_t *TsHoldsNew( size_t i_chunks )
+{
+    ts_holds_t *p_holds = malloc( sizeof(*p_holds) + i_chunks * sizeof(atomic_uint) );
+    if( unlikely(p_holds == NULL) )
+        return NULL;
+
+    atomic_init( &p_holds->refs, 1 );
+    for( size_t i = 0; i < i_chunks; i++ )
+        atomic_init( &p_holds->chunks[i], 0 );
+    return p_holds;
+}
+static void TsHoldsRelease( ts_holds_t *p_holds )
+{
+    if( atomic_fetch_sub( &p_holds->refs, 1 ) == 1 )
+        free( p_holds );
+}
+
+static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_max, mtime_t i_window )
 {
     ts_storage_t *p_storage = malloc( sizeof (*p_storage) );
     if( unlikely(p_storage == NULL) )
         return NULL;
 
+    /* Whole chunks, so that records never straddle the end of the ring
+     * unaligned */
+    p_storage->i_map_size = (i_tmp_size_max + TS_CHUNK_SIZE - 1) & ~(int64_t)(TS_CHUNK_SIZE - 1);
+    p_storage->i_map_length = p_storage->i_map_size;
+    p_storage->i_file_size = 0;
+    p_storage->p_map = NULL;
+    p_storage->p_holds = NULL;
+
     char *psz_file;
     int fd = GetTmpFile( &psz_file, psz_tmp_path );
     if( fd == -1 )
@@ -1112,41 +1261,40 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
         free( p_storage );
         return NULL;
     }
+    vlc_unlink( psz_file );
+    free( psz_file );
 
-    p_storage->p_filew = fdopen( fd, "w+b" );
-    if( p_storage->p_filew == NULL )
+#ifdef HAVE_MMAP
+    /* The file is allocated as it is written, see TsStorageGrow() */
+    void *p_map = mmap( NULL, p_storage->i_map_length, PROT_READ|PROT_WRITE,
+                        MAP_SHARED, fd, 0 );
+    p_storage->p_holds = TsHoldsNew( p_storage->i_map_size / TS_CHUNK_SIZE );
+    if( p_map == MAP_FAILED || p_storage->p_holds == NULL )
     {
+        if( p_map != MAP_FAILED )
+            munmap( p_map, p_storage->i_map_length );
+        free( p_storage->p_holds );
         vlc_close( fd );
-        vlc_unlink( psz_file );
-        goto error;
-    }
-
-    p_storage->p_filer = vlc_fopen( psz_file, "rb" );
-    if( p_storage->p_filer == NULL )
-    {
-        fclose( p_storage->p_filew );
-        vlc_unlink( psz_file );
-        goto error;
+        free( p_storage );
+        return NULL;
     }
-
-#ifndef _WIN32
-    vlc_unlink( psz_file );
-    free( psz_file );
-#else
-    p_storage->psz_file = psz_file;
+    p_storage->p_map = p_map;
 #endif
-    p_storage->p_next = NULL;
+    p_storage->fd = fd;
+    p_storage->i_write = 0;
+    p_storage->i_read = 0;
 
     /* */
-    p_storage->i_file_max = i_tmp_size_max;
-    p_storage->i_file_size = 0;
-
-    /* */
-    p_storage->i_cmd_w = 0;
+    p_storage->i_cmd_first = 0;
     p_storage->i_cmd_r = 0;
-    p_storage->i_cmd_max = 30000;
+    p_storage->i_cmd_live = 0;
+    p_storage->i_cmd_skip = 0;
+    p_storage->i_cmd_w = 0;
+    p_storage->i_cmd_dropped = 0;
+    p_storage->i_date_r = -1;
+    p_storage->i_window = i_window;
+    p_storage->i_cmd_max = 32768;
     p_storage->p_cmd = malloc( p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) );
-    //fprintf( stderr, "\nSTORAGE name=%s size=%d KiB\n", p_storage->psz_file, p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) /1024 );
 
     if( !p_storage->p_cmd )
     {
@@ -1154,126 +1302,500 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
         return NULL;
     }
     return p_storage;
-error:
-    free( psz_file );
-    free( p_storage );
-    return NULL;
 }
 
 static void TsStorageDelete( ts_storage_t *p_storage )
 {
-    while( p_storage->i_cmd_r < p_storage->i_cmd_w )
+    while( p_storage->p_cmd && !TsStorageIsEmpty( p_storage ) )
     {
         ts_cmd_t cmd;
 
-        TsStoragePopCmd( p_storage, &cmd, true );
+        if( TsStoragePopCmd( p_storage, &cmd, true ) )
+            break;
 
         CmdClean( &cmd );
     }
     free( p_storage->p_cmd );
 
-    fclose( p_storage->p_filer );
-    fclose( p_storage->p_filew );
-#ifdef _WIN32
-    vlc_unlink( p_storage->psz_file );
-    free( p_storage->psz_file );
+#ifdef HAVE_MMAP
+    /* Mapped blocks keep their own mappings */
+    munmap( p_storage->p_map, p_storage->i_map_length );
+    TsHoldsRelease( p_storage->p_holds );
 #endif
+    vlc_close( p_storage->fd );
     free( p_storage );
 }
 
-static void TsStoragePack( ts_storage_t *p_storage )
+static ts_cmd_t *TsStorageCmd( ts_storage_t *p_storage, uint64_t i_cmd )
 {
-    /* Try to release a bit of memory */
-    if( p_storage->i_cmd_w >= p_storage->i_cmd_max )
-        return;
+    return &p_storage->p_cmd[i_cmd & (p_storage->i_cmd_max - 1)];
+}
+/* Returns the end of the last chunk of the range held by a mapped block, or 0
+ * if none is */
+static size_t TsStorageHeldEnd( ts_storage_t *p_storage, size_t i_offset, size_t i_size )
+{
+    size_t i_end = 0;
 
-    p_storage->i_cmd_max = __MAX( p_storage->i_cmd_w, 1 );
+    if( !p_storage->p_holds )
+        return 0;
 
-    ts_cmd_t *p_new = realloc( p_storage->p_cmd, p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) );
-    if( p_new )
-        p_storage->p_cmd = p_new;
+    for( size_t i = i_offset / TS_CHUNK_SIZE; i <= (i_offset + i_size - 1) / TS_CHUNK_SIZE; i++ )
+    {
+        if( atomic_load( &p_storage->p_holds->chunks[i] ) > 0 )
+            i_end = (i + 1) * TS_CHUNK_SIZE;
+    }
+    return i_end;
 }
-static bool TsStorageIsFull( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
+static bool TsStorageIsEmpty( ts_storage_t *p_storage )
 {
-    if( p_cmd && p_cmd->i_type == C_SEND && p_storage->i_cmd_w > 0 )
+    return !p_storage || p_storage->i_cmd_r >= p_storage->i_cmd_w;
+}
+
+/* Copies data to and from the file */
+static int TsStoragePut( ts_storage_t *p_storage, size_t i_offset,
+                         const void *p_data, size_t i_size )
+{
+#ifdef HAVE_MMAP
+    memcpy( &p_storage->p_map[i_offset], p_data, i_size );
+#else
+    const uint8_t *p = p_data;
+
+    if( lseek( p_storage->fd, i_offset, SEEK_SET ) == (off_t)-1 )
+        return VLC_EGENERIC;
+    while( i_size > 0 )
     {
-        size_t i_size = sizeof(*p_cmd->u.send.p_block) + p_cmd->u.send.p_block->i_buffer;
+        ssize_t i_ret = write( p_storage->fd, p, i_size );
+        if( i_ret <= 0 )
+            return VLC_EGENERIC;
+        p += i_ret;
+        i_size -= i_ret;
+    }
+#endif
+    return VLC_SUCCESS;
+}
+static int TsStorageGet( ts_storage_t *p_storage, size_t i_offset,
+                         void *p_data, size_t i_size )
+{
+#ifdef HAVE_MMAP
+    memcpy( p_data, &p_storage->p_map[i_offset], i_size );
+#else
+    uint8_t *p = p_data;
 
-        if( p_storage->i_file_size + i_size >= p_storage->i_file_max )
-            return true;
+    if( lseek( p_storage->fd, i_offset, SEEK_SET ) == (off_t)-1 )
+        return VLC_EGENERIC;
+    while( i_size > 0 )
+    {
+        ssize_t i_ret = read( p_storage->fd, p, i_size );
+        if( i_ret <= 0 )
+            return VLC_EGENERIC;
+        p += i_ret;
+        i_size -= i_ret;
     }
-    return p_storage->i_cmd_w >= p_storage->i_cmd_max;
+#endif
+    return VLC_SUCCESS;
 }
-static bool TsStorageIsEmpty( ts_storage_t *p_storage )
+
+#ifdef HAVE_MMAP
+/* Allocates the file up to at least i_end: writing to a hole of a full file
+ * system through the mapping would crash. If the file cannot grow, the ring
+ * is cut down to what is allocated. This happens before the first wrap, where
+ * the positions of the payloads are still their offsets. */
+static int TsStorageGrow( ts_storage_t *p_storage, size_t i_end )
 {
-    return !p_storage || p_storage->i_cmd_r >= p_storage->i_cmd_w;
+    const size_t i_size = __MIN( (i_end + TS_GROW_SIZE - 1) & ~(size_t)(TS_GROW_SIZE - 1),
+                                 p_storage->i_map_size );
+
+# ifdef HAVE_POSIX_FALLOCATE
+    if( !posix_fallocate( p_storage->fd, p_storage->i_file_size,
+                          i_size - p_storage->i_file_size ) )
+# else
+    if( !ftruncate( p_storage->fd, i_size ) )
+# endif
+    {
+        p_storage->i_file_size = i_size;
+        return VLC_SUCCESS;
+    }
+    if( p_storage->i_file_size > 0 )
+        p_storage->i_map_size = p_storage->i_file_size;
+    return VLC_EGENERIC;
 }
-static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd, bool b_flush )
+#endif
+
+/* Drops the unread data and clock commands, from the reader up to the command
+ * i_cmd_end or to the first payload at or after i_pos_end, whichever comes
+ * first. The other commands are moved down, in order. Returns the number of
+ * commands dropped. */
+static uint64_t TsStorageDrop( ts_storage_t *p_storage, uint64_t i_cmd_end,
+                               uint64_t i_pos_end )
 {
-    ts_cmd_t cmd = *p_cmd;
+    uint64_t i_cmd_w = p_storage->i_cmd_r;
+    uint64_t i_cmd_live = p_storage->i_cmd_live;
+    uint64_t i_cmd_skip = p_storage->i_cmd_skip;
+    bool b_drop = true;
 
-    assert( !TsStorageIsFull( p_storage, p_cmd ) );
+    for( uint64_t i = p_storage->i_cmd_r; i < p_storage->i_cmd_w; i++ )
+    {
+        ts_cmd_t *p_cmd = TsStorageCmd( p_storage, i );
 
-    if( cmd.i_type == C_SEND )
+        if( i >= i_cmd_end ||
+            ( p_cmd->i_type == C_SEND && p_cmd->u.send.i_pos != TS_POS_LOST &&
+              p_cmd->u.send.i_pos >= i_pos_end ) )
+            b_drop = false;
+
+        if( b_drop && CmdIsReplayable( p_cmd ) )
+        {
+            CmdClean( p_cmd );
+            if( i < p_storage->i_cmd_live )
+                i_cmd_live--;
+            if( i < p_storage->i_cmd_skip )
+                i_cmd_skip--;
+            continue;
+        }
+        if( i_cmd_w != i )
+            *TsStorageCmd( p_storage, i_cmd_w ) = *p_cmd;
+        i_cmd_w++;
+    }
+
+    const uint64_t i_dropped = p_storage->i_cmd_w - i_cmd_w;
+    p_storage->i_cmd_live = i_cmd_live;
+    p_storage->i_cmd_skip = i_cmd_skip;
+    p_storage->i_cmd_w = i_cmd_w;
+    p_storage->i_cmd_dropped += i_dropped;
+
+    /* The payloads from the reader on must not be overwritten */
+    p_storage->i_read = p_storage->i_write;
+    for( uint64_t i = p_storage->i_cmd_r; i < p_storage->i_cmd_w; i++ )
     {
-        block_t *p_block = cmd.u.send.p_block;
+        const ts_cmd_t *p_cmd = TsStorageCmd( p_storage, i );
 
-        cmd.u.send.p_block = NULL;
-        cmd.u.send.i_offset = ftell( p_storage->p_filew );
+        if( p_cmd->i_type == C_SEND && p_cmd->u.send.i_pos != TS_POS_LOST )
+        {
+            p_storage->i_read = p_cmd->u.send.i_pos;
+            break;
+        }
+    }
+    return i_dropped;
+}
+
+/* Copies a payload after the last one. The chunks held by mapped blocks are
+ * skipped, and the oldest unread payloads are overwritten, an eighth of the
+ * ring at once. */
+static uint64_t TsStorageWrite( ts_storage_t *p_storage, const block_t *p_block )
+{
+    const size_t i_size = TS_PAYLOAD_HEADER +
+        ((p_block->i_buffer + TS_PAYLOAD_ALIGN - 1) & ~(TS_PAYLOAD_ALIGN - 1));
+    uint64_t i_pos = p_storage->i_write;
+    size_t i_offset = i_pos % p_storage->i_map_size;
 
-        if( fwrite( p_block, sizeof(*p_block), 1, p_storage->p_filew ) != 1 )
+    if( i_size > p_storage->i_map_size )
+        return TS_POS_LOST;
+    for( ;; )
+    {
+        if( i_offset + i_size > p_storage->i_map_size )
+        {
+            /* Records are not split at the end of the ring */
+            i_pos += p_storage->i_map_size - i_offset;
+            i_offset = 0;
+        }
+
+        const size_t i_held = TsStorageHeldEnd( p_storage, i_offset, i_size );
+        if( i_held == 0 )
+            break;
+        if( i_pos + i_held - i_offset - p_storage->i_write >= p_storage->i_map_size )
+            return TS_POS_LOST;
+        i_pos += i_held - i_offset;
+        i_offset = i_held;
+    }
+    if( i_pos + i_size - p_storage->i_read > p_storage->i_map_size )
+    {
+        TsStorageDrop( p_storage, UINT64_MAX, i_pos + i_size -
+                       p_storage->i_map_size + p_storage->i_map_size / 8 );
+        /* Nothing unread is left to overwrite */
+        if( i_pos + i_size - p_storage->i_read > p_storage->i_map_size )
+            p_storage->i_read = i_pos;
+    }
+#ifdef HAVE_MMAP
+    if( i_offset + i_size > p_storage->i_file_size &&
+        TsStorageGrow( p_storage, i_offset + i_size ) )
+        return TS_POS_LOST;
+#endif
+
+    const ts_payload_t payload = {
+        .i_dts        = p_block->i_dts,
+        .i_pts        = p_block->i_pts,
+        .i_length     = p_block->i_length,
+        .i_flags      = p_block->i_flags,
+        .i_nb_samples = p_block->i_nb_samples,
+        .i_buffer     = p_block->i_buffer,
+    };
+    if( TsStoragePut( p_storage, i_offset, &payload, sizeof(payload) ) ||
+        ( p_block->i_buffer > 0 &&
+          TsStoragePut( p_storage, i_offset + TS_PAYLOAD_HEADER,
+                        p_block->p_buffer, p_block->i_buffer ) ) )
+        return TS_POS_LOST;
+
+    p_storage->i_write = i_pos + i_size;
+    return i_pos;
+}
+
+#ifdef HAVE_MMAP
+static void TsBlockRelease( block_t *p_block )
+{
+    ts_block_t *p_sys = (ts_block_t *)p_block;
+
+    for( size_t i = p_sys->i_chunk; i < p_sys->i_chunk_end; i++ )
+        atomic_fetch_sub( &p_sys->p_holds->chunks[i], 1 );
+    TsHoldsRelease( p_sys->p_holds );
+
+    munmap( p_block->p_start, p_block->i_size );
+    free( p_sys );
+}
+
+/* Maps a payload privately: the file pages are shared with the storage until
+ * a decoder writes into them. The chunks stay held until the block is
+ * released, so that the writer does not change them under the mapping. */
+static block_t *TsStorageMap( ts_storage_t *p_storage, size_t i_offset, size_t i_buffer )
+{
+    const size_t i_page_mask = sysconf( _SC_PAGESIZE ) - 1;
+    const size_t i_left = i_offset & i_page_mask;
+    const size_t i_size = (i_left + i_buffer + i_page_mask) & ~i_page_mask;
+
+    ts_block_t *p_sys = malloc( sizeof(*p_sys) );
+    if( unlikely(p_sys == NULL) )
+        return NULL;
+
+    void *p_map = mmap( NULL, i_size, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+                        p_storage->fd, i_offset - i_left );
+    if( p_map == MAP_FAILED )
+    {
+        free( p_sys );
+        return NULL;
+    }
+
+    block_t *p_block = &p_sys->self;
+    block_Init( p_block, p_map, i_size );
+    p_block->p_buffer = (uint8_t *)p_map + i_left;
+    p_block->i_buffer = i_buffer;
+    p_block->pf_release = TsBlockRelease;
+
+    p_sys->p_holds = p_storage->p_holds;
+    p_sys->i_chunk = i_offset / TS_CHUNK_SIZE;
+    p_sys->i_chunk_end = (i_offset + i_buffer - 1) / TS_CHUNK_SIZE + 1;
+    atomic_fetch_add( &p_sys->p_holds->refs, 1 );
+    for( size_t i = p_sys->i_chunk; i < p_sys->i_chunk_end; i++ )
+        atomic_fetch_add( &p_sys->p_holds->chunks[i], 1 );
+    return p_block;
+}
+#endif
+
+static block_t *TsStorageRead( ts_storage_t *p_storage, uint64_t i_pos,
+                               const ts_payload_t *p_payload )
+{
+    const size_t i_offset = i_pos % p_storage->i_map_size;
+    block_t *p_block = NULL;
+
+#ifdef HAVE_MMAP
+    if( p_payload->i_buffer >= TS_MAP_MIN )
+        p_block = TsStorageMap( p_storage, i_offset + TS_PAYLOAD_HEADER,
+                                p_payload->i_buffer );
+#endif
+    if( !p_block )
+    {
+        p_block = block_Alloc( p_payload->i_buffer );
+        if( !p_block )
+            return NULL;
+        if( p_payload->i_buffer > 0 &&
+            TsStorageGet( p_storage, i_offset + TS_PAYLOAD_HEADER,
+                          p_block->p_buffer, p_payload->i_buffer ) )
         {
             block_Release( p_block );
-            return;
+            return NULL;
         }
-        p_storage->i_file_size += sizeof(*p_block);
-        if( p_block->i_buffer > 0 )
+    }
+    p_block->i_dts        = p_payload->i_dts;
+    p_block->i_pts        = p_payload->i_pts;
+    p_block->i_flags      = p_payload->i_flags;
+    p_block->i_length     = p_payload->i_length;
+    p_block->i_nb_samples = p_payload->i_nb_samples;
+    return p_block;
+}
+
+/* Makes room for one more command, growing the ring up to its limit rather
+ * than shortening the window, and dropping an eighth of the ring of unread
+ * commands last */
+static int TsStorageReserve( ts_storage_t *p_storage )
+{
+    if( p_storage->i_cmd_w - p_storage->i_cmd_first < p_storage->i_cmd_max )
+        return VLC_SUCCESS;
+
+    const size_t i_max = 2 * p_storage->i_cmd_max;
+    ts_cmd_t *p_cmd = NULL;
+    if( i_max <= p_storage->i_map_size / TS_CMD_RATIO / sizeof(*p_cmd) )
+        p_cmd = malloc( i_max * sizeof(*p_cmd) );
+    if( !p_cmd )
+    {
+        if( p_storage->i_cmd_first < p_storage->i_cmd_r )
         {
-            if( fwrite( p_block->p_buffer, p_block->i_buffer, 1, p_storage->p_filew ) != 1 )
-            {
-                block_Release( p_block );
-                return;
-            }
+            p_storage->i_cmd_first++;
+            return VLC_SUCCESS;
         }
-        p_storage->i_file_size += p_block->i_buffer;
-        block_Release( p_block );
+        if( TsStorageDrop( p_storage, p_storage->i_cmd_r + p_storage->i_cmd_max / 8,
+                           UINT64_MAX ) > 0 )
+            return VLC_SUCCESS;
+        return VLC_ENOMEM;
+    }
+
+    for( uint64_t i = p_storage->i_cmd_first; i < p_storage->i_cmd_w; i++ )
+        p_cmd[i & (i_max - 1)] = *TsStorageCmd( p_storage, i );
+    free( p_storage->p_cmd );
+    p_storage->p_cmd = p_cmd;
+    p_storage->i_cmd_max = i_max;
+    return VLC_SUCCESS;
+}
+
+/* Removes the commands that are too old, or whose payload was overwritten,
+ * from the window. It always starts with an available payload. */
+static void TsStorageTrim( ts_storage_t *p_storage, mtime_t i_date )
+{
+    const uint64_t i_valid = p_storage->i_write > p_storage->i_map_size ?
+                             p_storage->i_write - p_storage->i_map_size : 0;
+
+    while( p_storage->i_cmd_first < p_storage->i_cmd_r )
+    {
+        const ts_cmd_t *p_cmd = TsStorageCmd( p_storage, p_storage->i_cmd_first );
 
-        if( b_flush )
-            fflush( p_storage->p_filew );
+        if( p_cmd->i_type == C_SEND &&
+            p_cmd->u.send.i_pos != TS_POS_LOST &&
+            p_cmd->u.send.i_pos >= i_valid &&
+            ( p_storage->i_window <= 0 || p_cmd->i_date >= i_date - p_storage->i_window ) )
+            break;
+        p_storage->i_cmd_first++;
     }
-    p_storage->p_cmd[p_storage->i_cmd_w++] = cmd;
 }
-static void TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush )
+
+static int TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
 {
-    assert( !TsStorageIsEmpty( p_storage ) );
+    ts_cmd_t cmd = *p_cmd;
 
-    *p_cmd = p_storage->p_cmd[p_storage->i_cmd_r++];
-    if( p_cmd->i_type == C_SEND )
+    if( cmd.i_type == C_SEND )
     {
-        block_t block;
+        block_t *p_block = cmd.u.send.p_block;
 
-        if( !b_flush &&
-            !fseek( p_storage->p_filer, p_cmd->u.send.i_offset, SEEK_SET ) &&
-            fread( &block, sizeof(block), 1, p_storage->p_filer ) == 1 )
+        cmd.u.send.p_block = NULL;
+        cmd.u.send.i_pos = TsStorageWrite( p_storage, p_block );
+        block_Release( p_block );
+    }
+    TsStorageTrim( p_storage, cmd.i_date );
+
+    if( TsStorageReserve( p_storage ) )
+    {
+        CmdClean( &cmd );
+        return VLC_ENOMEM;
+    }
+    *TsStorageCmd( p_storage, p_storage->i_cmd_w++ ) = cmd;
+    return VLC_SUCCESS;
+}
+static int TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush )
+{
+    while( !TsStorageIsEmpty( p_storage ) )
+    {
+        const uint64_t i_cmd = p_storage->i_cmd_r++;
+        const bool b_live = i_cmd >= p_storage->i_cmd_live;
+
+        *p_cmd = *TsStorageCmd( p_storage, i_cmd );
+        if( b_live )
+            p_storage->i_cmd_live = i_cmd + 1;
+        p_storage->i_date_r = p_cmd->i_date;
+
+        if( p_cmd->i_type == C_SEND )
         {
-            block_t *p_block = block_Alloc( block.i_buffer );
-            if( p_block )
+            const uint64_t i_pos = p_cmd->u.send.i_pos;
+
+            ts_payload_t payload;
+
+            p_cmd->u.send.p_block = NULL;
+            if( i_pos != TS_POS_LOST &&
+                !TsStorageGet( p_storage, i_pos % p_storage->i_map_size,
+                               &payload, sizeof(payload) ) )
             {
-                p_block->i_dts      = block.i_dts;
-                p_block->i_pts      = block.i_pts;
-                p_block->i_flags    = block.i_flags;
-                p_block->i_length   = block.i_length;
-                p_block->i_nb_samples = block.i_nb_samples;
-                p_block->i_buffer = fread( p_block->p_buffer, 1, block.i_buffer, p_storage->p_filer );
+                p_storage->i_read = i_pos + TS_PAYLOAD_HEADER + payload.i_buffer;
+
+                if( !b_flush && i_cmd >= p_storage->i_cmd_skip )
+                    p_cmd->u.send.p_block = TsStorageRead( p_storage, i_pos, &payload );
             }
-            p_cmd->u.send.p_block = p_block;
         }
+
+        if( b_live )
+        {
+            /* The previous commands cannot be replayed past an ES change */
+            if( p_cmd->i_type == C_ADD || p_cmd->i_type == C_DEL ||
+                ( p_cmd->i_type == C_CONTROL && p_cmd->u.control.i_query == ES_OUT_DEL_GROUP ) )
+                p_storage->i_cmd_first = p_storage->i_cmd_r;
+
+            if( i_cmd < p_storage->i_cmd_skip && CmdIsReplayable( p_cmd ) )
+            {
+                CmdClean( p_cmd );
+                continue;
+            }
+            return VLC_SUCCESS;
+        }
+
+        /* Only the data and the clock are replayed. The other commands
+         * were cleaned when executed. */
+        if( !b_flush && i_cmd >= p_storage->i_cmd_skip && CmdIsReplayable( p_cmd ) )
+            return VLC_SUCCESS;
+    }
+    return VLC_EGENERIC;
+}
+
+/* Moves the reader to the first command of the window at or after i_offset
+ * from the newest command, the live edge, and returns its date */
+static mtime_t TsStorageSeek( ts_storage_t *p_storage, mtime_t i_offset )
+{
+    uint64_t i_low = p_storage->i_cmd_first;
+    uint64_t i_high = p_storage->i_cmd_w;
+
+    if( i_low >= i_high )
+        return -1;
+
+    const mtime_t i_date = TsStorageCmd( p_storage, i_high - 1 )->i_date + i_offset;
+
+    while( i_low < i_high )
+    {
+        const uint64_t i_mid = i_low + (i_high - i_low) / 2;
+
+        if( TsStorageCmd( p_storage, i_mid )->i_date < i_date )
+            i_low = i_mid + 1;
         else
+            i_high = i_mid;
+    }
+    if( i_low >= p_storage->i_cmd_w )
+        i_low = p_storage->i_cmd_w - 1;
+
+    /* The commands never read cannot be dropped, they are skipped */
+    if( i_low <= p_storage->i_cmd_live )
+    {
+        p_storage->i_cmd_r = i_low;
+        p_storage->i_cmd_skip = 0;
+    }
+    else
+    {
+        p_storage->i_cmd_r = p_storage->i_cmd_live;
+        p_storage->i_cmd_skip = i_low;
+    }
+
+    /* The payloads from there on must not be overwritten */
+    for( uint64_t i = p_storage->i_cmd_r; i < p_storage->i_cmd_w; i++ )
+    {
+        const ts_cmd_t *p_cmd = TsStorageCmd( p_storage, i );
+
+        if( p_cmd->i_type == C_SEND && p_cmd->u.send.i_pos != TS_POS_LOST )
         {
-            //perror( "TsStoragePopCmd" );
-            p_cmd->u.send.p_block = block_Alloc( 1 );
+            p_storage->i_read = p_cmd->u.send.i_pos;
+            break;
         }
     }
+    return TsStorageCmd( p_storage, i_low )->i_date;
 }
 
 /*****************************************************************************
@@ -1300,6 +1822,26 @@ static void CmdClean( ts_cmd_t *p_cmd )
     }
 }
 
+/* Commands that can be executed again from the window */
+static bool CmdIsReplayable( const ts_cmd_t *p_cmd )
+{
+    if( p_cmd->i_type == C_SEND )
+        return true;
+    if( p_cmd->i_type != C_CONTROL )
+        return false;
+
+    switch( p_cmd->u.control.i_query )
+    {
+    case ES_OUT_SET_PCR:
+    case ES_OUT_SET_GROUP_PCR:
+    case ES_OUT_RESET_PCR:
+    case ES_OUT_SET_NEXT_DISPLAY_TIME:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static int CmdInitAdd( ts_cmd_t *p_cmd, es_out_id_t *p_es, const es_format_t *p_fmt, bool b_copy )
 {
     p_cmd->i_type = C_ADD;
@@ -309,6 +309,7 @@ static input_thread_t *Create( vlc_object_t *p_parent, input_item_t *p_item,
 
     /* Init Common fields */
     p_input->p->b_can_pace_control = true;
+    p_input->p->b_system_clock = false;
     p_input->p->i_start = 0;
     p_input->p->i_time  = 0;
     p_input->p->i_stop  = 0;
@@ -877,6 +878,7 @@ static void InitTitle( input_thread_t * p_input )
     p_input->p->b_can_pace_control    = p_master->b_can_pace_control;
     p_input->p->b_can_pause        = p_master->b_can_pause;
     p_input->p->b_can_rate_control = p_master->b_can_rate_control;
+    p_input->p->b_system_clock     = p_master->b_system_clock;
     vlc_mutex_unlock( &p_input->p->p_item->lock );
 }
 
@@ -1779,6 +1781,14 @@ static bool Control( input_thread_t *p_input,
                 }
             }
             if( i_ret )
+            {
+                /* Move inside the timeshift window of a live stream. The
+                 * demuxer time is that of its live edge, not of the
+                 * delayed playback. */
+                i_ret = es_out_SeekTimeshift( p_input->p->p_es_out,
+                                    i_time - var_GetInteger( p_input, "time" ) );
+            }
+            if( i_ret )
             {
                 msg_Warn( p_input, "INPUT_CONTROL_SET_TIME %"PRId64
                          " failed or not possible", i_time );
@@ -2394,6 +2404,11 @@ static input_source_t *InputSourceNew( input_thread_t *p_input,
     if( var_GetInteger( p_input, "clock-synchro" ) != -1 )
         in->b_can_pace_control = !var_GetInteger( p_input, "clock-synchro" );
 
+    /* Capture dates are only meaningful for live sources */
+    if( in->b_can_pace_control ||
+        demux_Control( in->p_demux, DEMUX_IS_SYSTEM_CLOCK, &in->b_system_clock ) )
+        in->b_system_clock = false;
+
     return in;
 }
 
@@ -63,6 +63,7 @@ typedef struct
     bool b_can_rate_control;
     bool b_can_stream_record;
     bool b_rescale_ts;
+    bool b_system_clock;
     double f_fps;
 
     /* */
@@ -85,6 +86,7 @@ struct input_thread_private_t
     bool        b_can_pause;
     bool        b_can_rate_control;
     bool        b_can_pace_control;
+    bool        b_system_clock; /* timestamps are capture dates */
 
     /* Current state */
     int         i_state;
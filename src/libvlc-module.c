@@ -682,10 +682,17 @@ static const char *const ppsz_prefres[] = {
 #define INPUT_TIMESHIFT_PATH_LONGTEXT N_( \
     "Directory used to store the timeshift temporary files." )
 
-#define INPUT_TIMESHIFT_GRANULARITY_TEXT N_("Timeshift granularity")
+#define INPUT_TIMESHIFT_GRANULARITY_TEXT N_("Timeshift buffer size")
 #define INPUT_TIMESHIFT_GRANULARITY_LONGTEXT N_( \
-    "This is the maximum size in bytes of the temporary files " \
-    "that will be used to store the timeshifted streams." )
+    "This is the size in bytes of the temporary file " \
+    "that will be used to store the timeshifted streams. " \
+    "When it is full, the oldest data are overwritten, even if they were " \
+    "not played yet: the playback then skips forward." )
+
+#define INPUT_TIMESHIFT_WINDOW_TEXT N_("Timeshift window")
+#define INPUT_TIMESHIFT_WINDOW_LONGTEXT N_( \
+    "Maximum duration in seconds of the timeshifted streams that " \
+    "can be played again (0 for as much as the buffer holds)." )
 
 #define INPUT_TITLE_FORMAT_TEXT N_( "Change title according to current media" )
 #define INPUT_TITLE_FORMAT_LONGTEXT N_( "This option allows you to set the title according to what's being played<br>"  \
@@ -1874,6 +1881,8 @@ vlc_module_begin ()
                 INPUT_TIMESHIFT_PATH_LONGTEXT, true )
     add_integer( "input-timeshift-granularity", -1, INPUT_TIMESHIFT_GRANULARITY_TEXT,
                  INPUT_TIMESHIFT_GRANULARITY_LONGTEXT, true )
+    add_integer( "input-timeshift-window", 0, INPUT_TIMESHIFT_WINDOW_TEXT,
+                 INPUT_TIMESHIFT_WINDOW_LONGTEXT, true )
 
     add_string( "input-title-format", "$Z", INPUT_TITLE_FORMAT_TEXT, INPUT_TITLE_FORMAT_LONGTEXT, false );
 
@@ -30,6 +30,7 @@
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include "libvlc.h"
 
 /**
@@ -38,6 +39,13 @@
 
 /**
  * Internal state for block queues
+ *
+ * A FIFO created with block_FifoNewSPSC() keeps its blocks in a ring of
+ * pointers instead of the locked list. The producer publishes blocks in the
+ * ring and the consumer takes them without the lock. The lock is only taken
+ * to wake a waiting consumer up, and when the ring is full: blocks then go
+ * to the list (the spill) until the consumer has emptied it, so that the
+ * order is preserved and the FIFO remains unbounded.
  */
 struct block_fifo_t
 {
@@ -48,8 +56,122 @@ struct block_fifo_t
     block_t             **pp_last;
     size_t              i_depth;
     size_t              i_size;
+
+    /* Single producer single consumer ring */
+    block_t             **ring;
+    size_t              ring_mask;
+    size_t              seen;      /**< queued count at lock time */
+    unsigned            spin;      /**< dequeue attempts before sleeping */
+    atomic_size_t       head;      /**< written by the consumer */
+    atomic_size_t       tail;      /**< written by the producer */
+    atomic_size_t       spill;     /**< blocks in the locked list */
+    atomic_size_t       queued;    /**< blocks ever queued */
+    atomic_size_t       count;
+    atomic_size_t       bytes;
+    atomic_uint         waiters;
 };
 
+static void fifo_SpscPut(block_fifo_t *fifo, block_t *block, bool locked)
+{
+    size_t tail = atomic_load_explicit(&fifo->tail, memory_order_relaxed);
+    size_t n = 0;
+
+    while (block != NULL)
+    {
+        block_t *next = block->p_next;
+
+        block->p_next = NULL;
+        atomic_fetch_add_explicit(&fifo->count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&fifo->bytes, block->i_buffer,
+                                  memory_order_relaxed);
+
+        if (atomic_load_explicit(&fifo->spill, memory_order_acquire) == 0
+         && tail - atomic_load_explicit(&fifo->head, memory_order_acquire)
+                <= fifo->ring_mask)
+        {
+            fifo->ring[tail & fifo->ring_mask] = block;
+            atomic_store_explicit(&fifo->tail, ++tail, memory_order_release);
+        }
+        else
+        {   /* Ring full, or not yet emptied after it was full */
+            if (!locked)
+                vlc_mutex_lock(&fifo->lock);
+            *(fifo->pp_last) = block;
+            fifo->pp_last = &block->p_next;
+            atomic_fetch_add_explicit(&fifo->spill, 1, memory_order_release);
+            if (!locked)
+                vlc_mutex_unlock(&fifo->lock);
+        }
+        n++;
+        block = next;
+    }
+
+    if (n == 0)
+        return;
+
+    /* Pairs with the waiter count increment in vlc_fifo_Wait() */
+    atomic_fetch_add(&fifo->queued, n);
+    if (atomic_load(&fifo->waiters) > 0)
+    {
+        if (!locked)
+            vlc_mutex_lock(&fifo->lock);
+        vlc_cond_signal(&fifo->wait);
+        if (!locked)
+            vlc_mutex_unlock(&fifo->lock);
+    }
+}
+
+static block_t *fifo_SpscPeek(block_fifo_t *fifo, bool locked, bool remove)
+{
+    size_t head = atomic_load_explicit(&fifo->head, memory_order_relaxed);
+    block_t *block;
+
+    if (head != atomic_load_explicit(&fifo->tail, memory_order_acquire))
+    {
+        block = fifo->ring[head & fifo->ring_mask];
+        if (remove)
+            atomic_store_explicit(&fifo->head, head + 1, memory_order_release);
+    }
+    else
+    {
+        if (atomic_load_explicit(&fifo->spill, memory_order_acquire) == 0)
+            return NULL;
+        /* The producer has spilled, so it queued nothing more in the ring */
+        if (head != atomic_load_explicit(&fifo->tail, memory_order_acquire))
+            return fifo_SpscPeek(fifo, locked, remove);
+
+        if (!locked)
+            vlc_mutex_lock(&fifo->lock);
+        block = fifo->p_first;
+        assert(block != NULL);
+        if (remove)
+        {
+            fifo->p_first = block->p_next;
+            if (block->p_next == NULL)
+                fifo->pp_last = &fifo->p_first;
+            block->p_next = NULL;
+            atomic_fetch_sub_explicit(&fifo->spill, 1, memory_order_release);
+        }
+        if (!locked)
+            vlc_mutex_unlock(&fifo->lock);
+    }
+
+    if (remove)
+    {
+        atomic_fetch_sub_explicit(&fifo->bytes, block->i_buffer,
+                                  memory_order_relaxed);
+        atomic_fetch_sub_explicit(&fifo->count, 1, memory_order_relaxed);
+    }
+    return block;
+}
+
+static void fifo_SpscWaitCleanup(void *data)
+{
+    block_fifo_t *fifo = data;
+
+    atomic_fetch_sub(&fifo->waiters, 1);
+}
+
 /**
  * Locks a block FIFO. No more than one thread can lock the FIFO at any given
  * time, and no other thread can modify the FIFO while it is locked.
@@ -64,6 +186,8 @@ struct block_fifo_t
 void vlc_fifo_Lock(vlc_fifo_t *fifo)
 {
     vlc_mutex_lock(&fifo->lock);
+    if (fifo->ring != NULL)
+        fifo->seen = atomic_load(&fifo->queued);
 }
 
 /**
@@ -102,7 +226,22 @@ void vlc_fifo_Signal(vlc_fifo_t *fifo)
  */
 void vlc_fifo_Wait(vlc_fifo_t *fifo)
 {
-    vlc_fifo_WaitCond(fifo, &fifo->wait);
+    if (fifo->ring == NULL)
+    {
+        vlc_fifo_WaitCond(fifo, &fifo->wait);
+        return;
+    }
+
+    /* The producer does not take the lock to queue: it must be told that
+     * someone waits, and whatever it queued since the caller checked the
+     * FIFO (with the lock) must not be slept over. */
+    atomic_fetch_add(&fifo->waiters, 1);
+    vlc_cleanup_push(fifo_SpscWaitCleanup, fifo);
+    if (atomic_load(&fifo->queued) == fifo->seen)
+        vlc_cond_wait(&fifo->wait, &fifo->lock);
+    vlc_cleanup_pop();
+    atomic_fetch_sub(&fifo->waiters, 1);
+    fifo->seen = atomic_load(&fifo->queued);
 }
 
 void vlc_fifo_WaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar)
@@ -131,6 +270,9 @@ int vlc_fifo_TimedWaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar, mtime_t deadli
  */
 size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
 {
+    if (fifo->ring != NULL)
+        return atomic_load_explicit(&((vlc_fifo_t *)fifo)->count,
+                                    memory_order_relaxed);
     return fifo->i_depth;
 }
 
@@ -150,6 +292,9 @@ size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
  */
 size_t vlc_fifo_GetBytes(const vlc_fifo_t *fifo)
 {
+    if (fifo->ring != NULL)
+        return atomic_load_explicit(&((vlc_fifo_t *)fifo)->bytes,
+                                    memory_order_relaxed);
     return fifo->i_size;
 }
 
@@ -169,6 +314,12 @@ void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
     vlc_assert_locked(&fifo->lock);
     assert(*(fifo->pp_last) == NULL);
 
+    if (fifo->ring != NULL)
+    {
+        fifo_SpscPut(fifo, block, true);
+        return;
+    }
+
     *(fifo->pp_last) = block;
 
     while (block != NULL)
@@ -197,6 +348,9 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    if (fifo->ring != NULL)
+        return fifo_SpscPeek(fifo, true, true);
+
     block_t *block = fifo->p_first;
 
     if (block == NULL)
@@ -231,6 +385,18 @@ block_t *vlc_fifo_DequeueAllUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    if (fifo->ring != NULL)
+    {
+        block_t *head = NULL, **pp = &head, *block;
+
+        while ((block = fifo_SpscPeek(fifo, true, true)) != NULL)
+        {
+            *pp = block;
+            pp = &block->p_next;
+        }
+        return head;
+    }
+
     block_t *block = fifo->p_first;
 
     fifo->p_first = NULL;
@@ -258,7 +424,52 @@ block_fifo_t *block_FifoNew( void )
     p_fifo->p_first = NULL;
     p_fifo->pp_last = &p_fifo->p_first;
     p_fifo->i_depth = p_fifo->i_size = 0;
+    p_fifo->ring = NULL;
+
+    return p_fifo;
+}
+
+/**
+ * Creates a block FIFO for one producer and one consumer.
+ *
+ * Blocks are queued and dequeued without locking, through a ring of
+ * @p capacity pointers (rounded up to a power of two). Beyond that, blocks
+ * are queued with the lock, as in a FIFO from block_FifoNew().
+ *
+ * All the block_Fifo*() and vlc_fifo_*() functions apply, with two rules:
+ * - only one thread at a time may queue blocks,
+ * - only one thread may dequeue blocks, unless all of them dequeue with the
+ *   FIFO locked (vlc_fifo_DequeueUnlocked(), vlc_fifo_DequeueAllUnlocked()).
+ *
+ * @return the FIFO or NULL on memory error
+ */
+block_fifo_t *block_FifoNewSPSC( size_t capacity )
+{
+    block_fifo_t *p_fifo = block_FifoNew();
+    if( unlikely(p_fifo == NULL) )
+        return NULL;
 
+    size_t size = 16;
+    while( size < capacity )
+        size *= 2;
+
+    p_fifo->ring = malloc( size * sizeof( *p_fifo->ring ) );
+    if( unlikely(p_fifo->ring == NULL) )
+    {
+        block_FifoRelease( p_fifo );
+        return NULL;
+    }
+    p_fifo->ring_mask = size - 1;
+    p_fifo->seen = 0;
+    /* Busy waiting only helps if the producer runs meanwhile */
+    p_fifo->spin = vlc_GetCPUCount() > 1 ? 1000 : 1;
+    atomic_init( &p_fifo->head, 0 );
+    atomic_init( &p_fifo->tail, 0 );
+    atomic_init( &p_fifo->spill, 0 );
+    atomic_init( &p_fifo->queued, 0 );
+    atomic_init( &p_fifo->count, 0 );
+    atomic_init( &p_fifo->bytes, 0 );
+    atomic_init( &p_fifo->waiters, 0 );
     return p_fifo;
 }
 
@@ -268,6 +479,14 @@ block_fifo_t *block_FifoNew( void )
  */
 void block_FifoRelease( block_fifo_t *p_fifo )
 {
+    if( p_fifo->ring != NULL )
+    {
+        block_t *p_block;
+
+        while( (p_block = fifo_SpscPeek( p_fifo, true, true )) != NULL )
+            block_Release( p_block );
+        free( p_fifo->ring );
+    }
     block_ChainRelease( p_fifo->p_first );
     vlc_cond_destroy( &p_fifo->wait );
     vlc_mutex_destroy( &p_fifo->lock );
@@ -294,6 +513,12 @@ void block_FifoEmpty(block_fifo_t *fifo)
  */
 void block_FifoPut(block_fifo_t *fifo, block_t *block)
 {
+    if (fifo->ring != NULL)
+    {
+        fifo_SpscPut(fifo, block, false);
+        return;
+    }
+
     vlc_fifo_Lock(fifo);
     vlc_fifo_QueueUnlocked(fifo, block);
     vlc_fifo_Unlock(fifo);
@@ -311,6 +536,27 @@ block_t *block_FifoGet(block_fifo_t *fifo)
 
     vlc_testcancel();
 
+    if (fifo->ring != NULL)
+    {
+        /* Sleeping and waking up costs much more than a short wait */
+        for (unsigned i = 0; i < fifo->spin; i++)
+        {
+            block = fifo_SpscPeek(fifo, false, true);
+            if (likely(block != NULL))
+                return block;
+        }
+
+        /* The block count is raised before the block is visible: wait for
+         * the block itself */
+        vlc_fifo_Lock(fifo);
+        vlc_fifo_CleanupPush(fifo);
+        while ((block = fifo_SpscPeek(fifo, true, true)) == NULL)
+            vlc_fifo_Wait(fifo);
+        vlc_cleanup_pop();
+        vlc_fifo_Unlock(fifo);
+        return block;
+    }
+
     vlc_fifo_Lock(fifo);
     while (vlc_fifo_IsEmpty(fifo))
     {
@@ -339,6 +585,13 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
 {
     block_t *b;
 
+    if( p_fifo->ring != NULL )
+    {
+        b = fifo_SpscPeek( p_fifo, false, false );
+        assert(b != NULL);
+        return b;
+    }
+
     vlc_mutex_lock( &p_fifo->lock );
     assert(p_fifo->p_first != NULL);
     b = p_fifo->p_first;
@@ -352,6 +605,9 @@ size_t block_FifoSize (const block_fifo_t *fifo)
 {
     size_t size;
 
+    if (fifo->ring != NULL)
+        return vlc_fifo_GetBytes (fifo);
+
     vlc_mutex_lock (&fifo->lock);
     size = fifo->i_size;
     vlc_mutex_unlock (&fifo->lock);
@@ -363,6 +619,9 @@ size_t block_FifoCount (const block_fifo_t *fifo)
 {
     size_t depth;
 
+    if (fifo->ring != NULL)
+        return vlc_fifo_GetCount (fifo);
+
     vlc_mutex_lock (&fifo->lock);
     depth = fifo->i_depth;
     vlc_mutex_unlock (&fifo->lock);
@@ -312,6 +312,10 @@ static const vlc_fourcc_t p_I422_10L_fallback[] = {
 static const vlc_fourcc_t p_I422_10B_fallback[] = {
     VLC_CODEC_I422_10B, VLC_CODEC_I422_10L, VLC_CODEC_FALLBACK_422_16, 0
 };
+static const vlc_fourcc_t p_V210_fallback[] = {
+    VLC_CODEC_V210, VLC_CODEC_I422_10L, VLC_CODEC_I422_10B,
+    VLC_CODEC_FALLBACK_422_16, 0
+};
 static const vlc_fourcc_t p_I422_12L_fallback[] = {
     VLC_CODEC_I422_12L, VLC_CODEC_I422_12B, VLC_CODEC_FALLBACK_422_16, 0
 };
@@ -418,6 +422,7 @@ static const vlc_fourcc_t *pp_YUV_fallback[] = {
     p_I422_9B_fallback,
     p_I422_10L_fallback,
     p_I422_10B_fallback,
+    p_V210_fallback,
     p_I422_12L_fallback,
     p_I422_12B_fallback,
     p_J422_fallback,
@@ -452,6 +457,7 @@ static const vlc_fourcc_t p_list_YUV[] = {
     VLC_CODEC_YUV_SEMIPLANAR_444,
     VLC_CODEC_YUV_PACKED,
     VLC_CODEC_I411, VLC_CODEC_YUV_PLANAR_410, VLC_CODEC_Y211,
+    VLC_CODEC_V210,
     VLC_CODEC_YUV_PLANAR_420_16,
     VLC_CODEC_YUV_PLANAR_422_16,
     VLC_CODEC_YUV_PLANAR_444_16,
@@ -656,6 +662,9 @@ static const struct
         VLC_CODEC_BGRA, },                     PACKED_FMT(4, 32) },
 
     { { VLC_CODEC_Y211, 0 },                   { 1, { {{1,4}, {1,1}} }, 4, 32 } },
+    /* 6 pixels per 16 bytes: lines are padded to 48 pixels like the v210
+     * stride, but the visible pitch is rounded down to whole bytes */
+    { { VLC_CODEC_V210, 0 },                   { 1, { {{8,3}, {1,1}} }, 1, 10 } },
     { { VLC_CODEC_XYZ12,  0 },                 PACKED_FMT(6, 48) },
 
     { { VLC_CODEC_VDPAU_VIDEO_420, VLC_CODEC_VDPAU_VIDEO_422,
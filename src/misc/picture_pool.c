@@ -34,21 +34,49 @@
 #include <vlc_atomic.h>
 #include "picture.h"
 
-static const uintptr_t pool_max = CHAR_BIT * sizeof (unsigned long long);
-
+#define POOL_WORD_BITS (CHAR_BIT * sizeof (unsigned long long))
+
+typedef struct {
+    picture_pool_t *pool;
+    picture_t      *picture;
+} picture_pool_slot_t;
+
+/*
+ * Free pictures are the set bits of the available bitmap. Pictures are taken
+ * and returned with atomic operations on its words, without the lock. The
+ * lock only serves picture_pool_Wait() and picture_pool_Cancel().
+ */
 struct picture_pool_t {
     int       (*pic_lock)(picture_t *);
     void      (*pic_unlock)(picture_t *);
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
-    bool               canceled;
-    unsigned long long available;
-    atomic_ushort      refs;
-    unsigned short     picture_count;
-    picture_t  *picture[];
+    atomic_bool        canceled;
+    atomic_uint        waiters;
+    atomic_uint        refs;
+    unsigned           picture_count;
+    unsigned           word_count;
+    atomic_ullong     *available;
+
+    /* Statistics */
+    atomic_ullong      contended;
+    atomic_ullong      waits;
+    atomic_ullong      wait_time;
+
+    picture_pool_slot_t slot[];
 };
 
+static unsigned long long picture_pool_WordMask(const picture_pool_t *pool,
+                                                unsigned w)
+{
+    unsigned bits = pool->picture_count - w * POOL_WORD_BITS;
+
+    if (bits >= POOL_WORD_BITS)
+        return ~0ULL;
+    return (1ULL << bits) - 1;
+}
+
 static void picture_pool_Destroy(picture_pool_t *pool)
 {
     if (atomic_fetch_sub(&pool->refs, 1) != 1)
@@ -56,23 +84,87 @@ static void picture_pool_Destroy(picture_pool_t *pool)
 
     vlc_cond_destroy(&pool->wait);
     vlc_mutex_destroy(&pool->lock);
-    vlc_free(pool);
+    free(pool);
 }
 
 void picture_pool_Release(picture_pool_t *pool)
 {
     for (unsigned i = 0; i < pool->picture_count; i++)
-        picture_Release(pool->picture[i]);
+        picture_Release(pool->slot[i].picture);
     picture_pool_Destroy(pool);
 }
 
+/** Marks a picture as available, and wakes up a waiting thread if any */
+static void picture_pool_Put(picture_pool_t *pool, unsigned offset)
+{
+    unsigned long long bit = 1ULL << (offset % POOL_WORD_BITS);
+    unsigned long long old;
+
+    old = atomic_fetch_or(&pool->available[offset / POOL_WORD_BITS], bit);
+    assert(!(old & bit));
+    (void) old;
+
+    /* Pairs with the waiters increment in picture_pool_Wait() */
+    if (atomic_load(&pool->waiters) > 0)
+    {
+        vlc_mutex_lock(&pool->lock);
+        vlc_cond_signal(&pool->wait);
+        vlc_mutex_unlock(&pool->lock);
+    }
+}
+
+/**
+ * Takes the first available picture of a bitmap word, except those in skip.
+ * @return the picture offset, or -1 if none
+ */
+static int picture_pool_TakeWord(picture_pool_t *pool, unsigned w,
+                                 unsigned long long skip)
+{
+    unsigned long long v = atomic_load(&pool->available[w]);
+
+    while (v & ~skip)
+    {
+        unsigned bit = ffsll(v & ~skip) - 1;
+
+        if (atomic_compare_exchange_weak(&pool->available[w], &v,
+                                         v & ~(1ULL << bit)))
+            return w * POOL_WORD_BITS + bit;
+        atomic_fetch_add_explicit(&pool->contended, 1, memory_order_relaxed);
+    }
+    return -1;
+}
+
+/**
+ * Threads start looking for free pictures in different words, so that they
+ * do not all compete for the first pictures of large pools.
+ */
+static unsigned picture_pool_FirstWord(const picture_pool_t *pool)
+{
+    if (pool->word_count <= 1)
+        return 0;
+    return (vlc_thread_id() * 0x9E3779B1u) % pool->word_count;
+}
+
+static int picture_pool_Take(picture_pool_t *pool)
+{
+    unsigned first = picture_pool_FirstWord(pool);
+
+    for (unsigned n = 0; n < pool->word_count; n++)
+    {
+        int offset = picture_pool_TakeWord(pool,
+                                           (first + n) % pool->word_count, 0);
+        if (offset >= 0)
+            return offset;
+    }
+    return -1;
+}
+
 static void picture_pool_ReleasePicture(picture_t *clone)
 {
     picture_priv_t *priv = (picture_priv_t *)clone;
-    uintptr_t sys = (uintptr_t)priv->gc.opaque;
-    picture_pool_t *pool = (void *)(sys & ~(pool_max - 1));
-    unsigned offset = sys & (pool_max - 1);
-    picture_t *picture = pool->picture[offset];
+    picture_pool_slot_t *slot = priv->gc.opaque;
+    picture_pool_t *pool = slot->pool;
+    picture_t *picture = slot->picture;
 
     free(clone);
 
@@ -80,20 +172,14 @@ static void picture_pool_ReleasePicture(picture_t *clone)
         pool->pic_unlock(picture);
     picture_Release(picture);
 
-    vlc_mutex_lock(&pool->lock);
-    assert(!(pool->available & (1ULL << offset)));
-    pool->available |= 1ULL << offset;
-    vlc_cond_signal(&pool->wait);
-    vlc_mutex_unlock(&pool->lock);
-
+    picture_pool_Put(pool, slot - pool->slot);
     picture_pool_Destroy(pool);
 }
 
 static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
                                             unsigned offset)
 {
-    picture_t *picture = pool->picture[offset];
-    uintptr_t sys = ((uintptr_t)pool) + offset;
+    picture_t *picture = pool->slot[offset].picture;
     picture_resource_t res = {
         .p_sys = picture->p_sys,
         .pf_destroy = picture_pool_ReleasePicture,
@@ -107,7 +193,7 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
 
     picture_t *clone = picture_NewFromResource(&picture->format, &res);
     if (likely(clone != NULL)) {
-        ((picture_priv_t *)clone)->gc.opaque = (void *)sys;
+        ((picture_priv_t *)clone)->gc.opaque = &pool->slot[offset];
         picture_Hold(picture);
     }
     return clone;
@@ -115,11 +201,16 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
 
 picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg)
 {
-    if (unlikely(cfg->picture_count > pool_max))
-        return NULL;
+    unsigned words = (cfg->picture_count + POOL_WORD_BITS - 1)
+                   / POOL_WORD_BITS;
+    size_t size = sizeof (picture_pool_t)
+                + cfg->picture_count * sizeof (picture_pool_slot_t);
 
-    picture_pool_t *pool = vlc_memalign(pool_max,
-        sizeof (*pool) + cfg->picture_count * sizeof (picture_t *));
+    /* The bitmap follows the slots, aligned */
+    size = (size + sizeof (atomic_ullong) - 1)
+         & ~(sizeof (atomic_ullong) - 1);
+
+    picture_pool_t *pool = malloc(size + words * sizeof (atomic_ullong));
     if (unlikely(pool == NULL))
         return NULL;
 
@@ -127,12 +218,21 @@ picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg
     pool->pic_unlock = cfg->unlock;
     vlc_mutex_init(&pool->lock);
     vlc_cond_init(&pool->wait);
-    pool->available = (1ULL << cfg->picture_count) - 1;
+    atomic_init(&pool->canceled, false);
+    atomic_init(&pool->waiters, 0);
     atomic_init(&pool->refs,  1);
     pool->picture_count = cfg->picture_count;
-    memcpy(pool->picture, cfg->picture,
-           cfg->picture_count * sizeof (picture_t *));
-    pool->canceled = false;
+    pool->word_count = words;
+    pool->available = (atomic_ullong *)(((char *)pool) + size);
+    for (unsigned w = 0; w < words; w++)
+        atomic_init(&pool->available[w], picture_pool_WordMask(pool, w));
+    atomic_init(&pool->contended, 0);
+    atomic_init(&pool->waits, 0);
+    atomic_init(&pool->wait_time, 0);
+    for (unsigned i = 0; i < cfg->picture_count; i++) {
+        pool->slot[i].pool = pool;
+        pool->slot[i].picture = cfg->picture[i];
+    }
     return pool;
 }
 
@@ -193,83 +293,80 @@ error:
     return NULL;
 }
 
-/** Find next (bit) set */
-static int fnsll(unsigned long long x, unsigned i)
-{
-    if (i >= CHAR_BIT * sizeof (x))
-        return 0;
-    return ffsll(x & ~((1ULL << i) - 1));
-}
-
 picture_t *picture_pool_Get(picture_pool_t *pool)
 {
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    if (pool->canceled)
-    {
-        vlc_mutex_unlock(&pool->lock);
+    if (atomic_load(&pool->canceled))
         return NULL;
-    }
 
-    for (unsigned i = ffsll(pool->available); i; i = fnsll(pool->available, i))
-    {
-        pool->available &= ~(1ULL << (i - 1));
-        vlc_mutex_unlock(&pool->lock);
-
-        picture_t *picture = pool->picture[i - 1];
+    unsigned first = picture_pool_FirstWord(pool);
 
-        if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-            vlc_mutex_lock(&pool->lock);
-            pool->available |= 1ULL << (i - 1);
-            continue;
-        }
+    for (unsigned n = 0; n < pool->word_count; n++)
+    {
+        unsigned w = (first + n) % pool->word_count;
+        unsigned long long skip = 0;
+        int i;
 
-        picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
-        if (clone != NULL) {
-            assert(clone->p_next == NULL);
-            atomic_fetch_add(&pool->refs, 1);
+        while ((i = picture_pool_TakeWord(pool, w, skip)) >= 0)
+        {
+            picture_t *picture = pool->slot[i].picture;
+
+            if (pool->pic_lock != NULL
+             && pool->pic_lock(picture) != VLC_SUCCESS) {
+                picture_pool_Put(pool, i);
+                skip |= 1ULL << (i % POOL_WORD_BITS);
+                continue;
+            }
+
+            picture_t *clone = picture_pool_ClonePicture(pool, i);
+            if (clone != NULL) {
+                assert(clone->p_next == NULL);
+                atomic_fetch_add(&pool->refs, 1);
+            }
+            return clone;
         }
-        return clone;
     }
-
-    vlc_mutex_unlock(&pool->lock);
     return NULL;
 }
 
 picture_t *picture_pool_Wait(picture_pool_t *pool)
 {
-    unsigned i;
+    int i;
 
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    while (pool->available == 0)
+    i = picture_pool_Take(pool);
+    if (i < 0)
     {
-        if (pool->canceled)
+        mtime_t start = mdate();
+
+        vlc_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->waiters, 1);
+        while ((i = picture_pool_Take(pool)) < 0)
         {
-            vlc_mutex_unlock(&pool->lock);
-            return NULL;
+            if (atomic_load(&pool->canceled))
+                break;
+            vlc_cond_wait(&pool->wait, &pool->lock);
         }
-        vlc_cond_wait(&pool->wait, &pool->lock);
-    }
+        atomic_fetch_sub(&pool->waiters, 1);
+        vlc_mutex_unlock(&pool->lock);
 
-    i = ffsll(pool->available);
-    assert(i > 0);
-    pool->available &= ~(1ULL << (i - 1));
-    vlc_mutex_unlock(&pool->lock);
+        atomic_fetch_add_explicit(&pool->waits, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pool->wait_time, mdate() - start,
+                                  memory_order_relaxed);
+        if (i < 0)
+            return NULL;
+    }
 
-    picture_t *picture = pool->picture[i - 1];
+    picture_t *picture = pool->slot[i].picture;
 
     if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-        vlc_mutex_lock(&pool->lock);
-        pool->available |= 1ULL << (i - 1);
-        vlc_cond_signal(&pool->wait);
-        vlc_mutex_unlock(&pool->lock);
+        picture_pool_Put(pool, i);
         return NULL;
     }
 
-    picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
+    picture_t *clone = picture_pool_ClonePicture(pool, i);
     if (clone != NULL) {
         assert(clone->p_next == NULL);
         atomic_fetch_add(&pool->refs, 1);
@@ -280,9 +377,9 @@ picture_t *picture_pool_Wait(picture_pool_t *pool)
 void picture_pool_Cancel(picture_pool_t *pool, bool canceled)
 {
     vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    pool->canceled = canceled;
+    atomic_store(&pool->canceled, canceled);
     if (canceled)
         vlc_cond_broadcast(&pool->wait);
     vlc_mutex_unlock(&pool->lock);
@@ -290,18 +387,29 @@ void picture_pool_Cancel(picture_pool_t *pool, bool canceled)
 
 unsigned picture_pool_Reset(picture_pool_t *pool)
 {
-    unsigned ret;
-
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
-    ret = pool->picture_count - popcountll(pool->available);
-    pool->available = (1ULL << pool->picture_count) - 1;
-    pool->canceled = false;
-    vlc_mutex_unlock(&pool->lock);
+    unsigned ret = pool->picture_count;
 
+    assert(atomic_load(&pool->refs) > 0);
+    for (unsigned w = 0; w < pool->word_count; w++)
+        ret -= popcountll(atomic_exchange(&pool->available[w],
+                                          picture_pool_WordMask(pool, w)));
+    atomic_store(&pool->canceled, false);
     return ret;
 }
 
+void picture_pool_GetStats(const picture_pool_t *pool,
+                           picture_pool_stats_t *stats)
+{
+    picture_pool_t *p = (picture_pool_t *)pool;
+
+    stats->contended = atomic_load_explicit(&p->contended,
+                                            memory_order_relaxed);
+    stats->waits = atomic_load_explicit(&p->waits, memory_order_relaxed);
+    stats->wait_time = atomic_load_explicit(&p->wait_time,
+                                            memory_order_relaxed);
+    stats->waiters = atomic_load(&p->waiters);
+}
+
 unsigned picture_pool_GetSize(const picture_pool_t *pool)
 {
     return pool->picture_count;
@@ -313,5 +421,5 @@ void picture_pool_Enum(picture_pool_t *pool, void (*cb)(void *, picture_t *),
     /* NOTE: So far, the pictures table cannot change after the pool is created
      * so there is no need to lock the pool mutex here. */
     for (unsigned i = 0; i < pool->picture_count; i++)
-        cb(opaque, pool->picture[i]);
+        cb(opaque, pool->slot[i].picture);
 }
@@ -0,0 +1,211 @@
+/*****************************************************************************
+ * fifo.c: Test and benchmark for block FIFOs
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#undef msleep
+
+/* Blocks per run; set VLC_FIFO_BENCH for a longer benchmark */
+static unsigned count = 200000;
+#define POOL 1024
+
+static block_fifo_t *fifo_New(bool spsc, size_t capacity)
+{
+    block_fifo_t *fifo = spsc ? block_FifoNewSPSC(capacity) : block_FifoNew();
+    assert(fifo != NULL);
+    return fifo;
+}
+
+static void test_order(bool spsc)
+{
+    block_fifo_t *fifo = fifo_New(spsc, 16);
+    block_t *chain = NULL, **pp = &chain;
+
+    /* More than the ring holds, partly as a chain */
+    for (unsigned i = 0; i < 100; i++)
+    {
+        block_t *b = block_Alloc(i);
+        assert(b != NULL);
+        b->i_dts = i;
+        if (i < 50)
+            block_FifoPut(fifo, b);
+        else
+        {
+            *pp = b;
+            pp = &b->p_next;
+        }
+    }
+    block_FifoPut(fifo, chain);
+    assert(block_FifoCount(fifo) == 100);
+    assert(block_FifoSize(fifo) == 99 * 100 / 2);
+
+    for (unsigned i = 0; i < 40; i++)
+    {
+        assert(block_FifoShow(fifo)->i_dts == i);
+        block_t *b = block_FifoGet(fifo);
+        assert(b->i_dts == i && b->p_next == NULL);
+        block_Release(b);
+
+        /* Keep queueing while the ring is being emptied */
+        b = block_Alloc(0);
+        assert(b != NULL);
+        b->i_dts = 100 + i;
+        block_FifoPut(fifo, b);
+    }
+    assert(block_FifoCount(fifo) == 100);
+
+    vlc_fifo_Lock(fifo);
+    block_t *b = vlc_fifo_DequeueUnlocked(fifo);
+    assert(b->i_dts == 40);
+    block_Release(b);
+    b = vlc_fifo_DequeueAllUnlocked(fifo);
+    assert(vlc_fifo_IsEmpty(fifo) && vlc_fifo_GetBytes(fifo) == 0);
+    vlc_fifo_Unlock(fifo);
+
+    for (unsigned i = 41; i < 140; i++)
+    {
+        assert(b != NULL && b->i_dts == i);
+        block_t *next = b->p_next;
+        block_Release(b);
+        b = next;
+    }
+    assert(b == NULL);
+
+    /* Queued blocks are released with the FIFO */
+    block_FifoPut(fifo, block_Alloc(10));
+    block_FifoRelease(fifo);
+}
+
+static void *test_cancel_thread(void *data)
+{
+    block_t *b = block_FifoGet(data);
+    block_Release(b);
+    b = block_FifoGet(data);
+    assert(!"not reached");
+    block_Release(b);
+    return NULL;
+}
+
+static void test_cancel(bool spsc)
+{
+    block_fifo_t *fifo = fifo_New(spsc, 16);
+    vlc_thread_t th;
+
+    assert(!vlc_clone(&th, test_cancel_thread, fifo, VLC_THREAD_PRIORITY_LOW));
+    msleep(10000);
+    block_FifoPut(fifo, block_Alloc(0));
+    msleep(10000);
+    vlc_cancel(th);
+    vlc_join(th, NULL);
+    assert(block_FifoCount(fifo) == 0);
+    block_FifoRelease(fifo);
+}
+
+/* Blocks go back and forth between two FIFOs, as between a decoder and its
+ * owner, so that nothing is allocated while timing */
+struct bench
+{
+    block_fifo_t *data;
+    block_fifo_t *free;
+    bool batch;
+};
+
+static void *bench_consumer(void *data)
+{
+    struct bench *b = data;
+    unsigned next = 0;
+
+    while (next < count)
+    {
+        block_t *chain;
+
+        if (b->batch)
+        {   /* Like the UDP output thread */
+            vlc_fifo_Lock(b->data);
+            while (vlc_fifo_IsEmpty(b->data))
+                vlc_fifo_Wait(b->data);
+            chain = vlc_fifo_DequeueAllUnlocked(b->data);
+            vlc_fifo_Unlock(b->data);
+        }
+        else
+            chain = block_FifoGet(b->data);
+
+        for (block_t *p = chain; p != NULL; p = p->p_next)
+            assert(p->i_dts == next++);
+        block_FifoPut(b->free, chain);
+    }
+    return NULL;
+}
+
+static void bench(bool spsc, bool batch)
+{
+    struct bench b = { fifo_New(spsc, POOL), fifo_New(spsc, POOL), batch };
+    vlc_thread_t th;
+
+    for (unsigned i = 0; i < POOL; i++)
+        block_FifoPut(b.free, block_Alloc(1316));
+
+    mtime_t start = mdate();
+    assert(!vlc_clone(&th, bench_consumer, &b, VLC_THREAD_PRIORITY_LOW));
+    for (unsigned i = 0; i < count; i++)
+    {
+        block_t *p = block_FifoGet(b.free);
+        p->i_dts = i;
+        block_FifoPut(b.data, p);
+    }
+    vlc_join(th, NULL);
+    mtime_t end = mdate();
+
+    assert(block_FifoCount(b.free) == POOL);
+    assert(block_FifoCount(b.data) == 0);
+    block_FifoRelease(b.data);
+    block_FifoRelease(b.free);
+
+    printf("%-6s %-8s %8.1f ns/block\n", spsc ? "spsc" : "locked",
+           batch ? "batched" : "single", (end - start) * 1000. / count);
+}
+
+int main(void)
+{
+    const char *env = getenv("VLC_FIFO_BENCH");
+    if (env != NULL)
+        count = strtoul(env, NULL, 10);
+
+    for (unsigned i = 0; i < 2; i++)
+    {
+        test_order(i);
+        test_cancel(i);
+    }
+    for (unsigned i = 0; i < 2; i++)
+    {
+        bench(i, false);
+        bench(i, true);
+    }
+    return 0;
+}
@@ -31,6 +31,8 @@
 #include <vlc_picture_pool.h>
 
 #define PICTURES 10
+#define LARGE    200 /* more than one bitmap word */
+#define THREADS  4
 
 static video_format_t fmt;
 static picture_pool_t *pool, *reserve;
@@ -106,6 +108,157 @@ static void test(bool zombie)
             picture_Release(pics[i]);
 }
 
+static int lock_odd(picture_t *pic)
+{
+    /* Pictures of odd width cannot be locked */
+    return (pic->format.i_width & 1) ? VLC_EGENERIC : VLC_SUCCESS;
+}
+
+static void test_large(void)
+{
+    video_format_t small;
+    picture_t *tab[LARGE], *pics[LARGE];
+
+    video_format_Setup(&small, VLC_CODEC_I420, 16, 16, 16, 16, 1, 1);
+    pool = picture_pool_NewFromFormat(&small, LARGE);
+    assert(pool != NULL);
+    assert(picture_pool_GetSize(pool) == LARGE);
+
+    for (unsigned i = 0; i < LARGE; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+        for (unsigned j = 0; j < i; j++)
+            assert(pics[j]->p[0].p_pixels != pics[i]->p[0].p_pixels);
+    }
+    assert(picture_pool_Get(pool) == NULL);
+
+    /* Pictures come back from every bitmap word */
+    for (unsigned i = 0; i < LARGE; i += 7) {
+        void *plane = pics[i]->p[0].p_pixels;
+        picture_Release(pics[i]);
+        pics[i] = picture_pool_Wait(pool);
+        assert(pics[i] != NULL && pics[i]->p[0].p_pixels == plane);
+    }
+
+    /* Reserving across words */
+    for (unsigned i = 0; i < LARGE / 2; i++)
+        picture_Release(pics[i]);
+    reserve = picture_pool_Reserve(pool, LARGE / 2);
+    assert(reserve != NULL);
+    assert(picture_pool_Get(pool) == NULL);
+    picture_pool_Release(reserve);
+    for (unsigned i = 0; i < LARGE / 2; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+    }
+    for (unsigned i = 0; i < LARGE; i++)
+        picture_Release(pics[i]);
+    picture_pool_Release(pool);
+
+    /* Pictures that fail to lock are skipped */
+    for (unsigned i = 0; i < LARGE; i++) {
+        unsigned width = (i % 3 == 0) ? 17 : 16;
+
+        video_format_Setup(&small, VLC_CODEC_I420, width, 16, width, 16, 1, 1);
+        tab[i] = picture_NewFromFormat(&small);
+        assert(tab[i] != NULL);
+    }
+
+    picture_pool_configuration_t cfg = {
+        .picture_count = LARGE,
+        .picture = tab,
+        .lock = lock_odd,
+    };
+    pool = picture_pool_NewExtended(&cfg);
+    assert(pool != NULL);
+
+    unsigned n = 0;
+    while ((pics[n] = picture_pool_Get(pool)) != NULL) {
+        assert(!(pics[n]->format.i_width & 1));
+        n++;
+    }
+    assert(n == LARGE - (LARGE + 2) / 3);
+    while (n > 0)
+        picture_Release(pics[--n]);
+    picture_pool_Release(pool);
+}
+
+static void *test_thread(void *data)
+{
+    (void) data;
+
+    for (unsigned i = 0; i < 20000; i++) {
+        picture_t *pic = (i & 1) ? picture_pool_Get(pool)
+                                 : picture_pool_Wait(pool);
+        if (pic == NULL)
+            continue;
+        /* Nobody else holds this picture */
+        uint8_t *p = pic->p[0].p_pixels;
+        p[0] = i;
+        p[1] = i;
+        assert(p[0] == p[1]);
+        picture_Release(pic);
+    }
+    return NULL;
+}
+
+static void *test_wait_thread(void *data)
+{
+    picture_t *pic = picture_pool_Wait(pool);
+
+    assert(pic != NULL);
+    *(picture_t **)data = pic;
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    video_format_t small;
+    vlc_thread_t th[THREADS];
+    picture_pool_stats_t stats;
+
+    video_format_Setup(&small, VLC_CODEC_I420, 16, 16, 16, 16, 1, 1);
+    pool = picture_pool_NewFromFormat(&small, 3 * THREADS / 2);
+    assert(pool != NULL);
+
+    for (unsigned i = 0; i < THREADS; i++)
+        assert(!vlc_clone(&th[i], test_thread, NULL, VLC_THREAD_PRIORITY_LOW));
+    for (unsigned i = 0; i < THREADS; i++)
+        vlc_join(th[i], NULL);
+
+    /* All pictures were returned */
+    picture_t *pics[3 * THREADS / 2], *last = NULL;
+    for (unsigned i = 0; i < 3 * THREADS / 2; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+    }
+
+    /* A waiting thread gets the next released picture */
+    picture_pool_GetStats(pool, &stats);
+    uint64_t waits = stats.waits;
+
+    vlc_thread_t waiter;
+    assert(!vlc_clone(&waiter, test_wait_thread, &last,
+                      VLC_THREAD_PRIORITY_LOW));
+    do
+        picture_pool_GetStats(pool, &stats);
+    while (stats.waiters == 0);
+
+    void *plane = pics[2]->p[0].p_pixels;
+    picture_Release(pics[2]);
+    vlc_join(waiter, NULL);
+    assert(last != NULL && last->p[0].p_pixels == plane);
+
+    picture_pool_GetStats(pool, &stats);
+    assert(stats.waits == waits + 1);
+    assert(stats.waiters == 0);
+
+    pics[2] = last;
+    for (unsigned i = 0; i < 3 * THREADS / 2; i++)
+        picture_Release(pics[i]);
+    picture_pool_Release(pool);
+}
+
 int main(void)
 {
     video_format_Setup(&fmt, VLC_CODEC_I420, 320, 200, 320, 200, 1, 1);
@@ -122,6 +275,8 @@ int main(void)
 
     test(false);
     test(true);
+    test_large();
+    test_threads();
 
     return 0;
 }
@@ -713,6 +713,12 @@ static void VoutDisplayEvent(vout_display_t *vd, int event, va_list args)
         vlc_mutex_unlock(&osys->lock);
         break;
     }
+    case VOUT_DISPLAY_EVENT_PICTURES_LOST: {
+        const int count = (int)va_arg(args, int);
+
+        vout_SendDisplayEventPicturesLost(osys->vout, count);
+        break;
+    }
     default:
         msg_Err(vd, "VoutDisplayEvent received event %d", event);
         /* TODO add an assert when all event are handled */
@@ -1396,6 +1402,7 @@ static void SplitterEvent(vout_display_t *vd, int event, va_list args)
     case VOUT_DISPLAY_EVENT_FULLSCREEN:
     case VOUT_DISPLAY_EVENT_DISPLAY_SIZE:
     case VOUT_DISPLAY_EVENT_PICTURES_INVALID:
+    case VOUT_DISPLAY_EVENT_PICTURES_LOST:
         VoutDisplayEvent(vd, event, args);
         break;
 
@@ -1623,3 +1630,8 @@ void vout_SendDisplayEventMouse(vout_thread_t *vout, const vlc_mouse_t *m)
         vout_SendEventMouseDoubleClick(vout);
     vout->p->mouse = *m;
 }
+
+void vout_SendDisplayEventPicturesLost(vout_thread_t *vout, int count)
+{
+    vout_statistic_AddLost(&vout->p->statistic, count);
+}
@@ -33,6 +33,7 @@ vout_display_t *vout_NewSplitter(vout_thread_t *vout,
 
 /* FIXME should not be there */
 void vout_SendDisplayEventMouse(vout_thread_t *, const vlc_mouse_t *);
+void vout_SendDisplayEventPicturesLost(vout_thread_t *, int);
 
 vout_window_t *vout_NewDisplayWindow(vout_thread_t *, unsigned type);
 void vout_DeleteDisplayWindow(vout_thread_t *, vout_window_t *);
@@ -173,6 +173,12 @@ void vout_EndWrapper(vout_thread_t *vout)
 {
     vout_thread_sys_t *sys = vout->p;
 
+    picture_pool_stats_t stats;
+
+    picture_pool_GetStats(sys->decoder_pool, &stats);
+    msg_Dbg(vout, "decoder pool: %"PRIu64" contended gets, %"PRIu64" waits "
+            "(%"PRId64" us)", stats.contended, stats.waits, stats.wait_time);
+
     if (sys->private_pool)
         picture_pool_Release(sys->private_pool);
 
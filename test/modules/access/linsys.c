@@ -0,0 +1,291 @@
+/*****************************************************************************
+ * linsys.c: raw SDI unpacking tests, and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#ifdef NDEBUG
+ #undef NDEBUG
+#endif
+#include <assert.h>
+#include <vlc_common.h>
+#include "../modules/access/linsys/linsys_unpack.c"
+
+#define BENCH_RUNS 20
+
+/* 625 lines SD-SDI: 5 bytes EAV, 280 words HANC, 5 bytes SAV, 1440 words */
+#define SD_LINES    625
+#define SD_ANC      (5 + 280 * 5 / 4)
+#define SD_ACTIVE   (5 + 1440 * 5 / 4)
+#define SD_LINE     (SD_ANC + SD_ACTIVE)
+
+static const struct
+{
+    const char *name;
+    unsigned    cpu;
+} variants[] = {
+    { "C", 0 },
+#if defined (__i386__) || defined (__x86_64__)
+    { "SSE2", VLC_CPU_SSE2 },
+    { "SSSE3", VLC_CPU_SSSE3 | VLC_CPU_SSE2 },
+    { "AVX2", VLC_CPU_AVX2 | VLC_CPU_SSSE3 | VLC_CPU_SSE2 },
+#endif
+};
+
+static const uint8_t codes[] = { 0xb6, 0xab, 0x9d, 0x80, 0xf1, 0xec, 0xda, 0xc7 };
+
+static uint32_t rand_state = 1;
+
+static uint32_t next_rand(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+/* Packs 10-bit words, four in five bytes, as the card delivers them */
+static void pack10(uint8_t *dst, const uint16_t *words, size_t count)
+{
+    for (size_t i = 0; i + 4 <= count; i += 4, dst += 5)
+    {
+        dst[0] = words[i];
+        dst[1] = (words[i] >> 8) | (words[i + 1] << 2);
+        dst[2] = (words[i + 1] >> 6) | (words[i + 2] << 4);
+        dst[3] = (words[i + 2] >> 4) | (words[i + 3] << 6);
+        dst[4] = words[i + 3] >> 2;
+    }
+}
+
+static void put_reference(uint8_t *dst, uint8_t code)
+{
+    const uint16_t trs[4] = { 0x3ff, 0x000, 0x000, code << 2 };
+    pack10(dst, trs, 4);
+}
+
+/* Builds a frame with the timing references of an interlaced 625 lines
+ * signal and random samples, over the whole 10-bit range in one line out of
+ * eight to stress the saturation. */
+static uint8_t *build_frame(void)
+{
+    uint8_t *frame = malloc(SD_LINES * SD_LINE);
+    uint16_t words[1440];
+    assert(frame);
+
+    for (unsigned line = 0; line < SD_LINES; line++)
+    {
+        uint8_t *p = frame + line * SD_LINE;
+        bool field = line >= SD_LINES / 2;
+        bool vbi = (line % (SD_LINES / 2)) < 22;
+        unsigned base = (line % 8) ? 4 : 0;
+
+        put_reference(p, codes[field * 4 + !vbi * 2]);
+        put_reference(p + SD_ANC, codes[field * 4 + !vbi * 2 + 1]);
+
+        for (unsigned i = 0; i < 280; i++)
+            words[i] = base + next_rand() % (0x400 - 2 * base);
+        pack10(p + 5, words, 280);
+        for (unsigned i = 0; i < 1440; i++)
+            words[i] = base + next_rand() % (0x400 - 2 * base);
+        pack10(p + SD_ANC + 5, words, 1440);
+    }
+    return frame;
+}
+
+static void test_find(const linsys_unpack_t *ref, const linsys_unpack_t *simd,
+                      const uint8_t *buf, size_t size)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(codes); i++)
+    {
+        for (size_t offset = 0; offset < 5; offset++)
+        {
+            const uint8_t *p = buf + offset, *end = buf + size;
+
+            for (;;)
+            {
+                const uint8_t *found = ref->pf_find_reference(codes[i], p, end);
+                assert(simd->pf_find_reference(codes[i], p, end) == found);
+                if (found == NULL)
+                    break;
+                p = found + 5;
+            }
+        }
+    }
+}
+
+/* Also checks the bytes following the output, which must be left untouched */
+static void test_unpack_line(const linsys_unpack_t *ref,
+                             const linsys_unpack_t *simd,
+                             const uint8_t *line, unsigned size)
+{
+    const unsigned samples = size / 5 * 4;
+    uint8_t *out[2], *planes[2][3];
+    uint16_t *anc[2];
+
+    for (int i = 0; i < 2; i++)
+    {
+        out[i] = malloc(2 * samples + 64);
+        anc[i] = malloc((samples + 16) * sizeof (**anc));
+        assert(out[i] && anc[i]);
+        planes[i][0] = out[i];
+        planes[i][1] = out[i] + samples + 16;
+        planes[i][2] = out[i] + 3 * samples / 2 + 32;
+    }
+
+    for (int mode = 0; mode < 3; mode++)
+    {
+        for (unsigned j = 0; j < 2 * samples + 64; j++)
+            out[0][j] = out[1][j] = next_rand();
+        ref->pf_unpack10[mode](line, size, planes[0][0], planes[0][1],
+                               planes[0][2]);
+        simd->pf_unpack10[mode](line, size, planes[1][0], planes[1][1],
+                                planes[1][2]);
+        assert(!memcmp(out[0], out[1], 2 * samples + 64));
+
+        /* Same line, seen as UYVY */
+        size_t uyvy = size / 4 * 4;
+        for (unsigned j = 0; j < 2 * samples + 64; j++)
+            out[0][j] = out[1][j] = next_rand();
+        ref->pf_unpack8[mode](line, uyvy, planes[0][0], planes[0][1],
+                              planes[0][2]);
+        simd->pf_unpack8[mode](line, uyvy, planes[1][0], planes[1][1],
+                               planes[1][2]);
+        assert(!memcmp(out[0], out[1], 2 * samples + 64));
+    }
+
+    memset(out[0], 0x55, 2 * samples + 64);
+    memset(out[1], 0x55, 2 * samples + 64);
+    ref->pf_unpack_vbi(line, size, out[0]);
+    simd->pf_unpack_vbi(line, size, out[1]);
+    assert(!memcmp(out[0], out[1], 2 * samples + 64));
+
+    for (unsigned j = 0; j < samples + 16; j++)
+        anc[0][j] = anc[1][j] = 0xdead;
+    ref->pf_unpack_anc(line, size, anc[0]);
+    simd->pf_unpack_anc(line, size, anc[1]);
+    assert(!memcmp(anc[0], anc[1], (samples + 16) * sizeof (**anc)));
+
+    for (int i = 0; i < 2; i++)
+    {
+        free(out[i]);
+        free(anc[i]);
+    }
+}
+
+/* Walks the frame the way the SD demux does */
+static void test_frame(const linsys_unpack_t *ref, const linsys_unpack_t *simd,
+                       const uint8_t *frame)
+{
+    const uint8_t *end = frame + SD_LINES * SD_LINE;
+    const uint8_t *eav = ref->pf_find_reference(0xb6, frame, end);
+    const uint8_t *sav = ref->pf_find_reference(0xab, eav, end);
+
+    assert(eav == frame);
+    assert(sav == frame + SD_ANC);
+    assert(simd->pf_find_reference(0xb6, frame, end) == eav);
+    assert(simd->pf_find_reference(0xab, eav, end) == sav);
+    assert(simd->pf_find_reference(0xf1, frame, end)
+            == frame + SD_LINES / 2 * SD_LINE);
+
+    test_find(ref, simd, frame, SD_LINES * SD_LINE);
+
+    for (unsigned line = 0; line < SD_LINES; line++)
+    {
+        const uint8_t *p = frame + line * SD_LINE;
+        test_unpack_line(ref, simd, p + 5, SD_ANC - 5);
+        test_unpack_line(ref, simd, p + SD_ANC + 5, SD_ACTIVE - 5);
+    }
+
+    /* Short and unaligned lines */
+    for (unsigned size = 0; size <= 200; size += 5)
+        for (unsigned offset = 0; offset < 4; offset++)
+            test_unpack_line(ref, simd, frame + SD_ANC + 5 + offset, size);
+}
+
+/* Random data with many false positives */
+static void test_noise(const linsys_unpack_t *ref, const linsys_unpack_t *simd)
+{
+    const size_t size = 64 * 1024;
+    uint8_t *buf = malloc(size);
+    assert(buf);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        static const uint8_t bytes[] = { 0xff, 0x03, 0x00, 0xb6, 0x9d, 0xf1 };
+        buf[i] = bytes[next_rand() % ARRAY_SIZE(bytes)];
+    }
+    for (size_t i = 0; i < 64; i++)
+        put_reference(buf + next_rand() % (size - 5),
+                      codes[next_rand() % ARRAY_SIZE(codes)]);
+
+    test_find(ref, simd, buf, size);
+    free(buf);
+}
+
+static void bench(const char *name, const linsys_unpack_t *unpack,
+                  const uint8_t *frame)
+{
+    uint8_t *picture = malloc(720 * 576 * 3 / 2);
+    assert(picture);
+
+    mtime_t start = mdate();
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        const uint8_t *p = frame, *end = frame + SD_LINES * SD_LINE;
+        unsigned anc = 0;
+
+        p = unpack->pf_find_reference(0xb6, p, end);
+        anc = unpack->pf_find_reference(0xab, p, end) - p;
+        for (unsigned line = 0; line < 576; line++)
+        {
+            const uint8_t *active = frame + (24 + line) * SD_LINE + anc + 5;
+            unpack->pf_unpack10[line % 4 < 2 ? 0 : line % 4 - 1](active, SD_ACTIVE - 5,
+                                          picture + 720 * line,
+                                          picture + 720 * 576 + 360 * (line / 2),
+                                          picture + 720 * 576 * 5 / 4 + 360 * (line / 2));
+        }
+        /* Resynchronisation: scan the whole frame */
+        assert(unpack->pf_find_reference(0x42, frame, end) == NULL);
+    }
+    mtime_t time = (mdate() - start) / BENCH_RUNS;
+
+    printf("%-6s 576i unpack and scan: %6"PRId64" us/frame\n", name, time);
+    free(picture);
+}
+
+int main(void)
+{
+    const unsigned cpu = vlc_CPU();
+    const linsys_unpack_t *ref = linsys_GetUnpack(0);
+    uint8_t *frame = build_frame();
+
+    for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+    {
+        if ((cpu & variants[i].cpu) != variants[i].cpu)
+        {
+            printf("%-6s not supported, skipping\n", variants[i].name);
+            continue;
+        }
+
+        const linsys_unpack_t *simd = linsys_GetUnpack(variants[i].cpu);
+        test_frame(ref, simd, frame);
+        test_noise(ref, simd);
+        bench(variants[i].name, simd, frame);
+    }
+
+    free(frame);
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*****************************************************************************
+ * rtp_fec.c: RTP SMPTE 2022-1 FEC and 2022-7 merging tests
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../modules/access/rtp/fec.c"
+/* config.h may have defined it again */
+#undef NDEBUG
+#include <assert.h>
+
+#define L 5 /* columns */
+#define D 4 /* rows */
+#define SSRC 0x12345678
+
+static block_t *media(uint16_t seq)
+{
+    size_t len = 100 + (seq % 7) * 10;
+    block_t *b = block_Alloc(12 + len);
+    assert(b != NULL);
+    uint8_t *p = b->p_buffer;
+    p[0] = 0x80;
+    p[1] = 33 | ((seq % 3 == 0) ? 0x80 : 0);
+    SetWBE(p + 2, seq);
+    SetDWBE(p + 4, seq * 3600u);
+    SetDWBE(p + 8, SSRC);
+    for (size_t i = 0; i < len; i++)
+        p[12 + i] = seq * 31 + i;
+    return b;
+}
+
+/* XOR FEC packet over count packets from base, offset apart */
+static block_t *fec(uint16_t base, unsigned offset, unsigned count)
+{
+    size_t len = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        block_t *m = media(base + i * offset);
+        if (m->i_buffer - 12 > len)
+            len = m->i_buffer - 12;
+        block_Release(m);
+    }
+
+    block_t *b = block_Alloc(12 + 16 + len);
+    assert(b != NULL);
+    memset(b->p_buffer, 0, b->i_buffer);
+    uint8_t *p = b->p_buffer, *h = p + 12;
+    p[0] = 0x80;
+    p[1] = 96;
+    SetWBE(h, base);
+    h[12] = offset == 1 ? 0x40 : 0x00;
+    h[13] = offset;
+    h[14] = count;
+
+    uint16_t length = 0;
+    uint32_t ts = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        block_t *m = media(base + i * offset);
+        const uint8_t *q = m->p_buffer;
+        p[0] ^= q[0] & 0x3f;
+        p[1] ^= q[1] & 0x80;
+        length ^= m->i_buffer - 12;
+        h[4] ^= q[1] & 0x7f;
+        ts ^= GetDWBE(q + 4);
+        for (size_t j = 0; j < m->i_buffer - 12; j++)
+            h[16 + j] ^= q[12 + j];
+        block_Release(m);
+    }
+    SetWBE(h + 2, length);
+    SetDWBE(h + 8, ts);
+    return b;
+}
+
+static unsigned outc;
+static uint16_t outv[256];
+
+/* Checks and releases the output packets */
+static void output(block_t *chain)
+{
+    while (chain != NULL)
+    {
+        block_t *next = chain->p_next;
+        uint16_t seq = GetWBE(chain->p_buffer + 2);
+        block_t *ref = media(seq);
+
+        assert(chain->i_buffer == ref->i_buffer);
+        assert(!memcmp(chain->p_buffer, ref->p_buffer, ref->i_buffer));
+        block_Release(ref);
+        block_Release(chain);
+
+        assert(outc < 256);
+        outv[outc++] = seq;
+        chain = next;
+    }
+}
+
+static bool output_has(uint16_t seq)
+{
+    for (unsigned i = 0; i < outc; i++)
+        if (outv[i] == seq)
+            return true;
+    return false;
+}
+
+/* 2022-7: the second path is late and misses other packets */
+static void test_merge(void)
+{
+    rtp_fec_t *f = rtp_fec_create(false);
+    const uint16_t first = 65500; /* wraps */
+
+    outc = 0;
+    for (unsigned i = 0; i < 100; i++)
+    {
+        if (i % 10 != 3)
+            output(rtp_fec_media(f, media(first + i)));
+        if (i >= 5 && i % 10 != 7)
+            output(rtp_fec_media(f, media(first + i - 5)));
+    }
+    for (unsigned i = 95; i < 100; i++)
+        output(rtp_fec_media(f, media(first + i)));
+
+    assert(outc == 100);
+    for (unsigned i = 0; i < 100; i++)
+        assert(output_has(first + i));
+    assert(f->received == 100);
+    assert(f->duplicates == 80);
+    assert(f->lost == 0);
+    rtp_fec_destroy(f);
+}
+
+/* 2022-1 on a L x D matrix, some packets missing */
+static void test_matrix(const unsigned *lossv, unsigned lossc,
+                        bool recoverable)
+{
+    rtp_fec_t *f = rtp_fec_create(true);
+    const uint16_t first = 65530;
+
+    outc = 0;
+    for (unsigned i = 0; i < L * D; i++)
+    {
+        bool lost = false;
+        for (unsigned j = 0; j < lossc; j++)
+            lost |= lossv[j] == i;
+        if (!lost)
+            output(rtp_fec_media(f, media(first + i)));
+    }
+    assert(outc == L * D - lossc);
+
+    for (unsigned r = 0; r < D; r++)
+        output(rtp_fec_packet(f, fec(first + r * L, 1, L)));
+    for (unsigned c = 0; c < L; c++)
+        output(rtp_fec_packet(f, fec(first + c, L, D)));
+
+    if (recoverable)
+    {
+        for (unsigned i = 0; i < L * D; i++)
+            assert(output_has(first + i));
+        assert(outc == L * D);
+        assert(f->recovered == lossc);
+        assert(f->pendingc == 0);
+    }
+    else
+        assert(outc == L * D - lossc && f->recovered == 0);
+
+    /* A late copy of a recovered packet is a duplicate */
+    if (recoverable)
+    {
+        output(rtp_fec_media(f, media(first + lossv[0])));
+        assert(f->duplicates == 1);
+    }
+
+    /* Packets never received fall out of the window as lost */
+    for (unsigned i = L * D; i < L * D + FEC_WINDOW; i++)
+        block_Release(rtp_fec_media(f, media(first + i)));
+    assert(f->lost == (recoverable ? 0 : lossc));
+    rtp_fec_destroy(f);
+}
+
+int main(void)
+{
+    test_merge();
+
+    /* one per row */
+    const unsigned rows[] = { 2, 5, 14, 19 };
+    test_matrix(rows, 4, true);
+    /* two in a row, recovered by the columns */
+    const unsigned pair[] = { 6, 7 };
+    test_matrix(pair, 2, true);
+    /* an L, rows and columns in turn */
+    const unsigned corner[] = { 6, 7, 11 };
+    test_matrix(corner, 3, true);
+    /* a square cannot be recovered */
+    const unsigned square[] = { 11, 12, 16, 17 };
+    test_matrix(square, 4, false);
+
+    /* until one of them comes late */
+    rtp_fec_t *f = rtp_fec_create(true);
+    outc = 0;
+    for (unsigned i = 0; i < L * D; i++)
+        if (i != 11 && i != 12 && i != 16 && i != 17)
+            output(rtp_fec_media(f, media(i)));
+    for (unsigned r = 0; r < D; r++)
+        output(rtp_fec_packet(f, fec(r * L, 1, L)));
+    for (unsigned c = 0; c < L; c++)
+        output(rtp_fec_packet(f, fec(c, L, D)));
+    assert(outc == 16);
+    output(rtp_fec_media(f, media(11)));
+    assert(outc == 20 && f->recovered == 3 && f->pendingc == 0);
+    rtp_fec_destroy(f);
+    return 0;
+}
@@ -0,0 +1,360 @@
+/*****************************************************************************
+ * sdi.c: v210 conversion and ancillary data tests, and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#ifdef NDEBUG
+ #undef NDEBUG
+#endif
+#include <assert.h>
+#include <vlc_common.h>
+#include <vlc_picture.h>
+#include "../modules/access/sdi.c"
+
+#define BENCH_RUNS 20
+
+static const int widths[] = { 2, 4, 6, 8, 720, 1280, 1366, 1920 };
+
+static const struct
+{
+    const char *name;
+    unsigned    cpu;
+} variants[] = {
+    { "C", 0 },
+#if defined (__i386__) || defined (__x86_64__)
+    { "SSSE3", VLC_CPU_SSSE3 },
+    { "AVX2", VLC_CPU_AVX2 | VLC_CPU_SSSE3 },
+#endif
+};
+
+static uint32_t rand_state = 1;
+
+static uint32_t next_rand(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+static size_t v210_stride(int width)
+{
+    return ((width + 47) / 48) * 128;
+}
+
+/* Checks that line converters agree, including on the samples that follow
+ * the line, which must be left untouched. */
+static void test_unpack(v210_unpack_line_t unpack, int width)
+{
+    const size_t words = v210_stride(width) / 4;
+    uint32_t *src = malloc(words * 4);
+    uint16_t *ref = malloc((2 * width + 16) * sizeof (*ref));
+    uint16_t *out = malloc((2 * width + 16) * sizeof (*out));
+    assert(src && ref && out);
+
+    for (size_t i = 0; i < words; i++)
+        src[i] = next_rand();
+    for (int i = 0; i < 2 * width + 16; i++)
+        ref[i] = out[i] = 0xdead;
+
+    v210_unpack_line_c(ref, ref + width, ref + 3 * width / 2, src, width);
+    unpack(out, out + width, out + 3 * width / 2, src, width);
+    assert(!memcmp(ref, out, (2 * width + 16) * sizeof (*ref)));
+
+    free(src);
+    free(ref);
+    free(out);
+}
+
+static void test_pack(v210_pack_line_t pack, int width)
+{
+    const size_t size = v210_stride(width);
+    uint16_t *yuv = malloc(2 * width * sizeof (*yuv));
+    uint8_t *ref = malloc(size);
+    uint8_t *out = malloc(size);
+    assert(yuv && ref && out);
+
+    /* include out of range values to check clipping */
+    for (int i = 0; i < 2 * width; i++)
+        yuv[i] = (i % 7) ? (next_rand() & 0x3ff) : next_rand();
+    memset(ref, 0x5a, size);
+    memset(out, 0x5a, size);
+
+    v210_pack_line_c(ref, yuv, yuv + width, yuv + 3 * width / 2, width);
+    pack(out, yuv, yuv + width, yuv + 3 * width / 2, width);
+    assert(!memcmp(ref, out, size));
+
+    free(yuv);
+    free(ref);
+    free(out);
+}
+
+/* Round trips a picture through the V210 chroma, whose pitch must match the
+ * v210 line stride. */
+static void test_picture(int width)
+{
+    const int height = 4;
+    video_format_t fmt;
+
+    video_format_Setup(&fmt, VLC_CODEC_I422_10L, width, height,
+                       width, height, 1, 1);
+    picture_t *in = picture_NewFromFormat(&fmt);
+    picture_t *out = picture_NewFromFormat(&fmt);
+    fmt.i_chroma = VLC_CODEC_V210;
+    picture_t *packed = picture_NewFromFormat(&fmt);
+    assert(in && out && packed);
+    assert(packed->i_planes == 1);
+    assert((size_t)packed->p[0].i_pitch == v210_stride(width));
+
+    for (int i = 0; i < in->i_planes; i++)
+        for (int h = 0; h < height; h++) {
+            uint16_t *p = (uint16_t *)&in->p[i].p_pixels[h * in->p[i].i_pitch];
+            for (int w = 0; w < in->p[i].i_visible_pitch / 2; w++)
+                p[w] = 4 + next_rand() % 1016;
+        }
+
+    v210_pack(packed->p[0].p_pixels, in, packed->p[0].i_pitch);
+    v210_unpack_picture(out, packed->p[0].p_pixels, packed->p[0].i_pitch);
+
+    for (int i = 0; i < in->i_planes; i++)
+        for (int h = 0; h < height; h++)
+            assert(!memcmp(&in->p[i].p_pixels[h * in->p[i].i_pitch],
+                           &out->p[i].p_pixels[h * out->p[i].i_pitch],
+                           in->p[i].i_visible_pitch));
+
+    picture_Release(in);
+    picture_Release(out);
+    picture_Release(packed);
+}
+
+static uint16_t anc_word(uint8_t v)
+{
+    return v | (parity(v) << 8) | (!parity(v) << 9);
+}
+
+static size_t anc_packet(uint16_t *dst, uint8_t did, uint8_t sdid,
+                         const uint8_t *udw, uint8_t dc)
+{
+    uint16_t sum = 0;
+
+    dst[0] = 0x000;
+    dst[1] = dst[2] = 0x3ff;
+    dst[3] = anc_word(did);
+    dst[4] = anc_word(sdid);
+    dst[5] = anc_word(dc);
+    for (unsigned i = 0; i < dc; i++)
+        dst[6 + i] = anc_word(udw[i]);
+    for (unsigned i = 3; i < 6u + dc; i++)
+        sum += dst[i];
+    sum &= 0x1ff;
+    dst[6 + dc] = sum | ((~sum & 0x100) << 1);
+    return 7 + dc;
+}
+
+struct anc_results
+{
+    unsigned cc, afd, timecode, telx, unknown;
+};
+
+static void test_cc(void *opaque, const anc_packet_t *pkt)
+{
+    struct anc_results *res = opaque;
+    block_t *cc = anc_cea708_to_cc(NULL, pkt);
+    assert(cc && cc->i_buffer == 6);
+    assert(cc->p_buffer[0] == 0xfc && cc->p_buffer[5] == 0x42);
+    assert(pkt->line == 9);
+    block_Release(cc);
+    res->cc++;
+}
+
+static void test_afd(void *opaque, const anc_packet_t *pkt)
+{
+    struct anc_results *res = opaque;
+    anc_afd_t afd;
+    assert(anc_afd(pkt, &afd));
+    assert(afd.afd == 9 && afd.wide && afd.bar_flags == 0xc);
+    assert(afd.bar1 == 0x0102 && afd.bar2 == 0x0304);
+    res->afd++;
+}
+
+static void test_timecode(void *opaque, const anc_packet_t *pkt)
+{
+    struct anc_results *res = opaque;
+    anc_timecode_t tc;
+    assert(anc_timecode(pkt, &tc));
+    assert(tc.hours == 12 && tc.minutes == 34 && tc.seconds == 56);
+    assert(tc.frames == 7 && tc.drop_frame && tc.dbb1 == 1);
+    res->timecode++;
+}
+
+static void test_telx(void *opaque, const anc_packet_t *pkt)
+{
+    struct anc_results *res = opaque;
+    block_t *telx = anc_op47_to_telx(pkt);
+    assert(telx && telx->i_buffer == 1 + 46);
+    assert(telx->p_buffer[0] == 0x10 && telx->p_buffer[1] == 0x03);
+    assert(telx->p_buffer[3] == (0x20 | 21) && telx->p_buffer[4] == 0xe4);
+    assert(telx->p_buffer[5] == 0x00 && telx->p_buffer[6] == 0x80);
+    block_Release(telx);
+    res->telx++;
+}
+
+static void test_unknown(void *opaque, const anc_packet_t *pkt)
+{
+    struct anc_results *res = opaque;
+    (void) pkt;
+    res->unknown++;
+}
+
+/* Walks a line holding several packets, a corrupted one and garbage */
+static void test_anc(void)
+{
+    static const anc_handler_t handlers[] = {
+        { ANC_DID_CEA708,   ANC_SDID_CEA708,   test_cc },
+        { ANC_DID_AFD,      ANC_SDID_AFD,      test_afd },
+        { ANC_DID_TIMECODE, ANC_SDID_TIMECODE, test_timecode },
+        { ANC_DID_OP47,     ANC_SDID_OP47,     test_telx },
+        { 0x45,             0x02,              test_unknown },
+    };
+    static const uint8_t cdp[] = {
+        0x96, 0x69, 19, 0x4f, 0x43, 0x12, 0x34, 0x72, 0xe2,
+        0xfc, 0x94, 0x20, 0xfd, 0x80, 0x42,
+        0x74, 0x12, 0x34, 0x00 /* checksum */,
+    };
+    static const uint8_t afd[] = { (9 << 3) | 4, 0, 0, 0xc0, 1, 2, 3, 4 };
+    static const uint8_t tc[] = {
+        0x78, 0, 0x40, 0, 0x60, 0, 0x50, 0, 0x40, 0, 0x30, 0, 0x20, 0, 0x10, 0,
+    };
+    uint8_t op47[9 + 45 + 4] = { 0x51, 0x15, sizeof (op47), 0x02, 21 };
+    uint8_t cdp_sum[sizeof (cdp)];
+    uint16_t line[1024];
+    size_t len = 0;
+
+    memcpy(cdp_sum, cdp, sizeof (cdp));
+    uint8_t sum = 0;
+    for (size_t i = 0; i < sizeof (cdp) - 1; i++)
+        sum += cdp[i];
+    cdp_sum[sizeof (cdp) - 1] = sum ? 256 - sum : 0;
+
+    op47[9] = op47[10] = 0x55;
+    op47[11] = 0x27;
+    for (int i = 0; i < 42; i++)
+        op47[12 + i] = i;
+    op47[54] = 0x74;
+
+    line[len++] = 0x200;
+    line[len++] = 0x040;
+    len += anc_packet(&line[len], ANC_DID_CEA708, ANC_SDID_CEA708,
+                      cdp_sum, sizeof (cdp_sum));
+    len += anc_packet(&line[len], 0x45, 0x01, afd, sizeof (afd));
+    size_t corrupted = len;
+    len += anc_packet(&line[len], ANC_DID_AFD, ANC_SDID_AFD, afd, sizeof (afd));
+    line[corrupted + 7] ^= 0x001;
+    len += anc_packet(&line[len], ANC_DID_AFD, ANC_SDID_AFD, afd, sizeof (afd));
+    len += anc_packet(&line[len], ANC_DID_TIMECODE, ANC_SDID_TIMECODE,
+                      tc, sizeof (tc));
+    len += anc_packet(&line[len], ANC_DID_OP47, ANC_SDID_OP47,
+                      op47, sizeof (op47));
+    len += anc_packet(&line[len], 0x45, 0x02, afd, 3);
+    line[len++] = 0x000;
+    line[len++] = 0x3ff;
+
+    struct anc_results res = { 0, 0, 0, 0, 0 };
+    unsigned errors = anc_parse(line, len, 9, handlers, ARRAY_SIZE(handlers),
+                                &res);
+    assert(errors == 1);
+    assert(res.cc == 1 && res.afd == 1 && res.timecode == 1);
+    assert(res.telx == 1 && res.unknown == 1);
+
+    /* v210 multiplexes the words of a line as Cb Y Cr Y */
+    uint32_t v210[8];
+    uint16_t words[24];
+    for (int i = 0; i < 8; i++)
+        v210[i] = (3 * i) | ((3 * i + 1) << 10) | ((3 * i + 2) << 20);
+    assert(v210_unpack_anc(words, v210, 12, false) == 24);
+    for (int i = 0; i < 24; i++)
+        assert(words[i] == i);
+    assert(v210_unpack_anc(words, v210, 12, true) == 12);
+    for (int i = 0; i < 12; i++)
+        assert(words[i] == 2 * i + 1);
+}
+
+static void bench(const char *name, unsigned cpu)
+{
+    const int width = 1920, height = 1080;
+    const size_t stride = v210_stride(width);
+    uint32_t *src = malloc(stride * height);
+    uint16_t *planar = malloc(2 * width * height * sizeof (*planar));
+    assert(src && planar);
+
+    for (size_t i = 0; i < stride * height / 4; i++)
+        src[i] = next_rand();
+
+    v210_unpack_line_t unpack = v210_GetUnpackLine(cpu);
+    v210_pack_line_t pack = v210_GetPackLine(cpu);
+
+    mtime_t start = mdate();
+    for (int run = 0; run < BENCH_RUNS; run++)
+        for (int h = 0; h < height; h++)
+            unpack(&planar[h * width],
+                   &planar[width * height + h * width / 2],
+                   &planar[width * height * 3 / 2 + h * width / 2],
+                   &src[h * stride / 4], width);
+    mtime_t unpack_time = (mdate() - start) / BENCH_RUNS;
+
+    start = mdate();
+    for (int run = 0; run < BENCH_RUNS; run++)
+        for (int h = 0; h < height; h++)
+            pack((uint8_t *)&src[h * stride / 4],
+                 &planar[h * width],
+                 &planar[width * height + h * width / 2],
+                 &planar[width * height * 3 / 2 + h * width / 2], width);
+    mtime_t pack_time = (mdate() - start) / BENCH_RUNS;
+
+    printf("%-6s 1080p unpack: %6"PRId64" us/frame, pack: %6"PRId64" us/frame\n",
+           name, unpack_time, pack_time);
+
+    free(src);
+    free(planar);
+}
+
+int main(void)
+{
+    const unsigned cpu = vlc_CPU();
+
+    test_anc();
+    for (size_t j = 0; j < ARRAY_SIZE(widths); j++)
+        test_picture(widths[j]);
+
+    for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+    {
+        if ((cpu & variants[i].cpu) != variants[i].cpu)
+        {
+            printf("%-6s not supported, skipping\n", variants[i].name);
+            continue;
+        }
+
+        for (size_t j = 0; j < ARRAY_SIZE(widths); j++)
+        {
+            test_unpack(v210_GetUnpackLine(variants[i].cpu), widths[j]);
+            test_pack(v210_GetPackLine(variants[i].cpu), widths[j]);
+        }
+        bench(variants[i].name, variants[i].cpu);
+    }
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+/*****************************************************************************
+ * ts_monitor.c: TS demuxer TR 101 290 measurements tests
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../modules/demux/mpeg/ts_monitor.c"
+/* config.h may have defined it again */
+#undef NDEBUG
+#include <assert.h>
+#include <string.h>
+
+#define PID_PMT 0x100
+#define PID_PES 0x101
+#define PID_PCR 0x102
+#define TPP     10000 /* 27 MHz ticks per packet */
+
+/* A multiplex with a PAT and a PMT every 100 packets, a PCR every 10 and a
+ * PES starting every 100 */
+typedef struct
+{
+    ts_monitor_t *p_mon;
+    uint64_t i_packet;
+    uint8_t  cc[0x2000];
+    int64_t  i_pcr_jitter;
+    bool     b_skip_pat;
+    bool     b_skip_pes_start;
+    bool     b_skip_cc;
+    bool     b_dup;
+    bool     b_tei;
+} stream_t_;
+
+static void send(stream_t_ *s, int pid, bool pusi, const uint8_t *payload,
+                 size_t len, int64_t pcr)
+{
+    uint8_t p[188];
+    memset(p, 0xff, sizeof(p));
+    p[0] = 0x47;
+    p[1] = (pusi ? 0x40 : 0) | (pid >> 8) | (s->b_tei ? 0x80 : 0);
+    p[2] = pid & 0xff;
+
+    size_t i = 4;
+    if (pcr >= 0)
+    {
+        p[3] = 0x20 | s->cc[pid];
+        p[4] = 183;
+        p[5] = 0x10;
+        int64_t base = pcr / 300, ext = pcr % 300;
+        p[6] = base >> 25;
+        p[7] = base >> 17;
+        p[8] = base >> 9;
+        p[9] = base >> 1;
+        p[10] = ((base & 1) << 7) | 0x7e | (ext >> 8);
+        p[11] = ext;
+    }
+    else
+    {
+        if (s->b_skip_cc)
+            s->cc[pid] = (s->cc[pid] + 1) & 0xf;
+        p[3] = 0x10 | s->cc[pid];
+        if (s->b_dup)
+            p[3] = 0x10 | ((s->cc[pid] - 1) & 0xf);
+        else if (!s->b_tei)
+            s->cc[pid] = (s->cc[pid] + 1) & 0xf;
+        memcpy(&p[i], payload, len);
+    }
+    ts_monitor_Packet(s->p_mon, p, pid == PID_PMT ? TS_MONITOR_PID_PMT :
+                                   pid == PID_PES ? TS_MONITOR_PID_PES :
+                                                    TS_MONITOR_PID_OTHER);
+    s->i_packet++;
+}
+
+static void run(stream_t_ *s, unsigned count)
+{
+    static const uint8_t pat[] = { 0x00, 0x00, 0xb0, 0x0d };
+    static const uint8_t pmt[] = { 0x00, 0x02, 0xb0, 0x12 };
+    static const uint8_t pes[] = { 0x00, 0x00, 0x01, 0xe0, 0x00, 0x00,
+                                   0x80, 0x80, 0x05, 0x21, 0x00, 0x01,
+                                   0x00, 0x01 };
+    static const uint8_t data[] = { 0x00 };
+
+    while (count--)
+    {
+        unsigned n = s->i_packet % 100;
+        if (n == 0)
+        {
+            if (s->b_skip_pat)
+                send(s, 0x1fff, false, data, 1, -1);
+            else
+                send(s, 0x00, true, pat, sizeof(pat), -1);
+        }
+        else if (n == 1)
+            send(s, PID_PMT, true, pmt, sizeof(pmt), -1);
+        else if (n % 10 == 5)
+            send(s, PID_PCR, false, NULL, 0,
+                 s->i_packet * TPP + s->i_pcr_jitter);
+        else if (n == 2 && !s->b_skip_pes_start)
+            send(s, PID_PES, true, pes, sizeof(pes), -1);
+        else
+            send(s, PID_PES, false, data, 1, -1);
+    }
+}
+
+static void check(const ts_monitor_t *m, unsigned cc, unsigned tei,
+                  unsigned pat, unsigned pts)
+{
+    assert(m->errors.sync_loss == 0 && m->errors.sync_byte == 0);
+    assert(m->errors.cc == cc);
+    assert(m->errors.transport == tei);
+    assert(m->errors.pat == pat);
+    assert(m->errors.pmt == 0);
+    assert(m->errors.pcr_repetition == 0);
+    assert(m->errors.pcr_discontinuity == 0);
+    assert(m->errors.pts == pts);
+    assert(m->errors.cat == 0);
+}
+
+int main(void)
+{
+    stream_t_ s;
+    memset(&s, 0, sizeof(s));
+    s.p_mon = ts_monitor_New();
+    assert(s.p_mon != NULL);
+
+    /* Clean stream */
+    run(&s, 10000);
+    check(s.p_mon, 0, 0, 0, 0);
+    assert(s.p_mon->errors.pcr_accuracy == 0);
+    assert(s.p_mon->pids[PID_PCR].i_tpp == 16 * TPP);
+
+    /* 1.4: one packet lost on the PAT PID */
+    s.b_skip_cc = true;
+    run(&s, 1);
+    s.b_skip_cc = false;
+    run(&s, 100);
+    check(s.p_mon, 1, 0, 0, 0);
+    assert(s.p_mon->pids[0].i_cc_errors == 1);
+
+    /* a duplicate packet is allowed once */
+    while (s.i_packet % 100 != 50)
+        run(&s, 1);
+    s.b_dup = true;
+    run(&s, 1);
+    s.b_dup = false;
+    run(&s, 100);
+    check(s.p_mon, 1, 0, 0, 0);
+    s.b_dup = true;
+    run(&s, 2);
+    s.b_dup = false;
+    run(&s, 100);
+    check(s.p_mon, 2, 0, 0, 0);
+    assert(s.p_mon->pids[PID_PES].i_cc_errors == 1);
+
+    /* 2.1 */
+    s.b_tei = true;
+    run(&s, 1);
+    s.b_tei = false;
+    run(&s, 1000);
+    check(s.p_mon, 2, 1, 0, 0);
+
+    /* 2.4: a PCR 100 ticks (3.7 us) off, and the next one back */
+    s.i_pcr_jitter = 100;
+    while (s.i_packet % 10 != 5)
+        run(&s, 1);
+    run(&s, 1);
+    s.i_pcr_jitter = 0;
+    run(&s, 1000);
+    assert(s.p_mon->errors.pcr_accuracy == 2);
+    assert(s.p_mon->i_pcr_accuracy_max >= 100 * 1000 / 27 &&
+           s.p_mon->i_pcr_accuracy_max < 110 * 1000 / 27);
+    check(s.p_mon, 2, 1, 0, 0);
+
+    /* 1.3a: no PAT for 1.1 s */
+    s.b_skip_pat = true;
+    run(&s, 3000);
+    s.b_skip_pat = false;
+    run(&s, 1000);
+    check(s.p_mon, 2, 1, 1, 0);
+
+    /* 2.5: no PTS for 0.74 s */
+    s.b_skip_pes_start = true;
+    run(&s, 2000);
+    s.b_skip_pes_start = false;
+    run(&s, 1000);
+    check(s.p_mon, 2, 1, 1, 1);
+
+    /* 1.1 and 1.2 */
+    ts_monitor_SyncError(s.p_mon, false);
+    ts_monitor_SyncError(s.p_mon, true);
+    assert(s.p_mon->errors.sync_byte == 2 && s.p_mon->errors.sync_loss == 1);
+
+    /* Export */
+    input_item_t *item = input_item_New("file:///tmp/test.ts", "test");
+    assert(item != NULL);
+    ts_monitor_Export(s.p_mon, item, 1000000);
+    char *psz = input_item_GetInfo(item, "TR 101 290",
+                                   "1.4 Continuity_count_error");
+    assert(!strcmp(psz, "2"));
+    free(psz);
+    /* 188 * 8 bits per 10000 / 27000000 s */
+    psz = input_item_GetInfo(item, "TR 101 290", "Transport rate");
+    assert(!strcmp(psz, "4060 kb/s"));
+    free(psz);
+    psz = input_item_GetInfo(item, "TR 101 290", "PID 258");
+    assert(!strncmp(psz, "406 kb/s, 0 CC errors", 21));
+    free(psz);
+
+    /* At most once per second, and gone PIDs are removed */
+    ts_monitor_SyncError(s.p_mon, true);
+    ts_monitor_Export(s.p_mon, item, 1500000);
+    psz = input_item_GetInfo(item, "TR 101 290", "1.1 TS_sync_loss");
+    assert(!strcmp(psz, "1"));
+    free(psz);
+    ts_monitor_Export(s.p_mon, item, 2000000);
+    psz = input_item_GetInfo(item, "TR 101 290", "1.1 TS_sync_loss");
+    assert(!strcmp(psz, "2"));
+    free(psz);
+    psz = input_item_GetInfo(item, "TR 101 290", "PID 258");
+    assert(!strcmp(psz, ""));
+    free(psz);
+    input_item_Release(item);
+
+    ts_monitor_Delete(s.p_mon);
+    return 0;
+}
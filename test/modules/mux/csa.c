@@ -0,0 +1,152 @@
+/*****************************************************************************
+ * csa.c: bitsliced CSA scrambler tests
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include <vlc_common.h>
+#include "../modules/mux/mpeg/csa.c"
+/* config.h may have defined it again */
+#undef NDEBUG
+#include <assert.h>
+
+#define PACKETS 300
+
+static uint32_t seed = 1;
+
+static uint8_t Random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static void SetKeys(csa_t *c, bool use_odd)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        c->o_ck[i] = Random();
+        c->e_ck[i] = Random();
+    }
+    csa_ComputeKey(c->o_kk, c->o_ck);
+    csa_ComputeKey(c->e_kk, c->e_ck);
+    c->use_odd = use_odd;
+}
+
+/* Packets with and without adaptation field, some leaving nothing or less
+ * than a block to scramble */
+static void FillPackets(uint8_t pkts[][188], int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = 0; j < 188; j++)
+            pkts[i][j] = Random();
+        pkts[i][0] = 0x47;
+        pkts[i][3] = 0x10 | (i & 0xf);
+        switch (i % 5)
+        {
+            case 1:
+                pkts[i][3] |= 0x20;
+                pkts[i][4] = Random() % 184;
+                break;
+            case 2:
+                pkts[i][3] |= 0x20;
+                pkts[i][4] = 183 - i % 10;
+                break;
+        }
+    }
+}
+
+static void test_count(csa_t *c, csa_bs_cypher_t cypher, int count,
+                       int pkt_size)
+{
+    static uint8_t ref[PACKETS][188], pkts[PACKETS][188];
+    uint8_t *pp[PACKETS];
+
+    SetKeys(c, count & 1);
+    FillPackets(ref, count);
+    memcpy(pkts, ref, sizeof(pkts[0]) * count);
+
+    for (int i = 0; i < count; i++)
+    {
+        csa_Encrypt(c, ref[i], pkt_size);
+        pp[i] = pkts[i];
+    }
+    csa_EncryptLanes(c, pp, count, pkt_size, cypher);
+    assert(!memcmp(ref, pkts, sizeof(pkts[0]) * count));
+}
+
+static void test_cypher(csa_bs_cypher_t cypher, int lanes, int pkt_size)
+{
+    csa_t *c = csa_New();
+    assert(c);
+
+    for (int count = 1; count <= __MIN(lanes, 70); count++)
+        test_count(c, cypher, count, pkt_size);
+    test_count(c, cypher, lanes - 1, pkt_size);
+    test_count(c, cypher, lanes, pkt_size);
+    csa_Delete(c);
+}
+
+/* The public API, with the scalar code for the tail, and back */
+static void test_batch(void)
+{
+    static uint8_t ref[PACKETS][188], pkts[PACKETS][188];
+    uint8_t *pp[PACKETS];
+    csa_t *c = csa_New(), *copy = csa_New();
+    assert(c && copy);
+
+    SetKeys(c, true);
+    csa_CopyKeys(copy, c);
+    FillPackets(ref, PACKETS);
+    memcpy(pkts, ref, sizeof(pkts));
+
+    for (int i = 0; i < PACKETS; i++)
+        pp[i] = pkts[i];
+    /* 256 + 2 packets, then 42 */
+    csa_EncryptBatch(copy, pp, 258, 188);
+    csa_EncryptBatch(copy, pp + 258, PACKETS - 258, 188);
+
+    for (int i = 0; i < PACKETS; i++)
+    {
+        assert((pkts[i][3] & 0xc0) == 0xc0 || (pkts[i][3] & 0xc0) == 0);
+        csa_Decrypt(c, pkts[i], 188);
+    }
+    assert(!memcmp(ref, pkts, sizeof(pkts)));
+    csa_Delete(copy);
+    csa_Delete(c);
+}
+
+int main(void)
+{
+    static const int sizes[] = { 188, 184, 100, 12 };
+
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        test_cypher(csa_bs_StreamCypher_64, 64, sizes[i]);
+#ifdef HAVE_SSE2_INTRINSICS
+        if (vlc_CPU_SSE2())
+            test_cypher(csa_bs_StreamCypher_sse2, 128, sizes[i]);
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+        if (vlc_CPU_AVX2())
+            test_cypher(csa_bs_StreamCypher_avx2, 256, sizes[i]);
+#endif
+    }
+    test_batch();
+    return 0;
+}
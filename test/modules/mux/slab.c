@@ -0,0 +1,129 @@
+/*****************************************************************************
+ * slab.c: TS muxer packet slab tests
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#ifdef NDEBUG
+ #undef NDEBUG
+#endif
+#include <assert.h>
+#include <vlc_common.h>
+#include "../modules/mux/mpeg/slab.c"
+/* config.h may have defined it again */
+#undef NDEBUG
+#include <assert.h>
+
+#define PACKETS 16
+
+/* Fills a slab, sends runs of up to 7 packets, and checks that the runs
+ * cover the packets in order */
+static void test_runs(ts_slab_pool_t *pool)
+{
+    ts_slab_t *slab = ts_slab_Get(pool);
+    block_t *pkts[PACKETS], *other;
+    assert(slab);
+
+    for (int i = 0; i < PACKETS; i++)
+    {
+        pkts[i] = ts_slab_Packet(slab);
+        assert(pkts[i] && pkts[i]->i_buffer == 188);
+        memset(pkts[i]->p_buffer, i, 188);
+        pkts[i]->i_length = 10;
+        if (i > 0)
+            assert(pkts[i]->p_buffer == pkts[i - 1]->p_buffer + 188);
+    }
+    assert(ts_slab_Packet(slab) == NULL);
+    assert(atomic_load(&slab->refs) == PACKETS + 1);
+
+    /* Packets from another slab, or not a slab, never merge */
+    ts_slab_t *slab2 = ts_slab_Get(pool);
+    other = ts_slab_Packet(slab2);
+    assert(!ts_slab_Merge(pkts[PACKETS - 1], other));
+    block_t *heap = block_Alloc(188);
+    assert(!ts_slab_Merge(pkts[PACKETS - 1], heap));
+    assert(!ts_slab_Merge(heap, pkts[0]));
+    block_Release(heap);
+    block_Release(other);
+    ts_slab_Release(slab2);
+
+    /* Not consecutive */
+    assert(!ts_slab_Merge(pkts[0], pkts[2]));
+
+    block_t *runs[3] = { pkts[0], pkts[7], pkts[14] };
+    for (int i = 1; i < 7; i++)
+        assert(ts_slab_Merge(pkts[0], pkts[i]));
+    for (int i = 8; i < 14; i++)
+        assert(ts_slab_Merge(pkts[7], pkts[i]));
+    assert(ts_slab_Merge(pkts[14], pkts[15]));
+    assert(atomic_load(&slab->refs) == 3 + 1);
+
+    int n = 0;
+    for (int r = 0; r < 3; r++)
+    {
+        assert(runs[r]->i_buffer == (r < 2 ? 7 : 2) * 188u);
+        assert(runs[r]->i_length == (r < 2 ? 70 : 20));
+        for (size_t j = 0; j < runs[r]->i_buffer; j += 188, n++)
+            assert(runs[r]->p_buffer[j] == n && runs[r]->p_buffer[j + 187] == n);
+    }
+    assert(n == PACKETS);
+
+    ts_slab_Release(slab);
+    block_Release(runs[1]);
+    block_Release(runs[0]);
+    assert(pool->i_out == 1);
+    block_Release(runs[2]);
+    assert(pool->i_out == 0);
+    assert(pool->i_free == 2);
+
+    /* Recycled */
+    ts_slab_t *again = ts_slab_Get(pool);
+    assert(again == slab || again == slab2);
+    assert(again->i_used == 0 && atomic_load(&again->refs) == 1);
+    ts_slab_Release(again);
+}
+
+/* Blocks still held by the access output outlive the muxer */
+static void test_late_release(void)
+{
+    ts_slab_pool_t *pool = ts_slab_pool_New(PACKETS);
+    assert(pool);
+
+    ts_slab_t *slab = ts_slab_Get(pool);
+    block_t *a = ts_slab_Packet(slab);
+    block_t *b = ts_slab_Packet(slab);
+    assert(ts_slab_Merge(a, b));
+    ts_slab_Release(slab);
+
+    ts_slab_pool_Delete(pool);
+    memset(a->p_buffer, 0x47, a->i_buffer);
+    block_Release(a); /* frees the slab, then the pool */
+}
+
+int main(void)
+{
+    ts_slab_pool_t *pool = ts_slab_pool_New(PACKETS);
+    assert(pool);
+
+    for (int i = 0; i < 3; i++)
+        test_runs(pool);
+    ts_slab_pool_Delete(pool);
+
+    test_late_release();
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*****************************************************************************
+ * tstd.c: TS muxer T-STD buffer model tests
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include <vlc_common.h>
+#include <vlc_es.h>
+#include "../modules/mux/mpeg/tstd.c"
+/* config.h may have defined it again */
+#undef NDEBUG
+#include <assert.h>
+
+/* 2 Mbit/s transport buffer of 512 bytes: two packets fit, the third one
+ * once 52 bytes leaked */
+static void test_transport_buffer(void)
+{
+    es_format_t fmt;
+    tstd_buffer_t b;
+
+    es_format_Init(&fmt, AUDIO_ES, VLC_CODEC_MPGA);
+    tstd_Init(&b, &fmt);
+    assert(b.i_rx == 2000000 && b.i_size == 3584);
+
+    mtime_t date = 1000000;
+    tstd_Update(&b, date);
+    assert(tstd_CanSend(&b, 184));
+    tstd_Send(&b, date, 0, false, VLC_TS_INVALID);
+    assert(tstd_CanSend(&b, 184));
+    tstd_Send(&b, date, 0, false, VLC_TS_INVALID);
+    assert(!tstd_CanSend(&b, 184));
+    assert(b.i_tb_max == 376);
+
+    /* 52 bytes leak in 208 us */
+    tstd_Update(&b, date + 200);
+    assert(!tstd_CanSend(&b, 184));
+    tstd_Update(&b, date + 208);
+    assert(tstd_CanSend(&b, 184));
+
+    /* Much later, empty */
+    tstd_Update(&b, date + 10 * CLOCK_FREQ);
+    assert(b.i_tb == 0);
+}
+
+/* Access units fill B until their decoding time */
+static void test_main_buffer(void)
+{
+    es_format_t fmt;
+    tstd_buffer_t b;
+
+    es_format_Init(&fmt, AUDIO_ES, VLC_CODEC_MP4A);
+    tstd_Init(&b, &fmt);
+    b.i_rx = 0; /* B only */
+
+    mtime_t date = 1000000;
+    tstd_Update(&b, date);
+
+    /* 4 access units of 1000 bytes, decoded 20 ms apart */
+    for (int au = 0; au < 4; au++)
+    {
+        mtime_t decode = date + 100000 + au * 20000;
+        for (int i = 0; i < 5; i++)
+        {
+            if (au == 3 && i == 2)
+            {
+                /* 3600 bytes would not fit */
+                assert(b.i_fill == 3000 + 2 * 200);
+                assert(!tstd_CanSend(&b, 200));
+                break;
+            }
+            assert(tstd_CanSend(&b, 200));
+            tstd_Send(&b, date, 200, i == 0, decode);
+        }
+    }
+    assert(b.i_au_count == 4);
+    assert(b.i_fill_max == 3400);
+    assert(b.i_late == 0);
+
+    /* First access unit decoded */
+    tstd_Update(&b, date + 100000 - 1);
+    assert(b.i_fill == 3400);
+    tstd_Update(&b, date + 100000);
+    assert(b.i_fill == 2400 && b.i_au_count == 3);
+    assert(tstd_CanSend(&b, 200));
+
+    /* Late data */
+    tstd_Send(&b, date + 200000, 200, true, date + 190000);
+    assert(b.i_late == 1);
+    tstd_Update(&b, date + 200000);
+    assert(b.i_fill == 0 && b.i_au_count == 0);
+
+    /* An access unit larger than B goes through an empty buffer */
+    mtime_t decode = date + 300000;
+    for (int i = 0; i < 20; i++)
+    {
+        assert(tstd_CanSend(&b, 184) == (i == 0 || b.i_fill + 184 <= 3584));
+        tstd_Send(&b, date + 200000, 184, i == 0, decode);
+    }
+    assert(b.i_overflow > 0);
+    assert(b.i_au_count == 1);
+}
+
+static void test_sizes(void)
+{
+    es_format_t fmt;
+    tstd_buffer_t b;
+
+    es_format_Init(&fmt, VIDEO_ES, VLC_CODEC_H264);
+    fmt.i_level = 30;
+    tstd_Init(&b, &fmt);
+    assert(b.i_rx == 0);
+    assert(b.i_size == 10000 * 150 + 10000 * 150 / 100);
+
+    es_format_Init(&fmt, VIDEO_ES, VLC_CODEC_MPGV);
+    fmt.video.i_width = 1920;
+    tstd_Init(&b, &fmt);
+    assert(b.i_size == 1222656 + 4096);
+
+    es_format_Init(&fmt, SPU_ES, VLC_CODEC_TELETEXT);
+    tstd_Init(&b, &fmt);
+    assert(b.i_rx == 6750000 && b.i_size == 0);
+    assert(tstd_CanSend(&b, 184));
+}
+
+int main(void)
+{
+    test_transport_buffer();
+    test_main_buffer();
+    test_sizes();
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*****************************************************************************
+ * rtp_fec.c: RTP stream output SMPTE 2022-1 FEC generation tests
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../modules/stream_out/rtpfec.c"
+/* The receiver recovers what the generator protects */
+#include "../modules/access/rtp/fec.c"
+/* config.h may have defined it again */
+#undef NDEBUG
+#include <assert.h>
+
+#define L 5 /* columns */
+#define D 4 /* rows */
+#define MAX 1316
+
+static block_t *media(uint16_t seq)
+{
+    size_t len = (seq % 4) ? MAX : 100 + (seq % 9) * 37;
+    block_t *b = block_Alloc(12 + len);
+    assert(b != NULL);
+    uint8_t *p = b->p_buffer;
+    p[0] = 0x80;
+    p[1] = 33 | ((seq % 3 == 0) ? 0x80 : 0);
+    SetWBE(p + 2, seq);
+    SetDWBE(p + 4, seq * 3600u);
+    SetDWBE(p + 8, 0x12345678);
+    for (size_t i = 0; i < len; i++)
+        p[12 + i] = seq * 31 + i;
+    return b;
+}
+
+static unsigned outc;
+static bool outv[L * D];
+
+static void output(block_t *chain, uint16_t first)
+{
+    while (chain != NULL)
+    {
+        block_t *next = chain->p_next;
+        uint16_t seq = GetWBE(chain->p_buffer + 2);
+        block_t *ref = media(seq);
+
+        assert(chain->i_buffer == ref->i_buffer);
+        assert(!memcmp(chain->p_buffer, ref->p_buffer, ref->i_buffer));
+        block_Release(ref);
+        block_Release(chain);
+
+        assert((uint16_t)(seq - first) < L * D);
+        assert(!outv[(uint16_t)(seq - first)]);
+        outv[(uint16_t)(seq - first)] = true;
+        outc++;
+        chain = next;
+    }
+}
+
+static void test(bool rows, const unsigned *lossv, unsigned lossc)
+{
+    rtp_fec_encoder_t *enc = rtp_fec_encoder_New(L, D, rows, MAX);
+    rtp_fec_t *dec = rtp_fec_create(true);
+    block_t *fecv[L * D];
+    unsigned fecc = 0, rowc = 0;
+    const uint16_t first = 65525; /* wraps */
+
+    assert(enc != NULL && dec != NULL);
+    /* Two matrices: state is reset between them */
+    for (unsigned n = 0; n < 2; n++)
+    {
+        uint16_t base = first + n * L * D;
+
+        memset(outv, 0, sizeof(outv));
+        outc = 0;
+        fecc = rowc = 0;
+        for (unsigned i = 0; i < L * D; i++)
+        {
+            block_t *m = media(base + i), *row;
+            block_t *col = rtp_fec_encoder_Add(enc, m, &row);
+
+            assert((col != NULL) == (i >= (D - 1) * L));
+            assert((row != NULL) == (rows && i % L == L - 1));
+            if (row != NULL)
+            {
+                /* row FEC goes with the D bit, offset 1 and NA L */
+                const uint8_t *h = row->p_buffer + 12;
+                assert(GetWBE(h) == (uint16_t)(base + i + 1 - L));
+                assert(h[12] == 0x40 && h[13] == 1 && h[14] == L);
+                fecv[fecc++] = row;
+                rowc++;
+            }
+            if (col != NULL)
+            {
+                const uint8_t *h = col->p_buffer + 12;
+                assert(GetWBE(h) == (uint16_t)(base + i - (D - 1) * L));
+                assert(h[12] == 0x00 && h[13] == L && h[14] == D);
+                assert(col->i_buffer <= 12 + 16 + MAX);
+                fecv[fecc++] = col;
+            }
+
+            bool lost = false;
+            for (unsigned j = 0; j < lossc; j++)
+                lost |= lossv[j] == i;
+            if (lost)
+                block_Release(m);
+            else
+                output(rtp_fec_media(dec, m), base);
+        }
+        assert(fecc == L + rowc && rowc == (rows ? D : 0));
+        for (unsigned i = 0; i < fecc; i++)
+            output(rtp_fec_packet(dec, fecv[i]), base);
+
+        assert(outc == L * D);
+    }
+    assert(dec->recovered == 2 * lossc);
+    rtp_fec_destroy(dec);
+    rtp_fec_encoder_Delete(enc);
+}
+
+int main(void)
+{
+    /* one per column */
+    const unsigned cols[] = { 5, 1, 12, 18, 19 };
+    test(false, cols, 5);
+    test(true, cols, 5);
+    /* a row burst, recovered by the columns */
+    const unsigned burst[] = { 5, 6, 7, 8, 9 };
+    test(false, burst, 5);
+    /* two in a column need the rows */
+    const unsigned pair[] = { 6, 11, 16 };
+    test(true, pair, 3);
+    return 0;
+}